@@ -39,6 +39,9 @@ namespace Halley
 
 		virtual String getShaderLanguage() = 0;
 
+		// Whether the painter's recorded commands can be executed on a thread other than the one that created this API
+		virtual bool supportsRenderThread() const { return false; }
+
 		virtual void* getImplementationPointer(const String& id) { return nullptr; }
 	};
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <exception>
 #include <halley/data_structures/vector.h>
 #include <halley/time/halleytime.h>
 #include <halley/time/stopwatch.h>
@@ -12,6 +13,7 @@
 #include "halley_statics.h"
 #include <halley/data_structures/tree_map.h>
 #include "halley/support/logger.h"
+#include "halley/concurrency/future.h"
 
 namespace Halley
 {
@@ -23,6 +25,9 @@ namespace Halley
 	class RenderTarget;
 	class Environment;
 	class DevConClient;
+	class PainterCommandList;
+	class ExecutionQueue;
+	class ThreadPool;
 
 	class Core final : public CoreAPIInternal, public IMainLoopable, public ILoggerSink
 	{
@@ -69,6 +74,12 @@ namespace Halley
 		void doFixedUpdate(Time time);
 		void doVariableUpdate(Time time);
 		void doRender(Time time);
+		bool paintFrame(StopwatchAveraging& gameTimer);
+
+		void startRenderThread();
+		void stopRenderThread();
+		void waitForRenderThread();
+		void waitForRenderThreadWhileRendering();
 
 		void showComputerInfo() const;
 
@@ -91,6 +102,15 @@ namespace Halley
 		std::unique_ptr<RenderTarget> screenTarget;
 		Vector2i prevWindowSize = Vector2i(-1, -1);
 
+		// Frames are recorded into one list while the render thread executes the other
+		std::unique_ptr<ExecutionQueue> renderQueue;
+		std::unique_ptr<ThreadPool> renderThread;
+		std::array<std::unique_ptr<PainterCommandList>, 2> renderCommands;
+		size_t curRenderCommands = 0;
+		Future<void> renderFuture;
+		bool renderPending = false;
+		std::exception_ptr renderError;
+
 		std::unique_ptr<Stage> currentStage;
 		std::unique_ptr<Stage> nextStage;
 		bool pendingStageTransition = false;
@@ -31,6 +31,11 @@ namespace Halley
 
 		virtual int getTargetFPS() const { return 60; }
 
+		// Records each frame and submits it from a render thread, one frame behind, where the video plugin supports it.
+		// Recorded frames only reference render targets, so a game that opts in must not destroy any render target it painted to
+		// until the following frame has been rendered too.
+		virtual bool shouldUseRenderThread() const { return false; }
+
 		virtual String getDevConAddress() const { return ""; }
 		virtual int getDevConPort() const { return 12500; }
 
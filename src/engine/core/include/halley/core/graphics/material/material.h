@@ -79,6 +79,9 @@ namespace Halley
 		const MaterialDefinition& getDefinition() const { return *materialDefinition; }
 
 		std::shared_ptr<Material> clone() const;
+
+		// Makes this equal to other, which must share its definition, while keeping this material's own constant buffers
+		void copyDataFrom(const Material& other);
 		
 		const std::shared_ptr<const Texture>& getTexture(int textureUnit) const;
 		const Vector<MaterialTextureParameter>& getTextureUniforms() const;
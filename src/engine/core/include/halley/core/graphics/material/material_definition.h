@@ -236,6 +236,7 @@ namespace Halley
 		BlendType getBlend() const { return blend; }
 		Shader& getShader() const { return *shader; }
 		const MaterialDepthStencil& getDepthStencil() const { return depthStencil; }
+		const String& getShaderAssetId() const { return shaderAssetId; }
 
 		void serialize(Serializer& s) const;
 		void deserialize(Deserializer& s);
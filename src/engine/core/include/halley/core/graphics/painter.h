@@ -3,6 +3,7 @@
 #include "blend.h"
 #include "halley/maths/colour.h"
 #include <condition_variable>
+#include <array>
 #include <halley/maths/vector4.h>
 
 namespace Halley
@@ -14,6 +15,20 @@ namespace Halley
 	class Camera;
 	class RenderContext;
 	class Core;
+	class PainterCommandList;
+
+	// Why the pending batch had to be submitted before more geometry could be added to it
+	enum class PainterBatchBreak
+	{
+		Material,		// Next draw uses a material with different parameters
+		Clip,			// Clip rectangle changed
+		BufferFull,		// Mapped vertex region has no room left
+		IndexRange,		// Batch would exceed the 16-bit index range
+		Flush,			// Explicit flush, render target change or end of frame
+		Instancing,		// Switching between instanced sprites and regular geometry
+
+		NumOfBatchBreaks
+	};
 
 	class Painter
 	{
@@ -40,7 +55,7 @@ namespace Halley
 		Camera& getCurrentCamera() const { return *camera; }
 		Rect4f getWorldViewAABB() const;
 
-		virtual void clear(Colour colour) = 0;
+		void clear(Colour colour);
 		virtual void setMaterialPass(const Material& material, int pass) = 0;
 		virtual void setMaterialData(const Material& material) = 0;
 
@@ -53,7 +68,9 @@ namespace Halley
 
 		// Draw sprites takes a single vertex per sprite, duplicates the data across multiple vertices, and draws
 		// vertPosOffset is the offset, in bytes, from the start of each vertex's data, to a Vector2f which will be filled with the vertex's position in 0-1 space.
-		void drawSprites(std::shared_ptr<Material> material, size_t numSprites, const void* vertexData);
+		// If the backend supports instancing, the vertex is instead submitted once, and vertPos is taken from a shared unit quad.
+		// srcStride is the distance, in bytes, between each sprite's vertex in vertexData, or zero if they're tightly packed.
+		void drawSprites(std::shared_ptr<Material> material, size_t numSprites, const void* vertexData, size_t srcStride = 0);
 
 		// Draw one sliced sprite. Slices -> x = left, y = top, z = right, w = bottom, in [0..1] space relative to the texture
 		void drawSlicedSprite(std::shared_ptr<Material> material, Vector2f scale, Vector4f slices, const void* vertexData);
@@ -66,24 +83,59 @@ namespace Halley
 		size_t getPrevVertices() const { return prevVertices; }
 		size_t getPrevTriangles() const { return prevTriangles; }
 
+		size_t getNumBatchBreaks(PainterBatchBreak reason) const { return nBatchBreaks[size_t(reason)]; }
+		size_t getPrevBatchBreaks(PainterBatchBreak reason) const { return prevBatchBreaks[size_t(reason)]; }
+
+		// Vertex and index bytes written by the CPU for the backend to upload
+		size_t getNumBytesSubmitted() const { return nBytesSubmitted; }
+		size_t getPrevBytesSubmitted() const { return prevBytesSubmitted; }
+
+		// Instanced sprites are used whenever the backend supports them, unless disabled here
+		virtual bool supportsInstancedSprites() const { return false; }
+		void setSpriteInstancingEnabled(bool enabled);
+		bool isSpriteInstancingEnabled() const { return spriteInstancingEnabled; }
+
+		// While recording, nothing reaches the backend: its calls are stored in the list instead, to be executed later with replay().
+		// Replaying may happen on another thread, as long as the backend allows it (see VideoAPI::supportsRenderThread) and the list isn't being recorded to at the time.
+		void startRecording(PainterCommandList& list);
+		void stopRecording();
+		bool isRecording() const { return recording != nullptr; }
+		void replay(const PainterCommandList& list);
+
 	protected:
 		virtual void startDrawCall() {}
 		virtual void endDrawCall() {}
 		virtual void doStartRender() = 0;
 		virtual void doEndRender() = 0;
+		virtual void doClear(Colour colour) = 0;
 		virtual void setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices, bool standardQuadsOnly) = 0;
 		virtual void drawTriangles(size_t numIndices) = 0;
 
+		// Only called on backends that support instanced sprites.
+		// Each instance is one vertex of the material's layout, except for the vertPos attribute, which comes from a unit quad with corners (0, 0), (1, 0), (1, 1), (0, 1).
+		virtual void setInstances(const MaterialDefinition& material, size_t numInstances, void* instanceData) {}
+		virtual void drawInstancedQuads(size_t numInstances) {}
+
+		// Backends that can stream vertices through GPU-visible memory (e.g. a ring of mapped buffers) return a region with room for at least minBytes here,
+		// setting capacity to its real size. Vertices are written straight into it, and it's unmapped right before being passed to setVertices.
+		// Returning nullptr makes the painter stage vertices in its own memory instead.
+		virtual char* mapVertices(size_t minBytes, size_t& capacity) { return nullptr; }
+		virtual void unmapVertices(size_t bytesUsed) {}
+
 		virtual void setViewPort(Rect4i rect) = 0;
 		virtual void setClip(Rect4i clip, bool enable) = 0;
 
 		virtual void onUpdateProjection(Material& material) = 0;
 		void generateQuadIndices(unsigned short firstVertex, size_t numQuads, unsigned short* target);
+
+		// The render target the backend is currently drawing to. While replaying, this is the one bound by the list.
 		RenderTarget& getActiveRenderTarget();
 
 	private:
 		RenderContext* activeContext = nullptr;
 		RenderTarget* activeRenderTarget = nullptr;
+		RenderTarget* backendRenderTarget = nullptr;
+		PainterCommandList* recording = nullptr;
 		Matrix4f projection;
 		Rect4i viewPort;
 		Camera* camera = nullptr;
@@ -92,7 +144,12 @@ namespace Halley
 		size_t bytesPending = 0;
 		size_t indicesPending = 0;
 		bool allIndicesAreQuads = true;
+		bool instancesPending = false; // If set, verticesPending counts instances rather than vertices
+		bool spriteInstancingEnabled = true;
 		Vector<char> vertexBuffer;
+		char* vertexDst = nullptr;
+		size_t vertexDstCapacity = 0;
+		bool vertexDstMapped = false;
 		Vector<unsigned short> indexBuffer;
 		std::shared_ptr<Material> materialPending;
 		std::unique_ptr<Material> halleyGlobalMaterial;
@@ -103,6 +160,10 @@ namespace Halley
 		size_t prevDrawCalls = 0;
 		size_t prevVertices = 0;
 		size_t prevTriangles = 0;
+		size_t nBytesSubmitted = 0;
+		size_t prevBytesSubmitted = 0;
+		std::array<size_t, size_t(PainterBatchBreak::NumOfBatchBreaks)> nBatchBreaks;
+		std::array<size_t, size_t(PainterBatchBreak::NumOfBatchBreaks)> prevBatchBreaks;
 
 		Vector<unsigned short> stdQuadIndexCache;
 
@@ -113,9 +174,26 @@ namespace Halley
 		void endRender();
 		
 		void resetPending();
-		void startDrawCall(std::shared_ptr<Material>& material);
-		void flushPending();
-		void executeDrawTriangles(Material& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices);
+		void startDrawCall(std::shared_ptr<Material>& material, size_t numVertices, size_t numBytes, bool instanced);
+		void flushPending(PainterBatchBreak reason);
+		void addDrawStats(const Material& material, size_t numVertices, size_t numTriangles);
+
+		// Each submit either records the call, or executes it right away
+		void submitStartRender();
+		void submitEndRender();
+		void submitViewPort(Rect4i rect);
+		void submitClip(Rect4i rect, bool enable);
+		void submitBindRenderTarget(RenderTarget& target);
+		void submitUnbindRenderTarget(RenderTarget& target);
+		void submitUpdateProjection(Material& material);
+
+		void executeStartRender();
+		void executeBindRenderTarget(RenderTarget& target);
+		void executeUnbindRenderTarget(RenderTarget& target);
+		void executeDrawTriangles(Material& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices, bool standardQuadsOnly);
+		void executeDrawInstances(Material& material, size_t numInstances, void* instanceData);
+
+		void drawSpriteInstances(std::shared_ptr<Material>& material, size_t numSprites, const char* src, size_t srcStride);
 
 		void makeSpaceForPendingVertices(size_t numBytes);
 		void makeSpaceForPendingIndices(size_t numIndices);
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <memory>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <halley/data_structures/vector.h>
+#include <halley/data_structures/hash_map.h>
+#include "halley/maths/colour.h"
+#include "halley/maths/rect.h"
+
+namespace Halley
+{
+	class Material;
+	class RenderTarget;
+
+	enum class PainterCommandType : uint8_t
+	{
+		StartRender,
+		EndRender,
+		Clear,
+		SetViewPort,
+		SetClip,
+		BindRenderTarget,
+		UnbindRenderTarget,
+		UpdateProjection,
+		DrawTriangles,
+		DrawInstances
+	};
+
+	// Everything a Painter sends to its backend over a frame, recorded so it can be executed later (e.g. on a render thread).
+	// Materials are captured as snapshots and geometry is copied, so the game can keep changing both while the list waits.
+	// Render targets are only referenced, so they must outlive the execution of any list they're bound in.
+	class PainterCommandList
+	{
+	public:
+		struct ClearCommand
+		{
+			Colour colour;
+		};
+
+		struct SetViewPortCommand
+		{
+			Rect4i rect;
+		};
+
+		struct SetClipCommand
+		{
+			Rect4i rect;
+			bool enable;
+		};
+
+		struct RenderTargetCommand
+		{
+			RenderTarget* target;
+		};
+
+		struct UpdateProjectionCommand
+		{
+			Material* material;
+		};
+
+		struct DrawTrianglesCommand
+		{
+			Material* material;
+			char* vertices;
+			unsigned short* indices;
+			uint32_t numVertices;
+			uint32_t numIndices;
+			bool standardQuadsOnly;
+		};
+
+		struct DrawInstancesCommand
+		{
+			Material* material;
+			char* instances;
+			uint32_t numInstances;
+		};
+
+		PainterCommandList();
+		~PainterCommandList();
+
+		PainterCommandList(const PainterCommandList& other) = delete;
+		PainterCommandList& operator=(const PainterCommandList& other) = delete;
+
+		// Drops all commands, keeping the memory and material snapshots around for the next recording
+		void reset();
+
+		void addStartRender();
+		void addEndRender();
+		void addClear(Colour colour);
+		void addSetViewPort(Rect4i rect);
+		void addSetClip(Rect4i rect, bool enable);
+		void addBindRenderTarget(RenderTarget& target);
+		void addUnbindRenderTarget(RenderTarget& target);
+		void addUpdateProjection(const Material& material);
+		void addDrawTriangles(const Material& material, const char* vertices, size_t vertexBytes, size_t numVertices, const unsigned short* indices, size_t numIndices, bool standardQuadsOnly);
+		void addDrawInstances(const Material& material, const char* instances, size_t instanceBytes, size_t numInstances);
+
+		// Calls f(type, payload) for each command, in recording order. Payloads are read with getPayload<T>().
+		template <typename F>
+		void forEach(F&& f) const
+		{
+			for (size_t pos = 0; pos < commands.size(); ) {
+				auto& header = *reinterpret_cast<const CommandHeader*>(commands.data() + pos);
+				pos += sizeof(CommandHeader);
+				f(header.type, commands.data() + pos);
+				pos += header.size;
+			}
+		}
+
+		template <typename T>
+		static const T& getPayload(const char* payload)
+		{
+			return *reinterpret_cast<const T*>(payload);
+		}
+
+		size_t getNumCommands() const { return numCommands; }
+		size_t getCommandBytes() const { return commands.size(); }
+		size_t getDataBytes() const { return dataBytes; }
+		size_t getNumMaterialSnapshots() const { return snapshots.size(); }
+
+	private:
+		// Every command starts on a multiple of this, so payloads can be read in place
+		constexpr static size_t commandAlignment = 8;
+
+		struct CommandHeader
+		{
+			PainterCommandType type;
+			uint32_t size;
+		};
+		static_assert(sizeof(CommandHeader) == commandAlignment, "Unexpected command header size");
+
+		struct Block
+		{
+			std::unique_ptr<char[]> data;
+			size_t size = 0;
+			size_t used = 0;
+		};
+
+		struct Snapshot
+		{
+			std::shared_ptr<Material> material;
+			uint64_t lastUsed = 0;
+		};
+
+		constexpr static size_t blockSize = 1024 * 1024;
+		constexpr static uint64_t snapshotMaxAge = 4;
+
+		Vector<char> commands;
+		size_t numCommands = 0;
+
+		Vector<Block> blocks;
+		size_t curBlock = 0;
+		size_t dataBytes = 0;
+
+		HashMap<const Material*, Snapshot> snapshots;
+		Vector<std::shared_ptr<Material>> retiredSnapshots;
+		uint64_t recordingId = 1;
+
+		template <typename T>
+		void add(PainterCommandType type, const T& payload)
+		{
+			static_assert(std::is_trivially_destructible<T>::value, "Painter commands are never destroyed");
+			static_assert(alignof(T) <= commandAlignment, "Painter command is over-aligned");
+
+			new (addCommand(type, sizeof(T))) T(payload);
+		}
+
+		char* addCommand(PainterCommandType type, size_t payloadSize);
+		char* copyData(const void* src, size_t size);
+		Material* getSnapshot(const Material& material);
+	};
+}
@@ -11,6 +11,8 @@ namespace Halley
 		friend class Core;
 
 	public:
+		RenderContext(Painter& painter, Camera& camera, RenderTarget& renderTarget);
+
 		void bind(std::function<void(Painter&)> f)
 		{
 			pushContext();
@@ -35,7 +37,6 @@ namespace Halley
 
 		RenderContext* restore = nullptr;
 
-		RenderContext(Painter& painter, Camera& camera, RenderTarget& renderTarget);
 		void setActive();
 		void setInactive();
 		void pushContext();
@@ -121,6 +121,8 @@ namespace Halley
 		void reload(Resource&& resource) override;
 
 		const String& getName() const { return name; }
+		const String& getSpriteSheetName() const { return spriteSheetName; }
+		const String& getMaterialName() const { return materialName; }
 		const SpriteSheet& getSpriteSheet() const { return *spriteSheet; }
 		std::shared_ptr<Material> getMaterial() const { return material; }
 		const AnimationSequence& getSequence(const String& name) const;
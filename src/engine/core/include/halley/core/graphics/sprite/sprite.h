@@ -35,6 +35,8 @@ namespace Halley
 
 	class Sprite
 	{
+		friend class SpritePainterBuffer;
+
 	public:
 		Sprite();
 
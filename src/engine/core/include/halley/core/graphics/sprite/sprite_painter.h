@@ -1,16 +1,23 @@
 #pragma once
 
 #include <halley/data_structures/vector.h>
+#include <halley/data_structures/loose_grid.h>
 #include <cstddef>
+#include <cstdint>
 #include "halley/maths/rect.h"
+#include "sprite.h"
 #include <limits>
+#include <memory>
+#include <atomic>
+#include <mutex>
 
 namespace Halley
 {
 	class TextRenderer;
 	class String;
-	class Sprite;
 	class Painter;
+	class Material;
+	class SpritePainterBuffer;
 
 	enum class SpritePainterEntryType
 	{
@@ -22,6 +29,9 @@ namespace Halley
 
 	class SpritePainterEntry
 	{
+		friend class SpritePainter;
+		friend class SpritePainterBuffer;
+
 	public:
 		SpritePainterEntry(const Sprite& sprite, int mask, int layer, float tieBreaker);
 		SpritePainterEntry(const TextRenderer& text, int mask, int layer, float tieBreaker);
@@ -33,32 +43,132 @@ namespace Halley
 		const TextRenderer& getText() const;
 		size_t getIndex() const;
 		int getMask() const;
+		int getLayer() const;
+		uint64_t getSortKey() const;
 
 	private:
 		const void* ptr = nullptr;
 		unsigned int index = std::numeric_limits<unsigned int>::max();
+		const SpritePainterBuffer* buffer = nullptr; // Owner of cached entries, set when merging
 		SpritePainterEntryType type;
 		int layer;
 		int mask;
-		float tieBreaker;
+
+		// Order-preserving bits of the tie breaker, followed by a material id, so that sprites sharing a material end up together
+		uint64_t sortKey;
+	};
+
+	// Everything needed to draw a copied sprite. Materials are kept once per buffer, rather than referenced by each copy.
+	struct SpriteDrawRecord
+	{
+		SpriteVertexAttrib vertexAttrib;
+		Rect4f aabb;
+		uint32_t material;
+		uint32_t extra; // Index into the buffer's extras if the sprite is clipped or sliced, noExtra otherwise
+
+		constexpr static uint32_t noExtra = std::numeric_limits<uint32_t>::max();
+	};
+
+	// Sprites and text added by a single thread. Each buffer must only be used by one thread at a time,
+	// but any number of them can be filled concurrently, and they are all merged by SpritePainter when drawing.
+	class SpritePainterBuffer
+	{
+		friend class SpritePainter;
+
+	public:
+		SpritePainterBuffer();
+		~SpritePainterBuffer();
+
+		void add(const Sprite& sprite, int mask, int layer, float tieBreaker);
+		void addCopy(const Sprite& sprite, int mask, int layer, float tieBreaker);
+		void add(const TextRenderer& text, int mask, int layer, float tieBreaker);
+		void addCopy(const TextRenderer& text, int mask, int layer, float tieBreaker);
+
+		size_t size() const;
+		void clear();
+
+	private:
+		struct Extra
+		{
+			Rect4f clip; // Already relative to the painter's current clip
+			Vector4f slices; // Normalised by the sprite's size
+			bool clipped;
+			bool sliced;
+		};
+
+		Vector<SpritePainterEntry> entries;
+		Vector<SpriteDrawRecord> records;
+		Vector<Extra> extras;
+		Vector<std::shared_ptr<Material>> materials;
+		Vector<TextRenderer> texts;
+
+		uint32_t getMaterialIndex(const std::shared_ptr<Material>& material);
+		void draw(const SpriteDrawRecord& record, Painter& painter, Rect4f view) const;
 	};
 
 	class SpritePainter
 	{
 	public:
+		SpritePainter();
+		~SpritePainter();
+
 		void start(size_t nSprites);
 		void add(const Sprite& sprite, int mask, int layer, float tieBreaker);
 		void addCopy(const Sprite& sprite, int mask, int layer, float tieBreaker);
 		void add(const TextRenderer& sprite, int mask, int layer, float tieBreaker);
 		void addCopy(const TextRenderer& text, int mask, int layer, float tieBreaker);
+
+		// Buffer owned by the calling thread until the next start(), e.g. for render systems using System::invokeParallel.
+		// Buffers must be filled between start() and draw(); sprites from different buffers with equal layer and tie breaker draw in no particular order.
+		SpritePainterBuffer& getThreadBuffer();
+
+		// Sprites registered here are kept across frames, by reference, in a spatial index, and start() doesn't remove them.
+		// Each draw only sorts the ones overlapping the view. Update them whenever they move, or their layer or tie breaker change.
+		using IndexedSpriteId = LooseGrid::Handle;
+		IndexedSpriteId addIndexed(const Sprite& sprite, int mask, int layer, float tieBreaker);
+		void updateIndexed(IndexedSpriteId id, const Sprite& sprite, int mask, int layer, float tieBreaker);
+		void removeIndexed(IndexedSpriteId id);
+		size_t getNumIndexed() const;
+
 		void draw(int mask, Painter& painter);
+		void draw(int mask, Painter& painter, Rect4f view); // Culls against view, rather than the current camera
 
 	private:
+		struct SortItem
+		{
+			uint64_t key;
+			int layer;
+			uint32_t index;
+		};
+
+		SpritePainterBuffer mainBuffer;
+		Vector<std::unique_ptr<SpritePainterBuffer>> threadBuffers;
+		std::atomic<size_t> threadBuffersClaimed;
+		Vector<std::unique_ptr<SpritePainterBuffer>> overflowBuffers;
+		std::mutex overflowMutex;
+		uint64_t generation;
+
+		LooseGrid index;
+		Vector<SpritePainterEntry> indexedEntries; // By IndexedSpriteId
+		Vector<LooseGrid::Handle> visibleIndexed;
+		Rect4f lastView;
+		bool indexDirty = false;
+
 		Vector<SpritePainterEntry> sprites;
-		Vector<Sprite> cachedSprites;
-		Vector<TextRenderer> cachedText;
 		bool dirty = false;
 
+		Vector<SortItem> sortItems;
+		Vector<SortItem> sortScratch;
+		Vector<SpritePainterEntry> spritesScratch;
+		Vector<uint32_t> layerStart;
+		Vector<uint32_t> lastOrder;
+
+		void merge(Rect4f view);
+		void sort();
+		bool trySortIncremental();
+		void sortFull();
+		void applyOrder();
+
 		void draw(const Sprite& sprite, Painter& painter, Rect4f view);
 		void draw(const TextRenderer& text, Painter& painter, Rect4f view);
 	};
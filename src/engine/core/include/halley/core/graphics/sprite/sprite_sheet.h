@@ -64,6 +64,7 @@ namespace Halley
 
 		void addSprite(String name, const SpriteSheetEntry& sprite);
 		void setTextureName(String name);
+		const String& getTextureName() const { return textureName; }
 
 		static std::unique_ptr<SpriteSheet> loadResource(ResourceLoader& loader);
 		constexpr static AssetType getAssetType() { return AssetType::SpriteSheet; }
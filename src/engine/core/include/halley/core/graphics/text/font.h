@@ -55,6 +55,7 @@ namespace Halley
 		float getSmoothRadius() const;
 		float getReplacementScale() const;
 		String getName() const;
+		const String& getImageName() const { return imageName; }
 		bool isDistanceField() const;
 
 		void addGlyph(const Glyph& glyph);
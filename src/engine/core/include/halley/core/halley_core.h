@@ -12,6 +12,7 @@ namespace Halley {} // Get GitHub to realise this is C++ :3
 
 #include "graphics/blend.h"
 #include "graphics/painter.h"
+#include "graphics/painter_command_list.h"
 #include "graphics/render_context.h"
 #include "graphics/shader.h"
 #include "graphics/texture.h"
@@ -49,6 +50,7 @@ namespace Halley {} // Get GitHub to realise this is C++ :3
 #include "resources/asset_pack.h"
 #include "resources/resources.h"
 #include "resources/resource_locator.h"
+#include "resources/resource_preloader.h"
 
 #include "stage/stage.h"
 #include "stage/entity_stage.h"
@@ -1,9 +1,10 @@
 #pragma once
 
 #include "halley/text/halleystring.h"
-#include "halley/data_structures/tree_map.h"
-#include "halley/data_structures/hash_map.h"
+#include "halley/data_structures/vector.h"
+#include "halley/resources/asset_id.h"
 #include "halley/resources/metadata.h"
+#include "halley/bytes/compression.h"
 
 namespace Halley
 {
@@ -17,9 +18,21 @@ namespace Halley
 		public:
 			String path;
 			Metadata meta;
+			CompressionCodec compression = CompressionCodec::None; // If set, the data at path is in ChunkedCompression format
 
 			Entry();
-			Entry(const String& path, const Metadata& meta);
+			Entry(const String& path, const Metadata& meta, CompressionCodec compression = CompressionCodec::None);
+
+			void serialize(Serializer& s) const;
+			void deserialize(Deserializer& s);
+		};
+
+		class Asset
+		{
+		public:
+			AssetId id;
+			String name;
+			Entry entry;
 
 			void serialize(Serializer& s) const;
 			void deserialize(Deserializer& s);
@@ -28,19 +41,34 @@ namespace Halley
 		class TypedDB
 		{
 		public:
+			// Throws if another asset has the same id, so that ids can be relied upon at runtime
 			void add(const String& name, Entry&& asset);
+
+			// For adding many assets at once: append them all, then sort once, which also checks for ids in use by more than one asset.
+			// Nothing else can be done with the database in between.
+			void append(const String& name, Entry&& asset);
+			void sort();
+
 			const Entry& get(const String& name) const;
+			const Entry& get(AssetId id) const;
+			const Asset* tryGet(AssetId id) const;
 
 			void serialize(Serializer& s) const;
 			void deserialize(Deserializer& s);
 
-			const HashMap<String, Entry>& getAssets() const;
+			const Vector<Asset>& getAssets() const;
 
 		private:
-			HashMap<String, Entry> assets;
+			Vector<Asset> assets; // Sorted by id, unless appended to since the last sort
+			bool sorted = true;
 		};
 
+		// Older databases started with the number of asset types, which is always smaller than this
+		constexpr static int currentVersion = 101;
+
 		void addAsset(const String& name, AssetType type, Entry&& entry);
+		void appendAsset(const String& name, AssetType type, Entry&& entry);
+		void sortAssets();
 		const TypedDB& getDatabase(AssetType type) const;
 		std::vector<String> getAssets() const;
 
@@ -49,6 +77,6 @@ namespace Halley
 		std::vector<String> enumerate(AssetType type) const;
 
 	private:
-		mutable TreeMap<int, TypedDB> dbs;
+		Vector<TypedDB> dbs; // By asset type
 	};
 }
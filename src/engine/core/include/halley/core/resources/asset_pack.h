@@ -4,6 +4,7 @@
 #include <memory>
 #include <gsl/span>
 #include "halley/resources/resource_data.h"
+#include "halley/bytes/compression.h"
 
 namespace Halley {
 	enum class AssetType;
@@ -51,12 +52,19 @@ namespace Halley {
 		std::unique_ptr<ResourceDataReader> extractReader();
 
     private:
+		std::unique_ptr<ResourceData> getCompressedData(const String& path, size_t pos, size_t size, CompressionCodec codec);
+
 		std::unique_ptr<AssetDatabase> assetDb;
 		std::unique_ptr<ResourceDataReader> reader;
 		std::atomic<bool> hasReader;
+		bool readerSupportsReadAt = false;
 		std::mutex readerMutex;
 		size_t dataOffset = 0;
 		Bytes data;
+
+		// Set when the reader maps the whole pack in memory, in which case assets are served straight out of it
+		std::shared_ptr<const char> mappedData;
+		size_t mappedSize = 0;
 		std::array<char, 16> iv;
     };
 
@@ -78,4 +86,28 @@ namespace Halley {
 		size_t curPos = 0;
 		mutable std::mutex mutex;
 	};
+
+	// Reads data in ChunkedCompression format from another reader, decompressing one chunk at a time as it's needed
+	class ChunkedDecompressionReader : public ResourceDataReader {
+	public:
+		ChunkedDecompressionReader(std::unique_ptr<ResourceDataReader> source, CompressionCodec codec);
+
+		size_t size() const override;
+		int read(gsl::span<gsl::byte> dst) override;
+		void seek(int64_t pos, int whence) override;
+		size_t tell() const override;
+		void close() override;
+
+	private:
+		std::unique_ptr<ResourceDataReader> source;
+		const CompressionCodec codec;
+		ChunkedCompression::Table table;
+		size_t curPos = 0;
+
+		size_t curChunk = std::numeric_limits<size_t>::max();
+		Bytes chunkData;
+		Bytes compressedData;
+
+		void loadChunk(size_t chunk);
+	};
 }
@@ -5,6 +5,7 @@
 #include <functional>
 #include <halley/text/halleystring.h>
 #include <halley/resources/resource_data.h>
+#include <halley/resources/asset_id.h>
 #include <halley/data_structures/hash_map.h>
 
 namespace Halley
@@ -16,20 +17,25 @@ namespace Halley
 
 	class ResourceCollectionBase
 	{
+		friend class ResourcePreloader;
+
 		class Wrapper
 		{
 		public:
 			Wrapper(Wrapper&& other) noexcept
 				: res(std::move(other.res))
+				, name(std::move(other.name))
 				, depth(other.depth)
 			{}
 
-			Wrapper(std::shared_ptr<Resource> resource, int loadDepth)
+			Wrapper(std::shared_ptr<Resource> resource, String name, int loadDepth)
 				: res(resource)
+				, name(std::move(name))
 				, depth(loadDepth)
 			{}
 
 			std::shared_ptr<Resource> res;
+			String name;
 			int depth;
 		};
 
@@ -46,6 +52,7 @@ namespace Halley
 		void unload(const String& assetId);
 		void unloadAll(int minDepth = 0);
 		bool exists(const String& assetId);
+		bool isLoaded(const String& assetId) const;
 
 		void reload(const String& assetId);
 		void purge(const String& assetId);
@@ -56,11 +63,13 @@ namespace Halley
 		virtual std::shared_ptr<Resource> loadResource(ResourceLoader& loader) = 0;
 
 		std::shared_ptr<Resource> doGet(const String& name, ResourceLoadPriority priority);
-		std::shared_ptr<Resource> loadAsset(const String& assetId, ResourceLoadPriority priority);
+		std::shared_ptr<Resource> doGet(AssetId id, ResourceLoadPriority priority);
+		std::shared_ptr<Resource> loadAsset(const String& assetId, ResourceLoadPriority priority, std::unique_ptr<ResourceDataStatic> prefetched = {});
+		std::shared_ptr<Resource> decode(const String& assetId, ResourceLoadPriority priority, std::unique_ptr<ResourceDataStatic> data);
 
 	private:
 		Resources& parent;
-		HashMap<String, Wrapper> resources;
+		HashMap<AssetId, Wrapper> resources;
 		AssetType type;
 		ResourceLoaderFunc resourceLoader;
 	};
@@ -80,6 +89,11 @@ namespace Halley
 			return std::static_pointer_cast<T>(doGet(assetId, priority));
 		}
 
+		std::shared_ptr<const T> get(AssetId id, ResourceLoadPriority priority = ResourceLoadPriority::Normal)
+		{
+			return std::static_pointer_cast<T>(doGet(id, priority));
+		}
+
 	protected:
 		std::shared_ptr<Resource> loadResource(ResourceLoader& loader) override {
 			return T::loadResource(loader);
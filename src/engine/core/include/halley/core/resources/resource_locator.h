@@ -24,6 +24,7 @@
 #include <ctime>
 #include <halley/text/halleystring.h>
 #include <halley/resources/resource_data.h>
+#include <halley/resources/asset_id.h>
 #include <halley/data_structures/hash_map.h>
 #include <halley/data_structures/vector.h>
 
@@ -58,6 +59,7 @@ namespace Halley {
 
 		std::vector<String> enumerate(const AssetType type);
 		bool exists(const String& asset);
+		const String& getAssetName(AssetId id, AssetType type) const;
 
 	private:
 		SystemAPI& system;
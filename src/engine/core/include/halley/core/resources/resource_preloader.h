@@ -0,0 +1,127 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <array>
+#include <halley/text/halleystring.h>
+#include <halley/resources/resource_data.h>
+#include <halley/data_structures/hash_map.h>
+#include <halley/data_structures/vector.h>
+#include <halley/time/halleytime.h>
+#include <gsl/gsl>
+
+namespace Halley {
+	enum class AssetType;
+	class Resource;
+	class Resources;
+	class ResourceLocator;
+
+	struct ResourceRef {
+		AssetType type;
+		String assetId;
+
+		ResourceRef(AssetType type, String assetId)
+			: type(type)
+			, assetId(std::move(assetId))
+		{}
+	};
+
+	enum class ResourcePreloadPolicy {
+		None, // Only loaded on the main thread, in order. For types that already stream their data in on their own.
+		ReadAhead, // Data is read and inflated on worker threads, the resource is then constructed on the main thread
+		Decode // The resource is also constructed on a worker thread. Only for types whose loaders don't use other resources or the APIs.
+	};
+
+	// Given an asset's data, lists the assets it'll get while loading. Runs on a worker thread, so it must not touch Resources.
+	// For types that aren't read ahead, it's called on the main thread with no data instead.
+	using ResourceDependencyResolver = std::function<Vector<ResourceRef>(const String& assetId, const ResourceDataStatic* data)>;
+
+	// Loads assets ahead of time, so that getting them later doesn't stall the main thread.
+	// Data is read on the disk IO thread, then inflated, scanned for dependencies and, where possible, decoded on CPU workers.
+	// Whatever has to happen on the main thread is done a few at a time by update(), highest priority first, once all of
+	// their dependencies have been loaded. Getting an asset before that blocks only until that one asset is read.
+	class ResourcePreloader {
+	public:
+		ResourcePreloader(Resources& resources, ResourceLocator& locator);
+		~ResourcePreloader();
+
+		ResourcePreloader(const ResourcePreloader& other) = delete;
+		ResourcePreloader& operator=(const ResourcePreloader& other) = delete;
+
+		void configure(AssetType type, ResourcePreloadPolicy policy, ResourceDependencyResolver resolver);
+
+		void preload(gsl::span<const ResourceRef> assets, ResourceLoadPriority priority);
+		// Finishes loading whatever is ready, spending up to budget seconds on it, but always finishing at least one
+		void update(Time budget);
+
+		bool isPending(AssetType type, const String& assetId) const;
+		size_t getPendingCount() const;
+
+	private:
+		friend class ResourceCollectionBase;
+
+		enum class State {
+			Queued,
+			Loading,
+			Ready
+		};
+
+		struct Request {
+			AssetType type;
+			String assetId;
+			ResourceLoadPriority priority;
+			ResourcePreloadPolicy policy;
+			State state = State::Queued;
+			bool compressed = false;
+			bool dependenciesQueued = false;
+
+			Vector<ResourceRef> dependencies;
+			std::unique_ptr<ResourceDataStatic> data;
+			std::shared_ptr<Resource> resource;
+			std::exception_ptr error;
+		};
+
+		struct TypeConfig {
+			ResourcePreloadPolicy policy = ResourcePreloadPolicy::ReadAhead;
+			ResourceDependencyResolver resolver;
+		};
+
+		struct Result {
+			std::unique_ptr<ResourceDataStatic> data;
+			std::shared_ptr<Resource> resource;
+			std::exception_ptr error;
+		};
+
+		constexpr static size_t maxInFlight = 4;
+		constexpr static size_t numPriorities = 3;
+
+		Resources& resources;
+		ResourceLocator& locator;
+		Vector<TypeConfig> types;
+
+		mutable std::mutex mutex;
+		std::condition_variable requestDone;
+		Vector<HashMap<String, std::shared_ptr<Request>>> requests; // By asset type
+		std::array<std::deque<std::shared_ptr<Request>>, numPriorities> queues; // By priority
+		size_t inFlight = 0;
+		size_t pendingCount = 0;
+
+		const TypeConfig& getConfig(AssetType type) const;
+		ResourcePreloadPolicy getPolicy(AssetType type, const String& assetId) const;
+
+		std::shared_ptr<Request> find(AssetType type, const String& assetId) const;
+		void erase(const Request& request);
+		void startQueued(); // Must be called with the mutex locked
+		void read(Request& request, ResourceLoadPriority priority);
+		void decode(Request& request, ResourceLoadPriority priority);
+		bool isSettled(const Request& request) const;
+
+		// Called by ResourceCollectionBase when an asset is needed right away. Returns false if it wasn't read ahead,
+		// in which case it's no longer pending and should be loaded as usual.
+		bool take(AssetType type, const String& assetId, Result& result);
+	};
+}
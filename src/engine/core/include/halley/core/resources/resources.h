@@ -26,6 +26,7 @@
 #include <halley/support/exception.h>
 #include "halley/resources/resource.h"
 #include "resource_collection.h"
+#include "resource_preloader.h"
 #include "halley/text/string_converter.h"
 
 namespace Halley {
@@ -66,6 +67,13 @@ namespace Halley {
 			return of<T>().get(name, priority);
 		}
 
+		// Skips hashing the name, for assets that are gotten often
+		template <typename T>
+		std::shared_ptr<const T> get(AssetId id, ResourceLoadPriority priority = ResourceLoadPriority::Normal) const
+		{
+			return of<T>().get(id, priority);
+		}
+
 		template <typename T>
 		void unload(const String& name) const
 		{
@@ -89,10 +97,31 @@ namespace Halley {
 		{
 			return of<T>().enumerate();
 		}
+
+		template <typename T>
+		void setPreloadPolicy(ResourcePreloadPolicy policy, ResourceDependencyResolver resolver = {})
+		{
+			preloader->configure(T::getAssetType(), policy, std::move(resolver));
+		}
+
+		// Starts loading assets in the background; getting them later only waits for whatever isn't done yet
+		void preload(gsl::span<const ResourceRef> assets, ResourceLoadPriority priority = ResourceLoadPriority::Normal);
+
+		template <typename T>
+		void preload(const String& name, ResourceLoadPriority priority = ResourceLoadPriority::Normal)
+		{
+			preload(Vector<ResourceRef>{ ResourceRef(T::getAssetType(), name) }, priority);
+		}
+
+		size_t getPreloadsPending() const;
+
+		// Called by Core every frame, to finish loading preloaded assets on the main thread
+		void update(Time budget);
 		
 	private:
 		const std::unique_ptr<ResourceLocator> locator;
 		Vector<std::unique_ptr<ResourceCollectionBase>> resources;
 		const HalleyAPI* const api;
+		std::unique_ptr<ResourcePreloader> preloader; // Destroyed first, as it might still be loading into the collections
 	};
 }
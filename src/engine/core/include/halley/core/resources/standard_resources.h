@@ -3,10 +3,11 @@
 namespace Halley
 {
 	class Resources;
+	class HalleyAPI;
 
 	class StandardResources
 	{
 	public:
-		static void initialize(Resources& resources);
+		static void initialize(Resources& resources, const HalleyAPI& api);
 	};
 }
\ No newline at end of file
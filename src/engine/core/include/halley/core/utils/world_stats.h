@@ -1,5 +1,6 @@
 #pragma once
 #include "halley/core/graphics/text/text_renderer.h"
+#include "halley/core/graphics/sprite/sprite.h"
 #include <cstdint>
 
 namespace Halley
@@ -13,15 +14,19 @@ namespace Halley
 	{
 	public:
 		WorldStatsView(CoreAPI& coreApi);
+		~WorldStatsView();
 
 		void draw(RenderContext& context);
 		void setWorld(const World* world);
 
 	private:
 		String formatTime(int64_t ns) const;
+		void drawFlameView(Painter& painter, Rect4f area);
 
 		const CoreAPI& coreAPI;
 		const World* world = nullptr;
 		TextRenderer text;
+		TextRenderer flameText;
+		Sprite flameBar;
 	};
 }
@@ -4,6 +4,11 @@
 #include <halley/core/graphics/shader.h>
 #include <halley/core/graphics/render_target/render_target_texture.h>
 #include "dummy_system.h"
+#include <halley/core/graphics/material/material.h>
+#include <halley/core/graphics/material/material_definition.h>
+#include <halley/core/graphics/material/material_parameter.h>
+#include <halley/utils/utils.h>
+#include <gsl/gsl_assert>
 
 using namespace Halley;
 
@@ -78,6 +83,11 @@ String DummyVideoAPI::getShaderLanguage()
 	return "glsl";
 }
 
+bool DummyVideoAPI::supportsRenderThread() const
+{
+	return true;
+}
+
 DummyTexture::DummyTexture(Vector2i size)
 	: Texture(size)
 {
@@ -100,26 +110,181 @@ int DummyShader::getBlockLocation(const String&, ShaderType)
 
 void DummyMaterialConstantBuffer::update(const MaterialDataBlock&) {}
 
+namespace {
+	enum class DummyPainterCall : uint8_t
+	{
+		StartRender,
+		EndRender,
+		Clear,
+		SetViewPort,
+		SetClip,
+		UpdateProjection,
+		SetMaterialPass,
+		SetMaterialData,
+		SetVertices,
+		DrawTriangles,
+		SetInstances,
+		DrawInstancedQuads
+	};
+}
+
+constexpr size_t DummyPainter::ringBufferSize;
+
 DummyPainter::DummyPainter(Resources& resources)
 	: Painter(resources)
 {}
 
-void DummyPainter::clear(Colour colour) {}
+void DummyPainter::setStreamingEnabled(bool enabled)
+{
+	streamingEnabled = enabled;
+}
+
+void DummyPainter::setCallLogEnabled(bool enabled)
+{
+	callLogEnabled = enabled;
+}
+
+void DummyPainter::clearCallLog()
+{
+	callLog.clear();
+}
 
-void DummyPainter::setMaterialPass(const Material&, int) {}
+void DummyPainter::log(const void* data, size_t size)
+{
+	if (callLogEnabled) {
+		auto src = static_cast<const Byte*>(data);
+		callLog.insert(callLog.end(), src, src + size);
+	}
+}
 
-void DummyPainter::doStartRender() {}
+void DummyPainter::doClear(Colour colour)
+{
+	log(DummyPainterCall::Clear);
+	log(colour);
+}
 
-void DummyPainter::doEndRender() {}
+void DummyPainter::setMaterialPass(const Material& material, int pass)
+{
+	log(DummyPainterCall::SetMaterialPass);
+	log(material.getHash());
+	log(pass);
+}
 
-void DummyPainter::setVertices(const MaterialDefinition&, size_t, void*, size_t, unsigned short*, bool) {}
+void DummyPainter::doStartRender()
+{
+	log(DummyPainterCall::StartRender);
 
-void DummyPainter::drawTriangles(size_t) {}
+	verticesSubmitted = 0;
+	verticesStreamed = 0;
+	instancesSubmitted = 0;
+}
 
-void DummyPainter::setViewPort(Rect4i) {}
+void DummyPainter::doEndRender()
+{
+	log(DummyPainterCall::EndRender);
+}
 
-void DummyPainter::setClip(Rect4i, bool) {}
+void DummyPainter::setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices, bool standardQuadsOnly)
+{
+	log(DummyPainterCall::SetVertices);
+	log(numVertices);
+	log(vertexData, numVertices * material.getVertexStride());
+	log(numIndices);
+	log(indices, numIndices * sizeof(unsigned short));
+	log(standardQuadsOnly);
+
+	verticesSubmitted += numVertices;
+
+	auto& buffer = ring[ringIndex];
+	auto data = static_cast<const char*>(vertexData);
+	if (data >= buffer.data() && data + numVertices * material.getVertexStride() <= buffer.data() + buffer.size()) {
+		verticesStreamed += numVertices;
+	}
+}
 
-void DummyPainter::setMaterialData(const Material&) {}
+char* DummyPainter::mapVertices(size_t minBytes, size_t& capacity)
+{
+	Expects(!mapped);
+
+	if (!streamingEnabled) {
+		return nullptr;
+	}
+
+	if (ringOffset + minBytes > ring[ringIndex].size()) {
+		// Move on to the next buffer, which a real backend would have to fence against the GPU
+		if (!ring[ringIndex].empty()) {
+			ringIndex = (ringIndex + 1) % ring.size();
+		}
+		ringOffset = 0;
+		auto& buffer = ring[ringIndex];
+		if (buffer.size() < minBytes) {
+			buffer.resize(std::max(ringBufferSize, nextPowerOf2(minBytes)));
+		}
+	}
+
+	auto& buffer = ring[ringIndex];
+	mapped = buffer.data() + ringOffset;
+	capacity = buffer.size() - ringOffset;
+	return mapped;
+}
 
-void DummyPainter::onUpdateProjection(Material&) {}
+void DummyPainter::unmapVertices(size_t bytesUsed)
+{
+	Expects(mapped);
+	ringOffset = alignUp(ringOffset + bytesUsed, size_t(16));
+	mapped = nullptr;
+}
+
+void DummyPainter::drawTriangles(size_t numIndices)
+{
+	log(DummyPainterCall::DrawTriangles);
+	log(numIndices);
+}
+
+bool DummyPainter::supportsInstancedSprites() const
+{
+	return true;
+}
+
+void DummyPainter::setInstances(const MaterialDefinition& material, size_t numInstances, void* instanceData)
+{
+	log(DummyPainterCall::SetInstances);
+	log(numInstances);
+	log(instanceData, numInstances * material.getVertexStride());
+
+	instancesSubmitted += numInstances;
+}
+
+void DummyPainter::drawInstancedQuads(size_t numInstances)
+{
+	log(DummyPainterCall::DrawInstancedQuads);
+	log(numInstances);
+}
+
+void DummyPainter::setViewPort(Rect4i rect)
+{
+	log(DummyPainterCall::SetViewPort);
+	log(rect);
+}
+
+void DummyPainter::setClip(Rect4i clip, bool enable)
+{
+	log(DummyPainterCall::SetClip);
+	log(clip);
+	log(enable);
+}
+
+void DummyPainter::setMaterialData(const Material& material)
+{
+	log(DummyPainterCall::SetMaterialData);
+	log(material.getHash());
+}
+
+void DummyPainter::onUpdateProjection(Material& material)
+{
+	log(DummyPainterCall::UpdateProjection);
+	for (auto& block: material.getDataBlocks()) {
+		auto data = block.getData();
+		log(data.data(), size_t(data.size()));
+	}
+}
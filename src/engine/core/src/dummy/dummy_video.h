@@ -25,6 +25,7 @@ namespace Halley {
 		void deInit() override;
 		std::unique_ptr<Painter> makePainter(Resources& resources) override;
 		String getShaderLanguage() override;
+		bool supportsRenderThread() const override;
 
 	private:
 		std::shared_ptr<Window> window;
@@ -54,7 +55,7 @@ namespace Halley {
 	{
 	public:
 		explicit DummyPainter(Resources& resources);
-		void clear(Colour colour) override;
+		void doClear(Colour colour) override;
 		void setMaterialPass(const Material& material, int pass) override;
 		void doStartRender() override;
 		void doEndRender() override;
@@ -64,5 +65,49 @@ namespace Halley {
 		void setClip(Rect4i clip, bool enable) override;
 		void setMaterialData(const Material& material) override;
 		void onUpdateProjection(Material& material) override;
+		bool supportsInstancedSprites() const override;
+
+		size_t getVerticesSubmitted() const { return verticesSubmitted; }
+		size_t getInstancesSubmitted() const { return instancesSubmitted; }
+		size_t getVerticesStreamed() const { return verticesStreamed; }
+
+		// Streaming changes where batches are broken, so it needs to be off when comparing with recorded frames, which don't stream
+		void setStreamingEnabled(bool enabled);
+
+		// Logs every backend call with all of its arguments and data, so different ways of painting the same frames can be compared byte-for-byte
+		void setCallLogEnabled(bool enabled);
+		const Bytes& getCallLog() const { return callLog; }
+		void clearCallLog();
+
+	protected:
+		char* mapVertices(size_t minBytes, size_t& capacity) override;
+		void unmapVertices(size_t bytesUsed) override;
+		void setInstances(const MaterialDefinition& material, size_t numInstances, void* instanceData) override;
+		void drawInstancedQuads(size_t numInstances) override;
+
+	private:
+		// Stands in for a ring of persistently mapped GPU buffers, so the streaming path can be exercised headless
+		constexpr static size_t ringBufferSize = 256 * 1024;
+		std::array<Vector<char>, 3> ring;
+		size_t ringIndex = 0;
+		size_t ringOffset = 0;
+		char* mapped = nullptr;
+
+		size_t verticesSubmitted = 0;
+		size_t verticesStreamed = 0;
+		size_t instancesSubmitted = 0;
+
+		bool streamingEnabled = true;
+		bool callLogEnabled = false;
+		Bytes callLog;
+
+		void log(const void* data, size_t size);
+
+		template <typename T>
+		void log(const T& value)
+		{
+			static_assert(std::is_standard_layout<T>::value, "Only plain values can be logged");
+			log(&value, sizeof(T));
+		}
 	};
 }
@@ -5,6 +5,7 @@
 #include "api/halley_api.h"
 #include "graphics/camera.h"
 #include "graphics/render_context.h"
+#include "graphics/painter_command_list.h"
 #include "graphics/render_target/render_target_screen.h"
 #include "graphics/window.h"
 #include "resources/resources.h"
@@ -12,8 +13,11 @@
 #include "resources/standard_resources.h"
 #include <halley/os/os.h>
 #include <halley/support/debug.h>
+#include <halley/support/profiler.h>
 #include <halley/support/console.h>
 #include <halley/concurrency/concurrent.h>
+#include <halley/data_structures/frame_arena.h>
+#include <gsl/gsl_util>
 #include <fstream>
 #include <chrono>
 #include <ctime>
@@ -97,6 +101,7 @@ const HalleyStatics& Core::getStatics()
 void Core::onSuspended()
 {
 	HALLEY_DEBUG_TRACE();
+	waitForRenderThread();
 	if (api->videoInternal) {
 		api->videoInternal->onSuspend();
 	}
@@ -154,6 +159,10 @@ int Core::getTargetFPS()
 
 void Core::init()
 {
+#ifdef DEV_BUILD
+	Profiler::setThreadName("Main");
+#endif
+
 	// Initialize API
 	api->init();
 	api->systemInternal->setEnvironment(environment.get());
@@ -177,6 +186,9 @@ void Core::init()
 	// Get video resources
 	if (api->video) {
 		painter = api->videoInternal->makePainter(api->core->getResources());
+		if (game->shouldUseRenderThread() && api->video->supportsRenderThread()) {
+			startRenderThread();
+		}
 	}
 }
 
@@ -184,6 +196,9 @@ void Core::deInit()
 {
 	std::cout << "Game shutting down." << std::endl;
 
+	// Finish the last frame, as it might still refer to the stage's resources
+	stopRenderThread();
+
 	// Ensure stage is cleaned up
 	running = false;
 	transitionStage();
@@ -233,7 +248,7 @@ void Core::initResources()
 	auto gamePath = environment->getProgramPath();
 	game->initResourceLocator(gamePath, api->system->getAssetsPath(gamePath.string()), api->system->getUnpackedAssetsPath(gamePath.string()), *locator);
 	resources = std::make_unique<Resources>(std::move(locator), &*api);
-	StandardResources::initialize(*resources);
+	StandardResources::initialize(*resources, *api);
 	api->audioInternal->setResources(*resources);
 }
 
@@ -292,11 +307,18 @@ void Core::onVariableUpdate(Time time)
 	if (isRunning()) {
 		doRender(time);
 	}
+
+	// The render thread may still be replaying this frame, which is fine, as frame memory lasts until the end of the next one
+	FrameArena::beginFrame();
+#ifdef DEV_BUILD
+	Profiler::endFrame();
+#endif
 }
 
 void Core::doFixedUpdate(Time time)
 {
 	HALLEY_DEBUG_TRACE();
+	HALLEY_PROFILE_ZONE("Core::doFixedUpdate");
 	auto& engineTimer = engineTimers[int(TimeLine::FixedUpdate)];
 	auto& gameTimer = gameTimers[int(TimeLine::FixedUpdate)];
 	engineTimer.beginSample();
@@ -319,11 +341,13 @@ void Core::doFixedUpdate(Time time)
 void Core::doVariableUpdate(Time time)
 {
 	HALLEY_DEBUG_TRACE();
+	HALLEY_PROFILE_ZONE("Core::doVariableUpdate");
 	auto& engineTimer = engineTimers[int(TimeLine::VariableUpdate)];
 	auto& gameTimer = gameTimers[int(TimeLine::VariableUpdate)];
 	engineTimer.beginSample();
 
 	pumpEvents(time);
+	resources->update(0.004); // Up to 4ms a frame finishing off preloaded assets
 	gameTimer.beginSample();
 	if (running && currentStage) {
 		try {
@@ -349,42 +373,53 @@ void Core::doVariableUpdate(Time time)
 void Core::doRender(Time)
 {
 	HALLEY_DEBUG_TRACE();
+	HALLEY_PROFILE_ZONE("Core::doRender");
 	auto& engineTimer = engineTimers[int(TimeLine::Render)];
 	auto& gameTimer = gameTimers[int(TimeLine::Render)];
 	bool gameSampled = false;
 	engineTimer.beginSample();
 
 	if (api->video) {
-		api->video->startRender();
-		painter->startRender();
-
-		if (currentStage) {
-			auto windowSize = api->video->getWindow().getDefinition().getSize();
-			if (windowSize != prevWindowSize) {
-				screenTarget.reset();
-				screenTarget = api->video->createScreenRenderTarget();
-				camera = std::make_unique<Camera>(Vector2f(windowSize) * 0.5f);
-				prevWindowSize = windowSize;
+		if (renderThread) {
+			// Record this frame while the render thread is still submitting the previous one
+			auto& commands = *renderCommands[curRenderCommands];
+			{
+				painter->startRecording(commands);
+				auto stopRecording = gsl::finally([&] () { painter->stopRecording(); });
+				gameSampled = paintFrame(gameTimer);
 			}
-			RenderContext context(*painter, *camera, *screenTarget);
-
-			gameTimer.beginSample();
 
-			try {
-				currentStage->onRender(context);
-			} catch (Exception& e) {
-				game->onUncaughtException(e, TimeLine::Render);
+			vsyncTimer.beginSample();
+			{
+				HALLEY_PROFILE_ZONE("Wait for render thread");
+				waitForRenderThreadWhileRendering();
 			}
+			vsyncTimer.endSample();
+
+			renderFuture = Concurrent::execute(*renderQueue, [this, &commands] ()
+			{
+				try {
+					HALLEY_PROFILE_ZONE("Replay frame");
+					api->video->startRender();
+					painter->replay(commands);
+					api->video->finishRender();
+				} catch (...) {
+					renderError = std::current_exception();
+				}
+			});
+			renderPending = true;
+			curRenderCommands = (curRenderCommands + 1) % renderCommands.size();
+		} else {
+			api->video->startRender();
+			gameSampled = paintFrame(gameTimer);
 
-			gameTimer.endSample();
-			gameSampled = true;
+			vsyncTimer.beginSample();
+			{
+				HALLEY_PROFILE_ZONE("Finish render");
+				api->video->finishRender();
+			}
+			vsyncTimer.endSample();
 		}
-
-		painter->endRender();
-
-		vsyncTimer.beginSample();
-		api->video->finishRender();
-		vsyncTimer.endSample();
 	}
 
 	if (!gameSampled) {
@@ -472,6 +507,92 @@ Stage& Core::getCurrentStage()
 	return *currentStage;
 }
 
+bool Core::paintFrame(StopwatchAveraging& gameTimer)
+{
+	bool gameSampled = false;
+	painter->startRender();
+
+	if (currentStage) {
+		auto windowSize = api->video->getWindow().getDefinition().getSize();
+		if (windowSize != prevWindowSize) {
+			// The previous frame might still be drawing to the old target
+			waitForRenderThreadWhileRendering();
+			screenTarget.reset();
+			screenTarget = api->video->createScreenRenderTarget();
+			camera = std::make_unique<Camera>(Vector2f(windowSize) * 0.5f);
+			prevWindowSize = windowSize;
+		}
+		RenderContext context(*painter, *camera, *screenTarget);
+
+		gameTimer.beginSample();
+
+		try {
+			currentStage->onRender(context);
+		} catch (Exception& e) {
+			game->onUncaughtException(e, TimeLine::Render);
+		}
+
+		gameTimer.endSample();
+		gameSampled = true;
+	}
+
+	painter->endRender();
+	return gameSampled;
+}
+
+void Core::startRenderThread()
+{
+#if HAS_THREADS
+	for (auto& commands: renderCommands) {
+		commands = std::make_unique<PainterCommandList>();
+	}
+	renderQueue = std::make_unique<ExecutionQueue>();
+	renderThread = std::make_unique<ThreadPool>("Render", *renderQueue, 1, [this] (String name, std::function<void()> runnable)
+	{
+		return api->system->createThread(name, ThreadPriority::High, runnable);
+	});
+#endif
+}
+
+void Core::stopRenderThread()
+{
+	try {
+		waitForRenderThread();
+	} catch (std::exception& e) {
+		Logger::logException(e);
+	}
+
+	renderThread.reset();
+	renderQueue.reset();
+	for (auto& commands: renderCommands) {
+		commands.reset();
+	}
+}
+
+void Core::waitForRenderThread()
+{
+	if (renderPending) {
+		renderFuture.wait();
+		renderPending = false;
+	}
+
+	if (renderError) {
+		auto error = renderError;
+		renderError = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+void Core::waitForRenderThreadWhileRendering()
+{
+	// Errors from replaying a frame go to the game just like those from painting it immediately would
+	try {
+		waitForRenderThread();
+	} catch (Exception& e) {
+		game->onUncaughtException(e, TimeLine::Render);
+	}
+}
+
 bool Core::transitionStage()
 {
 	// If it's not running anymore, reset stage
@@ -482,9 +603,10 @@ bool Core::transitionStage()
 
 	// Check if there's a stage waiting to be switched to
 	if (pendingStageTransition) {
-		// Get rid of current stage
+		// Get rid of current stage, once the render thread is done with it
 		if (currentStage) {
 			HALLEY_DEBUG_TRACE();
+			waitForRenderThread();
 			currentStage.reset();
 			HALLEY_DEBUG_TRACE();
 		}
@@ -353,3 +353,23 @@ std::shared_ptr<Material> Material::clone() const
 {
 	return std::make_shared<Material>(*this);
 }
+
+void Material::copyDataFrom(const Material& other)
+{
+	Expects(materialDefinition == other.materialDefinition);
+
+	for (size_t i = 0; i < dataBlocks.size(); ++i) {
+		auto& block = dataBlocks[i];
+		const auto& otherBlock = other.dataBlocks[i];
+		if (block.data != otherBlock.data) {
+			block.data = otherBlock.data;
+			block.dirty = true;
+			needToUploadData = true;
+		}
+	}
+	textures = other.textures;
+	passEnabled = other.passEnabled;
+
+	hashValue = other.getHash();
+	needToUpdateHash = false;
+}
@@ -1,4 +1,5 @@
 #include "halley/core/graphics/painter.h"
+#include "halley/core/graphics/painter_command_list.h"
 #include "halley/core/graphics/render_context.h"
 #include "halley/core/graphics/render_target/render_target.h"
 #include "halley/core/graphics/material/material.h"
@@ -6,13 +7,21 @@
 #include "halley/core/graphics/material/material_parameter.h"
 #include <cstring> // memmove
 #include <gsl/gsl_assert>
+#include <halley/support/profiler.h>
 #include "resources/resources.h"
 
 using namespace Halley;
 
+namespace {
+	// Indices are 16-bit, so a single batch can't address more vertices than this
+	constexpr size_t maxVerticesPerBatch = 65536;
+}
+
 Painter::Painter(Resources& resources)
 	: halleyGlobalMaterial(std::make_unique<Material>(resources.get<MaterialDefinition>("Halley/MaterialBase"), true))
 {
+	nBatchBreaks.fill(0);
+	prevBatchBreaks.fill(0);
 }
 
 Painter::~Painter()
@@ -21,27 +30,115 @@ Painter::~Painter()
 
 void Painter::startRender()
 {
-	Material::resetBindCache();
 	prevDrawCalls = nDrawCalls;
 	prevTriangles = nTriangles;
 	prevVertices = nVertices;
 	nDrawCalls = nTriangles = nVertices = 0;
+	prevBytesSubmitted = nBytesSubmitted;
+	nBytesSubmitted = 0;
+	prevBatchBreaks = nBatchBreaks;
+	nBatchBreaks.fill(0);
 
 	resetPending();
-	doStartRender();
+	submitStartRender();
 }
 
 void Painter::endRender()
 {
-	flush();
-	doEndRender();
+	flushPending(PainterBatchBreak::Flush);
+	submitEndRender();
 	camera = nullptr;
 	viewPort = Rect4i(0, 0, 0, 0);
 }
 
 void Painter::flush()
 {
-	flushPending();
+	flushPending(PainterBatchBreak::Flush);
+}
+
+void Painter::clear(Colour colour)
+{
+	if (recording) {
+		recording->addClear(colour);
+	} else {
+		doClear(colour);
+	}
+}
+
+void Painter::startRecording(PainterCommandList& list)
+{
+	Expects(!recording);
+	Expects(verticesPending == 0);
+
+	list.reset();
+	recording = &list;
+}
+
+void Painter::stopRecording()
+{
+	Expects(recording);
+
+	flushPending(PainterBatchBreak::Flush);
+	recording = nullptr;
+}
+
+void Painter::replay(const PainterCommandList& list)
+{
+	// Only touches backend state, so this can run on a render thread while the next frame is being recorded
+	using Commands = PainterCommandList;
+	list.forEach([&] (PainterCommandType type, const char* payload)
+	{
+		switch (type) {
+		case PainterCommandType::StartRender:
+			executeStartRender();
+			break;
+
+		case PainterCommandType::EndRender:
+			doEndRender();
+			break;
+
+		case PainterCommandType::Clear:
+			doClear(Commands::getPayload<Commands::ClearCommand>(payload).colour);
+			break;
+
+		case PainterCommandType::SetViewPort:
+			setViewPort(Commands::getPayload<Commands::SetViewPortCommand>(payload).rect);
+			break;
+
+		case PainterCommandType::SetClip:
+			{
+				const auto& cmd = Commands::getPayload<Commands::SetClipCommand>(payload);
+				setClip(cmd.rect, cmd.enable);
+			}
+			break;
+
+		case PainterCommandType::BindRenderTarget:
+			executeBindRenderTarget(*Commands::getPayload<Commands::RenderTargetCommand>(payload).target);
+			break;
+
+		case PainterCommandType::UnbindRenderTarget:
+			executeUnbindRenderTarget(*Commands::getPayload<Commands::RenderTargetCommand>(payload).target);
+			break;
+
+		case PainterCommandType::UpdateProjection:
+			onUpdateProjection(*Commands::getPayload<Commands::UpdateProjectionCommand>(payload).material);
+			break;
+
+		case PainterCommandType::DrawTriangles:
+			{
+				const auto& cmd = Commands::getPayload<Commands::DrawTrianglesCommand>(payload);
+				executeDrawTriangles(*cmd.material, cmd.numVertices, cmd.vertices, cmd.numIndices, cmd.indices, cmd.standardQuadsOnly);
+			}
+			break;
+
+		case PainterCommandType::DrawInstances:
+			{
+				const auto& cmd = Commands::getPayload<Commands::DrawInstancesCommand>(payload);
+				executeDrawInstances(*cmd.material, cmd.numInstances, cmd.instances);
+			}
+			break;
+		}
+	});
 }
 
 Rect4f Painter::getWorldViewAABB() const
@@ -62,17 +159,17 @@ Painter::PainterVertexData Painter::addDrawData(std::shared_ptr<Material>& mater
 	Expects(numVertices > 0);
 	Expects(numIndices >= numVertices);
 
-	startDrawCall(material);
-
 	PainterVertexData result;
 
 	result.vertexSize = material->getDefinition().getVertexSize();
 	result.vertexStride = material->getDefinition().getVertexStride();
 	result.dataSize = numVertices * result.vertexStride;
+
+	startDrawCall(material, numVertices, result.dataSize, false);
 	makeSpaceForPendingVertices(result.dataSize);
 	makeSpaceForPendingIndices(numIndices);
 
-	result.dstVertex = vertexBuffer.data() + bytesPending;
+	result.dstVertex = vertexDst + bytesPending;
 	result.dstIndex = indexBuffer.data() + indicesPending;
 	result.firstIndex = static_cast<unsigned short>(verticesPending);
 
@@ -95,9 +192,27 @@ void Painter::drawQuads(std::shared_ptr<Material> material, size_t numVertices,
 	generateQuadIndices(result.firstIndex, numVertices / 4, result.dstIndex);
 }
 
-void Painter::drawSprites(std::shared_ptr<Material> material, size_t numSprites, const void* vertexData)
+void Painter::setSpriteInstancingEnabled(bool enabled)
+{
+	spriteInstancingEnabled = enabled;
+}
+
+void Painter::drawSprites(std::shared_ptr<Material> material, size_t numSprites, const void* vertexData, size_t srcStride)
 {
 	Expects(vertexData != nullptr);
+	if (numSprites == 0) {
+		return;
+	}
+
+	const char* const src = reinterpret_cast<const char*>(vertexData);
+	if (srcStride == 0) {
+		srcStride = material->getDefinition().getVertexStride();
+	}
+
+	if (spriteInstancingEnabled && supportsInstancedSprites()) {
+		drawSpriteInstances(material, numSprites, src, srcStride);
+		return;
+	}
 
 	const size_t verticesPerSprite = 4;
 	const size_t numVertices = verticesPerSprite * numSprites;
@@ -105,11 +220,9 @@ void Painter::drawSprites(std::shared_ptr<Material> material, size_t numSprites,
 
 	auto result = addDrawData(material, numVertices, numSprites * 6, true);
 
-	const char* const src = reinterpret_cast<const char*>(vertexData);
-
 	for (size_t i = 0; i < numSprites; i++) {
 		for (size_t j = 0; j < verticesPerSprite; j++) {
-			size_t srcOffset = i * result.vertexStride;
+			size_t srcOffset = i * srcStride;
 			size_t dstOffset = (i * verticesPerSprite + j) * result.vertexStride;
 			memmove(result.dstVertex + dstOffset, src + srcOffset, result.vertexSize);
 
@@ -127,6 +240,28 @@ void Painter::drawSprites(std::shared_ptr<Material> material, size_t numSprites,
 	generateQuadIndices(result.firstIndex, numSprites, result.dstIndex);
 }
 
+void Painter::drawSpriteInstances(std::shared_ptr<Material>& material, size_t numSprites, const char* src, size_t srcStride)
+{
+	const size_t vertexSize = material->getDefinition().getVertexSize();
+	const size_t vertexStride = material->getDefinition().getVertexStride();
+	const size_t dataSize = numSprites * vertexStride;
+
+	startDrawCall(material, numSprites, dataSize, true);
+	makeSpaceForPendingVertices(dataSize);
+
+	char* dst = vertexDst + bytesPending;
+	if (srcStride == vertexStride) {
+		memcpy(dst, src, dataSize);
+	} else {
+		for (size_t i = 0; i < numSprites; i++) {
+			memcpy(dst + i * vertexStride, src + i * srcStride, vertexSize);
+		}
+	}
+
+	verticesPending += numSprites;
+	bytesPending += dataSize;
+}
+
 void Painter::drawSlicedSprite(std::shared_ptr<Material> material, Vector2f scale, Vector4f slices, const void* vertexData)
 {
 	Expects(vertexData != nullptr);
@@ -180,9 +315,30 @@ void Painter::drawSlicedSprite(std::shared_ptr<Material> material, Vector2f scal
 
 void Painter::makeSpaceForPendingVertices(size_t numBytes)
 {
-	size_t requiredSize = bytesPending + numBytes;
-	if (vertexBuffer.size() < requiredSize) {
-		vertexBuffer.resize(requiredSize * 2);
+	if (!vertexDst && !recording) {
+		// First draw of this batch, see if the backend can give us memory to write into directly
+		Expects(bytesPending == 0);
+		size_t capacity = 0;
+		char* mapped = mapVertices(numBytes, capacity);
+		if (mapped) {
+			Expects(capacity >= numBytes);
+			vertexDst = mapped;
+			vertexDstCapacity = capacity;
+			vertexDstMapped = true;
+			return;
+		}
+	}
+
+	if (vertexDstMapped) {
+		// startDrawCall has already broken the batch if this didn't fit
+		Expects(bytesPending + numBytes <= vertexDstCapacity);
+	} else {
+		size_t requiredSize = bytesPending + numBytes;
+		if (vertexBuffer.size() < requiredSize) {
+			vertexBuffer.resize(requiredSize * 2);
+		}
+		vertexDst = vertexBuffer.data();
+		vertexDstCapacity = vertexBuffer.size();
 	}
 }
 
@@ -203,11 +359,11 @@ void Painter::bind(RenderContext& context)
 
 	// Set render target
 	activeRenderTarget = &camera->getActiveRenderTarget();
-	activeRenderTarget->onBind(*this);
+	submitBindRenderTarget(*activeRenderTarget);
 
 	// Set viewport
 	viewPort = camera->getActiveViewPort();
-	setViewPort(getRectangleForActiveRenderTarget(viewPort));
+	submitViewPort(getRectangleForActiveRenderTarget(viewPort));
 	setClip();
 
 	// Update projection
@@ -216,8 +372,8 @@ void Painter::bind(RenderContext& context)
 
 void Painter::unbind(RenderContext& context)
 {
-	flush();
-	activeRenderTarget->onUnbind(*this);
+	flushPending(PainterBatchBreak::Flush);
+	submitUnbindRenderTarget(*activeRenderTarget);
 	activeRenderTarget = nullptr;
 	camera->rendering = false;
 }
@@ -241,15 +397,15 @@ void Painter::setRelativeClip(Rect4f rect)
 
 void Painter::setClip(Rect4i rect)
 {
-	flushPending();
+	flushPending(PainterBatchBreak::Clip);
 	Rect4i finalRect = (rect + viewPort.getTopLeft()).intersection(viewPort);
-	setClip(getRectangleForActiveRenderTarget(finalRect), finalRect != activeRenderTarget->getViewPort());
+	submitClip(getRectangleForActiveRenderTarget(finalRect), finalRect != activeRenderTarget->getViewPort());
 }
 
 void Painter::setClip()
 {
-	flushPending();
-	setClip(getRectangleForActiveRenderTarget(viewPort), viewPort != activeRenderTarget->getViewPort());
+	flushPending(PainterBatchBreak::Clip);
+	submitClip(getRectangleForActiveRenderTarget(viewPort), viewPort != activeRenderTarget->getViewPort());
 }
 
 Rect4i Painter::getRectangleForActiveRenderTarget(Rect4i r)
@@ -264,43 +420,169 @@ Rect4i Painter::getRectangleForActiveRenderTarget(Rect4i r)
 	}
 }
 
-void Painter::startDrawCall(std::shared_ptr<Material>& material)
+void Painter::startDrawCall(std::shared_ptr<Material>& material, size_t numVertices, size_t numBytes, bool instanced)
 {
-	if (material != materialPending) {
-		if (materialPending != std::shared_ptr<Material>() && !(*material == *materialPending)) {
-			flushPending();
+	if (verticesPending > 0) {
+		// Distinct material instances with the same definition and parameters can share a batch
+		if (material != materialPending && !(*material == *materialPending)) {
+			flushPending(PainterBatchBreak::Material);
+		} else if (instanced != instancesPending) {
+			flushPending(PainterBatchBreak::Instancing);
+		} else if (!instanced && verticesPending + numVertices > maxVerticesPerBatch) {
+			flushPending(PainterBatchBreak::IndexRange);
+		} else if (vertexDstMapped && bytesPending + numBytes > vertexDstCapacity) {
+			flushPending(PainterBatchBreak::BufferFull);
 		}
-		materialPending = material;
 	}
+	materialPending = material;
+	instancesPending = instanced;
 }
 
-void Painter::flushPending()
+void Painter::flushPending(PainterBatchBreak reason)
 {
 	if (verticesPending > 0) {
-		executeDrawTriangles(*materialPending, verticesPending, vertexBuffer.data(), indicesPending, indexBuffer.data());
+		HALLEY_PROFILE_ZONE("Painter::flushPending");
+		nBatchBreaks[size_t(reason)]++;
+		if (vertexDstMapped) {
+			unmapVertices(bytesPending);
+			vertexDstMapped = false;
+		}
+		nBytesSubmitted += bytesPending + indicesPending * sizeof(unsigned short);
+		if (instancesPending) {
+			addDrawStats(*materialPending, verticesPending * 4, verticesPending * 2);
+			if (recording) {
+				recording->addDrawInstances(*materialPending, vertexDst, bytesPending, verticesPending);
+			} else {
+				executeDrawInstances(*materialPending, verticesPending, vertexDst);
+			}
+		} else {
+			addDrawStats(*materialPending, verticesPending, indicesPending / 3);
+			if (recording) {
+				recording->addDrawTriangles(*materialPending, vertexDst, bytesPending, verticesPending, indexBuffer.data(), indicesPending, allIndicesAreQuads);
+			} else {
+				executeDrawTriangles(*materialPending, verticesPending, vertexDst, indicesPending, indexBuffer.data(), allIndicesAreQuads);
+			}
+		}
 	}
 
 	resetPending();
 }
 
+void Painter::addDrawStats(const Material& material, size_t numVertices, size_t numTriangles)
+{
+	// Counted here rather than when the draw executes, so they're always available on the thread that's painting
+	for (int i = 0; i < material.getDefinition().getNumPasses(); i++) {
+		if (material.isPassEnabled(i)) {
+			nDrawCalls++;
+			nTriangles += numTriangles;
+			nVertices += numVertices;
+		}
+	}
+}
+
 void Painter::resetPending()
 {
 	bytesPending = 0;
 	verticesPending = 0;
 	indicesPending = 0;
 	allIndicesAreQuads = true;
-	if (materialPending) {
-		Material::resetBindCache();
-		materialPending.reset();
+	instancesPending = false;
+	if (vertexDstMapped) {
+		unmapVertices(0);
+		vertexDstMapped = false;
+	}
+	vertexDst = nullptr;
+	vertexDstCapacity = 0;
+	materialPending.reset();
+}
+
+void Painter::submitStartRender()
+{
+	if (recording) {
+		recording->addStartRender();
+	} else {
+		executeStartRender();
 	}
 }
 
-void Painter::executeDrawTriangles(Material& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices)
+void Painter::submitEndRender()
+{
+	if (recording) {
+		recording->addEndRender();
+	} else {
+		doEndRender();
+	}
+}
+
+void Painter::submitViewPort(Rect4i rect)
+{
+	if (recording) {
+		recording->addSetViewPort(rect);
+	} else {
+		setViewPort(rect);
+	}
+}
+
+void Painter::submitClip(Rect4i rect, bool enable)
+{
+	if (recording) {
+		recording->addSetClip(rect, enable);
+	} else {
+		setClip(rect, enable);
+	}
+}
+
+void Painter::submitBindRenderTarget(RenderTarget& target)
+{
+	if (recording) {
+		recording->addBindRenderTarget(target);
+	} else {
+		executeBindRenderTarget(target);
+	}
+}
+
+void Painter::submitUnbindRenderTarget(RenderTarget& target)
+{
+	if (recording) {
+		recording->addUnbindRenderTarget(target);
+	} else {
+		executeUnbindRenderTarget(target);
+	}
+}
+
+void Painter::submitUpdateProjection(Material& material)
+{
+	if (recording) {
+		recording->addUpdateProjection(material);
+	} else {
+		onUpdateProjection(material);
+	}
+}
+
+void Painter::executeStartRender()
+{
+	Material::resetBindCache();
+	doStartRender();
+}
+
+void Painter::executeBindRenderTarget(RenderTarget& target)
+{
+	backendRenderTarget = &target;
+	target.onBind(*this);
+}
+
+void Painter::executeUnbindRenderTarget(RenderTarget& target)
+{
+	target.onUnbind(*this);
+	backendRenderTarget = nullptr;
+}
+
+void Painter::executeDrawTriangles(Material& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices, bool standardQuadsOnly)
 {
 	startDrawCall();
 
 	// Load vertices
-	setVertices(material.getDefinition(), numVertices, vertexData, numIndices, indices, allIndicesAreQuads);
+	setVertices(material.getDefinition(), numVertices, vertexData, numIndices, indices, standardQuadsOnly);
 
 	// Load material uniforms
 	material.uploadData(*this);
@@ -314,15 +596,41 @@ void Painter::executeDrawTriangles(Material& material, size_t numVertices, void*
 
 			// Draw
 			drawTriangles(numIndices);
+		}
+	}
 
-			// Log stats
-			nDrawCalls++;
-			nTriangles += numIndices / 3;
-			nVertices += numVertices;
+	endDrawCall();
+
+	// The material might be changed before it's drawn again
+	Material::resetBindCache();
+}
+
+void Painter::executeDrawInstances(Material& material, size_t numInstances, void* instanceData)
+{
+	startDrawCall();
+
+	// Load instances
+	setInstances(material.getDefinition(), numInstances, instanceData);
+
+	// Load material uniforms
+	material.uploadData(*this);
+	setMaterialData(material);
+
+	// Go through each pass
+	for (int i = 0; i < material.getDefinition().getNumPasses(); i++) {
+		if (material.isPassEnabled(i)) {
+			// Bind pass
+			material.bind(i, *this);
+
+			// Draw
+			drawInstancedQuads(numInstances);
 		}
 	}
 
 	endDrawCall();
+
+	// The material might be changed before it's drawn again
+	Material::resetBindCache();
 }
 
 unsigned short* Painter::getStandardQuadIndices(size_t numQuads)
@@ -373,8 +681,8 @@ void Painter::generateQuadIndices(unsigned short pos, size_t numQuads, unsigned
 
 RenderTarget& Painter::getActiveRenderTarget()
 {
-	Expects(activeRenderTarget);
-	return *activeRenderTarget;
+	Expects(backendRenderTarget);
+	return *backendRenderTarget;
 }
 
 void Painter::generateQuadIndicesOffset(unsigned short pos, unsigned short lineStride, unsigned short* target)
@@ -400,6 +708,6 @@ void Painter::updateProjection()
 	auto old = halleyGlobalMaterial->clone();
 	halleyGlobalMaterial->set("u_mvp", projection);
 	if (*old != *halleyGlobalMaterial) {
-		onUpdateProjection(*halleyGlobalMaterial);
+		submitUpdateProjection(*halleyGlobalMaterial);
 	}
 }
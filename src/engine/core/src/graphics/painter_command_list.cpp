@@ -0,0 +1,167 @@
+#include "halley/core/graphics/painter_command_list.h"
+#include "halley/core/graphics/material/material.h"
+#include "halley/core/graphics/material/material_parameter.h"
+#include "halley/utils/utils.h"
+#include <gsl/gsl_assert>
+#include <cstring>
+
+using namespace Halley;
+
+constexpr size_t PainterCommandList::blockSize;
+constexpr uint64_t PainterCommandList::snapshotMaxAge;
+constexpr size_t PainterCommandList::commandAlignment;
+
+PainterCommandList::PainterCommandList()
+{
+}
+
+PainterCommandList::~PainterCommandList()
+{
+}
+
+void PainterCommandList::reset()
+{
+	commands.clear();
+	numCommands = 0;
+
+	for (auto& block: blocks) {
+		block.used = 0;
+	}
+	curBlock = 0;
+	dataBytes = 0;
+
+	retiredSnapshots.clear();
+	++recordingId;
+
+	// Snapshots of materials that haven't been drawn in a while are most likely of materials that no longer exist
+	for (auto iter = snapshots.begin(); iter != snapshots.end(); ) {
+		if (iter->second.lastUsed + snapshotMaxAge < recordingId) {
+			iter = snapshots.erase(iter);
+		} else {
+			++iter;
+		}
+	}
+}
+
+void PainterCommandList::addStartRender()
+{
+	addCommand(PainterCommandType::StartRender, 0);
+}
+
+void PainterCommandList::addEndRender()
+{
+	addCommand(PainterCommandType::EndRender, 0);
+}
+
+void PainterCommandList::addClear(Colour colour)
+{
+	add(PainterCommandType::Clear, ClearCommand{ colour });
+}
+
+void PainterCommandList::addSetViewPort(Rect4i rect)
+{
+	add(PainterCommandType::SetViewPort, SetViewPortCommand{ rect });
+}
+
+void PainterCommandList::addSetClip(Rect4i rect, bool enable)
+{
+	add(PainterCommandType::SetClip, SetClipCommand{ rect, enable });
+}
+
+void PainterCommandList::addBindRenderTarget(RenderTarget& target)
+{
+	add(PainterCommandType::BindRenderTarget, RenderTargetCommand{ &target });
+}
+
+void PainterCommandList::addUnbindRenderTarget(RenderTarget& target)
+{
+	add(PainterCommandType::UnbindRenderTarget, RenderTargetCommand{ &target });
+}
+
+void PainterCommandList::addUpdateProjection(const Material& material)
+{
+	add(PainterCommandType::UpdateProjection, UpdateProjectionCommand{ getSnapshot(material) });
+}
+
+void PainterCommandList::addDrawTriangles(const Material& material, const char* vertices, size_t vertexBytes, size_t numVertices, const unsigned short* indices, size_t numIndices, bool standardQuadsOnly)
+{
+	DrawTrianglesCommand cmd;
+	cmd.material = getSnapshot(material);
+	cmd.vertices = copyData(vertices, vertexBytes);
+	cmd.indices = reinterpret_cast<unsigned short*>(copyData(indices, numIndices * sizeof(unsigned short)));
+	cmd.numVertices = uint32_t(numVertices);
+	cmd.numIndices = uint32_t(numIndices);
+	cmd.standardQuadsOnly = standardQuadsOnly;
+	add(PainterCommandType::DrawTriangles, cmd);
+}
+
+void PainterCommandList::addDrawInstances(const Material& material, const char* instances, size_t instanceBytes, size_t numInstances)
+{
+	DrawInstancesCommand cmd;
+	cmd.material = getSnapshot(material);
+	cmd.instances = copyData(instances, instanceBytes);
+	cmd.numInstances = uint32_t(numInstances);
+	add(PainterCommandType::DrawInstances, cmd);
+}
+
+char* PainterCommandList::addCommand(PainterCommandType type, size_t payloadSize)
+{
+	// The vector's storage is at least this aligned, so keeping every size a multiple of it aligns every command
+	const size_t size = alignUp(payloadSize, commandAlignment);
+	const size_t pos = commands.size();
+	commands.resize(pos + sizeof(CommandHeader) + size);
+
+	auto header = new (commands.data() + pos) CommandHeader();
+	header->type = type;
+	header->size = uint32_t(size);
+	++numCommands;
+
+	return commands.data() + pos + sizeof(CommandHeader);
+}
+
+char* PainterCommandList::copyData(const void* src, size_t size)
+{
+	// Blocks are never reallocated while recording, so pointers into them stay valid until the next reset
+	const size_t alignedSize = alignUp(size, size_t(16));
+	while (curBlock < blocks.size() && blocks[curBlock].used + alignedSize > blocks[curBlock].size) {
+		++curBlock;
+	}
+	if (curBlock == blocks.size()) {
+		Block block;
+		block.size = std::max(blockSize, nextPowerOf2(alignedSize));
+		block.data.reset(new char[block.size]);
+		blocks.push_back(std::move(block));
+	}
+
+	auto& block = blocks[curBlock];
+	char* dst = block.data.get() + block.used;
+	memcpy(dst, src, size);
+	block.used += alignedSize;
+	dataBytes += size;
+	return dst;
+}
+
+Material* PainterCommandList::getSnapshot(const Material& material)
+{
+	auto& snapshot = snapshots[&material];
+	if (snapshot.material && &snapshot.material->getDefinition() == &material.getDefinition()) {
+		if (*snapshot.material == material) {
+			snapshot.lastUsed = recordingId;
+			return snapshot.material.get();
+		}
+
+		if (snapshot.lastUsed != recordingId) {
+			// Nothing recorded since the last reset refers to this snapshot, so it can be updated in place
+			snapshot.material->copyDataFrom(material);
+			snapshot.lastUsed = recordingId;
+			return snapshot.material.get();
+		}
+
+		// Commands already recorded still need the old state
+		retiredSnapshots.push_back(std::move(snapshot.material));
+	}
+
+	snapshot.material = material.clone();
+	snapshot.lastUsed = recordingId;
+	return snapshot.material.get();
+}
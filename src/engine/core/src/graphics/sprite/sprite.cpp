@@ -74,25 +74,12 @@ void Sprite::draw(const Sprite* sprites, size_t n, Painter& painter) // static
 	auto& material = sprites[0].material;
 	Expects(material->getDefinition().getVertexStride() == sizeof(SpriteVertexAttrib));
 
-	size_t spriteSize = sizeof(SpriteVertexAttrib);
-	char buffer[4096];
-	char* vertexData;
-	std::vector<char> vertices;
-	const size_t vertexDataSize = n * spriteSize;
-	if (vertexDataSize <= 4096) {
-		vertexData = buffer;
-	} else {
-		vertices.resize(vertexDataSize);
-		vertexData = vertices.data();
-	}
-
 	for (size_t i = 0; i < n; i++) {
-		auto& sprite = sprites[i];
-		Expects(sprite.material == material);
-		memcpy(&vertexData[i * spriteSize], &sprite.vertexAttrib, spriteSize);
+		Expects(sprites[i].material == material);
 	}
 
-	painter.drawSprites(material, n, vertexData);
+	// The painter reads the attributes straight out of each sprite
+	painter.drawSprites(material, n, &sprites[0].vertexAttrib, sizeof(Sprite));
 }
 
 void Sprite::drawMixedMaterials(const Sprite* sprites, size_t n, Painter& painter)
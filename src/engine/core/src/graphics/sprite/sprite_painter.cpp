@@ -1,17 +1,58 @@
 #include "graphics/sprite/sprite_painter.h"
 #include "graphics/sprite/sprite.h"
 #include "graphics/painter.h"
+#include "graphics/material/material.h"
+#include "graphics/material/material_definition.h"
+#include "halley/data_structures/frame_arena.h"
 #include <gsl/gsl>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <thread>
 #include "graphics/text/text_renderer.h"
 
 using namespace Halley;
 
+namespace {
+	uint32_t getOrderedBits(float value)
+	{
+		// Flips the bits of floats so that comparing them as unsigned integers gives the same order
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+	}
+
+	uint64_t makeSortKey(float tieBreaker, const void* material)
+	{
+		// Only used to group equal materials together, so truncating the pointer is fine
+		const auto materialId = uint32_t(reinterpret_cast<uintptr_t>(material) >> 4);
+		return (uint64_t(getOrderedBits(tieBreaker)) << 32) | materialId;
+	}
+
+	const void* getMaterialId(const Sprite& sprite)
+	{
+		return sprite.hasMaterial() ? &sprite.getMaterial() : nullptr;
+	}
+
+	// The buffer this thread got from the painter started as the given generation. Generations are unique across all painters.
+	struct ThreadBufferCache
+	{
+		uint64_t generation = 0;
+		SpritePainterBuffer* buffer = nullptr;
+	};
+
+	thread_local ThreadBufferCache threadBufferCache;
+	std::atomic<uint64_t> nextGeneration(1);
+}
+
+constexpr uint32_t SpriteDrawRecord::noExtra;
+
 SpritePainterEntry::SpritePainterEntry(const Sprite& sprite, int mask, int layer, float tieBreaker)
 	: ptr(&sprite)
 	, type(SpritePainterEntryType::SpriteRef)
 	, layer(layer)
 	, mask(mask)
-	, tieBreaker(tieBreaker)
+	, sortKey(makeSortKey(tieBreaker, getMaterialId(sprite)))
 {}
 
 SpritePainterEntry::SpritePainterEntry(const TextRenderer& text, int mask, int layer, float tieBreaker)
@@ -19,7 +60,7 @@ SpritePainterEntry::SpritePainterEntry(const TextRenderer& text, int mask, int l
 	, type(SpritePainterEntryType::TextRef)
 	, layer(layer)
 	, mask(mask)
-	, tieBreaker(tieBreaker)
+	, sortKey(makeSortKey(tieBreaker, nullptr))
 {
 }
 
@@ -28,17 +69,15 @@ SpritePainterEntry::SpritePainterEntry(SpritePainterEntryType type, size_t sprit
 	, type(type)
 	, layer(layer)
 	, mask(mask)
-	, tieBreaker(tieBreaker)
+	, sortKey(makeSortKey(tieBreaker, nullptr))
 {}
 
 bool SpritePainterEntry::operator<(const SpritePainterEntry& o) const
 {
 	if (layer != o.layer) {
 		return layer < o.layer;
-	} else if (tieBreaker != o.tieBreaker) {
-		return tieBreaker < o.tieBreaker;
 	} else {
-		return ptr < o.ptr;
+		return sortKey < o.sortKey;
 	}
 }
 
@@ -72,57 +111,270 @@ int SpritePainterEntry::getMask() const
 	return mask;
 }
 
+int SpritePainterEntry::getLayer() const
+{
+	return layer;
+}
+
+uint64_t SpritePainterEntry::getSortKey() const
+{
+	return sortKey;
+}
+
+SpritePainterBuffer::SpritePainterBuffer()
+{
+}
+
+SpritePainterBuffer::~SpritePainterBuffer()
+{
+}
+
+void SpritePainterBuffer::add(const Sprite& sprite, int mask, int layer, float tieBreaker)
+{
+	entries.push_back(SpritePainterEntry(sprite, mask, layer, tieBreaker));
+	entries.back().buffer = this;
+}
+
+void SpritePainterBuffer::addCopy(const Sprite& sprite, int mask, int layer, float tieBreaker)
+{
+	// Hidden sprites would never pass culling anyway
+	if (!sprite.isVisible()) {
+		return;
+	}
+	Expects(sprite.material);
+	Expects(sprite.material->getDefinition().getVertexStride() == sizeof(SpriteVertexAttrib));
+
+	SpriteDrawRecord record;
+	record.vertexAttrib = sprite.vertexAttrib;
+	record.aabb = sprite.getAABB();
+	record.material = getMaterialIndex(sprite.material);
+	record.extra = SpriteDrawRecord::noExtra;
+
+	if (sprite.clip || sprite.sliced) {
+		// Resolve everything Sprite::draw would work out at draw time
+		Extra extra;
+		extra.clipped = bool(sprite.clip);
+		extra.sliced = sprite.sliced;
+		if (sprite.clip) {
+			const bool absolute = sprite.absoluteClip && !sprite.sliced;
+			extra.clip = sprite.clip.get() + (absolute ? Vector2f() : sprite.vertexAttrib.pos);
+		}
+		if (sprite.sliced) {
+			extra.slices = Vector4f(sprite.slices);
+			extra.slices.x /= sprite.size.x;
+			extra.slices.y /= sprite.size.y;
+			extra.slices.z /= sprite.size.x;
+			extra.slices.w /= sprite.size.y;
+		}
+		record.extra = uint32_t(extras.size());
+		extras.push_back(extra);
+	}
+
+	auto entry = SpritePainterEntry(SpritePainterEntryType::SpriteCached, records.size(), mask, layer, tieBreaker);
+	entry.sortKey = makeSortKey(tieBreaker, sprite.material.get());
+	entry.buffer = this;
+	entries.push_back(entry);
+	records.push_back(record);
+}
+
+void SpritePainterBuffer::add(const TextRenderer& text, int mask, int layer, float tieBreaker)
+{
+	entries.push_back(SpritePainterEntry(text, mask, layer, tieBreaker));
+	entries.back().buffer = this;
+}
+
+void SpritePainterBuffer::addCopy(const TextRenderer& text, int mask, int layer, float tieBreaker)
+{
+	entries.push_back(SpritePainterEntry(SpritePainterEntryType::TextCached, texts.size(), mask, layer, tieBreaker));
+	entries.back().buffer = this;
+	texts.push_back(text);
+}
+
+size_t SpritePainterBuffer::size() const
+{
+	return entries.size();
+}
+
+void SpritePainterBuffer::clear()
+{
+	entries.clear();
+	records.clear();
+	extras.clear();
+	materials.clear();
+	texts.clear();
+}
+
+uint32_t SpritePainterBuffer::getMaterialIndex(const std::shared_ptr<Material>& material)
+{
+	// Consecutive sprites very often share their material, so only the last one is checked
+	if (materials.empty() || materials.back() != material) {
+		materials.push_back(material);
+	}
+	return uint32_t(materials.size() - 1);
+}
+
+void SpritePainterBuffer::draw(const SpriteDrawRecord& record, Painter& painter, Rect4f view) const
+{
+	if (!record.aabb.overlaps(view)) {
+		return;
+	}
+
+	auto& material = materials[record.material];
+	if (record.extra == SpriteDrawRecord::noExtra) {
+		painter.drawSprites(material, 1, &record.vertexAttrib);
+		return;
+	}
+
+	auto& extra = extras[record.extra];
+	if (extra.clipped) {
+		painter.setRelativeClip(extra.clip);
+	}
+	if (extra.sliced) {
+		painter.drawSlicedSprite(material, record.vertexAttrib.scale, extra.slices, &record.vertexAttrib);
+	} else {
+		painter.drawSprites(material, 1, &record.vertexAttrib);
+	}
+	if (extra.clipped) {
+		painter.setClip();
+	}
+}
+
+SpritePainter::SpritePainter()
+	: threadBuffersClaimed(0)
+	, generation(nextGeneration++)
+{
+}
+
+SpritePainter::~SpritePainter()
+{
+}
+
 void SpritePainter::start(size_t nSprites)
 {
 	if (sprites.capacity() < nSprites) {
 		sprites.reserve(nSprites);
 	}
 	sprites.clear();
-	cachedSprites.clear();
-	cachedText.clear();
+	mainBuffer.clear();
+
+	// Buffers created on demand last time are kept, so there should be enough of them up front from now on
+	for (auto& buffer: overflowBuffers) {
+		threadBuffers.push_back(std::move(buffer));
+	}
+	overflowBuffers.clear();
+	if (threadBuffers.empty()) {
+		const size_t nThreads = std::max(size_t(std::thread::hardware_concurrency()), size_t(4));
+		for (size_t i = 0; i < nThreads; ++i) {
+			threadBuffers.push_back(std::make_unique<SpritePainterBuffer>());
+		}
+	}
+
+	const size_t nClaimed = std::min(threadBuffersClaimed.load(), threadBuffers.size());
+	for (size_t i = 0; i < nClaimed; ++i) {
+		threadBuffers[i]->clear();
+	}
+	threadBuffersClaimed = 0;
+
+	// Invalidates every thread's cached buffer
+	generation = nextGeneration++;
+	dirty = true;
 }
 
 void SpritePainter::add(const Sprite& sprite, int mask, int layer, float tieBreaker)
 {
-	sprites.push_back(SpritePainterEntry(sprite, mask, layer, tieBreaker));
+	mainBuffer.add(sprite, mask, layer, tieBreaker);
 	dirty = true;
 }
 
 void SpritePainter::addCopy(const Sprite& sprite, int mask, int layer, float tieBreaker)
 {
-	sprites.push_back(SpritePainterEntry(SpritePainterEntryType::SpriteCached, cachedSprites.size(), mask, layer, tieBreaker));
-	cachedSprites.push_back(sprite);
+	mainBuffer.addCopy(sprite, mask, layer, tieBreaker);
 	dirty = true;
 }
 
 void SpritePainter::add(const TextRenderer& text, int mask, int layer, float tieBreaker)
 {
-	sprites.push_back(SpritePainterEntry(text, mask, layer, tieBreaker));
+	mainBuffer.add(text, mask, layer, tieBreaker);
 	dirty = true;
 }
 
 void SpritePainter::addCopy(const TextRenderer& text, int mask, int layer, float tieBreaker)
 {
-	sprites.push_back(SpritePainterEntry(SpritePainterEntryType::TextCached, cachedText.size(), mask, layer, tieBreaker));
-	cachedText.push_back(text);
+	mainBuffer.addCopy(text, mask, layer, tieBreaker);
 	dirty = true;
 }
 
+SpritePainterBuffer& SpritePainter::getThreadBuffer()
+{
+	auto& cache = threadBufferCache;
+	if (cache.generation == generation) {
+		return *cache.buffer;
+	}
+
+	// Buffers are handed out in order, so the only thing threads contend on is this counter
+	const size_t idx = threadBuffersClaimed.fetch_add(1);
+	SpritePainterBuffer* buffer;
+	if (idx < threadBuffers.size()) {
+		buffer = threadBuffers[idx].get();
+	} else {
+		std::unique_lock<std::mutex> lock(overflowMutex);
+		overflowBuffers.push_back(std::make_unique<SpritePainterBuffer>());
+		buffer = overflowBuffers.back().get();
+	}
+
+	cache.generation = generation;
+	cache.buffer = buffer;
+	return *buffer;
+}
+
+SpritePainter::IndexedSpriteId SpritePainter::addIndexed(const Sprite& sprite, int mask, int layer, float tieBreaker)
+{
+	// Ids are either reused, or the next one after all that were ever handed out
+	const auto id = index.add(sprite.getAABB());
+	const auto entry = SpritePainterEntry(sprite, mask, layer, tieBreaker);
+	if (id == indexedEntries.size()) {
+		indexedEntries.push_back(entry);
+	} else {
+		indexedEntries[id] = entry;
+	}
+	indexDirty = true;
+	return id;
+}
+
+void SpritePainter::updateIndexed(IndexedSpriteId id, const Sprite& sprite, int mask, int layer, float tieBreaker)
+{
+	index.update(id, sprite.getAABB());
+	indexedEntries[id] = SpritePainterEntry(sprite, mask, layer, tieBreaker);
+	indexDirty = true;
+}
+
+void SpritePainter::removeIndexed(IndexedSpriteId id)
+{
+	index.remove(id);
+	indexDirty = true;
+}
+
+size_t SpritePainter::getNumIndexed() const
+{
+	return index.size();
+}
+
 void SpritePainter::draw(int mask, Painter& painter)
 {
-	if (dirty) {
-		// TODO: implement hierarchical bucketing.
-		// - one bucket per layer
-		// - for each layer, one bucket per vertical band of the screen (32px or so)
-		// - sort each leaf bucket
-		std::sort(sprites.begin(), sprites.end()); // lol
+	draw(mask, painter, painter.getCurrentCamera().getClippingRectangle());
+}
+
+void SpritePainter::draw(int mask, Painter& painter, Rect4f view)
+{
+	// Which indexed sprites are in the list depends on the view, so it has to be rebuilt if that changes
+	if (dirty || indexDirty || (index.size() > 0 && view != lastView)) {
+		merge(view);
+		sort();
 		dirty = false;
+		indexDirty = false;
+		lastView = view;
 	}
 
-	// View
-	auto& cam = painter.getCurrentCamera();
-	Rect4f view = cam.getClippingRectangle();
-
 	// Draw!
 	for (auto& s : sprites) {
 		if ((s.getMask() & mask) != 0) {
@@ -130,17 +382,49 @@ void SpritePainter::draw(int mask, Painter& painter)
 			if (type == SpritePainterEntryType::SpriteRef) {
 				draw(s.getSprite(), painter, view);
 			} else if (type == SpritePainterEntryType::SpriteCached) {
-				draw(cachedSprites[s.getIndex()], painter, view);
+				s.buffer->draw(s.buffer->records[s.getIndex()], painter, view);
 			} else if (type == SpritePainterEntryType::TextRef) {
 				draw(s.getText(), painter, view);
 			} else if (type == SpritePainterEntryType::TextCached) {
-				draw(cachedText[s.getIndex()], painter, view);
+				draw(s.buffer->texts[s.getIndex()], painter, view);
 			}
 		}
 	}
 	painter.flush();
 }
 
+void SpritePainter::merge(Rect4f view)
+{
+	visibleIndexed.clear();
+	index.query(view, visibleIndexed);
+
+	const size_t nClaimed = std::min(threadBuffersClaimed.load(), threadBuffers.size());
+	size_t total = mainBuffer.size() + visibleIndexed.size();
+	for (size_t i = 0; i < nClaimed; ++i) {
+		total += threadBuffers[i]->size();
+	}
+	for (auto& buffer: overflowBuffers) {
+		total += buffer->size();
+	}
+
+	sprites.clear();
+	sprites.reserve(total);
+	auto append = [&] (const SpritePainterBuffer& buffer)
+	{
+		sprites.insert(sprites.end(), buffer.entries.begin(), buffer.entries.end());
+	};
+	append(mainBuffer);
+	for (size_t i = 0; i < nClaimed; ++i) {
+		append(*threadBuffers[i]);
+	}
+	for (auto& buffer: overflowBuffers) {
+		append(*buffer);
+	}
+	for (auto id: visibleIndexed) {
+		sprites.push_back(indexedEntries[id]);
+	}
+}
+
 void SpritePainter::draw(const Sprite& sprite, Painter& painter, Rect4f view)
 {
 	if (sprite.isInView(view)) {
@@ -152,3 +436,183 @@ void SpritePainter::draw(const TextRenderer& text, Painter& painter, Rect4f view
 {
 	text.draw(painter);
 }
+
+namespace {
+	template <typename T>
+	bool isSortedBefore(const T& a, const T& b)
+	{
+		if (a.layer != b.layer) {
+			return a.layer < b.layer;
+		} else if (a.key != b.key) {
+			return a.key < b.key;
+		} else {
+			return a.index < b.index;
+		}
+	}
+
+	template <typename T>
+	void insertionSort(T* items, size_t n)
+	{
+		for (size_t i = 1; i < n; ++i) {
+			auto item = items[i];
+			size_t j = i;
+			for (; j > 0 && item.key < items[j - 1].key; --j) {
+				items[j] = items[j - 1];
+			}
+			items[j] = item;
+		}
+	}
+
+	// Stable LSD radix sort on the 64-bit key, one byte per pass. Passes where every key has the same byte are skipped.
+	template <typename T>
+	void radixSort(T* items, T* scratch, size_t n)
+	{
+		std::array<std::array<uint32_t, 256>, 8> histograms = {};
+		for (size_t i = 0; i < n; ++i) {
+			auto key = items[i].key;
+			for (size_t pass = 0; pass < 8; ++pass) {
+				histograms[pass][(key >> (pass * 8)) & 0xFF]++;
+			}
+		}
+
+		T* src = items;
+		T* dst = scratch;
+		for (size_t pass = 0; pass < 8; ++pass) {
+			auto& histogram = histograms[pass];
+			if (histogram[(src[0].key >> (pass * 8)) & 0xFF] == n) {
+				continue;
+			}
+
+			uint32_t offset = 0;
+			for (auto& count: histogram) {
+				const uint32_t c = count;
+				count = offset;
+				offset += c;
+			}
+			for (size_t i = 0; i < n; ++i) {
+				dst[histogram[(src[i].key >> (pass * 8)) & 0xFF]++] = src[i];
+			}
+			std::swap(src, dst);
+		}
+
+		if (src != items) {
+			std::copy(src, src + n, items);
+		}
+	}
+}
+
+void SpritePainter::sort()
+{
+	if (!trySortIncremental()) {
+		sortFull();
+	}
+	applyOrder();
+}
+
+bool SpritePainter::trySortIncremental()
+{
+	// Sprites tend to be submitted in the same order every frame, and only a few of them change their sort position.
+	// If so, last frame's order will be almost sorted, and an insertion sort can quickly fix it.
+	const size_t n = sprites.size();
+	if (lastOrder.size() != n || n == 0) {
+		return false;
+	}
+
+	sortItems.resize(n);
+	for (size_t i = 0; i < n; ++i) {
+		const uint32_t idx = lastOrder[i];
+		auto& s = sprites[idx];
+		sortItems[i] = SortItem{ s.getSortKey(), s.getLayer(), idx };
+	}
+
+	// Give up if it's moving too many entries around
+	size_t budget = n / 8 + 64;
+	for (size_t i = 1; i < n; ++i) {
+		const auto item = sortItems[i];
+		size_t j = i;
+		for (; j > 0 && isSortedBefore(item, sortItems[j - 1]); --j) {
+			if (budget-- == 0) {
+				return false;
+			}
+			sortItems[j] = sortItems[j - 1];
+		}
+		sortItems[j] = item;
+	}
+	return true;
+}
+
+void SpritePainter::sortFull()
+{
+	const size_t n = sprites.size();
+	sortItems.resize(n);
+	sortScratch.resize(n);
+	if (n == 0) {
+		return;
+	}
+
+	int minLayer = std::numeric_limits<int>::max();
+	int maxLayer = std::numeric_limits<int>::min();
+	for (auto& s: sprites) {
+		minLayer = std::min(minLayer, s.getLayer());
+		maxLayer = std::max(maxLayer, s.getLayer());
+	}
+
+	// Bucket by layer first. If layers are too far apart for a counting sort, just sort by layer.
+	constexpr int64_t maxLayerRange = 64 * 1024;
+	const int64_t layerRange = int64_t(maxLayer) - int64_t(minLayer) + 1;
+	FrameVector<std::pair<uint32_t, uint32_t>> buckets;
+	buckets.reserve(size_t(std::min(layerRange, int64_t(n))));
+	if (layerRange <= maxLayerRange) {
+		layerStart.assign(size_t(layerRange) + 1, 0);
+		for (auto& s: sprites) {
+			layerStart[s.getLayer() - minLayer + 1]++;
+		}
+		for (size_t i = 1; i < layerStart.size(); ++i) {
+			if (layerStart[i] > 0) {
+				buckets.emplace_back(layerStart[i - 1], layerStart[i - 1] + layerStart[i]);
+			}
+			layerStart[i] += layerStart[i - 1];
+		}
+		for (size_t i = 0; i < n; ++i) {
+			auto& s = sprites[i];
+			sortItems[layerStart[s.getLayer() - minLayer]++] = SortItem{ s.getSortKey(), s.getLayer(), uint32_t(i) };
+		}
+	} else {
+		for (size_t i = 0; i < n; ++i) {
+			auto& s = sprites[i];
+			sortItems[i] = SortItem{ s.getSortKey(), s.getLayer(), uint32_t(i) };
+		}
+		std::stable_sort(sortItems.begin(), sortItems.end(), [] (const SortItem& a, const SortItem& b) { return a.layer < b.layer; });
+		uint32_t start = 0;
+		for (uint32_t i = 1; i <= n; ++i) {
+			if (i == n || sortItems[i].layer != sortItems[start].layer) {
+				buckets.emplace_back(start, i);
+				start = i;
+			}
+		}
+	}
+
+	// Then sort each layer by key
+	for (auto& bucket: buckets) {
+		const size_t size = bucket.second - bucket.first;
+		if (size < 64) {
+			insertionSort(sortItems.data() + bucket.first, size);
+		} else {
+			radixSort(sortItems.data() + bucket.first, sortScratch.data() + bucket.first, size);
+		}
+	}
+}
+
+void SpritePainter::applyOrder()
+{
+	const size_t n = sprites.size();
+	spritesScratch.clear();
+	spritesScratch.reserve(n);
+	lastOrder.resize(n);
+	for (size_t i = 0; i < n; ++i) {
+		const auto idx = sortItems[i].index;
+		spritesScratch.push_back(sprites[idx]);
+		lastOrder[i] = idx;
+	}
+	std::swap(sprites, spritesScratch);
+}
@@ -1,66 +1,164 @@
 #include "halley/core/resources/asset_database.h"
 #include "halley/bytes/byte_serializer.h"
 #include "halley/support/exception.h"
+#include <algorithm>
 #include <set>
+#include <gsl/gsl_assert>
 
 using namespace Halley;
 
 AssetDatabase::Entry::Entry() {}
 
-AssetDatabase::Entry::Entry(const String& path, const Metadata& meta)
+AssetDatabase::Entry::Entry(const String& path, const Metadata& meta, CompressionCodec compression)
 	: path(path)
 	, meta(meta)
+	, compression(compression)
 {}
 
 void AssetDatabase::Entry::serialize(Serializer& s) const
 {
 	s << path;
 	s << meta;
+	s << compression;
 }
 
 void AssetDatabase::Entry::deserialize(Deserializer& s)
 {
 	s >> path;
 	s >> meta;
+	s >> compression;
+}
+
+void AssetDatabase::Asset::serialize(Serializer& s) const
+{
+	s << id.getValue();
+	s << name;
+	s << entry;
+}
+
+void AssetDatabase::Asset::deserialize(Deserializer& s)
+{
+	uint64_t value;
+	s >> value;
+	id = AssetId::fromValue(value);
+	s >> name;
+	s >> entry;
 }
 
 void AssetDatabase::TypedDB::add(const String& name, Entry&& asset)
 {
-	assets[name] = std::move(asset);
+	Expects(sorted);
+	const AssetId id(name);
+	auto iter = std::lower_bound(assets.begin(), assets.end(), id, [] (const Asset& a, AssetId id) { return a.id < id; });
+	if (iter != assets.end() && iter->id == id) {
+		if (iter->name != name) {
+			throw Exception("Assets \"" + iter->name + "\" and \"" + name + "\" have the same id, please rename one of them.", HalleyExceptions::Resources);
+		}
+		iter->entry = std::move(asset);
+	} else {
+		assets.insert(iter, Asset{ id, name, std::move(asset) });
+	}
+}
+
+void AssetDatabase::TypedDB::append(const String& name, Entry&& asset)
+{
+	assets.push_back(Asset{ AssetId(name), name, std::move(asset) });
+	sorted = false;
+}
+
+void AssetDatabase::TypedDB::sort()
+{
+	if (sorted) {
+		return;
+	}
+
+	// Stable, so that if the same asset was appended more than once, the last one comes last and replaces the others, as with add()
+	std::stable_sort(assets.begin(), assets.end(), [] (const Asset& a, const Asset& b) { return a.id < b.id; });
+
+	size_t n = 0;
+	for (size_t i = 0; i < assets.size(); ++i) {
+		if (n > 0 && assets[n - 1].id == assets[i].id) {
+			if (assets[n - 1].name != assets[i].name) {
+				throw Exception("Assets \"" + assets[n - 1].name + "\" and \"" + assets[i].name + "\" have the same id, please rename one of them.", HalleyExceptions::Resources);
+			}
+			assets[n - 1].entry = std::move(assets[i].entry);
+		} else {
+			if (n != i) {
+				assets[n] = std::move(assets[i]);
+			}
+			++n;
+		}
+	}
+	assets.resize(n);
+	sorted = true;
 }
 
 const AssetDatabase::Entry& AssetDatabase::TypedDB::get(const String& name) const
 {
-	auto i = assets.find(name);
-	if (i == assets.end()) {
+	auto asset = tryGet(AssetId(name));
+	if (!asset || asset->name != name) {
 		throw Exception("Asset not found: " + name, HalleyExceptions::Resources);
 	}
-	return i->second;
+	return asset->entry;
+}
+
+const AssetDatabase::Entry& AssetDatabase::TypedDB::get(AssetId id) const
+{
+	auto asset = tryGet(id);
+	if (!asset) {
+		throw Exception("Asset not found: " + toString(id.getValue(), 16), HalleyExceptions::Resources);
+	}
+	return asset->entry;
+}
+
+const AssetDatabase::Asset* AssetDatabase::TypedDB::tryGet(AssetId id) const
+{
+	Expects(sorted);
+	auto iter = std::lower_bound(assets.begin(), assets.end(), id, [] (const Asset& a, AssetId id) { return a.id < id; });
+	return iter != assets.end() && iter->id == id ? &*iter : nullptr;
 }
 
 void AssetDatabase::TypedDB::serialize(Serializer& s) const
 {
+	Expects(sorted);
 	s << assets;
 }
 
 void AssetDatabase::TypedDB::deserialize(Deserializer& s)
 {
+	// Written out in order, so there's no need to sort again
 	s >> assets;
+	sorted = true;
 }
 
-const HashMap<String, AssetDatabase::Entry>& AssetDatabase::TypedDB::getAssets() const
+const Vector<AssetDatabase::Asset>& AssetDatabase::TypedDB::getAssets() const
 {
 	return assets;
 }
 
 void AssetDatabase::addAsset(const String& name, AssetType type, Entry&& entry)
 {
+	dbs.resize(std::max(dbs.size(), size_t(int(type) + 1)));
 	dbs[int(type)].add(name, std::move(entry));
 }
 
+void AssetDatabase::appendAsset(const String& name, AssetType type, Entry&& entry)
+{
+	dbs.resize(std::max(dbs.size(), size_t(int(type) + 1)));
+	dbs[int(type)].append(name, std::move(entry));
+}
+
+void AssetDatabase::sortAssets()
+{
+	for (auto& db: dbs) {
+		db.sort();
+	}
+}
+
 const AssetDatabase::TypedDB& AssetDatabase::getDatabase(AssetType type) const
 {
-	return dbs[int(type)];
+	static const TypedDB empty;
+	return size_t(type) < dbs.size() ? dbs[int(type)] : empty;
 }
 
 std::vector<String> AssetDatabase::getAssets() const
@@ -68,8 +166,8 @@ std::vector<String> AssetDatabase::getAssets() const
 	std::set<String> contains;
 	std::vector<String> result;
 	for (auto& db: dbs) {
-		for (auto& asset: db.second.getAssets()) {
-			const String& name = asset.first;
+		for (auto& asset: db.getAssets()) {
+			const String& name = asset.name;
 			if (contains.find(name) == contains.end()) {
 				contains.insert(name);
 				result.push_back(name);
@@ -80,21 +178,54 @@ std::vector<String> AssetDatabase::getAssets() const
 	return result;
 }
 
+constexpr int AssetDatabase::currentVersion;
+
 void AssetDatabase::serialize(Serializer& s) const
 {
-	s << dbs;
+	int version = currentVersion;
+	s << version;
+
+	// Only the types that have any assets, each preceded by its type
+	unsigned int numDbs = 0;
+	for (auto& db: dbs) {
+		if (!db.getAssets().empty()) {
+			++numDbs;
+		}
+	}
+	s << numDbs;
+	for (size_t i = 0; i < dbs.size(); ++i) {
+		if (!dbs[i].getAssets().empty()) {
+			s << int(i);
+			s << dbs[i];
+		}
+	}
 }
 
 void AssetDatabase::deserialize(Deserializer& s)
 {
-	s >> dbs;
+	int version;
+	s >> version;
+	if (version != currentVersion) {
+		throw Exception("Asset database is out of date, please reimport assets.", HalleyExceptions::Resources);
+	}
+	s.setVersion(version);
+
+	unsigned int numDbs;
+	s >> numDbs;
+	dbs.clear();
+	for (unsigned int i = 0; i < numDbs; ++i) {
+		int type;
+		s >> type;
+		dbs.resize(std::max(dbs.size(), size_t(type + 1)));
+		s >> dbs[type];
+	}
 }
 
 std::vector<String> AssetDatabase::enumerate(AssetType type) const
 {
 	std::vector<String> result;
 	for (auto& asset: getDatabase(type).getAssets()) {
-		result.push_back(asset.first);
+		result.push_back(asset.name);
 	}
 	return result;
 }
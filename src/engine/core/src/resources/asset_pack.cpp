@@ -5,6 +5,7 @@
 #include "halley/bytes/compression.h"
 #include "halley/maths/random.h"
 #include "halley/utils/encrypt.h"
+#include "halley/concurrency/executor.h"
 
 using namespace Halley;
 
@@ -64,13 +65,23 @@ AssetPack::AssetPack(std::unique_ptr<ResourceDataReader> _reader, const String&
 	memset(ivEmpty.data(), 0, ivEmpty.size());
 	const bool hasCrypt = memcmp(iv.data(), ivEmpty.data(), iv.size()) != 0 && !encryptionKey.isEmpty();
 
-	if (preLoad || hasCrypt) {
-		readToMemory();
-	}
-
 	if (hasCrypt) {
+		readToMemory();
 		decrypt(encryptionKey);
+	} else {
+		// If the whole pack is mapped, preloading is just a hint for the OS to start paging it in, rather than a copy
+		mappedData = reader->getMappedData();
+		if (mappedData) {
+			mappedSize = totalSize;
+			if (preLoad) {
+				reader->adviseAccess(dataOffset, totalSize - dataOffset, ResourceDataAccessHint::WillNeed);
+			}
+		} else if (preLoad) {
+			readToMemory();
+		}
 	}
+
+	readerSupportsReadAt = reader && reader->supportsReadAt();
 }
 
 AssetPack::~AssetPack()
@@ -86,9 +97,14 @@ AssetPack& AssetPack::operator=(AssetPack&& other)
 	reader = std::move(other.reader);
 	data = std::move(other.data);
 	hasReader = !!reader;
+	readerSupportsReadAt = other.readerSupportsReadAt;
+	mappedData = std::move(other.mappedData);
+	mappedSize = other.mappedSize;
 
 	other.hasReader = false;
+	other.readerSupportsReadAt = false;
 	other.reader.reset();
+	other.mappedSize = 0;
 
 	return *this;
 }
@@ -130,16 +146,41 @@ Bytes AssetPack::writeOut() const
 std::unique_ptr<ResourceData> AssetPack::getData(const String& asset, AssetType type, bool stream)
 {
 	auto path = asset;
-	auto ps = assetDb->getDatabase(type).get(asset).path.split(':');
+	const auto& entry = assetDb->getDatabase(type).get(asset);
+	auto ps = entry.path.split(':');
 	size_t pos = size_t(ps.at(0).toInteger());
 	size_t size = size_t(ps.at(1).toInteger());
 
+	if (entry.compression != CompressionCodec::None) {
+		const auto codec = entry.compression;
+		if (stream) {
+			return std::make_unique<ResourceDataStream>(path, [=] () -> std::unique_ptr<ResourceDataReader> {
+				if (mappedData && hasReader) {
+					reader->adviseAccess(dataOffset + pos, size, ResourceDataAccessHint::Sequential);
+				}
+				return std::make_unique<ChunkedDecompressionReader>(std::make_unique<PackDataReader>(*this, pos, size), codec);
+			});
+		} else {
+			return getCompressedData(path, pos, size, codec);
+		}
+	}
+
 	if (stream) {
 		return std::make_unique<ResourceDataStream>(path, [=] () -> std::unique_ptr<ResourceDataReader> {
+			if (mappedData && hasReader) {
+				// Streams (audio, movies) are read front to back, so let the OS read ahead aggressively
+				reader->adviseAccess(dataOffset + pos, size, ResourceDataAccessHint::Sequential);
+			}
 			return std::make_unique<PackDataReader>(*this, pos, size);
 		});
 	} else {
-		if (hasReader) {
+		if (mappedData) {
+			// Zero-copy: the data points into the mapping, and keeps it alive
+			if (dataOffset + pos + size > mappedSize) {
+				throw Exception("Asset \"" + asset + "\" is out of pack bounds.", HalleyExceptions::Resources);
+			}
+			return std::make_unique<ResourceDataStatic>(std::shared_ptr<const char>(mappedData, mappedData.get() + dataOffset + pos), size, path);
+		} else if (hasReader) {
 			auto result = new char[size];
 			try {
 				readData(pos, gsl::as_writeable_bytes(gsl::span<char>(result, size)));
@@ -159,13 +200,54 @@ std::unique_ptr<ResourceData> AssetPack::getData(const String& asset, AssetType
 	}
 }
 
+std::unique_ptr<ResourceData> AssetPack::getCompressedData(const String& path, size_t pos, size_t size, CompressionCodec codec)
+{
+	// Decompress straight out of the mapping or preloaded data if possible, otherwise read the compressed data first
+	Bytes tmp;
+	gsl::span<const gsl::byte> src;
+	if (mappedData) {
+		if (dataOffset + pos + size > mappedSize) {
+			throw Exception("Asset \"" + path + "\" is out of pack bounds.", HalleyExceptions::Resources);
+		}
+		src = gsl::as_bytes(gsl::span<const char>(mappedData.get() + dataOffset + pos, size));
+	} else if (!hasReader) {
+		if (pos + size > data.size()) {
+			throw Exception("Asset \"" + path + "\" is out of pack bounds.", HalleyExceptions::Resources);
+		}
+		src = gsl::as_bytes(gsl::span<const Byte>(data.data() + pos, size));
+	} else {
+		tmp.resize(size);
+		readData(pos, gsl::as_writeable_bytes(gsl::span<Byte>(tmp)));
+		src = gsl::as_bytes(gsl::span<const Byte>(tmp));
+	}
+
+	const size_t uncompressedSize = ChunkedCompression::Table(src).getUncompressedSize();
+	auto result = new char[uncompressedSize];
+	try {
+		// Large assets have their chunks decompressed in parallel
+		auto dst = gsl::as_writeable_bytes(gsl::span<char>(result, uncompressedSize));
+		if (uncompressedSize > ChunkedCompression::defaultChunkSize) {
+			ChunkedCompression::decompress(src, codec, dst, Executors::getCPUAux());
+		} else {
+			ChunkedCompression::decompress(src, codec, dst);
+		}
+		return std::make_unique<ResourceDataStatic>(result, uncompressedSize, path, true);
+	} catch (...) {
+		delete[] result;
+		throw;
+	}
+}
+
 void AssetPack::readToMemory()
 {
 	std::unique_lock<std::mutex> lock(readerMutex);
 	reader->seek(dataOffset, SEEK_SET);
 	data = reader->readAll();
 	hasReader = false;
+	readerSupportsReadAt = false;
 	reader.reset();
+	mappedData.reset();
+	mappedSize = 0;
 }
 
 void AssetPack::encrypt(const String& key)
@@ -188,6 +270,22 @@ void AssetPack::decrypt(const String& key)
 
 void AssetPack::readData(size_t pos, gsl::span<gsl::byte> dst)
 {
+	if (mappedData) {
+		if (dataOffset + pos + size_t(dst.size()) > mappedSize) {
+			throw Exception("Asset data is out of pack bounds.", HalleyExceptions::Resources);
+		}
+		memcpy(dst.data(), mappedData.get() + dataOffset + pos, dst.size());
+		return;
+	}
+
+	if (readerSupportsReadAt) {
+		// Positional reads don't need the lock, so concurrent streams don't contend on it
+		if (reader->readAt(pos + dataOffset, dst) != int(dst.size())) {
+			throw Exception("Unable to read asset data from pack.", HalleyExceptions::Resources);
+		}
+		return;
+	}
+
 	if (hasReader) {
 		std::unique_lock<std::mutex> lock(readerMutex);
 		if (reader) {
@@ -208,6 +306,7 @@ std::unique_ptr<ResourceDataReader> AssetPack::extractReader()
 {
 	std::unique_lock<std::mutex> lock(readerMutex);
 	hasReader = false;
+	readerSupportsReadAt = false;
 	return std::move(reader);
 }
 
@@ -261,3 +360,85 @@ void PackDataReader::close()
 {
 }
 
+
+ChunkedDecompressionReader::ChunkedDecompressionReader(std::unique_ptr<ResourceDataReader> src, CompressionCodec codec)
+	: source(std::move(src))
+	, codec(codec)
+{
+	ChunkedCompression::Header header;
+	source->seek(0, SEEK_SET);
+	if (source->read(gsl::as_writeable_bytes(gsl::span<ChunkedCompression::Header>(&header, 1))) != int(sizeof(header))) {
+		throw Exception("Unable to read compressed data header.", HalleyExceptions::Resources);
+	}
+
+	Bytes tableData(ChunkedCompression::Table::getTableSize(header));
+	source->seek(0, SEEK_SET);
+	if (source->read(gsl::as_writeable_bytes(gsl::span<Byte>(tableData))) != int(tableData.size())) {
+		throw Exception("Unable to read compressed data table.", HalleyExceptions::Resources);
+	}
+	table = ChunkedCompression::Table(gsl::as_bytes(gsl::span<const Byte>(tableData)));
+}
+
+size_t ChunkedDecompressionReader::size() const
+{
+	return table.getUncompressedSize();
+}
+
+int ChunkedDecompressionReader::read(gsl::span<gsl::byte> dst)
+{
+	const size_t total = std::min(size_t(dst.size()), size() - std::min(curPos, size()));
+	size_t done = 0;
+	while (done < total) {
+		const size_t chunk = curPos / table.getChunkSize();
+		loadChunk(chunk);
+
+		const size_t offset = curPos - chunk * table.getChunkSize();
+		const size_t n = std::min(total - done, chunkData.size() - offset);
+		memcpy(dst.data() + done, chunkData.data() + offset, n);
+		done += n;
+		curPos += n;
+	}
+	return int(done);
+}
+
+void ChunkedDecompressionReader::loadChunk(size_t chunk)
+{
+	if (chunk == curChunk) {
+		return;
+	}
+
+	compressedData.resize(table.getChunkCompressedSize(chunk));
+	source->seek(int64_t(table.getChunkStart(chunk)), SEEK_SET);
+	if (source->read(gsl::as_writeable_bytes(gsl::span<Byte>(compressedData))) != int(compressedData.size())) {
+		throw Exception("Unable to read compressed data.", HalleyExceptions::Resources);
+	}
+
+	chunkData.resize(table.getChunkUncompressedSize(chunk));
+	ChunkedCompression::decompressChunk(gsl::as_bytes(gsl::span<const Byte>(compressedData)), codec, gsl::as_writeable_bytes(gsl::span<Byte>(chunkData)));
+	curChunk = chunk;
+}
+
+void ChunkedDecompressionReader::seek(int64_t pos, int whence)
+{
+	switch (whence) {
+	case SEEK_SET:
+		curPos = size_t(pos);
+		break;
+	case SEEK_CUR:
+		curPos = size_t(curPos + pos);
+		break;
+	case SEEK_END:
+		curPos = size_t(size() + pos);
+		break;
+	}
+}
+
+size_t ChunkedDecompressionReader::tell() const
+{
+	return curPos;
+}
+
+void ChunkedDecompressionReader::close()
+{
+	source->close();
+}
@@ -1,8 +1,10 @@
 #include "resources/resource_collection.h"
 #include "resources/resource_locator.h"
 #include "resources/resources.h"
+#include "resources/resource_preloader.h"
 #include <halley/resources/resource.h>
 #include "halley/support/logger.h"
+#include "halley/support/profiler.h"
 
 using namespace Halley;
 
@@ -20,7 +22,7 @@ void ResourceCollectionBase::clear()
 
 void ResourceCollectionBase::unload(const String& assetId)
 {
-	resources.erase(assetId);
+	resources.erase(AssetId(assetId));
 }
 
 void ResourceCollectionBase::unloadAll(int minDepth)
@@ -40,7 +42,7 @@ void ResourceCollectionBase::unloadAll(int minDepth)
 
 void ResourceCollectionBase::reload(const String& assetId)
 {
-	auto res = resources.find(assetId);
+	auto res = resources.find(AssetId(assetId));
 	if (res != resources.end()) {
 		auto& resWrap = res->second;
 		try {
@@ -68,7 +70,8 @@ std::vector<String> ResourceCollectionBase::enumerate() const
 	return parent.locator->enumerate(type);
 }
 
-std::shared_ptr<Resource> ResourceCollectionBase::loadAsset(const String& assetId, ResourceLoadPriority priority) {
+std::shared_ptr<Resource> ResourceCollectionBase::loadAsset(const String& assetId, ResourceLoadPriority priority, std::unique_ptr<ResourceDataStatic> prefetched) {
+	HALLEY_PROFILE_ZONE(Profiler::isEnabled() ? Profiler::internName("Load " + assetId) : "");
 	std::shared_ptr<Resource> newRes;
 
 	if (resourceLoader) {
@@ -77,6 +80,7 @@ std::shared_ptr<Resource> ResourceCollectionBase::loadAsset(const String& assetI
 	} else {
 		// Normal loading
 		auto resLoader = ResourceLoader(*(parent.locator), assetId, type, priority, parent.api);
+		resLoader.prefetched = std::move(prefetched);
 		newRes = loadResource(resLoader);
 		if (!newRes && resLoader.loaded) {
 			throw Exception("Unable to construct resource from data: " + assetId, HalleyExceptions::Resources);
@@ -89,30 +93,73 @@ std::shared_ptr<Resource> ResourceCollectionBase::loadAsset(const String& assetI
 	return newRes;
 }
 
+std::shared_ptr<Resource> ResourceCollectionBase::decode(const String& assetId, ResourceLoadPriority priority, std::unique_ptr<ResourceDataStatic> data)
+{
+	// Called by ResourcePreloader from a worker thread, so this mustn't touch anything else in this collection
+	HALLEY_PROFILE_ZONE(Profiler::isEnabled() ? Profiler::internName("Decode " + assetId) : "");
+	auto resLoader = ResourceLoader(*(parent.locator), assetId, type, priority, parent.api);
+	resLoader.prefetched = std::move(data);
+	auto newRes = loadResource(resLoader);
+	if (!newRes) {
+		throw Exception("Unable to construct resource from data: " + assetId, HalleyExceptions::Resources);
+	}
+	return newRes;
+}
+
 std::shared_ptr<Resource> ResourceCollectionBase::doGet(const String& assetId, ResourceLoadPriority priority)
 {
 	// Look in cache and return if it's there
-	auto res = resources.find(assetId);
+	const AssetId id(assetId);
+	auto res = resources.find(id);
 	if (res != resources.end()) {
+		if (res->second.name != assetId) {
+			throw Exception("Resources \"" + res->second.name + "\" and \"" + assetId + "\" have the same id", HalleyExceptions::Resources);
+		}
 		return res->second.res;
 	}
 	
-	// Load resource from disk
-	std::shared_ptr<Resource> newRes = loadAsset(assetId, priority);
+	// Use whatever was preloaded, waiting for it if it's on its way, or load resource from disk
+	std::shared_ptr<Resource> newRes;
+	ResourcePreloader::Result preloaded;
+	if (parent.preloader->take(type, assetId, preloaded)) {
+		if (preloaded.error) {
+			std::rethrow_exception(preloaded.error);
+		}
+		newRes = preloaded.resource ? std::move(preloaded.resource) : loadAsset(assetId, priority, std::move(preloaded.data));
+	} else {
+		newRes = loadAsset(assetId, priority);
+	}
 
 	// Store in cache
 	newRes->setAssetId(assetId);
-	resources.emplace(assetId, Wrapper(newRes, 0));
+	resources.emplace(id, Wrapper(newRes, assetId, 0));
 	newRes->onLoaded(parent);
 
 	return newRes;
 }
 
+std::shared_ptr<Resource> ResourceCollectionBase::doGet(AssetId id, ResourceLoadPriority priority)
+{
+	auto res = resources.find(id);
+	if (res != resources.end()) {
+		return res->second.res;
+	}
+
+	// Not loaded yet, so find out what it's called from the asset database
+	return doGet(parent.locator->getAssetName(id, type), priority);
+}
+
+bool ResourceCollectionBase::isLoaded(const String& assetId) const
+{
+	auto res = resources.find(AssetId(assetId));
+	return res != resources.end() && res->second.name == assetId;
+}
+
 bool ResourceCollectionBase::exists(const String& assetId)
 {
 	// Look in cache
-	auto res = resources.find(assetId);
-	if (res != resources.end()) {
+	auto res = resources.find(AssetId(assetId));
+	if (res != resources.end() && res->second.name == assetId) {
 		return true;
 	}
 
@@ -120,7 +167,7 @@ bool ResourceCollectionBase::exists(const String& assetId)
 }
 
 void ResourceCollectionBase::setResource(int curDepth, const String& name, std::shared_ptr<Resource> resource) {
-	resources.emplace(name, Wrapper(resource, curDepth));
+	resources.emplace(AssetId(name), Wrapper(resource, name, curDepth));
 }
 
 void ResourceCollectionBase::setResourceLoader(ResourceLoaderFunc loader)
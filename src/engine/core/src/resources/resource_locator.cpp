@@ -95,7 +95,7 @@ void ResourceLocator::addFileSystem(const Path& path)
 
 void ResourceLocator::addPack(const Path& path, const String& encryptionKey, bool preLoad, bool allowFailure)
 {
-	auto dataReader = system.getDataReader(path.string());
+	auto dataReader = PackResourceLocator::makeReader(system, path);
 	if (dataReader) {
 		add(std::make_unique<PackResourceLocator>(std::move(dataReader), path, encryptionKey, preLoad));
 	} else {
@@ -121,3 +121,14 @@ bool ResourceLocator::exists(const String& asset)
 {
 	return locators.find(asset) != locators.end();
 }
+
+const String& ResourceLocator::getAssetName(AssetId id, AssetType type) const
+{
+	for (auto& l: locatorList) {
+		auto asset = l->getAssetDatabase().getDatabase(type).tryGet(id);
+		if (asset) {
+			return asset->name;
+		}
+	}
+	throw Exception("Unable to locate resource with id " + toString(id.getValue(), 16), HalleyExceptions::Resources);
+}
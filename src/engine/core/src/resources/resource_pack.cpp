@@ -2,6 +2,7 @@
 #include <utility>
 #include "resources/asset_pack.h"
 #include "api/system_api.h"
+#include "halley/file/memory_mapped_file.h"
 using namespace Halley;
 
 PackResourceLocator::PackResourceLocator(std::unique_ptr<ResourceDataReader> reader, Path path, String key, bool preLoad)
@@ -16,6 +17,15 @@ PackResourceLocator::~PackResourceLocator()
 {
 }
 
+std::unique_ptr<ResourceDataReader> PackResourceLocator::makeReader(SystemAPI& system, const Path& path)
+{
+	auto file = MemoryMappedFile::open(path);
+	if (file) {
+		return std::make_unique<MemoryMappedFileReader>(std::move(file));
+	}
+	return system.getDataReader(path.string());
+}
+
 std::unique_ptr<ResourceData> PackResourceLocator::getData(const String& asset, AssetType type, bool stream)
 {
 	if (!assetPack) {
@@ -40,5 +50,5 @@ void PackResourceLocator::purge(SystemAPI& sys)
 
 void PackResourceLocator::loadAfterPurge()
 {
-	assetPack = std::make_unique<AssetPack>(system->getDataReader(path.string()), encryptionKey, preLoad);
+	assetPack = std::make_unique<AssetPack>(makeReader(*system, path), encryptionKey, preLoad);
 }
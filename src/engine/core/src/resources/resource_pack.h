@@ -12,6 +12,9 @@ namespace Halley {
 		explicit PackResourceLocator(std::unique_ptr<ResourceDataReader> reader, Path path, String encryptionKey = "", bool preLoad = false);
 		~PackResourceLocator();
 
+		// Maps the pack straight from the file system when possible, falling back to the system's reader otherwise
+		static std::unique_ptr<ResourceDataReader> makeReader(SystemAPI& system, const Path& path);
+
 	protected:
 		std::unique_ptr<ResourceData> getData(const String& asset, AssetType type, bool stream) override;
 		const AssetDatabase& getAssetDatabase() override;
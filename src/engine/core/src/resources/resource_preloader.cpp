@@ -0,0 +1,314 @@
+#include "resources/resource_preloader.h"
+#include "resources/resources.h"
+#include "resources/resource_locator.h"
+#include <halley/resources/resource.h>
+#include <halley/resources/metadata.h>
+#include <halley/concurrency/concurrent.h>
+#include <halley/support/logger.h>
+#include <halley/support/profiler.h>
+#include <algorithm>
+#include <chrono>
+
+using namespace Halley;
+
+constexpr size_t ResourcePreloader::maxInFlight;
+constexpr size_t ResourcePreloader::numPriorities;
+
+ResourcePreloader::ResourcePreloader(Resources& resources, ResourceLocator& locator)
+	: resources(resources)
+	, locator(locator)
+{
+}
+
+ResourcePreloader::~ResourcePreloader()
+{
+	// Tasks already started hold on to this, so let them finish
+	std::unique_lock<std::mutex> lock(mutex);
+	for (auto& queue: queues) {
+		queue.clear();
+	}
+	requestDone.wait(lock, [&] () { return inFlight == 0; });
+}
+
+void ResourcePreloader::configure(AssetType type, ResourcePreloadPolicy policy, ResourceDependencyResolver resolver)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	types.resize(std::max(types.size(), size_t(int(type) + 1)));
+	types[int(type)] = TypeConfig{ policy, std::move(resolver) };
+}
+
+void ResourcePreloader::preload(gsl::span<const ResourceRef> assets, ResourceLoadPriority priority)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for (auto& asset: assets) {
+		auto existing = find(asset.type, asset.assetId);
+		if (existing) {
+			// Move it up if it's now wanted sooner
+			if (int(priority) > int(existing->priority)) {
+				if (existing->state == State::Queued) {
+					auto& oldQueue = queues[int(existing->priority)];
+					oldQueue.erase(std::find(oldQueue.begin(), oldQueue.end(), existing));
+					queues[int(priority)].push_back(existing);
+				}
+				existing->priority = priority;
+			}
+			continue;
+		}
+
+		if (resources.ofType(asset.type).isLoaded(asset.assetId)) {
+			continue;
+		}
+
+		auto request = std::make_shared<Request>();
+		request->type = asset.type;
+		request->assetId = asset.assetId;
+		request->priority = priority;
+		request->policy = getPolicy(asset.type, asset.assetId);
+
+		if (request->policy == ResourcePreloadPolicy::None) {
+			// Nothing to do off the main thread, so it's only waiting for its dependencies
+			auto& config = getConfig(asset.type);
+			if (config.resolver && config.policy == ResourcePreloadPolicy::None) {
+				request->dependencies = config.resolver(asset.assetId, nullptr);
+			}
+			request->state = State::Ready;
+		} else {
+			request->compressed = locator.getMetaData(asset.assetId, asset.type).getString("asset_compression", "") == "deflate";
+			queues[int(priority)].push_back(request);
+		}
+
+		requests.resize(std::max(requests.size(), size_t(int(asset.type) + 1)));
+		requests[int(asset.type)][asset.assetId] = std::move(request);
+		++pendingCount;
+	}
+
+	startQueued();
+}
+
+void ResourcePreloader::update(Time budget)
+{
+	HALLEY_PROFILE_ZONE("ResourcePreloader::update");
+	const auto start = std::chrono::steady_clock::now();
+
+	// Queue up dependencies found since the last update. This has to happen here, as checking what's loaded isn't thread-safe.
+	Vector<std::pair<Vector<ResourceRef>, ResourceLoadPriority>> dependencies;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (auto& byType: requests) {
+			for (auto& entry: byType) {
+				auto& request = *entry.second;
+				if (request.state == State::Ready && !request.dependenciesQueued) {
+					request.dependenciesQueued = true;
+					if (!request.dependencies.empty()) {
+						dependencies.emplace_back(request.dependencies, request.priority);
+					}
+				}
+			}
+		}
+	}
+	for (auto& deps: dependencies) {
+		preload(deps.first, deps.second);
+	}
+
+	while (true) {
+		std::shared_ptr<Request> next;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			std::shared_ptr<Request> fallback;
+			for (auto& byType: requests) {
+				for (auto& entry: byType) {
+					auto& request = entry.second;
+					if (request->state == State::Ready && (!next || int(request->priority) > int(next->priority))) {
+						if (isSettled(*request)) {
+							next = request;
+						} else if (!fallback) {
+							fallback = request;
+						}
+					}
+				}
+			}
+
+			// If nothing else is being loaded, the rest must be depending on each other, so just go ahead with one of them
+			const bool idle = inFlight == 0 && std::all_of(queues.begin(), queues.end(), [] (const std::deque<std::shared_ptr<Request>>& q) { return q.empty(); });
+			if (!next && idle) {
+				next = fallback;
+			}
+		}
+		if (!next) {
+			break;
+		}
+
+		// Getting it takes it back out of the pending requests, and finishes loading it
+		try {
+			resources.ofType(next->type).doGet(next->assetId, next->priority);
+		} catch (std::exception& e) {
+			Logger::logError("Error preloading " + next->assetId + ": " + e.what());
+		} catch (...) {
+			Logger::logError("Unknown error preloading " + next->assetId);
+		}
+
+		{
+			// In case something else loaded it in the meantime, without going through take()
+			std::unique_lock<std::mutex> lock(mutex);
+			if (find(next->type, next->assetId) == next) {
+				erase(*next);
+			}
+		}
+
+		const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (elapsed >= budget) {
+			break;
+		}
+	}
+}
+
+bool ResourcePreloader::isPending(AssetType type, const String& assetId) const
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return bool(find(type, assetId));
+}
+
+size_t ResourcePreloader::getPendingCount() const
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return pendingCount;
+}
+
+const ResourcePreloader::TypeConfig& ResourcePreloader::getConfig(AssetType type) const
+{
+	static const TypeConfig defaultConfig;
+	return size_t(type) < types.size() ? types[int(type)] : defaultConfig;
+}
+
+ResourcePreloadPolicy ResourcePreloader::getPolicy(AssetType type, const String& assetId) const
+{
+	if (resources.ofType(type).resourceLoader || !locator.exists(assetId)) {
+		// Left for the main thread to deal with, including failing to find it
+		return ResourcePreloadPolicy::None;
+	}
+	if (locator.getMetaData(assetId, type).getBool("streaming", false)) {
+		// Its data is never read all at once
+		return ResourcePreloadPolicy::None;
+	}
+	return getConfig(type).policy;
+}
+
+std::shared_ptr<ResourcePreloader::Request> ResourcePreloader::find(AssetType type, const String& assetId) const
+{
+	if (size_t(type) >= requests.size()) {
+		return {};
+	}
+	auto& byType = requests[int(type)];
+	auto iter = byType.find(assetId);
+	return iter != byType.end() ? iter->second : std::shared_ptr<Request>();
+}
+
+void ResourcePreloader::erase(const Request& request)
+{
+	requests[int(request.type)].erase(request.assetId);
+	--pendingCount;
+}
+
+void ResourcePreloader::startQueued()
+{
+	for (int priority = int(numPriorities) - 1; priority >= 0 && inFlight < maxInFlight; --priority) {
+		auto& queue = queues[priority];
+		while (!queue.empty() && inFlight < maxInFlight) {
+			auto request = std::move(queue.front());
+			queue.pop_front();
+			request->state = State::Loading;
+			++inFlight;
+
+			// Requests being loaded stay in the map until they're ready, so the tasks don't need to hold on to them
+			Request* loading = request.get();
+			const auto loadPriority = request->priority;
+			Concurrent::execute(Executors::getDiskIO(), [this, loading, loadPriority] ()
+			{
+				read(*loading, loadPriority);
+			});
+		}
+	}
+}
+
+void ResourcePreloader::read(Request& request, ResourceLoadPriority priority)
+{
+	HALLEY_PROFILE_ZONE("ResourcePreloader::read");
+	try {
+		request.data = locator.getStatic(request.assetId, request.type);
+	} catch (...) {
+		request.error = std::current_exception();
+	}
+
+	// Free up the disk thread for the next read as soon as possible
+	Concurrent::execute(Executors::getCPUAux(), [this, &request, priority] ()
+	{
+		decode(request, priority);
+	});
+}
+
+void ResourcePreloader::decode(Request& request, ResourceLoadPriority priority)
+{
+	HALLEY_PROFILE_ZONE("ResourcePreloader::decode");
+	if (!request.error) {
+		try {
+			if (request.compressed) {
+				request.data->inflate();
+			}
+
+			auto& resolver = getConfig(request.type).resolver;
+			if (resolver) {
+				request.dependencies = resolver(request.assetId, request.data.get());
+			}
+
+			if (request.policy == ResourcePreloadPolicy::Decode) {
+				request.resource = resources.ofType(request.type).decode(request.assetId, priority, std::move(request.data));
+			}
+		} catch (...) {
+			request.error = std::current_exception();
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	request.state = State::Ready;
+	--inFlight;
+	startQueued();
+	requestDone.notify_all();
+}
+
+bool ResourcePreloader::isSettled(const Request& request) const
+{
+	if (!request.dependenciesQueued) {
+		return false;
+	}
+	for (auto& dep: request.dependencies) {
+		if (find(dep.type, dep.assetId)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ResourcePreloader::take(AssetType type, const String& assetId, Result& result)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	auto request = find(type, assetId);
+	if (!request) {
+		return false;
+	}
+
+	if (request->state == State::Queued) {
+		// Not worth waiting for the disk thread to get to it
+		auto& queue = queues[int(request->priority)];
+		queue.erase(std::find(queue.begin(), queue.end(), request));
+		erase(*request);
+		return false;
+	}
+
+	requestDone.wait(lock, [&] () { return request->state == State::Ready; });
+	erase(*request);
+	result.data = std::move(request->data);
+	result.resource = std::move(request->resource);
+	result.error = request->error;
+	return result.data || result.resource || result.error;
+}
@@ -7,6 +7,22 @@ using namespace Halley;
 Resources::Resources(std::unique_ptr<ResourceLocator> locator, const HalleyAPI* api)
 	: locator(std::move(locator))
 	, api(api)
+	, preloader(std::make_unique<ResourcePreloader>(*this, *this->locator))
 {}
 
 Resources::~Resources() = default;
+
+void Resources::preload(gsl::span<const ResourceRef> assets, ResourceLoadPriority priority)
+{
+	preloader->preload(assets, priority);
+}
+
+size_t Resources::getPreloadsPending() const
+{
+	return preloader->getPendingCount();
+}
+
+void Resources::update(Time budget)
+{
+	preloader->update(budget);
+}
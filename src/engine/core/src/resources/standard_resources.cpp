@@ -12,10 +12,12 @@
 #include "halley/audio/audio_event.h"
 #include "halley/file_formats/binary_file.h"
 #include "halley/file_formats/image.h"
+#include "halley/core/api/halley_api.h"
+#include "halley/bytes/byte_serializer.h"
 
 using namespace Halley;
 
-void StandardResources::initialize(Resources& resources)
+void StandardResources::initialize(Resources& resources, const HalleyAPI& api)
 {
 	resources.init<Animation>();
 	resources.init<SpriteSheet>();
@@ -55,4 +57,65 @@ void StandardResources::initialize(Resources& resources)
 
 		return result;
 	});
+
+	// These read their own data asynchronously already
+	resources.setPreloadPolicy<Texture>(ResourcePreloadPolicy::None);
+	resources.setPreloadPolicy<AudioClip>(ResourcePreloadPolicy::None);
+
+	// These only deserialize their data, so they can be constructed on worker threads too
+	resources.setPreloadPolicy<Image>(ResourcePreloadPolicy::Decode);
+	resources.setPreloadPolicy<ShaderFile>(ResourcePreloadPolicy::Decode);
+	resources.setPreloadPolicy<BinaryFile>(ResourcePreloadPolicy::Decode);
+	resources.setPreloadPolicy<TextFile>(ResourcePreloadPolicy::Decode);
+	resources.setPreloadPolicy<ConfigFile>(ResourcePreloadPolicy::Decode);
+	resources.setPreloadPolicy<AudioEvent>(ResourcePreloadPolicy::Decode);
+
+	// The rest get other resources while loading, so those are preloaded first
+	resources.setPreloadPolicy<SpriteSheet>(ResourcePreloadPolicy::Decode, [] (const String&, const ResourceDataStatic* data) -> Vector<ResourceRef>
+	{
+		// The texture is only gotten once it's drawn, but it's going to be
+		SpriteSheet sheet;
+		Deserializer s(data->getSpan());
+		sheet.deserialize(s);
+		return { ResourceRef(AssetType::Texture, sheet.getTextureName()) };
+	});
+
+	resources.setPreloadPolicy<SpriteResource>(ResourcePreloadPolicy::None, [&] (const String&, const ResourceDataStatic*) -> Vector<ResourceRef>
+	{
+		// Sprites are found by going through every sprite sheet
+		Vector<ResourceRef> result;
+		for (auto& sheetName: resources.enumerate<SpriteSheet>()) {
+			result.emplace_back(AssetType::SpriteSheet, sheetName);
+		}
+		return result;
+	});
+
+	resources.setPreloadPolicy<Animation>(ResourcePreloadPolicy::ReadAhead, [] (const String&, const ResourceDataStatic* data) -> Vector<ResourceRef>
+	{
+		Animation animation;
+		Deserializer s(data->getSpan());
+		animation.deserialize(s);
+		return { ResourceRef(AssetType::SpriteSheet, animation.getSpriteSheetName()), ResourceRef(AssetType::MaterialDefinition, animation.getMaterialName()) };
+	});
+
+	const String shaderLanguage = api.video ? api.video->getShaderLanguage() : "";
+	resources.setPreloadPolicy<MaterialDefinition>(ResourcePreloadPolicy::ReadAhead, [shaderLanguage] (const String&, const ResourceDataStatic* data) -> Vector<ResourceRef>
+	{
+		MaterialDefinition definition;
+		Deserializer s(data->getSpan());
+		definition.deserialize(s);
+		Vector<ResourceRef> result;
+		for (int i = 0; i < definition.getNumPasses(); ++i) {
+			result.emplace_back(AssetType::Shader, definition.getPass(i).getShaderAssetId() + ":" + shaderLanguage);
+		}
+		return result;
+	});
+
+	resources.setPreloadPolicy<Font>(ResourcePreloadPolicy::ReadAhead, [] (const String&, const ResourceDataStatic* data) -> Vector<ResourceRef>
+	{
+		Font font("", "", 0, 0, 0, 1);
+		Deserializer s(data->getSpan());
+		font.deserialize(s);
+		return { ResourceRef(AssetType::Texture, font.getImageName()), ResourceRef(AssetType::MaterialDefinition, font.isDistanceField() ? "Halley/Text" : "Halley/Sprite") };
+	});
 }
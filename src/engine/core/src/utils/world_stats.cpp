@@ -6,13 +6,24 @@
 #include <halley/entity/world.h>
 #include <halley/entity/system.h>
 #include "halley/text/string_converter.h"
+#include "halley/support/profiler.h"
 
 using namespace Halley;
 
 WorldStatsView::WorldStatsView(CoreAPI& coreAPI)
 	: coreAPI(coreAPI)
 	, text(coreAPI.getResources().get<Font>("Ubuntu Bold"), "", 16, Colour(1, 1, 1), 1.0f, Colour(0.1f, 0.1f, 0.1f))
+	, flameText(coreAPI.getResources().get<Font>("Ubuntu Bold"), "", 11, Colour(1, 1, 1), 1.0f, Colour(0.1f, 0.1f, 0.1f))
 {
+	flameBar.setMaterial(coreAPI.getResources(), "Halley/SolidColour").setPivot(Vector2f(0, 0));
+
+	// Only worth the overhead while someone is looking
+	Profiler::setEnabled(true);
+}
+
+WorldStatsView::~WorldStatsView()
+{
+	Profiler::setEnabled(false);
 }
 
 void WorldStatsView::draw(RenderContext& context)
@@ -79,12 +90,68 @@ void WorldStatsView::draw(RenderContext& context)
 		int maxFPS = int(lround(1'000'000'000.0 / grandTotal));
 		text
 			.setColour(Colour(1, 1, 1))
-			.setText("Total elapsed: " + formatTime(grandTotal) + " ms [" + toString(maxFPS) + " FPS maximum].\n" + toString(painter.getPrevDrawCalls()) + " draw calls, " + toString(painter.getPrevTriangles()) + " triangles, " + toString(painter.getPrevVertices()) + " vertices.")
+			.setText("Total elapsed: " + formatTime(grandTotal) + " ms [" + toString(maxFPS) + " FPS maximum].\n" + toString(painter.getPrevDrawCalls()) + " draw calls, " + toString(painter.getPrevTriangles()) + " triangles, " + toString(painter.getPrevVertices()) + " vertices, " + String::prettySize(painter.getPrevBytesSubmitted()) + " submitted.\n"
+				+ "Batch breaks: " + toString(painter.getPrevBatchBreaks(PainterBatchBreak::Material)) + " material, " + toString(painter.getPrevBatchBreaks(PainterBatchBreak::Clip)) + " clip, "
+				+ toString(painter.getPrevBatchBreaks(PainterBatchBreak::BufferFull) + painter.getPrevBatchBreaks(PainterBatchBreak::IndexRange)) + " buffer, " + toString(painter.getPrevBatchBreaks(PainterBatchBreak::Instancing)) + " instancing, " + toString(painter.getPrevBatchBreaks(PainterBatchBreak::Flush)) + " flush.")
 			.setPosition(Vector2f(20, 20))
 			.draw(painter);
+
+		const auto viewPort = Rect4f(context.getCamera().getActiveViewPort());
+		drawFlameView(painter, Rect4f(Vector2f(20, viewPort.getHeight() * 0.6f), Vector2f(viewPort.getWidth() - 20, viewPort.getHeight() - 20)));
 	});
 }
 
+void WorldStatsView::drawFlameView(Painter& painter, Rect4f area)
+{
+	// One lane per thread, one row per nesting level, spanning the last frame
+	const auto capture = Profiler::getLastFrame();
+	const int64_t duration = capture.endNs - capture.startNs;
+	if (duration <= 0) {
+		return;
+	}
+
+	constexpr float rowHeight = 14.0f;
+	const float scale = area.getWidth() / float(duration);
+	auto toX = [&] (int64_t ns)
+	{
+		return area.getLeft() + clamp(float(ns - capture.startNs) * scale, 0.0f, area.getWidth());
+	};
+
+	float y = area.getTop();
+	flameText.setColour(Colour(0.2f, 1.0f, 0.3f)).setText("Last frame: " + formatTime(duration) + " ms").setPosition(Vector2f(area.getLeft(), y)).draw(painter);
+	y += 16;
+
+	for (auto& thread: capture.threads) {
+		int maxDepth = 0;
+		for (auto& e: thread.events) {
+			maxDepth = std::max(maxDepth, e.depth);
+		}
+		const float laneHeight = float(maxDepth + 1) * rowHeight;
+		if (y + 14 + laneHeight > area.getBottom()) {
+			break;
+		}
+
+		flameText.setColour(Colour(0.8f, 0.8f, 0.8f)).setText(thread.threadName).setPosition(Vector2f(area.getLeft(), y)).draw(painter);
+		y += 14;
+
+		for (auto& e: thread.events) {
+			const float x0 = toX(e.startNs);
+			const float x1 = std::max(toX(e.endNs), x0 + 1.0f);
+			const auto pos = Vector2f(x0, y + float(e.depth) * rowHeight);
+
+			// Same name, same colour, from one frame to the next
+			const auto hash = std::hash<std::string>()(e.name);
+			const auto colour = Colour4f(0.4f + float(hash % 7) * 0.08f, 0.3f + float((hash / 7) % 5) * 0.08f, 0.2f + float((hash / 35) % 3) * 0.1f, 0.9f);
+			Sprite(flameBar).setColour(colour).setPos(pos).setSize(Vector2f(x1 - x0, rowHeight - 1)).draw(painter);
+
+			if (x1 - x0 > 80.0f) {
+				flameText.setColour(Colour(1, 1, 1)).setText(String(e.name) + " " + formatTime(e.endNs - e.startNs)).setPosition(pos + Vector2f(2, 0)).draw(painter);
+			}
+		}
+		y += laneHeight + 4;
+	}
+}
+
 void WorldStatsView::setWorld(const World* w)
 {
 	world = w;
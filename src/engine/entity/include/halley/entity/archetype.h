@@ -0,0 +1,122 @@
+#pragma once
+
+#include <memory>
+#include <cstdint>
+#include <mutex>
+#include <halley/data_structures/vector.h>
+#include <halley/data_structures/hash_map.h>
+#include "family_mask.h"
+#include "entity_id.h"
+
+namespace Halley {
+	class Archetype;
+	class Entity;
+
+	struct ArchetypeLocation
+	{
+		Archetype* archetype = nullptr;
+		uint32_t chunk = 0;
+		uint32_t slot = 0;
+	};
+
+	// A fixed-size block of entities sharing the same archetype, with each component type stored in its own array
+	class ArchetypeChunk
+	{
+		friend class Archetype;
+
+	public:
+		size_t getUsed() const { return used; }
+		size_t getLiveCount() const { return liveCount; }
+		bool isAlive(size_t slot) const { return alive[slot] != 0; }
+		EntityId getEntityId(size_t slot) const { return ids[slot]; }
+		char* getColumn(size_t column) const { return columns[column]; }
+
+		bool contains(const void* p) const
+		{
+			auto c = static_cast<const char*>(p);
+			return c >= data.get() && c < data.get() + dataSize;
+		}
+
+	private:
+		std::unique_ptr<char[]> data;
+		size_t dataSize = 0;
+		EntityId* ids = nullptr;
+		uint8_t* alive = nullptr;
+		Vector<char*> columns;
+		size_t used = 0;
+		size_t liveCount = 0;
+	};
+
+	class Archetype
+	{
+	public:
+		Archetype(FamilyMaskType mask, Vector<int> componentIds);
+
+		FamilyMaskType getMask() const { return mask; }
+		const Vector<int>& getComponentIds() const { return componentIds; }
+		const Vector<std::unique_ptr<ArchetypeChunk>>& getChunks() const { return chunks; }
+		size_t getChunkCapacity() const { return capacity; }
+		size_t getEntityCount() const { return entityCount; }
+
+		// Returns the column storing the given component, or -1 if this archetype doesn't have it
+		int getColumn(int componentIndex) const
+		{
+			return componentIndex < int(columnByComponent.size()) ? columnByComponent[componentIndex] : -1;
+		}
+
+		size_t getComponentSize(int column) const { return componentSizes[column]; }
+
+		ArchetypeLocation allocate(EntityId id);
+		void release(const ArchetypeLocation& location);
+		void* getComponent(const ArchetypeLocation& location, int column) const;
+
+	private:
+		FamilyMaskType mask;
+		Vector<int> componentIds;
+		Vector<int> columnByComponent;
+		Vector<size_t> componentSizes;
+		Vector<size_t> columnOffsets;
+		size_t idsOffset = 0;
+		size_t aliveOffset = 0;
+		size_t chunkSize = 0;
+		size_t capacity = 0;
+		size_t entityCount = 0;
+
+		Vector<std::unique_ptr<ArchetypeChunk>> chunks;
+		Vector<ArchetypeLocation> freeSlots;
+
+		void computeLayout();
+		void addChunk();
+	};
+
+	// Opt-in World storage where entities with identical masks have their components packed together in chunks.
+	// Component addresses are stable for as long as an entity keeps the same mask, so families can keep pointers to them.
+	class ArchetypeStorage
+	{
+	public:
+		ArchetypeStorage();
+		~ArchetypeStorage();
+
+		// Moves all of the entity's components into the archetype matching its current mask
+		void moveEntity(Entity& entity);
+		void removeEntity(Entity& entity);
+
+		// Safe to call from concurrently running systems, as long as no entities are being moved
+		Vector<Archetype*> getArchetypesMatching(FamilyMaskType mask);
+		size_t getArchetypeCount() const { return archetypes.size(); }
+
+	private:
+		struct MatchCache
+		{
+			Vector<Archetype*> matching;
+			size_t nChecked = 0;
+		};
+
+		Vector<std::unique_ptr<Archetype>> archetypes;
+		Vector<Archetype*> archetypeByMask;
+		HashMap<int, MatchCache> matchCache;
+		std::mutex matchMutex;
+
+		Archetype& getArchetype(FamilyMaskType mask);
+	};
+}
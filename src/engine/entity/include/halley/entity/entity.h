@@ -3,27 +3,16 @@
 #include <array>
 #include <memory>
 #include "component.h"
-#include "message.h"
 #include "family_mask.h"
 #include "entity_id.h"
 #include "type_deleter.h"
+#include "archetype.h"
 #include <halley/data_structures/vector.h>
 
 namespace Halley {
 	class World;
 	class System;
 
-	class MessageEntry
-	{
-	public:
-		std::unique_ptr<Message> msg;
-		int type = -1;
-		int age = -1;
-
-		MessageEntry() {}
-		MessageEntry(std::unique_ptr<Message> msg, int type, int age) : msg(std::move(msg)), type(type), age(age) {}
-	};
-
 	class EntityRef;
 
 	class Entity
@@ -31,6 +20,7 @@ namespace Halley {
 		friend class World;
 		friend class System;
 		friend class EntityRef;
+		friend class ArchetypeStorage;
 
 	public:
 		~Entity();
@@ -85,9 +75,10 @@ namespace Halley {
 
 	private:
 		Vector<std::pair<int, Component*>> components;
-		Vector<MessageEntry> inbox;
 		FamilyMaskType mask;
 		EntityId uid;
+		ArchetypeLocation archetypeLocation;
+		size_t worldIndex = 0;
 		int liveComponents = 0;
 		bool dirty = false;
 		bool alive = true;
@@ -122,6 +113,7 @@ namespace Halley {
 		void addComponent(Component* component, int id);
 		void removeComponentAt(int index);
 		void deleteComponent(Component* component, int id);
+		bool isInArchetype(const Component* component) const;
 		void onReady();
 
 		void markDirty(World& world);
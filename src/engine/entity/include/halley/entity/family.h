@@ -1,7 +1,9 @@
 #pragma once
 
 #include <algorithm>
+#include <functional>
 #include <gsl/gsl_assert>
+#include <gsl/gsl>
 #include "family_type.h"
 #include "family_mask.h"
 #include "entity_id.h"
@@ -31,6 +33,11 @@ namespace Halley {
 			return static_cast<char*>(elems) + (n * elemSize);
 		}
 
+		constexpr static size_t npos = size_t(-1);
+
+		// Returns the entity's index in this family, or npos if it's not in it
+		size_t getEntitySlot(EntityId id) const;
+
 		void addOnEntitiesAdded(FamilyBindingBase* bind);
 		void removeOnEntityAdded(FamilyBindingBase* bind);
 		void addOnEntitiesRemoved(FamilyBindingBase* bind);
@@ -41,6 +48,7 @@ namespace Halley {
 
 	protected:
 		virtual void addEntity(Entity& entity) = 0;
+		virtual void addEntities(gsl::span<Entity* const> entities);
 		void removeEntity(Entity& entity);
 		virtual void updateEntities() = 0;
 		virtual void clearEntities() = 0;
@@ -48,13 +56,19 @@ namespace Halley {
 		void* elems = nullptr;
 		size_t elemCount = 0;
 		size_t elemSize = 0;
-		Vector<EntityId> toRemove;
+		Vector<size_t> toRemove;
 
 		Vector<FamilyBindingBase*> addEntityCallbacks;
 		Vector<FamilyBindingBase*> removeEntityCallbacks;
 
+		void setEntitySlot(EntityId id, size_t slot);
+		void clearEntitySlots();
+
 	private:
 		FamilyMaskType inclusionMask;
+
+		// Sparse index from each entity's pool index to its slot in the family plus one, zero meaning absent
+		Vector<uint32_t> slotByEntity;
 	};
 
 	class FamilyBase {
@@ -85,8 +99,9 @@ namespace Halley {
 		return a > b ? a : b;
 	}
 
+	// Layout of a family element T: the FamilyBase header, followed by one pointer per component
 	template <typename T>
-	class FamilyImpl : public Family
+	struct FamilyStorage : public FamilyBase
 	{
 		constexpr static size_t storageSize = sizeof(T) - alignUp(sizeof(FamilyBase), alignof(void*));
 		static_assert(std::is_base_of<FamilyBase, T>::value, "Family type does not derive from FamilyBase");
@@ -94,10 +109,15 @@ namespace Halley {
 		// I don't know why this needs to be aligned up to 8 on Win32. :|
 		static_assert(alignUp(T::Type::getNumComponents() * sizeof(void*), size_t(8)) == storageSize, "Family type has unexpected storage size");
 
-		struct StorageType : public FamilyBase
-		{
-			alignas(alignof(void*)) std::array<char, storageSize> data;
-		};
+		alignas(alignof(void*)) std::array<char, storageSize> data;
+
+		void** getComponents() { return reinterpret_cast<void**>(&data[0]); }
+	};
+
+	template <typename T>
+	class FamilyImpl : public Family
+	{
+		using StorageType = FamilyStorage<T>;
 
 	public:
 		FamilyImpl() : Family(T::Type::inclusionMask()) {}
@@ -109,10 +129,19 @@ namespace Halley {
 			auto& e = entities.back();
 			e.entityId = entity.getEntityId();
 			T::Type::loadComponents(entity, &e.data[0]);
+			setEntitySlot(e.entityId, entities.size() - 1);
 
 			dirty = true;
 		}
 
+		void addEntities(gsl::span<Entity* const> toAdd) override
+		{
+			entities.reserve(entities.size() + size_t(toAdd.size()));
+			for (auto e: toAdd) {
+				addEntity(*e);
+			}
+		}
+
 		void updateEntities() override
 		{
 			if (dirty) {
@@ -137,6 +166,7 @@ namespace Halley {
 		{
 			notifyRemove(entities.data(), entities.size());
 			entities.clear();
+			clearEntitySlots();
 			updateElems();
 		}
 
@@ -154,50 +184,31 @@ namespace Halley {
 		void removeDeadEntities()
 		{
 			// Performance-critical code
-			// Benchmarks suggest that using a Vector is faster than std::set and std::unordered_set
+			// Each removed entity is swapped with the last one, so this is proportional to the number of removals rather than the family size
 			if (!toRemove.empty()) {
 				HALLEY_DEBUG_TRACE();
-				size_t removeCount = toRemove.size();
-				Expects(removeCount > 0);
+				const size_t removeCount = toRemove.size();
 				Expects(removeCount <= entities.size());
-				std::sort(toRemove.begin(), toRemove.end());
-
-				for (size_t i = 1; i < toRemove.size(); ++i) {
-					Expects(toRemove[i - 1] != toRemove[i]);
-				}
 
-				// Move all entities to be removed to the back of the vector
-				{
-					int n = int(entities.size());
-					// Note: it's important to scan it forward. Scanning backwards would improve performance for short-lived entities,
-					// but it causes an issue where an entity is removed and added to the same family in one frame.
-					for (int i = 0; i < n; i++) {
-						EntityId id = entities[i].entityId;
-						auto iter = std::lower_bound(toRemove.begin(), toRemove.end(), id);
-						if (iter != toRemove.end() && id == *iter) {
-							toRemove.erase(iter);
-							if (i != n - 1) {
-								std::swap(entities[i], entities[n - 1]);
-								i--;
-							}
-							n--;
-							if (toRemove.empty()) {
-								break;
-							}
-						}
+				// Going from the highest slot down guarantees that the entity swapped in is never one that's also being removed
+				std::sort(toRemove.begin(), toRemove.end(), std::greater<size_t>());
+				size_t n = entities.size();
+				for (auto slot: toRemove) {
+					Expects(slot < n);
+					--n;
+					if (slot != n) {
+						std::swap(entities[slot], entities[n]);
+						setEntitySlot(entities[slot].entityId, slot);
 					}
-					Ensures(size_t(n) + removeCount == entities.size());
 				}
-
-				Expects(toRemove.empty());
+				toRemove.clear();
 
 				// Notify removal
-				size_t newSize = entities.size() - removeCount;
-				Ensures(newSize < entities.size());
-				notifyRemove(entities.data() + newSize, removeCount);
+				Ensures(n + removeCount == entities.size());
+				notifyRemove(entities.data() + n, removeCount);
 
 				// Remove them
-				entities.resize(newSize);
+				entities.resize(n);
 				updateElems();
 			}
 			Ensures(toRemove.empty());
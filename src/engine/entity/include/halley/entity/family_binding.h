@@ -2,11 +2,14 @@
 
 #include "family_mask.h"
 #include "world.h"
+#include "archetype.h"
 #include <halley/support/exception.h>
+#include <halley/concurrency/concurrent.h>
 #include <functional>
 
 namespace Halley {
 	class Family;
+	class ArchetypeStorage;
 
 	class FamilyBindingBase {
 	public:
@@ -20,6 +23,8 @@ namespace Halley {
 		void* getElement(size_t index) const { return family->getElement(index); }
 		virtual void bindFamily(World& world) = 0;
 		void setFamily(Family* family);
+		void setWorld(World& world);
+		ArchetypeStorage* getArchetypeStorage() const;
 
 		void setOnEntitiesAdded(std::function<void(void*, size_t)> callback);
 		void setOnEntitiesRemoved(std::function<void(void*, size_t)> callback);
@@ -32,6 +37,7 @@ namespace Halley {
 		friend class Family;
 
 		Family* family = nullptr;
+		World* world = nullptr;
 		const FamilyMaskType readMask;
 		const FamilyMaskType writeMask;
 		std::function<void(void*, size_t)> addedCallback;
@@ -134,9 +140,93 @@ namespace Halley {
 			throw Exception("No element in family matches predicate.", HalleyExceptions::Entity);
 		}
 
+		// Calls f on every element. With archetype storage enabled, this walks the component chunks directly
+		// instead of the family's pointer table; the element passed to f is only valid for the duration of the call.
+		template <typename F>
+		void forEach(F&& f)
+		{
+			auto storage = getArchetypeStorage();
+			if (!storage) {
+				for (auto& e: *this) {
+					f(e);
+				}
+				return;
+			}
+
+			for (auto& chunk: getChunks(*storage)) {
+				forEachInChunk(chunk, f);
+			}
+		}
+
+		template <typename F>
+		void forEachParallel(F&& f)
+		{
+			auto storage = getArchetypeStorage();
+			if (!storage) {
+				Concurrent::parallelFor(begin(), end(), [&] (T& e) {
+					f(e);
+				});
+				return;
+			}
+
+			auto chunks = getChunks(*storage);
+			Concurrent::parallelFor(chunks.begin(), chunks.end(), [&] (const ChunkRef& chunk) {
+				forEachInChunk(chunk, f);
+			}, 1);
+		}
+
 	protected:
 		void bindFamily(World& world) override {
 			setFamily(&world.getFamily<T>());
+			setWorld(world);
+		}
+
+	private:
+		constexpr static size_t numComponents = T::Type::getNumComponents();
+
+		struct ChunkRef
+		{
+			const ArchetypeChunk* chunk;
+			std::array<int, numComponents> columns;
+			std::array<size_t, numComponents> sizes;
+		};
+
+		Vector<ChunkRef> getChunks(ArchetypeStorage& storage) const
+		{
+			const auto ids = T::Type::getComponentIndices();
+			Vector<ChunkRef> result;
+			for (auto archetype: storage.getArchetypesMatching(T::Type::inclusionMask())) {
+				ChunkRef ref;
+				for (size_t i = 0; i < numComponents; ++i) {
+					// Optional components might not be present in this archetype
+					ref.columns[i] = archetype->getColumn(ids[i]);
+					ref.sizes[i] = ref.columns[i] >= 0 ? archetype->getComponentSize(ref.columns[i]) : 0;
+				}
+				for (auto& chunk: archetype->getChunks()) {
+					if (chunk->getLiveCount() > 0) {
+						ref.chunk = chunk.get();
+						result.push_back(ref);
+					}
+				}
+			}
+			return result;
+		}
+
+		template <typename F>
+		static void forEachInChunk(const ChunkRef& ref, F& f)
+		{
+			auto& chunk = *ref.chunk;
+			FamilyStorage<T> element;
+			auto components = element.getComponents();
+			for (size_t slot = 0; slot < chunk.getUsed(); ++slot) {
+				if (chunk.isAlive(slot)) {
+					element.entityId = chunk.getEntityId(slot);
+					for (size_t i = 0; i < numComponents; ++i) {
+						components[i] = ref.columns[i] >= 0 ? chunk.getColumn(ref.columns[i]) + slot * ref.sizes[i] : nullptr;
+					}
+					f(*reinterpret_cast<T*>(&element));
+				}
+			}
 		}
 	};
 }
@@ -26,7 +26,8 @@ namespace Halley {
 		template <typename T, typename... Ts>
 		struct Evaluator <T, Ts...> {
 			static void buildEntity(Entity& entity, void** data, size_t offset) {
-				data[offset] = entity.tryGetComponent<typename StripMaybeRef<T>::type>();
+				using ComponentType = typename std::remove_const<typename StripMaybeRef<T>::type>::type;
+				data[offset] = entity.tryGetComponent<ComponentType>();
 				Evaluator<Ts...>::buildEntity(entity, data, offset + 1);
 			}
 		};
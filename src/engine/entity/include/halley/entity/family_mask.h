@@ -27,6 +27,7 @@ namespace Halley {
 			const RealType& getRealValue() const;
 			
 			bool contains(const Handle& handle) const;
+			int getIndex() const { return value; }
 
 		private:
 			int value = -1;
@@ -61,6 +62,20 @@ namespace Halley {
 
 
 
+		template <typename T>
+		struct IsMaybeRef : std::false_type {};
+
+		template <typename T>
+		struct IsMaybeRef<MaybeRef<T>> : std::true_type {};
+
+		template <typename T>
+		struct IsReadOnly : std::is_const<T> {};
+
+		template <typename T>
+		struct IsReadOnly<MaybeRef<T>> : std::is_const<T> {};
+
+
+
 		template <typename... Ts>
 		struct Evaluator;
 
@@ -100,10 +115,10 @@ namespace Halley {
 		template <typename T, typename... Ts>
 		struct MutableEvaluator <T, Ts...> {
 			static void makeMask(RealType& mask) {
-				if (std::is_const<T>::value) {
+				if (!IsReadOnly<T>::value) {
 					FamilyMask::setBit(mask, RetrieveComponentIndex<T>::componentIndex);
 				}
-				Evaluator<Ts...>::makeMask(mask);
+				MutableEvaluator<Ts...>::makeMask(mask);
 			}
 
 			static HandleType getMask() {
@@ -114,13 +129,6 @@ namespace Halley {
 		};
 
 
-		template <typename T>
-		struct IsMaybeRef : std::false_type {};
-
-		template <typename T>
-		struct IsMaybeRef<MaybeRef<T>> : std::true_type {};
-
-
 		template <typename... Ts>
 		struct InclusionEvaluator;
 
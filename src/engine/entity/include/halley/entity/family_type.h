@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include "family_extractor.h"
 
 namespace Halley {
@@ -22,6 +23,11 @@ namespace Halley {
 			Halley::FamilyExtractor::Evaluator<Ts...>::buildEntity(entity, reinterpret_cast<void**>(data), 0);
 		}
 
+		static std::array<int, sizeof...(Ts)> getComponentIndices()
+		{
+			return {{ std::remove_const<typename FamilyExtractor::StripMaybeRef<Ts>::type>::type::componentIndex... }};
+		}
+
 		constexpr static size_t getNumComponents()
 		{
 			return sizeof...(Ts);
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <memory>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+#include <halley/data_structures/vector.h>
+#include "entity_id.h"
+#include "message.h"
+
+namespace Halley {
+	class MessageBus;
+
+	// FIFO of messages of a single type, stored by value in fixed-size blocks that are recycled through the bus
+	class MessageQueue
+	{
+	public:
+		MessageQueue(MessageBus& bus, size_t stride);
+		~MessageQueue();
+
+		MessageQueue(const MessageQueue& other) = delete;
+		MessageQueue& operator=(const MessageQueue& other) = delete;
+
+		size_t getStride() const { return stride; }
+		size_t getLiveCount() const { return liveCount; }
+		uint64_t getNextSequence() const { return tail; }
+
+		// Returns uninitialised storage for the message
+		void* push(EntityId target);
+
+		// Destroys all messages in the [begin, end) sequence range
+		void release(uint64_t begin, uint64_t end);
+
+		template <typename F>
+		void forEach(F&& f) const
+		{
+			for (uint64_t seq = head; seq < tail; ) {
+				const auto& block = *blocks[(seq - firstBlockSeq) / perBlock];
+				const size_t start = size_t((seq - firstBlockSeq) % perBlock);
+				const size_t end = size_t(std::min(uint64_t(perBlock), tail - seq + start));
+				for (size_t i = start; i < end; ++i) {
+					if (block.alive[i]) {
+						f(block.targets[i], reinterpret_cast<Message*>(block.payload + i * stride));
+					}
+				}
+				seq += end - start;
+			}
+		}
+
+	private:
+		friend class MessageBus;
+
+		struct Block
+		{
+			std::unique_ptr<char[]> data;
+			size_t size = 0;
+			EntityId* targets = nullptr;
+			uint8_t* alive = nullptr;
+			char* payload = nullptr;
+		};
+
+		MessageBus& bus;
+		const size_t stride;
+		size_t perBlock;
+		size_t blockSize;
+
+		Vector<std::unique_ptr<Block>> blocks;
+		uint64_t firstBlockSeq = 0;
+		uint64_t head = 0;
+		uint64_t tail = 0;
+		size_t liveCount = 0;
+
+		void trim();
+	};
+
+	// Type-segregated message storage, shared by all systems in a World.
+	// Messages are only stored if some system receives their type, and are constructed in place, so sending doesn't allocate once the block pool is warm.
+	class MessageBus
+	{
+	public:
+		// Sequence ranges sent by one system, so they can be released in bulk when it runs again
+		struct SentRange
+		{
+			int type;
+			uint64_t begin;
+			uint64_t end;
+		};
+		using SentRanges = Vector<SentRange>;
+
+		constexpr static size_t blockSize = 16 * 1024;
+
+		MessageBus();
+		~MessageBus();
+
+		void addReceiver(int msgType);
+		void removeReceiver(int msgType);
+		bool hasReceivers(int msgType) const;
+
+		template <typename T>
+		void send(EntityId target, const T& msg, SentRanges& sent)
+		{
+			static_assert(std::is_base_of<Message, T>::value, "Messages must extend the Message class");
+			static_assert(alignof(T) <= alignof(std::max_align_t), "Messages can't be over-aligned");
+
+			constexpr int type = T::messageIndex;
+			if (!hasReceivers(type)) {
+				return;
+			}
+
+			auto& queue = getQueue(type, sizeof(T));
+			const uint64_t seq = queue.getNextSequence();
+			new (queue.push(target)) T(msg);
+			onSent(type, seq, sent);
+		}
+
+		void release(SentRanges& sent);
+
+		template <typename F>
+		void forEach(int msgType, F&& f) const
+		{
+			if (msgType < int(queues.size()) && queues[msgType]) {
+				queues[msgType]->forEach(f);
+			}
+		}
+
+		size_t getMessageCount(int msgType) const;
+		size_t getPooledBlockCount() const { return freeBlocks.size(); }
+
+	private:
+		friend class MessageQueue;
+
+		Vector<std::unique_ptr<MessageQueue>> queues;
+		Vector<int> receiverCount;
+		Vector<std::unique_ptr<MessageQueue::Block>> freeBlocks;
+
+		MessageQueue& getQueue(int msgType, size_t msgSize);
+		void onSent(int type, uint64_t seq, SentRanges& sent);
+
+		std::unique_ptr<MessageQueue::Block> allocBlock(size_t size);
+		void freeBlock(std::unique_ptr<MessageQueue::Block> block);
+	};
+}
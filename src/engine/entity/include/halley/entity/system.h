@@ -36,7 +36,7 @@ namespace Halley {
 		virtual ~System() {}
 
 		String getName() const { return name; }
-		void setName(String n) { name = n; }
+		void setName(String n);
 		size_t getEntityCount() const;
 		void tryInit();
 
@@ -53,6 +53,9 @@ namespace Halley {
 		virtual void renderBase(RenderContext&) {}
 		virtual void onMessagesReceived(int, Message**, size_t*, size_t) {}
 
+		// Thread-safe systems only touch components through their families, and may run concurrently with non-conflicting systems
+		virtual bool isThreadSafe() const { return false; }
+
 		template <typename F, typename V>
 		static void invokeIndividual(F&& f, V& fam)
 		{
@@ -64,17 +67,27 @@ namespace Halley {
 		template <typename F, typename V>
 		static void invokeParallel(F&& f, V& fam)
 		{
-			Concurrent::foreach(std::begin(fam), std::end(fam), [&] (auto& e) {
+			Concurrent::parallelFor(std::begin(fam), std::end(fam), [&] (auto& e) {
 				f(e);
 			});
 		}
 
+		template <typename F, typename T>
+		static void invokeIndividual(F&& f, FamilyBinding<T>& fam)
+		{
+			fam.forEach(f);
+		}
+
+		template <typename F, typename T>
+		static void invokeParallel(F&& f, FamilyBinding<T>& fam)
+		{
+			fam.forEachParallel(f);
+		}
+
 		template <typename T>
 		void sendMessageGeneric(EntityId entityId, const T& msg)
 		{
-			auto toSend = std::make_unique<T>();
-			*toSend = msg;
-			doSendMessage(entityId, std::move(toSend), sizeof(T), T::messageIndex);
+			world->getMessageBus().send(entityId, msg, messagesSent);
 		}
 
 		template <typename T, typename std::enable_if<HasInitMember<T>::value, int>::type = 0>
@@ -122,15 +135,18 @@ namespace Halley {
 
 	private:
 		friend class World;
+		friend class SystemScheduler;
 
 		Vector<FamilyBindingBase*> families;
 		Vector<int> messageTypesReceived;
-		Vector<EntityId> messagesSentTo;
-		Vector<std::pair<EntityId, MessageEntry>> outbox;
+		MessageBus::SentRanges messagesSent;
+		Vector<Message*> messagesReceived;
+		Vector<size_t> messagesReceivedIdx;
 
 		World* world = nullptr;
 		const HalleyAPI* api = nullptr;
 		String name;
+		const char* profilerName = "System";
 		int systemId = -1;
 		bool initialised = false;
 		bool collectSamples = false;
@@ -141,10 +157,11 @@ namespace Halley {
 		void doRender(RenderContext& rc);
 		void onAddedToWorld(World& world, int id);
 
+		FamilyMask::RealType getReadMask() const;
+		FamilyMask::RealType getWriteMask() const;
+
 		void purgeMessages();
 		void processMessages();
-		void doSendMessage(EntityId target, std::unique_ptr<Message> msg, size_t msgSize, int msgId);
-		void dispatchMessages();
 	};
 
 }
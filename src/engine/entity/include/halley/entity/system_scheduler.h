@@ -0,0 +1,63 @@
+#pragma once
+
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <halley/data_structures/vector.h>
+#include <halley/time/halleytime.h>
+#include <halley/text/halleystring.h>
+
+namespace Halley {
+	class System;
+
+	struct SystemTraceEntry
+	{
+		const System* system = nullptr;
+		int thread = 0; // 0 is the calling thread, anything else is a worker lane
+		int64_t startNs = 0;
+		int64_t endNs = 0;
+	};
+
+	class SystemScheduleTrace
+	{
+	public:
+		Vector<SystemTraceEntry> entries;
+		int64_t totalNs = 0;
+		bool parallel = false;
+
+		bool overlaps(size_t a, size_t b) const;
+		size_t getOverlapCount() const;
+		String toString() const;
+	};
+
+	class SystemScheduler
+	{
+	public:
+		void invalidate();
+		void setParallel(bool enabled);
+		bool isParallel() const;
+
+		// onSerialSystemDone is called on the calling thread after each system that isn't thread-safe, with no other systems running
+		void run(Vector<std::unique_ptr<System>>& systems, Time time, const std::function<void()>& onSerialSystemDone);
+
+		const SystemScheduleTrace& getLastTrace() const;
+
+	private:
+		struct Node
+		{
+			System* system = nullptr;
+			Vector<size_t> dependents;
+			int nDependencies = 0;
+			bool serial = true;
+		};
+
+		Vector<Node> graph;
+		SystemScheduleTrace trace;
+		bool dirty = true;
+		bool parallel = true;
+
+		void buildGraph(Vector<std::unique_ptr<System>>& systems);
+		void runSerial(Vector<std::unique_ptr<System>>& systems, Time time, const std::function<void()>& onSerialSystemDone);
+		void runParallel(Time time, const std::function<void()>& onSerialSystemDone, size_t maxWorkers);
+	};
+}
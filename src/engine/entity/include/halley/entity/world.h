@@ -1,8 +1,11 @@
 #pragma once
 
 #include <memory>
+#include <atomic>
+#include <functional>
 #include <typeinfo>
 #include <type_traits>
+#include <gsl/gsl>
 #include "entity_id.h"
 #include "family_mask.h"
 #include "family.h"
@@ -13,6 +16,8 @@
 #include <halley/data_structures/vector.h>
 #include <halley/data_structures/tree_map.h>
 #include "service.h"
+#include "system_scheduler.h"
+#include "message_bus.h"
 
 namespace Halley {
 	class ConfigNode;
@@ -21,6 +26,7 @@ namespace Halley {
 	class System;
 	class Painter;
 	class HalleyAPI;
+	class ArchetypeStorage;
 
 	class World
 	{
@@ -34,6 +40,17 @@ namespace Halley {
 		
 		int64_t getAverageTime(TimeLine timeline) const;
 
+		void setParallelSystems(bool enabled);
+		bool isParallelSystems() const;
+		const SystemScheduleTrace& getScheduleTrace(TimeLine timeline) const;
+
+		// Packs components of entities with the same set of components into contiguous chunks.
+		// Must be set before any entities are created.
+		void setArchetypeStorage(bool enabled);
+		ArchetypeStorage* getArchetypeStorage() const;
+
+		MessageBus& getMessageBus();
+
 		System& addSystem(std::unique_ptr<System> system, TimeLine timeline);
 		void removeSystem(System& system);
 		Vector<System*> getSystems();
@@ -52,14 +69,21 @@ namespace Halley {
 		}
 
 		EntityRef createEntity();
+		// Creates n entities in one go, calling prototype(entity, i) to set up each of them
+		Vector<EntityId> createEntities(size_t n, std::function<void(EntityRef&, size_t)> prototype);
 		void destroyEntity(EntityId id);
+		void destroyEntities(gsl::span<const EntityId> ids);
+
+		// Thread-safe, so parallel systems can spawn entities. The id is valid right away, but the entity is only created at the next
+		// spawnPending, which then calls init on it, on that thread. Until then, looking the id up finds nothing.
+		EntityId reserveEntity(std::function<void(EntityRef&)> init);
 		EntityRef getEntity(EntityId id);
 		Entity* tryGetEntity(EntityId id);
 		size_t numEntities() const;
 
 		void spawnPending(); // Warning: use with care, will invalidate entities
 
-		void onEntityDirty();
+		void onEntityDirty(Entity& entity);
 
 		template <typename T>
 		Family& getFamily()
@@ -85,21 +109,55 @@ namespace Halley {
 		const HalleyAPI* api;
 		std::array<Vector<std::unique_ptr<System>>, static_cast<int>(TimeLine::NUMBER_OF_TIMELINES)> systems;
 		bool collectMetrics = false;
-		bool entityDirty = false;
+		MessageBus messageBus;
 		
 		Vector<Entity*> entities;
 		Vector<Entity*> entitiesPendingCreation;
+		Vector<Entity*> dirtyEntities;
+		Vector<Entity*> entitiesRemoved;
 		MappedPool<Entity*> entityMap;
 
+		// Entities are carved out of slabs, so creating many at once is a single allocation
+		Vector<std::unique_ptr<char[]>> entitySlabs;
+		size_t entitySlabUsed = 0;
+		size_t entitySlabCapacity = 0;
+		Vector<void*> freeEntityMemory;
+
+		struct ReservedEntity {
+			EntityId id;
+			std::function<void(EntityRef&)> init;
+			ReservedEntity* next = nullptr;
+		};
+		std::atomic<ReservedEntity*> reservedEntities;
+
 		//TreeMap<FamilyMaskType, std::unique_ptr<Family>> families;
 		Vector<std::unique_ptr<Family>> families;
 		TreeMap<String, std::shared_ptr<Service>> services;
 
-		TreeMap<FamilyMaskType, std::vector<Family*>> familyCache;
+		// Both indexed by mask handle, which are small dense integers, so no hashing is needed
+		struct FamilyCacheEntry {
+			Vector<Family*> families;
+			bool valid = false;
+		};
+		struct FamilyTodo {
+			FamilyMaskType mask;
+			Vector<Entity*> toAdd;
+			Vector<Entity*> toRemove;
+			bool pending = false;
+		};
+		Vector<FamilyCacheEntry> familyCache;
+		Vector<FamilyTodo> familyTodo;
+		Vector<size_t> pendingFamilyTodo;
 
 		mutable std::array<StopwatchAveraging, 3> timer;
+		std::array<SystemScheduler, static_cast<int>(TimeLine::NUMBER_OF_TIMELINES)> schedulers;
+		bool parallelSystems = true;
+		std::unique_ptr<ArchetypeStorage> archetypeStorage;
 
+		Entity* newEntity();
+		void reserveEntityMemory(size_t n);
 		void allocateEntity(Entity* entity);
+		void commitReservedEntities();
 		void updateEntities();
 		void initSystems() const;
 		void deleteEntity(Entity* entity);
@@ -111,6 +169,7 @@ namespace Halley {
 
 		Service& getService(const String& name) const;
 
-		const std::vector<Family*>& getFamiliesFor(const FamilyMaskType& mask);
+		const Vector<Family*>& getFamiliesFor(const FamilyMaskType& mask);
+		FamilyTodo& getFamilyTodo(const FamilyMaskType& mask);
 	};
 }
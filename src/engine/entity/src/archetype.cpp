@@ -0,0 +1,195 @@
+#include "archetype.h"
+#include "entity.h"
+#include "type_deleter.h"
+#include <halley/data_structures/memory_pool.h>
+#include <halley/support/exception.h>
+#include <halley/utils/utils.h>
+#include <algorithm>
+
+using namespace Halley;
+
+namespace {
+	constexpr size_t targetChunkSize = 16 * 1024;
+}
+
+Archetype::Archetype(FamilyMaskType mask, Vector<int> ids)
+	: mask(mask)
+	, componentIds(std::move(ids))
+{
+	std::sort(componentIds.begin(), componentIds.end());
+	for (size_t i = 0; i < componentIds.size(); ++i) {
+		const int id = componentIds[i];
+		if (id >= int(columnByComponent.size())) {
+			columnByComponent.resize(id + 1, -1);
+		}
+		columnByComponent[id] = int(i);
+
+		const auto deleter = ComponentDeleterTable::get(id);
+		if (deleter->getAlignment() > alignof(std::max_align_t)) {
+			throw Exception("Component " + toString(id) + " is over-aligned and can't be stored in an archetype.", HalleyExceptions::Entity);
+		}
+		componentSizes.push_back(alignUp(deleter->getSize(), deleter->getAlignment()));
+	}
+	computeLayout();
+}
+
+void Archetype::computeLayout()
+{
+	constexpr size_t align = alignof(std::max_align_t);
+	auto layout = [&] (size_t n) -> size_t
+	{
+		size_t pos = 0;
+		idsOffset = pos;
+		pos = alignUp(pos + n * sizeof(EntityId), align);
+		aliveOffset = pos;
+		pos = alignUp(pos + n, align);
+		columnOffsets.resize(componentSizes.size());
+		for (size_t i = 0; i < componentSizes.size(); ++i) {
+			columnOffsets[i] = pos;
+			pos = alignUp(pos + n * componentSizes[i], align);
+		}
+		return pos;
+	};
+
+	size_t perEntity = sizeof(EntityId) + 1;
+	for (auto s: componentSizes) {
+		perEntity += s;
+	}
+	capacity = std::max(size_t(1), targetChunkSize / perEntity);
+	while (capacity > 1 && layout(capacity) > targetChunkSize) {
+		--capacity;
+	}
+	chunkSize = layout(capacity);
+}
+
+void Archetype::addChunk()
+{
+	auto chunk = std::make_unique<ArchetypeChunk>();
+	chunk->data = std::make_unique<char[]>(chunkSize);
+	chunk->dataSize = chunkSize;
+	chunk->ids = reinterpret_cast<EntityId*>(chunk->data.get() + idsOffset);
+	chunk->alive = reinterpret_cast<uint8_t*>(chunk->data.get() + aliveOffset);
+	for (auto offset: columnOffsets) {
+		chunk->columns.push_back(chunk->data.get() + offset);
+	}
+	chunks.push_back(std::move(chunk));
+}
+
+ArchetypeLocation Archetype::allocate(EntityId id)
+{
+	ArchetypeLocation location;
+	if (!freeSlots.empty()) {
+		location = freeSlots.back();
+		freeSlots.pop_back();
+	} else {
+		if (chunks.empty() || chunks.back()->used == capacity) {
+			addChunk();
+		}
+		location.archetype = this;
+		location.chunk = uint32_t(chunks.size() - 1);
+		location.slot = uint32_t(chunks.back()->used++);
+	}
+
+	auto& chunk = *chunks[location.chunk];
+	chunk.ids[location.slot] = id;
+	chunk.alive[location.slot] = 1;
+	chunk.liveCount++;
+	entityCount++;
+	return location;
+}
+
+void Archetype::release(const ArchetypeLocation& location)
+{
+	Expects(location.archetype == this);
+	auto& chunk = *chunks[location.chunk];
+	Expects(chunk.alive[location.slot]);
+	chunk.alive[location.slot] = 0;
+	chunk.ids[location.slot] = EntityId();
+	chunk.liveCount--;
+	entityCount--;
+
+	// Slots aren't compacted, as that would move other entities' components around. Reuse them instead.
+	freeSlots.push_back(location);
+}
+
+void* Archetype::getComponent(const ArchetypeLocation& location, int column) const
+{
+	return chunks[location.chunk]->columns[column] + location.slot * componentSizes[column];
+}
+
+ArchetypeStorage::ArchetypeStorage() = default;
+
+ArchetypeStorage::~ArchetypeStorage() = default;
+
+Archetype& ArchetypeStorage::getArchetype(FamilyMaskType mask)
+{
+	const int idx = mask.getIndex();
+	if (idx >= int(archetypeByMask.size())) {
+		archetypeByMask.resize(idx + 1, nullptr);
+	}
+
+	auto& archetype = archetypeByMask[idx];
+	if (!archetype) {
+		Vector<int> ids;
+		const auto& bits = mask.getRealValue();
+		for (size_t i = 0; i < bits.size(); ++i) {
+			if (bits[i]) {
+				ids.push_back(int(i));
+			}
+		}
+		archetypes.push_back(std::make_unique<Archetype>(mask, std::move(ids)));
+		archetype = archetypes.back().get();
+	}
+	return *archetype;
+}
+
+void ArchetypeStorage::moveEntity(Entity& entity)
+{
+	auto& archetype = getArchetype(entity.getMask());
+	const auto oldLocation = entity.archetypeLocation;
+	if (oldLocation.archetype == &archetype) {
+		return;
+	}
+
+	const auto newLocation = archetype.allocate(entity.getEntityId());
+	for (auto& c: entity.components) {
+		const int column = archetype.getColumn(c.first);
+		Expects(column >= 0);
+		void* dst = archetype.getComponent(newLocation, column);
+
+		auto deleter = ComponentDeleterTable::get(c.first);
+		deleter->moveConstruct(dst, c.second);
+		deleter->callDestructor(c.second);
+		if (!entity.isInArchetype(c.second)) {
+			PoolPool::getPool(deleter->getSize())->free(c.second);
+		}
+		c.second = static_cast<Component*>(dst);
+	}
+
+	if (oldLocation.archetype) {
+		oldLocation.archetype->release(oldLocation);
+	}
+	entity.archetypeLocation = newLocation;
+}
+
+void ArchetypeStorage::removeEntity(Entity& entity)
+{
+	// The entity's destructor is still responsible for destroying the components themselves
+	auto& location = entity.archetypeLocation;
+	if (location.archetype) {
+		location.archetype->release(location);
+	}
+}
+
+Vector<Archetype*> ArchetypeStorage::getArchetypesMatching(FamilyMaskType mask)
+{
+	std::unique_lock<std::mutex> lock(matchMutex);
+	auto& cache = matchCache[mask.getIndex()];
+	for (; cache.nChecked < archetypes.size(); ++cache.nChecked) {
+		auto archetype = archetypes[cache.nChecked].get();
+		if (archetype->getMask().contains(mask)) {
+			cache.matching.push_back(archetype);
+		}
+	}
+	return cache.matching;
+}
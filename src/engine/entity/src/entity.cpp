@@ -38,7 +38,16 @@ void Entity::deleteComponent(Component* component, int id)
 {
 	TypeDeleterBase* deleter = ComponentDeleterTable::get(id);
 	deleter->callDestructor(component);
-	PoolPool::getPool(deleter->getSize())->free(component);
+	if (!isInArchetype(component)) {
+		PoolPool::getPool(deleter->getSize())->free(component);
+	}
+}
+
+bool Entity::isInArchetype(const Component* component) const
+{
+	// Components living in an archetype chunk are owned by the chunk, not by the pool
+	auto archetype = archetypeLocation.archetype;
+	return archetype && archetype->getChunks()[archetypeLocation.chunk]->contains(component);
 }
 
 void Entity::onReady()
@@ -49,7 +58,7 @@ void Entity::markDirty(World& world)
 {
 	if (!dirty) {
 		dirty = true;
-		world.onEntityDirty();
+		world.onEntityDirty(*this);
 	}
 }
 
@@ -1,8 +1,11 @@
 #include "family.h"
 #include "family_binding.h"
+#include "entity.h"
 
 using namespace Halley;
 
+constexpr size_t Family::npos;
+
 Family::Family(FamilyMaskType mask) 
 	: inclusionMask(mask)
 {}
@@ -42,7 +45,56 @@ void Family::notifyRemove(void* entities, size_t count)
 	}
 }
 
+namespace {
+	size_t getEntityIndex(EntityId id)
+	{
+		// The low bits of the id are the entity's index in the world's pool, which is unique among live entities
+		return size_t(id.value & 0xFFFFFFFFll);
+	}
+}
+
+size_t Family::getEntitySlot(EntityId id) const
+{
+	const size_t idx = getEntityIndex(id);
+	if (idx >= slotByEntity.size() || slotByEntity[idx] == 0) {
+		return npos;
+	}
+
+	// The pool index might have been reused by a different entity
+	const size_t slot = slotByEntity[idx] - 1;
+	if (slot >= elemCount || static_cast<const FamilyBase*>(getElement(slot))->entityId != id) {
+		return npos;
+	}
+	return slot;
+}
+
+void Family::addEntities(gsl::span<Entity* const> entities)
+{
+	for (auto e: entities) {
+		addEntity(*e);
+	}
+}
+
 void Family::removeEntity(Entity& entity)
 {
-	toRemove.push_back(entity.getEntityId());
+	const size_t idx = getEntityIndex(entity.getEntityId());
+	Expects(idx < slotByEntity.size() && slotByEntity[idx] != 0);
+	toRemove.push_back(slotByEntity[idx] - 1);
+
+	// The entity might be re-added to this family before the removal is processed
+	slotByEntity[idx] = 0;
+}
+
+void Family::setEntitySlot(EntityId id, size_t slot)
+{
+	const size_t idx = getEntityIndex(id);
+	if (idx >= slotByEntity.size()) {
+		slotByEntity.resize(std::max(idx + 1, slotByEntity.size() * 2), 0);
+	}
+	slotByEntity[idx] = uint32_t(slot + 1);
+}
+
+void Family::clearEntitySlots()
+{
+	slotByEntity.clear();
 }
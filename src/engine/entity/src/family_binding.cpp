@@ -33,6 +33,16 @@ void FamilyBindingBase::setFamily(Family* f) {
 	family = f;
 }
 
+void FamilyBindingBase::setWorld(World& w)
+{
+	world = &w;
+}
+
+ArchetypeStorage* FamilyBindingBase::getArchetypeStorage() const
+{
+	return world ? world->getArchetypeStorage() : nullptr;
+}
+
 void FamilyBindingBase::setOnEntitiesAdded(std::function<void(void*, size_t)> callback)
 {
 	addedCallback = callback;
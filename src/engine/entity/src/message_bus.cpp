@@ -0,0 +1,175 @@
+#include "message_bus.h"
+#include <halley/support/exception.h>
+#include <halley/utils/utils.h>
+
+using namespace Halley;
+
+constexpr size_t MessageBus::blockSize;
+
+MessageQueue::MessageQueue(MessageBus& bus, size_t stride)
+	: bus(bus)
+	, stride(stride)
+{
+	// Targets, alive flags and payloads each get their own array, with the payloads aligned for any message type
+	constexpr size_t align = alignof(std::max_align_t);
+	const size_t overhead = 2 * align;
+	perBlock = std::max(size_t(1), (MessageBus::blockSize - overhead) / (sizeof(EntityId) + 1 + stride));
+	blockSize = std::max(MessageBus::blockSize, alignUp(perBlock * (sizeof(EntityId) + 1), align) + perBlock * stride);
+}
+
+MessageQueue::~MessageQueue()
+{
+	release(head, tail);
+}
+
+void* MessageQueue::push(EntityId target)
+{
+	const uint64_t idx = tail - firstBlockSeq;
+	if (idx / perBlock >= blocks.size()) {
+		auto block = bus.allocBlock(blockSize);
+		auto data = block->data.get();
+		block->targets = reinterpret_cast<EntityId*>(data);
+		block->alive = reinterpret_cast<uint8_t*>(data + perBlock * sizeof(EntityId));
+		block->payload = data + alignUp(perBlock * (sizeof(EntityId) + 1), alignof(std::max_align_t));
+		blocks.push_back(std::move(block));
+	}
+
+	auto& block = *blocks[size_t(idx / perBlock)];
+	const size_t i = size_t(idx % perBlock);
+	block.targets[i] = target;
+	block.alive[i] = 1;
+	++tail;
+	++liveCount;
+	return block.payload + i * stride;
+}
+
+void MessageQueue::release(uint64_t begin, uint64_t end)
+{
+	Expects(begin >= head || begin == end);
+	Expects(end <= tail);
+
+	for (uint64_t seq = begin; seq < end; ++seq) {
+		auto& block = *blocks[size_t((seq - firstBlockSeq) / perBlock)];
+		const size_t i = size_t((seq - firstBlockSeq) % perBlock);
+		if (block.alive[i]) {
+			reinterpret_cast<Message*>(block.payload + i * stride)->~Message();
+			block.alive[i] = 0;
+			--liveCount;
+		}
+	}
+
+	trim();
+}
+
+void MessageQueue::trim()
+{
+	// Senders normally release in the same order they sent, so this usually consumes everything that was just released
+	while (head < tail) {
+		auto& block = *blocks[size_t((head - firstBlockSeq) / perBlock)];
+		if (block.alive[(head - firstBlockSeq) % perBlock]) {
+			break;
+		}
+		++head;
+	}
+
+	if (head == tail) {
+		for (auto& b: blocks) {
+			bus.freeBlock(std::move(b));
+		}
+		blocks.clear();
+		firstBlockSeq = head;
+	} else {
+		size_t nFree = size_t((head - firstBlockSeq) / perBlock);
+		for (size_t i = 0; i < nFree; ++i) {
+			bus.freeBlock(std::move(blocks[i]));
+		}
+		blocks.erase(blocks.begin(), blocks.begin() + nFree);
+		firstBlockSeq += nFree * perBlock;
+	}
+}
+
+MessageBus::MessageBus() = default;
+
+MessageBus::~MessageBus()
+{
+	queues.clear();
+}
+
+void MessageBus::addReceiver(int msgType)
+{
+	if (msgType >= int(receiverCount.size())) {
+		receiverCount.resize(msgType + 1, 0);
+	}
+	receiverCount[msgType]++;
+}
+
+void MessageBus::removeReceiver(int msgType)
+{
+	Expects(hasReceivers(msgType));
+	receiverCount[msgType]--;
+}
+
+bool MessageBus::hasReceivers(int msgType) const
+{
+	return msgType < int(receiverCount.size()) && receiverCount[msgType] > 0;
+}
+
+MessageQueue& MessageBus::getQueue(int msgType, size_t msgSize)
+{
+	if (msgType >= int(queues.size())) {
+		queues.resize(msgType + 1);
+	}
+	auto& queue = queues[msgType];
+	if (!queue) {
+		queue = std::make_unique<MessageQueue>(*this, msgSize);
+	}
+	Expects(queue->getStride() == msgSize);
+	return *queue;
+}
+
+void MessageBus::onSent(int type, uint64_t seq, SentRanges& sent)
+{
+	if (!sent.empty()) {
+		auto& last = sent.back();
+		if (last.type == type && last.end == seq) {
+			last.end = seq + 1;
+			return;
+		}
+	}
+	sent.push_back(SentRange{ type, seq, seq + 1 });
+}
+
+void MessageBus::release(SentRanges& sent)
+{
+	for (auto& range: sent) {
+		queues[range.type]->release(range.begin, range.end);
+	}
+	sent.clear();
+}
+
+size_t MessageBus::getMessageCount(int msgType) const
+{
+	return msgType < int(queues.size()) && queues[msgType] ? queues[msgType]->getLiveCount() : 0;
+}
+
+std::unique_ptr<MessageQueue::Block> MessageBus::allocBlock(size_t size)
+{
+	if (size == blockSize && !freeBlocks.empty()) {
+		auto block = std::move(freeBlocks.back());
+		freeBlocks.pop_back();
+		return block;
+	}
+
+	auto block = std::make_unique<MessageQueue::Block>();
+	block->data = std::make_unique<char[]>(size);
+	block->size = size;
+	return block;
+}
+
+void MessageBus::freeBlock(std::unique_ptr<MessageQueue::Block> block)
+{
+	// Oversized blocks, for very large messages, aren't worth keeping around
+	if (block->size == blockSize) {
+		freeBlocks.push_back(std::move(block));
+	}
+}
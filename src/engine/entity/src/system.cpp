@@ -1,6 +1,6 @@
 #include "system.h"
-#include <halley/data_structures/flat_map.h>
 #include "halley/support/debug.h"
+#include "halley/support/profiler.h"
 
 using namespace Halley;
 
@@ -10,6 +10,14 @@ System::System(std::initializer_list<FamilyBindingBase*> uninitializedFamilies,
 {
 }
 
+void System::setName(String n)
+{
+	name = n;
+#ifdef DEV_BUILD
+	profilerName = Profiler::internName(name);
+#endif
+}
+
 size_t System::getEntityCount() const
 {
 	size_t n = 0;
@@ -40,77 +48,63 @@ void System::onAddedToWorld(World& w, int id) {
 	}
 }
 
-void System::purgeMessages()
+FamilyMask::RealType System::getReadMask() const
 {
-	if (messagesSentTo.size() > 0) {
-		for (auto& target: messagesSentTo) {
-			// Purge all messages of this age
-			Entity* entity = world->tryGetEntity(target);
-
-			if (entity) {
-				auto& inbox = entity->inbox;
-				inbox.erase(std::remove_if(inbox.begin(), inbox.end(), [&] (const MessageEntry& e) { return e.age == systemId; }), inbox.end());
-			}
-		}
-		messagesSentTo.clear();
+	FamilyMask::RealType result;
+	for (auto f : families) {
+		result |= f->readMask.getRealValue();
 	}
+	return result;
 }
 
-void System::processMessages()
+FamilyMask::RealType System::getWriteMask() const
 {
-	// This whole method is probably very inefficient.
-	struct MessageBox
-	{
-		Vector<Message*> msg;
-		Vector<size_t> elemIdx;
-	};
-	FlatMap<int, MessageBox> inboxes;
-
-	if (!families.empty()) {
-		auto& fam = *families[0];
-		size_t sz = fam.count();
-		for (size_t i = 0; i < sz; i++) {
-			FamilyBase* elem = reinterpret_cast<FamilyBase*>(fam.getElement(i));
-			Entity* entity = world->tryGetEntity(elem->entityId);
-			if (entity) {
-				for (const auto& msg: entity->inbox) {
-					if (std::find(messageTypesReceived.begin(), messageTypesReceived.end(), msg.type) != messageTypesReceived.end()) {
-						auto& inbox = inboxes[msg.type];
-						inbox.msg.emplace_back(msg.msg.get());
-						inbox.elemIdx.emplace_back(i);
-					}
-				}
-			}
-		}
-		for (auto& iter : inboxes) {
-			int id = iter.first;
-			auto& inbox = iter.second;
-			onMessagesReceived(id, inbox.msg.data(), inbox.elemIdx.data(), inbox.msg.size());
-		}
+	FamilyMask::RealType result;
+	for (auto f : families) {
+		result |= f->writeMask.getRealValue();
 	}
+	return result;
 }
 
-void System::doSendMessage(EntityId entityId, std::unique_ptr<Message> msg, size_t, int id)
+void System::purgeMessages()
 {
-	outbox.emplace_back(std::make_pair(entityId, MessageEntry(std::move(msg), id, systemId)));
+	// Messages live until the system that sent them runs again
+	if (!messagesSent.empty()) {
+		world->getMessageBus().release(messagesSent);
+	}
 }
 
-void System::dispatchMessages()
+void System::processMessages()
 {
-	if (!outbox.empty()) {
-		for (auto& o: outbox) {
-			Entity* entity = world->tryGetEntity(o.first);
-			if (entity) {
-				entity->inbox.emplace_back(std::move(o.second));
-				messagesSentTo.push_back(o.first);
+	// Messages are delivered to entities in the main family, one batch per type
+	if (families.empty()) {
+		return;
+	}
+
+	auto& family = *families[0]->family;
+	auto& bus = world->getMessageBus();
+	for (int type: messageTypesReceived) {
+		messagesReceived.clear();
+		messagesReceivedIdx.clear();
+
+		bus.forEach(type, [&] (EntityId target, Message* msg)
+		{
+			const size_t idx = family.getEntitySlot(target);
+			if (idx != Family::npos) {
+				messagesReceived.push_back(msg);
+				messagesReceivedIdx.push_back(idx);
 			}
+		});
+
+		if (!messagesReceived.empty()) {
+			onMessagesReceived(type, messagesReceived.data(), messagesReceivedIdx.data(), messagesReceived.size());
 		}
-		outbox.clear();
 	}
 }
 
 void System::doUpdate(Time time) {
 	HALLEY_DEBUG_TRACE_COMMENT(name.c_str());
+	HALLEY_PROFILE_ZONE(profilerName);
 	if (collectSamples) {
 		timer.beginSample();
 	}
@@ -121,7 +115,6 @@ void System::doUpdate(Time time) {
 	}
 	
 	updateBase(time);
-	dispatchMessages();
 
 	if (collectSamples) {
 		timer.endSample();
@@ -131,6 +124,7 @@ void System::doUpdate(Time time) {
 
 void System::doRender(RenderContext& rc) {
 	HALLEY_DEBUG_TRACE_COMMENT(name.c_str());
+	HALLEY_PROFILE_ZONE(profilerName);
 	if (collectSamples) {
 		timer.beginSample();
 	}
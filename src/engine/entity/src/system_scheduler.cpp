@@ -0,0 +1,300 @@
+#include "system_scheduler.h"
+#include "system.h"
+#include <halley/concurrency/concurrent.h>
+#include <halley/support/debug.h>
+#include <halley/data_structures/frame_arena.h>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+
+using namespace Halley;
+
+namespace {
+	int64_t nanoSecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+bool SystemScheduleTrace::overlaps(size_t a, size_t b) const
+{
+	auto& x = entries.at(a);
+	auto& y = entries.at(b);
+	return x.startNs < y.endNs && y.startNs < x.endNs;
+}
+
+size_t SystemScheduleTrace::getOverlapCount() const
+{
+	size_t n = 0;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		for (size_t j = i + 1; j < entries.size(); ++j) {
+			if (overlaps(i, j)) {
+				++n;
+			}
+		}
+	}
+	return n;
+}
+
+String SystemScheduleTrace::toString() const
+{
+	String result;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		auto& e = entries[i];
+		result += e.system->getName() + " [thread " + Halley::toString(e.thread) + "] " + Halley::toString(e.startNs / 1000) + "-" + Halley::toString(e.endNs / 1000) + " us";
+		bool first = true;
+		for (size_t j = 0; j < entries.size(); ++j) {
+			if (i != j && overlaps(i, j)) {
+				result += (first ? ", overlaps " : ", ") + entries[j].system->getName();
+				first = false;
+			}
+		}
+		result += "\n";
+	}
+	return result;
+}
+
+void SystemScheduler::invalidate()
+{
+	dirty = true;
+}
+
+void SystemScheduler::setParallel(bool enabled)
+{
+	parallel = enabled;
+}
+
+bool SystemScheduler::isParallel() const
+{
+	return parallel;
+}
+
+const SystemScheduleTrace& SystemScheduler::getLastTrace() const
+{
+	return trace;
+}
+
+void SystemScheduler::run(Vector<std::unique_ptr<System>>& systems, Time time, const std::function<void()>& onSerialSystemDone)
+{
+	// Leave at least one worker free for any tasks that the running systems queue and then block on
+	const size_t nThreads = parallel ? Executors::getCPU().threadCount() : 0;
+	const size_t maxWorkers = nThreads > 1 ? nThreads - 1 : 0;
+
+	if (dirty) {
+		buildGraph(systems);
+	}
+
+	trace.entries.clear();
+	trace.parallel = maxWorkers > 0;
+
+	const auto start = std::chrono::steady_clock::now();
+	if (trace.parallel) {
+		runParallel(time, onSerialSystemDone, maxWorkers);
+	} else {
+		runSerial(systems, time, onSerialSystemDone);
+	}
+	trace.totalNs = nanoSecondsSince(start);
+}
+
+void SystemScheduler::buildGraph(Vector<std::unique_ptr<System>>& systems)
+{
+	const size_t n = systems.size();
+	graph.clear();
+	graph.resize(n);
+
+	Vector<FamilyMask::RealType> reads(n);
+	Vector<FamilyMask::RealType> writes(n);
+	for (size_t i = 0; i < n; ++i) {
+		auto& node = graph[i];
+		node.system = systems[i].get();
+		node.serial = !node.system->isThreadSafe();
+		reads[i] = node.system->getReadMask();
+		writes[i] = node.system->getWriteMask();
+	}
+
+	// System i depends on an earlier system j if either writes what the other one accesses.
+	// Systems that aren't thread-safe act as barriers, since they can touch the world in arbitrary ways.
+	for (size_t i = 0; i < n; ++i) {
+		for (size_t j = 0; j < i; ++j) {
+			const bool conflict = graph[i].serial || graph[j].serial
+				|| (writes[i] & reads[j]).any()
+				|| (writes[j] & reads[i]).any();
+			if (conflict) {
+				graph[j].dependents.push_back(i);
+				graph[i].nDependencies++;
+			}
+		}
+	}
+
+	dirty = false;
+}
+
+void SystemScheduler::runSerial(Vector<std::unique_ptr<System>>& systems, Time time, const std::function<void()>& onSerialSystemDone)
+{
+	const auto start = std::chrono::steady_clock::now();
+	for (auto& system : systems) {
+		SystemTraceEntry entry;
+		entry.system = system.get();
+		entry.startNs = nanoSecondsSince(start);
+		system->doUpdate(time);
+		entry.endNs = nanoSecondsSince(start);
+		trace.entries.push_back(entry);
+
+		onSerialSystemDone();
+	}
+}
+
+void SystemScheduler::runParallel(Time time, const std::function<void()>& onSerialSystemDone, size_t maxWorkers)
+{
+	HALLEY_DEBUG_TRACE();
+	const size_t n = graph.size();
+	const auto start = std::chrono::steady_clock::now();
+
+	// All sized for the worst case up front, as frame memory isn't given back when a vector grows
+	FrameVector<int> pendingDependencies(n);
+	FrameVector<size_t> ready;
+	ready.reserve(n);
+	for (size_t i = 0; i < n; ++i) {
+		pendingDependencies[i] = graph[i].nDependencies;
+		if (pendingDependencies[i] == 0) {
+			ready.push_back(i);
+		}
+	}
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	FrameVector<size_t> finished;
+	finished.reserve(n);
+	FrameVector<bool> laneBusy(maxWorkers, false);
+	FrameVector<int> systemLane(n, 0);
+	FrameVector<SystemTraceEntry> workerEntries;
+	workerEntries.reserve(n);
+	std::exception_ptr error;
+	size_t running = 0;
+	size_t nDone = 0;
+
+	auto onDone = [&] (size_t idx)
+	{
+		++nDone;
+		for (auto dependent : graph[idx].dependents) {
+			if (--pendingDependencies[dependent] == 0) {
+				ready.push_back(dependent);
+			}
+		}
+	};
+
+	auto runOnCaller = [&] (size_t idx)
+	{
+		auto& node = graph[idx];
+		SystemTraceEntry entry;
+		entry.system = node.system;
+		entry.startNs = nanoSecondsSince(start);
+		node.system->doUpdate(time);
+		entry.endNs = nanoSecondsSince(start);
+		trace.entries.push_back(entry);
+
+		if (node.serial) {
+			onSerialSystemDone();
+		}
+		onDone(idx);
+	};
+
+	auto waitForWorkers = [&] ()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (running > finished.size()) {
+			condition.wait(lock);
+		}
+	};
+
+	while (nDone < n) {
+		if (!ready.empty()) {
+			// Keep the original order as a priority, so the schedule is stable between frames
+			std::sort(ready.begin(), ready.end(), std::greater<size_t>());
+			const size_t next = ready.back();
+			ready.pop_back();
+
+			if (graph[next].serial) {
+				// Barrier: by construction, nothing else can be running at this point
+				runOnCaller(next);
+				continue;
+			}
+
+			// Hand everything else that's ready off to workers, then do this one ourselves
+			while (!ready.empty() && running < maxWorkers) {
+				const size_t idx = ready.back();
+				if (graph[idx].serial) {
+					break;
+				}
+				ready.pop_back();
+				++running;
+				const int lane = int(std::find(laneBusy.begin(), laneBusy.end(), false) - laneBusy.begin());
+				laneBusy[lane] = true;
+				systemLane[idx] = lane + 1;
+
+				Executors::getCPU().addToQueue([&, idx] ()
+				{
+					SystemTraceEntry entry;
+					entry.system = graph[idx].system;
+					entry.thread = systemLane[idx];
+					entry.startNs = nanoSecondsSince(start);
+					std::exception_ptr exception;
+					try {
+						graph[idx].system->doUpdate(time);
+					} catch (...) {
+						exception = std::current_exception();
+					}
+					entry.endNs = nanoSecondsSince(start);
+
+					std::unique_lock<std::mutex> lock(mutex);
+					workerEntries.push_back(entry);
+					finished.push_back(idx);
+					if (exception && !error) {
+						error = exception;
+					}
+					condition.notify_one();
+				});
+			}
+
+			try {
+				runOnCaller(next);
+			} catch (...) {
+				// Workers still hold references into this frame
+				waitForWorkers();
+				throw;
+			}
+		} else {
+			std::unique_lock<std::mutex> lock(mutex);
+			while (finished.empty()) {
+				condition.wait(lock);
+			}
+		}
+
+		// Collect anything the workers have completed
+		bool failed;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			for (auto idx : finished) {
+				--running;
+				laneBusy[systemLane[idx] - 1] = false;
+				onDone(idx);
+			}
+			finished.clear();
+			failed = error != nullptr;
+		}
+
+		if (failed) {
+			// Don't schedule anything else, just let the workers finish before bailing out
+			waitForWorkers();
+			std::rethrow_exception(error);
+		}
+	}
+
+	for (auto& e : workerEntries) {
+		trace.entries.push_back(e);
+	}
+	std::sort(trace.entries.begin(), trace.entries.end(), [] (const SystemTraceEntry& a, const SystemTraceEntry& b) { return a.startNs < b.startNs; });
+	HALLEY_DEBUG_TRACE();
+}
@@ -1,20 +1,27 @@
 #include <iostream>
 #include <chrono>
 #include <halley/support/exception.h>
-#include <halley/data_structures/memory_pool.h>
+#include <halley/data_structures/frame_arena.h>
+#include <algorithm>
 #include <halley/utils/utils.h>
 #include "world.h"
 #include "system.h"
 #include "family.h"
+#include "archetype.h"
 #include "halley/text/string_converter.h"
 #include "halley/support/debug.h"
 #include "halley/file_formats/config_file.h"
 
 using namespace Halley;
 
+namespace {
+	constexpr size_t entitySlabSize = 4096;
+}
+
 World::World(const HalleyAPI* api, bool collectMetrics)
 	: api(api)
 	, collectMetrics(collectMetrics)
+	, reservedEntities(nullptr)
 {	
 }
 
@@ -33,6 +40,11 @@ World::~World()
 	for (auto e: entities) {
 		deleteEntity(e);
 	}
+	for (auto r = reservedEntities.exchange(nullptr); r; ) {
+		auto next = r->next;
+		delete r;
+		r = next;
+	}
 	families.clear();
 	services.clear();
 }
@@ -45,15 +57,25 @@ System& World::addSystem(std::unique_ptr<System> system, TimeLine timelineType)
 	auto& timeline = getSystems(timelineType);
 	timeline.emplace_back(std::move(system));
 	ref.onAddedToWorld(*this, int(timeline.size()));
+	for (int msgType: ref.messageTypesReceived) {
+		messageBus.addReceiver(msgType);
+	}
+	schedulers[int(timelineType)].invalidate();
 	return ref;
 }
 
 void World::removeSystem(System& system)
 {
-	for (auto& sys : systems) {
+	for (size_t tl = 0; tl < systems.size(); tl++) {
+		auto& sys = systems[tl];
 		for (size_t i = 0; i < sys.size(); i++) {
 			if (sys[i].get() == &system) {
+				messageBus.release(system.messagesSent);
+				for (int msgType: system.messageTypesReceived) {
+					messageBus.removeReceiver(msgType);
+				}
 				sys.erase(sys.begin() + i);
+				schedulers[tl].invalidate();
 				return;
 			}
 		}
@@ -140,24 +162,69 @@ Service& World::getService(const String& name) const
 
 EntityRef World::createEntity()
 {
-	Entity* entity = new(PoolAllocator<Entity>::alloc()) Entity();
-	if (entity == nullptr) {
-		throw Exception("Error creating entity - out of memory?", HalleyExceptions::Entity);
-	}
+	Entity* entity = newEntity();
 	entitiesPendingCreation.push_back(entity);
 	allocateEntity(entity);
 	return EntityRef(*entity, *this);
 }
 
+Vector<EntityId> World::createEntities(size_t n, std::function<void(EntityRef&, size_t)> prototype)
+{
+	Vector<EntityId> ids;
+	ids.reserve(n);
+	reserveEntityMemory(n);
+	entitiesPendingCreation.reserve(entitiesPendingCreation.size() + n);
+	dirtyEntities.reserve(dirtyEntities.size() + n);
+
+	// All ids and memory are claimed before any prototype runs, as those might create more entities
+	const size_t first = entitiesPendingCreation.size();
+	entityMap.alloc(n, [&] (Entity** slot, int64_t id) {
+		Entity* entity = newEntity();
+		*slot = entity;
+		entity->uid.value = id;
+		entitiesPendingCreation.push_back(entity);
+		ids.push_back(entity->uid);
+	});
+
+	for (size_t i = 0; i < n; ++i) {
+		EntityRef ref(*entitiesPendingCreation[first + i], *this);
+		prototype(ref, i);
+	}
+	return ids;
+}
+
 void World::destroyEntity(EntityId id)
 {
 	auto e = tryGetEntity(id);
-	if (e) {
+	if (e && e->isAlive()) {
+		const bool wasDirty = e->needsRefresh();
 		e->destroy();
-		entityDirty = true;
+		if (!wasDirty) {
+			dirtyEntities.push_back(e);
+		}
 	}
 }
 
+void World::destroyEntities(gsl::span<const EntityId> ids)
+{
+	dirtyEntities.reserve(dirtyEntities.size() + size_t(ids.size()));
+	for (auto& id: ids) {
+		destroyEntity(id);
+	}
+}
+
+EntityId World::reserveEntity(std::function<void(EntityRef&)> init)
+{
+	auto reserved = new ReservedEntity();
+	reserved->id.value = entityMap.allocConcurrent().second;
+	reserved->init = std::move(init);
+
+	reserved->next = reservedEntities.load(std::memory_order_relaxed);
+	while (!reservedEntities.compare_exchange_weak(reserved->next, reserved, std::memory_order_release, std::memory_order_relaxed)) {
+	}
+	return reserved->id;
+}
+
 EntityRef World::getEntity(EntityId id)
 {
 	Entity* entity = tryGetEntity(id);
@@ -181,16 +248,50 @@ size_t World::numEntities() const
 	return entities.size();
 }
 
-void World::onEntityDirty()
+void World::onEntityDirty(Entity& entity)
+{
+	dirtyEntities.push_back(&entity);
+}
+
+Entity* World::newEntity()
+{
+	void* memory;
+	if (!freeEntityMemory.empty()) {
+		memory = freeEntityMemory.back();
+		freeEntityMemory.pop_back();
+	} else {
+		if (entitySlabUsed == entitySlabCapacity) {
+			reserveEntityMemory(1);
+		}
+		memory = entitySlabs.back().get() + entitySlabUsed * sizeof(Entity);
+		++entitySlabUsed;
+	}
+	return new (memory) Entity();
+}
+
+void World::reserveEntityMemory(size_t n)
 {
-	entityDirty = true;
+	const size_t available = freeEntityMemory.size() + (entitySlabCapacity - entitySlabUsed);
+	if (available >= n) {
+		return;
+	}
+
+	// Whatever is left of the current slab is used up first
+	for (; entitySlabUsed < entitySlabCapacity; ++entitySlabUsed) {
+		freeEntityMemory.push_back(entitySlabs.back().get() + entitySlabUsed * sizeof(Entity));
+	}
+
+	const size_t size = std::max(entitySlabSize, n - available);
+	entitySlabs.emplace_back(new char[size * sizeof(Entity)]);
+	entitySlabCapacity = size;
+	entitySlabUsed = 0;
 }
 
 void World::deleteEntity(Entity* entity)
 {
 	Expects (entity);
 	entity->~Entity();
-	PoolAllocator<Entity>::free(entity);
+	freeEntityMemory.push_back(entity);
 }
 
 bool World::hasSystemsOnTimeLine(TimeLine timeline) const
@@ -203,6 +304,42 @@ int64_t World::getAverageTime(TimeLine timeline) const
 	return timer[int(timeline)].averageElapsedNanoSeconds();
 }
 
+void World::setParallelSystems(bool enabled)
+{
+	parallelSystems = enabled;
+}
+
+bool World::isParallelSystems() const
+{
+	return parallelSystems;
+}
+
+const SystemScheduleTrace& World::getScheduleTrace(TimeLine timeline) const
+{
+	return schedulers[int(timeline)].getLastTrace();
+}
+
+void World::setArchetypeStorage(bool enabled)
+{
+	if (enabled == (archetypeStorage != nullptr)) {
+		return;
+	}
+	if (!entities.empty() || !entitiesPendingCreation.empty()) {
+		throw Exception("Archetype storage can only be changed before any entities are created.", HalleyExceptions::Entity);
+	}
+	archetypeStorage = enabled ? std::make_unique<ArchetypeStorage>() : std::unique_ptr<ArchetypeStorage>();
+}
+
+ArchetypeStorage* World::getArchetypeStorage() const
+{
+	return archetypeStorage.get();
+}
+
+MessageBus& World::getMessageBus()
+{
+	return messageBus;
+}
+
 void World::step(TimeLine timeline, Time elapsed)
 {
 	auto& t = timer[int(timeline)];
@@ -241,16 +378,53 @@ void World::allocateEntity(Entity* entity) {
 	entity->uid.value = res.second;
 }
 
+void World::commitReservedEntities()
+{
+	auto reserved = reservedEntities.exchange(nullptr, std::memory_order_acquire);
+	if (!reserved) {
+		return;
+	}
+
+	size_t n = 0;
+	for (auto r = reserved; r; r = r->next) {
+		++n;
+	}
+	FrameVector<std::unique_ptr<ReservedEntity>> toCommit;
+	toCommit.reserve(n);
+	for (; reserved; reserved = reserved->next) {
+		toCommit.emplace_back(reserved);
+	}
+
+	// The list comes out newest first
+	std::reverse(toCommit.begin(), toCommit.end());
+
+	reserveEntityMemory(toCommit.size());
+	const size_t first = entitiesPendingCreation.size();
+	for (auto& r: toCommit) {
+		Entity* entity = newEntity();
+		entity->uid = r->id;
+		*entityMap.get(r->id.value) = entity;
+		entitiesPendingCreation.push_back(entity);
+	}
+	for (size_t i = 0; i < toCommit.size(); ++i) {
+		EntityRef ref(*entitiesPendingCreation[first + i], *this);
+		toCommit[i]->init(ref);
+	}
+}
+
 void World::spawnPending()
 {
+	commitReservedEntities();
+
 	if (!entitiesPendingCreation.empty()) {
 		HALLEY_DEBUG_TRACE();
+		entities.reserve(entities.size() + entitiesPendingCreation.size());
 		for (auto& e : entitiesPendingCreation) {
 			e->onReady();
+			e->worldIndex = entities.size();
+			entities.push_back(e);
 		}
-		std::move(entitiesPendingCreation.begin(), entitiesPendingCreation.end(), std::insert_iterator<decltype(entities)>(entities, entities.end()));
 		entitiesPendingCreation.clear();
-		entityDirty = true;
 		HALLEY_DEBUG_TRACE();
 	}
 
@@ -259,62 +433,71 @@ void World::spawnPending()
 
 void World::updateEntities()
 {
-	if (!entityDirty) {
+	// Only entities that changed since the last update are visited
+	if (dirtyEntities.empty()) {
 		return;
 	}
 
 	HALLEY_DEBUG_TRACE();
-	size_t nEntities = entities.size();
-
-	std::vector<size_t> entitiesRemoved;
+	const size_t nDirty = dirtyEntities.size();
+	entitiesRemoved.clear();
 
-	struct FamilyTodo {
-		std::vector<Entity*> toAdd;
-		std::vector<Entity*> toRemove;
-	};
-	std::map<FamilyMaskType, FamilyTodo> pending;
-
-	// Update all entities
+	// Update all dirty entities
 	// This loop should be as fast as reasonably possible
-	for (size_t i = 0; i < nEntities; i++) {
-		auto& entity = *entities[i];
-		if (i + 20 < nEntities) { // Watch out for sign! Don't subtract!
-			prefetchL2(entities[i + 20]);
+	for (size_t i = 0; i < nDirty; i++) {
+		auto& entity = *dirtyEntities[i];
+		if (i + 20 < nDirty) { // Watch out for sign! Don't subtract!
+			prefetchL2(dirtyEntities[i + 20]);
 		}
 
-		// Check if it needs any sort of updating
-		if (entity.needsRefresh()) {
-			// First of all, let's check if it's dead
-			if (!entity.isAlive()) {
-				// Remove from systems
-				pending[entity.getMask()].toRemove.push_back(&entity);
-				entitiesRemoved.push_back(i);
-			} else {
-				// It's alive, so check old and new system inclusions
-				FamilyMaskType oldMask = entity.getMask();
-				entity.refresh();
-				FamilyMaskType newMask = entity.getMask();
-
-				// Did it change?
-				if (oldMask != newMask) {
-					pending[oldMask].toRemove.push_back(&entity);
-					pending[newMask].toAdd.push_back(&entity);
+		// First of all, let's check if it's dead
+		if (!entity.isAlive()) {
+			// Remove from systems
+			getFamilyTodo(entity.getMask()).toRemove.push_back(&entity);
+			entitiesRemoved.push_back(&entity);
+		} else {
+			// It's alive, so check old and new system inclusions
+			FamilyMaskType oldMask = entity.getMask();
+			entity.refresh();
+			FamilyMaskType newMask = entity.getMask();
+
+			// Did it change?
+			if (oldMask != newMask) {
+				// Families re-read the component pointers when the entity is re-added below
+				if (archetypeStorage) {
+					archetypeStorage->moveEntity(entity);
 				}
+				getFamilyTodo(oldMask).toRemove.push_back(&entity);
+				getFamilyTodo(newMask).toAdd.push_back(&entity);
 			}
 		}
 	}
+	dirtyEntities.clear();
 
 	HALLEY_DEBUG_TRACE();
-	for (auto& todo: pending) {
-		for (auto& fam: getFamiliesFor(todo.first)) {
-			for (auto& e: todo.second.toRemove) {
-				fam->removeEntity(*e);
+	// All removals must be done before any additions, as an entity might be leaving and re-entering the same family
+	for (auto idx: pendingFamilyTodo) {
+		auto& todo = familyTodo[idx];
+		if (!todo.toRemove.empty()) {
+			for (auto& fam: getFamiliesFor(todo.mask)) {
+				for (auto& e: todo.toRemove) {
+					fam->removeEntity(*e);
+				}
 			}
-			for (auto& e: todo.second.toAdd) {
-				fam->addEntity(*e);
+		}
+	}
+	for (auto idx: pendingFamilyTodo) {
+		auto& todo = familyTodo[idx];
+		if (!todo.toAdd.empty()) {
+			for (auto& fam: getFamiliesFor(todo.mask)) {
+				fam->addEntities(todo.toAdd);
 			}
 		}
+		todo.toAdd.clear();
+		todo.toRemove.clear();
+		todo.pending = false;
 	}
+	pendingFamilyTodo.clear();
 
 	HALLEY_DEBUG_TRACE();
 	// Update families
@@ -324,23 +507,23 @@ void World::updateEntities()
 
 	HALLEY_DEBUG_TRACE();
 	// Actually remove dead entities
-	if (!entitiesRemoved.empty()) {
-		size_t livingEntityCount = entities.size();
-		for (int i = int(entitiesRemoved.size()); --i >= 0; ) {
-			size_t idx = entitiesRemoved[i];
-			auto& entity = *entities[idx];
-
-			// Remove
-			entityMap.freeId(entity.getEntityId().value);
-			deleteEntity(&entity);
-
-			// Put it at the back of the array, so it's removed when the array gets resized
-			std::swap(entities[idx], entities[--livingEntityCount]);
+	for (auto entity: entitiesRemoved) {
+		// Swap with the last entity
+		const size_t idx = entity->worldIndex;
+		auto last = entities.back();
+		entities[idx] = last;
+		last->worldIndex = idx;
+		entities.pop_back();
+
+		// Remove
+		entityMap.freeId(entity->getEntityId().value);
+		if (archetypeStorage) {
+			archetypeStorage->removeEntity(*entity);
 		}
-		entities.resize(livingEntityCount);
+		deleteEntity(entity);
 	}
+	entitiesRemoved.clear();
 
-	entityDirty = false;
 	HALLEY_DEBUG_TRACE();
 }
 
@@ -355,10 +538,10 @@ void World::initSystems() const
 
 void World::updateSystems(TimeLine timeline, Time time)
 {
-	for (auto& system : getSystems(timeline)) {
-		system->doUpdate(time);
-		spawnPending();
-	}
+	auto& scheduler = schedulers[int(timeline)];
+	scheduler.setParallel(parallelSystems);
+	scheduler.run(getSystems(timeline), time, [this] () { spawnPending(); });
+	spawnPending();
 }
 
 void World::renderSystems(RenderContext& rc) const
@@ -380,24 +563,46 @@ void World::onAddFamily(Family& family)
 			family.addEntity(entity);
 		}
 	}
-	familyCache.clear();
+	for (auto& entry: familyCache) {
+		entry.valid = false;
+	}
 }
 
-const std::vector<Family*>& World::getFamiliesFor(const FamilyMaskType& mask)
+const Vector<Family*>& World::getFamiliesFor(const FamilyMaskType& mask)
 {
-	auto i = familyCache.find(mask);
-	if (i != familyCache.end()) {
-		return i->second;
-	} else {
-		std::vector<Family*> result;
+	// Offset by one, so the unset handle (-1) gets its own entry
+	const size_t idx = size_t(mask.getIndex() + 1);
+	if (idx >= familyCache.size()) {
+		familyCache.resize(idx + 1);
+	}
+
+	auto& entry = familyCache[idx];
+	if (!entry.valid) {
+		entry.families.clear();
 		for (auto& iter : families) {
 			auto& family = *iter;
 			FamilyMaskType famMask = family.inclusionMask;
 			if (mask.contains(famMask)) {
-				result.push_back(&family);
+				entry.families.push_back(&family);
 			}
 		}
-		familyCache[mask] = std::move(result);
-		return familyCache[mask];
+		entry.valid = true;
+	}
+	return entry.families;
+}
+
+World::FamilyTodo& World::getFamilyTodo(const FamilyMaskType& mask)
+{
+	const size_t idx = size_t(mask.getIndex() + 1);
+	if (idx >= familyTodo.size()) {
+		familyTodo.resize(idx + 1);
+	}
+
+	auto& todo = familyTodo[idx];
+	if (!todo.pending) {
+		todo.pending = true;
+		todo.mask = mask;
+		pendingFamilyTodo.push_back(idx);
 	}
+	return todo;
 }
@@ -1,9 +1,27 @@
 #pragma once
 #include "../utils/utils.h"
+#include "../text/string_converter.h"
 #include <gsl/gsl>
 #include <limits>
 
 namespace Halley {
+	class ExecutionQueue;
+
+	enum class CompressionCodec {
+		None,
+		Deflate
+	};
+
+	template <>
+	struct EnumNames<CompressionCodec> {
+		constexpr std::array<const char*, 2> operator()() const {
+			return{{
+				"none",
+				"deflate"
+			}};
+		}
+	};
+
 	class Compression {
 	public:
 		static Bytes compress(const Bytes& bytes);
@@ -14,5 +32,50 @@ namespace Halley {
 
 		static Bytes compressRaw(gsl::span<const gsl::byte> bytes, bool insertLength);
 		static Bytes decompressRaw(gsl::span<const gsl::byte> bytes, size_t maxSize, size_t expectedSize = 0);
+		static void decompressRaw(gsl::span<const gsl::byte> bytes, gsl::span<gsl::byte> dst);
+	};
+
+	// Data compressed as a series of independently decodable chunks, so it can be decompressed in parallel, or streamed one chunk at a time.
+	// Layout is a Header, followed by chunkCount + 1 uint64_t offsets (relative to the end of the table), followed by the chunks.
+	class ChunkedCompression {
+	public:
+		constexpr static size_t defaultChunkSize = 256 * 1024;
+
+		struct Header {
+			uint64_t uncompressedSize;
+			uint32_t chunkSize;
+			uint32_t chunkCount;
+		};
+
+		class Table {
+		public:
+			Table() = default;
+			explicit Table(gsl::span<const gsl::byte> src); // Needs at least getTableSize() bytes
+
+			// Size of the whole table, given just the header
+			static size_t getTableSize(const Header& header);
+
+			size_t getTableSize() const;
+			size_t getUncompressedSize() const { return size_t(header.uncompressedSize); }
+			size_t getChunkCount() const { return header.chunkCount; }
+			size_t getChunkSize() const { return header.chunkSize; }
+
+			// Positions relative to the start of the compressed data, including the table
+			size_t getChunkStart(size_t chunk) const;
+			size_t getChunkCompressedSize(size_t chunk) const;
+			size_t getChunkUncompressedSize(size_t chunk) const;
+
+		private:
+			Header header = {};
+			Vector<uint64_t> offsets;
+		};
+
+		static Bytes compress(gsl::span<const gsl::byte> src, CompressionCodec codec, size_t chunkSize = defaultChunkSize);
+
+		static void decompressChunk(gsl::span<const gsl::byte> chunk, CompressionCodec codec, gsl::span<gsl::byte> dst);
+		static void decompress(gsl::span<const gsl::byte> src, CompressionCodec codec, gsl::span<gsl::byte> dst);
+
+		// Chunks are spread across the queue's workers, with the calling thread helping
+		static void decompress(gsl::span<const gsl::byte> src, CompressionCodec codec, gsl::span<gsl::byte> dst, ExecutionQueue& queue);
 	};
 }
@@ -1,6 +1,9 @@
 #pragma once
 #include <array>
 #include <functional>
+#include <memory>
+#include <exception>
+#include <algorithm>
 #include <halley/text/halleystring.h>
 #include "executor.h"
 #include "future.h"
@@ -52,28 +55,95 @@ namespace Halley
 			return future.getFuture();
 		}
 
+		// Shared state for parallelFor. Work is claimed in chunks through an atomic cursor, so uneven costs balance out.
+		class ParallelForState
+		{
+		public:
+			ParallelForState(size_t count, size_t grainSize);
+
+			// Returns false once there's nothing left to claim
+			bool claim(size_t& start, size_t& end);
+			void onChunkDone(size_t count, std::exception_ptr exception);
+			void wait();
+
+		private:
+			const size_t count;
+			const size_t grainSize;
+			std::atomic<size_t> cursor;
+			std::atomic<size_t> done;
+			std::exception_ptr exception;
+			std::mutex mutex;
+			std::condition_variable condition;
+		};
+
+		size_t getParallelForGrainSize(size_t count, size_t nThreads);
+
 		template <typename T, typename F>
-		void foreach(ExecutionQueue& e, T begin, T end, F f)
+		void runParallelForChunks(ParallelForState& state, T begin, F& f)
 		{
-			const size_t n = end - begin;
-			constexpr size_t maxThreads = 8;
-			size_t nThreads = std::max(size_t(1), std::min(maxThreads, e.threadCount()));
-			std::array<Future<void>, maxThreads> futures;
-
-			size_t prevEnd = 0;
-			for (size_t j = 0; j < nThreads; ++j) {
-				size_t curStart = prevEnd;
-				size_t curEnd = n * (j + 1) / nThreads;
-				prevEnd = curEnd;
-
-				futures[j] = execute([begin, f, curStart, curEnd]() {
-					for (auto i = begin + curStart; i < begin + curEnd; ++i) {
+			size_t start;
+			size_t end;
+			while (state.claim(start, end)) {
+				std::exception_ptr exception;
+				try {
+					for (auto i = begin + start; i < begin + end; ++i) {
 						f(*i);
 					}
+				} catch (...) {
+					exception = std::current_exception();
+				}
+				state.onChunkDone(end - start, exception);
+			}
+		}
+
+		// Runs f on every element in [begin, end), using the calling thread and the workers of e.
+		// Chunks are claimed dynamically (grainSize elements at a time, or an automatic size if zero).
+		// Safe to call from inside tasks running on e, as it never waits for work that hasn't started.
+		template <typename T, typename F>
+		void parallelFor(ExecutionQueue& e, T begin, T end, F&& f, size_t grainSize = 0)
+		{
+			const size_t n = end - begin;
+			const size_t nThreads = e.threadCount();
+			if (n == 0) {
+				return;
+			}
+			if (grainSize == 0) {
+				grainSize = getParallelForGrainSize(n, nThreads);
+			}
+
+			const size_t nChunks = (n + grainSize - 1) / grainSize;
+			const size_t nHelpers = HAS_THREADS ? std::min(nThreads, nChunks - 1) : 0;
+			if (nHelpers == 0) {
+				for (auto i = begin; i < end; ++i) {
+					f(*i);
+				}
+				return;
+			}
+
+			// Helpers may start after everything is done, so they share ownership of the state.
+			// They only touch f while holding a claimed chunk, and wait() returns only after every claimed chunk is done.
+			auto state = std::make_shared<ParallelForState>(n, grainSize);
+			auto* func = &f;
+			for (size_t i = 0; i < nHelpers; ++i) {
+				e.addToQueue([state, begin, func] () {
+					runParallelForChunks(*state, begin, *func);
 				});
 			}
 
-			whenAll(futures.data(), futures.data() + nThreads).wait();
+			runParallelForChunks(*state, begin, f);
+			state->wait();
+		}
+
+		template <typename T, typename F>
+		void parallelFor(T begin, T end, F&& f, size_t grainSize = 0)
+		{
+			parallelFor(ExecutionQueue::getDefault(), begin, end, std::forward<F>(f), grainSize);
+		}
+
+		template <typename T, typename F>
+		void foreach(ExecutionQueue& e, T begin, T end, F f)
+		{
+			parallelFor(e, begin, end, f);
 		}
 
 		template <typename T, typename F>
@@ -6,36 +6,86 @@
 #include <functional>
 #include <atomic>
 #include <vector>
+#include <memory>
 #include "halley/text/halleystring.h"
+#include "task_base.h"
 
 namespace Halley
 {
-	using TaskBase = std::function<void()>;
-
 	class ExecutionQueue
 	{
 	public:
 		ExecutionQueue();
-		void addToQueue(TaskBase task);
+		virtual ~ExecutionQueue() {}
+
+		virtual void addToQueue(TaskBase task);
 
-		TaskBase getNext();
-		std::vector<TaskBase> getAll();
+		virtual TaskBase getNext();
+		virtual std::vector<TaskBase> getAll();
 
 		size_t threadCount() const;
-		void onAttached();
-		void onDetached();
-		void abort();
+		virtual void onAttached();
+		virtual void onDetached();
+		virtual void onThreadStarted() {}
+		virtual void onThreadStopped() {}
+		virtual void abort();
 
 		static ExecutionQueue& getDefault();
 
+	protected:
+		std::atomic<int> attachedCount;
+		std::atomic<bool> aborted;
+
 	private:
 		std::deque<TaskBase> queue;
 		std::mutex mutex;
 		std::condition_variable condition;
 
-		std::atomic<int> attachedCount;
 		std::atomic<bool> hasTasks;
-		std::atomic<bool> aborted;
+	};
+
+	// Queue with one Chase-Lev deque per worker thread. Tasks queued from a worker thread go into its own deque,
+	// so child tasks run on the same worker (LIFO) unless idle workers steal them. Tasks queued from other threads
+	// are distributed round-robin between per-worker inboxes.
+	class WorkStealingQueue : public ExecutionQueue
+	{
+	public:
+		explicit WorkStealingQueue(size_t maxWorkers = 64, size_t dequeCapacity = 512);
+		~WorkStealingQueue();
+
+		void addToQueue(TaskBase task) override;
+
+		TaskBase getNext() override;
+		std::vector<TaskBase> getAll() override;
+
+		void onAttached() override;
+		void onThreadStarted() override;
+		void onThreadStopped() override;
+		void abort() override;
+
+		bool isWorkerThread() const;
+
+	private:
+		class Worker;
+
+		const size_t dequeCapacity;
+		std::vector<std::unique_ptr<Worker>> workers;
+		std::atomic<size_t> nWorkers;
+		std::atomic<size_t> nextInbox;
+		std::mutex registrationMutex;
+
+		std::atomic<int64_t> pending;
+		std::atomic<int> nSleeping;
+		std::mutex sleepMutex;
+		std::condition_variable sleepCondition;
+
+		std::mutex injectionMutex;
+		std::deque<TaskBase> injection;
+		std::atomic<size_t> injectionCount;
+
+		Worker* getCurrentWorker() const;
+		bool tryGetTask(Worker* self, TaskBase& task);
+		void onTaskAdded();
 	};
 
 	class Executors
@@ -53,8 +103,8 @@ namespace Halley
 	private:
 		static Executors* instance;
 
-		ExecutionQueue cpu;
-		ExecutionQueue cpuAux;
+		WorkStealingQueue cpu;
+		WorkStealingQueue cpuAux;
 		ExecutionQueue videoAux;
 		ExecutionQueue mainThread;
 		ExecutionQueue diskIO;
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Halley
+{
+	// Type-erased, move-only void() callable.
+	// Callables up to inlineSize bytes are stored in place, so queueing them doesn't touch the heap.
+	class TaskBase
+	{
+	public:
+		constexpr static size_t inlineSize = 96;
+
+		TaskBase() = default;
+
+		template <typename F, typename std::enable_if<!std::is_same<typename std::decay<F>::type, TaskBase>::value, int>::type = 0>
+		TaskBase(F&& f)
+		{
+			using T = typename std::decay<F>::type;
+			constexpr bool fitsInline = sizeof(T) <= inlineSize && alignof(T) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<T>::value;
+			construct<T>(std::forward<F>(f), std::integral_constant<bool, fitsInline>());
+		}
+
+		TaskBase(TaskBase&& other) noexcept
+		{
+			moveFrom(other);
+		}
+
+		TaskBase& operator=(TaskBase&& other) noexcept
+		{
+			if (this != &other) {
+				reset();
+				moveFrom(other);
+			}
+			return *this;
+		}
+
+		TaskBase(const TaskBase& other) = delete;
+		TaskBase& operator=(const TaskBase& other) = delete;
+
+		~TaskBase()
+		{
+			reset();
+		}
+
+		void operator()()
+		{
+			vtable->invoke(&storage);
+		}
+
+		explicit operator bool() const
+		{
+			return vtable != nullptr;
+		}
+
+		bool isInline() const
+		{
+			return vtable != nullptr && vtable->isInline;
+		}
+
+		void reset()
+		{
+			if (vtable) {
+				vtable->destroy(&storage);
+				vtable = nullptr;
+			}
+		}
+
+	private:
+		struct VTable
+		{
+			void (*invoke)(void* storage);
+			void (*move)(void* dst, void* src);
+			void (*destroy)(void* storage);
+			bool isInline;
+		};
+
+		template <typename T>
+		struct InlineOps
+		{
+			static void invoke(void* s) { (*static_cast<T*>(s))(); }
+			static void move(void* dst, void* src) { new (dst) T(std::move(*static_cast<T*>(src))); static_cast<T*>(src)->~T(); }
+			static void destroy(void* s) { static_cast<T*>(s)->~T(); }
+			constexpr static VTable vtable = { &invoke, &move, &destroy, true };
+		};
+
+		template <typename T>
+		struct HeapOps
+		{
+			static T*& get(void* s) { return *static_cast<T**>(s); }
+			static void invoke(void* s) { (*get(s))(); }
+			static void move(void* dst, void* src) { new (dst) T*(get(src)); }
+			static void destroy(void* s) { delete get(s); }
+			constexpr static VTable vtable = { &invoke, &move, &destroy, false };
+		};
+
+		template <typename T, typename F>
+		void construct(F&& f, std::true_type)
+		{
+			new (&storage) T(std::forward<F>(f));
+			vtable = &InlineOps<T>::vtable;
+		}
+
+		template <typename T, typename F>
+		void construct(F&& f, std::false_type)
+		{
+			new (&storage) T*(new T(std::forward<F>(f)));
+			vtable = &HeapOps<T>::vtable;
+		}
+
+		void moveFrom(TaskBase& other)
+		{
+			if (other.vtable) {
+				other.vtable->move(&storage, &other.storage);
+				vtable = other.vtable;
+				other.vtable = nullptr;
+			}
+		}
+
+		typename std::aligned_storage<inlineSize, alignof(std::max_align_t)>::type storage;
+		const VTable* vtable = nullptr;
+	};
+
+	template <typename T> constexpr TaskBase::VTable TaskBase::InlineOps<T>::vtable;
+	template <typename T> constexpr TaskBase::VTable TaskBase::HeapOps<T>::vtable;
+}
@@ -52,10 +52,33 @@ namespace Halley
 		void* data;
 	};
 
+	class BinPackSearchResult
+	{
+	public:
+		BinPackSearchResult(Vector2i binSize, Vector<BinPackResult> results)
+			: binSize(binSize)
+			, results(std::move(results))
+		{}
+
+		Vector2i binSize;
+		Vector<BinPackResult> results;
+	};
+
 	class BinPack
 	{
 	public:
 		static boost::optional<Vector<BinPackResult>> pack(const std::vector<BinPackEntry>& entries, Vector2i binSize);
 		static boost::optional<Vector<BinPackResult>> fastPack(const std::vector<BinPackEntry>& entries, Vector2i binSize);
+
+		// MaxRects: entries are placed largest first, each in the free space where it leaves the shortest side over, rotated
+		// if they can be and that fits better. The result only depends on the entries and their order.
+		static boost::optional<Vector<BinPackResult>> maxRectsPack(const std::vector<BinPackEntry>& entries, Vector2i binSize);
+
+		// Whether the entries could fit binSize at all, going only by their sizes and total area
+		static bool canFit(const std::vector<BinPackEntry>& entries, Vector2i binSize);
+
+		// Packs with maxRectsPack into the first of candidateSizes (smallest first) that fits. Sizes that canFit rules out are
+		// skipped without packing, and the others are tried a few at a time in parallel on the CPU aux queue.
+		static boost::optional<BinPackSearchResult> packSmallest(const std::vector<BinPackEntry>& entries, const std::vector<Vector2i>& candidateSizes);
 	};
 }
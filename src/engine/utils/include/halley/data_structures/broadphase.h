@@ -0,0 +1,246 @@
+#pragma once
+
+#include "vector.h"
+#include "halley/maths/rect.h"
+#include "halley/maths/vector2.h"
+#include <gsl/gsl>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <algorithm>
+
+namespace Halley {
+	// Open addressing map from integer keys to indices, with linear probing and backward shift deletion, so it never leaves tombstones
+	template <typename K>
+	class FlatIndexMap {
+	public:
+		constexpr static uint32_t none = std::numeric_limits<uint32_t>::max();
+
+		uint32_t find(K key) const
+		{
+			if (count == 0) {
+				return none;
+			}
+			for (size_t i = getHome(key); ; i = (i + 1) & mask) {
+				if (values[i] == none) {
+					return none;
+				}
+				if (keys[i] == key) {
+					return values[i];
+				}
+			}
+		}
+
+		void set(K key, uint32_t value)
+		{
+			if ((count + 1) * 4 > keys.size() * 3) {
+				rehash(std::max(keys.size() * 2, size_t(16)));
+			}
+			size_t i = getHome(key);
+			for (; values[i] != none; i = (i + 1) & mask) {
+				if (keys[i] == key) {
+					values[i] = value;
+					return;
+				}
+			}
+			keys[i] = key;
+			values[i] = value;
+			++count;
+		}
+
+		bool erase(K key)
+		{
+			if (count == 0) {
+				return false;
+			}
+			size_t i = getHome(key);
+			for (; keys[i] != key || values[i] == none; i = (i + 1) & mask) {
+				if (values[i] == none) {
+					return false;
+				}
+			}
+
+			// Pull back any entry further along the run that would otherwise become unreachable
+			for (size_t j = (i + 1) & mask; values[j] != none; j = (j + 1) & mask) {
+				const size_t home = getHome(keys[j]);
+				if (((j - home) & mask) >= ((j - i) & mask)) {
+					keys[i] = keys[j];
+					values[i] = values[j];
+					i = j;
+				}
+			}
+			values[i] = none;
+			--count;
+			return true;
+		}
+
+		void reserve(size_t n)
+		{
+			if (n * 4 > keys.size() * 3) {
+				size_t size = 16;
+				while (n * 4 > size * 3) {
+					size *= 2;
+				}
+				rehash(size);
+			}
+		}
+
+		void clear()
+		{
+			std::fill(values.begin(), values.end(), none);
+			count = 0;
+		}
+
+		size_t size() const { return count; }
+
+	private:
+		Vector<K> keys;
+		Vector<uint32_t> values;
+		size_t mask = 0;
+		size_t count = 0;
+
+		size_t getHome(K key) const
+		{
+			// splitmix64 finaliser, as keys are often small or sequential
+			uint64_t x = uint64_t(key);
+			x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+			x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+			x = x ^ (x >> 31);
+			return size_t(x) & mask;
+		}
+
+		void rehash(size_t size)
+		{
+			Vector<K> oldKeys = std::move(keys);
+			Vector<uint32_t> oldValues = std::move(values);
+			keys.assign(size, K());
+			values.assign(size, none);
+			mask = size - 1;
+			count = 0;
+			for (size_t i = 0; i < oldKeys.size(); ++i) {
+				if (oldValues[i] != none) {
+					set(oldKeys[i], oldValues[i]);
+				}
+			}
+		}
+	};
+
+	template <typename K>
+	constexpr uint32_t FlatIndexMap<K>::none;
+
+	// Grid broadphase for rectangles identified by an integer.
+	// Each rect is listed, by index, in every cell it overlaps, so moving one only touches the cells it enters or leaves.
+	// Results are deduplicated without any shared scratch state: an overlap is only reported from the cell holding the top-left corner of the intersection.
+	// All const methods are safe to call from any number of threads at once (e.g. within System::invokeParallel), as long as nothing is modified meanwhile.
+	class Broadphase {
+	public:
+		using DataType = int;
+
+		struct Update {
+			DataType data;
+			Rect4i rect;
+		};
+
+		// Resolution is the grid size, given in 2^resolution units.
+		// Lower values = finer resolution.
+		// Recommended: a value of around 7 (128x128)
+		explicit Broadphase(int resolution = 7);
+
+		// Returns false if data was already present, in which case its rect is updated
+		bool add(Rect4i rect, DataType data);
+		bool remove(DataType data);
+		// Adds data if it's not present yet, returning whether it was
+		bool update(Rect4i rect, DataType data);
+		void update(gsl::span<const Update> updates);
+		void clear();
+
+		bool contains(DataType data) const;
+		Rect4i getRect(DataType data) const;
+		size_t size() const;
+
+		// Appends every data whose rect overlaps rect, once each. Empty rects are never found.
+		void query(Rect4i rect, Vector<DataType>& results) const;
+		// Appends every pair of overlapping rects, once each
+		void getOverlappingPairs(Vector<std::pair<DataType, DataType>>& results) const;
+
+		template <typename F>
+		void forEachInRect(Rect4i rect, F f) const
+		{
+			const auto c0 = pointToCell(rect.getTopLeft());
+			const auto c1 = pointToCell(rect.getBottomRight());
+			for (int y = c0.y; y <= c1.y; ++y) {
+				for (int x = c0.x; x <= c1.x; ++x) {
+					const auto cellIdx = cellIndices.find(getCellKey(x, y));
+					if (cellIdx == FlatIndexMap<uint64_t>::none) {
+						continue;
+					}
+					for (auto idx: cells[cellIdx]) {
+						auto& e = entries[idx];
+						if (e.rect.overlaps(rect) && isFirstSharedCell(x, y, e.rect, rect)) {
+							f(e.data);
+						}
+					}
+				}
+			}
+		}
+
+		// Calls f(a, b) for each overlapping pair, once each
+		template <typename F>
+		void forEachOverlappingPair(F f) const
+		{
+			for (size_t c = 0; c < cells.size(); ++c) {
+				const auto& cell = cells[c];
+				const auto pos = cellPositions[c];
+				const size_t n = cell.size();
+				for (size_t i = 0; i < n; ++i) {
+					auto& a = entries[cell[i]];
+					for (size_t j = i + 1; j < n; ++j) {
+						auto& b = entries[cell[j]];
+						if (a.rect.overlaps(b.rect) && isFirstSharedCell(pos.x, pos.y, a.rect, b.rect)) {
+							f(a.data, b.data);
+						}
+					}
+				}
+			}
+		}
+
+	private:
+		struct Entry {
+			Rect4i rect;
+			Vector2i cell0; // Range of cells it's listed in, inclusive
+			Vector2i cell1;
+			DataType data;
+			bool inGrid;
+		};
+
+		int resolution;
+
+		Vector<Entry> entries;
+		Vector<uint32_t> freeEntries;
+		FlatIndexMap<DataType> entryIndices;
+
+		Vector<Vector<uint32_t>> cells;
+		Vector<Vector2i> cellPositions;
+		FlatIndexMap<uint64_t> cellIndices;
+
+		Vector2i pointToCell(Vector2i point) const
+		{
+			return Vector2i(point.x >> resolution, point.y >> resolution);
+		}
+
+		static uint64_t getCellKey(int x, int y)
+		{
+			return (uint64_t(uint32_t(x)) << 32) | uint64_t(uint32_t(y));
+		}
+
+		bool isFirstSharedCell(int x, int y, Rect4i a, Rect4i b) const
+		{
+			const auto corner = pointToCell(Vector2i(std::max(a.getLeft(), b.getLeft()), std::max(a.getTop(), b.getTop())));
+			return corner.x == x && corner.y == y;
+		}
+
+		void setRect(Entry& entry, uint32_t idx, Rect4i rect);
+		Vector<uint32_t>& getCell(int x, int y);
+		void removeFromCell(int x, int y, uint32_t idx);
+	};
+}
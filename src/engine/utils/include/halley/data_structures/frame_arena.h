@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+#include "vector.h"
+
+namespace Halley {
+	struct FrameArenaStats {
+		size_t bytes = 0;
+		size_t allocations = 0;
+	};
+
+	// Bump allocator for temporaries that live for a frame or so. Each thread has its own arena, so allocating never takes a lock.
+	// Core calls beginFrame() at the start of each frame. Anything allocated during a frame stays valid until the end of the next one,
+	// so it can be handed to the render thread, and then the memory is reused. Nothing is ever freed on its own.
+	class FrameArena {
+	public:
+		constexpr static size_t blockSize = 64 * 1024;
+
+		// The calling thread's arena
+		static FrameArena& get();
+
+		static void beginFrame();
+		// False until beginFrame is first called, e.g. in tools that don't run Core's main loop
+		static bool isActive();
+		// Totals over every thread, for the last frame that ended
+		static FrameArenaStats getLastFrameStats();
+
+		~FrameArena();
+		FrameArena(const FrameArena& other) = delete;
+		FrameArena& operator=(const FrameArena& other) = delete;
+
+		void* alloc(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	private:
+		struct Half {
+			Vector<char*> blocks; // All blockSize long, kept between frames
+			Vector<char*> largeBlocks; // For allocations that don't fit a block, freed on rewind
+			size_t curBlock = 0;
+			size_t used = 0; // Bytes used in blocks[curBlock]
+		};
+
+		std::array<Half, 2> halves;
+		size_t cur = 0;
+		uint64_t frame = 0;
+
+		// Added to by the owning thread, collected by beginFrame
+		std::atomic<size_t> bytes;
+		std::atomic<size_t> allocations;
+
+		FrameArena();
+		void flip(uint64_t now);
+		void rewind(Half& half);
+		char* newBlock();
+	};
+
+	// STL allocator drawing from the calling thread's FrameArena. Deallocation does nothing, so reserve up front rather than growing.
+	// Containers using it must not outlive the next frame. Outside of Core's main loop, it falls back to the heap.
+	template <typename T>
+	class FrameAllocator {
+	public:
+		using value_type = T;
+
+		FrameAllocator()
+			: useArena(FrameArena::isActive())
+		{}
+
+		template <typename U>
+		FrameAllocator(const FrameAllocator<U>& other)
+			: useArena(other.useArena)
+		{}
+
+		T* allocate(size_t n)
+		{
+			if (useArena) {
+				return static_cast<T*>(FrameArena::get().alloc(n * sizeof(T), alignof(T)));
+			}
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+		}
+
+		void deallocate(T* p, size_t)
+		{
+			if (!useArena) {
+				::operator delete(p);
+			}
+		}
+
+		template <typename U>
+		bool operator==(const FrameAllocator<U>& other) const { return useArena == other.useArena; }
+		template <typename U>
+		bool operator!=(const FrameAllocator<U>& other) const { return useArena != other.useArena; }
+
+	private:
+		template <typename U> friend class FrameAllocator;
+		bool useArena;
+	};
+
+	template <typename T> using FrameVector = std::vector<T, FrameAllocator<T>>;
+}
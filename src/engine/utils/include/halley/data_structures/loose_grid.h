@@ -0,0 +1,105 @@
+#pragma once
+
+#include "vector.h"
+#include "halley/maths/rect.h"
+#include "halley/maths/vector2.h"
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+
+namespace Halley {
+	// Spatial index of rectangles that move around, e.g. sprites.
+	// Each rect is filed in the one cell containing its centre, so it can be updated in place for as long as it stays in that cell.
+	// Rects bigger than a cell (or too far away from everything else) are kept in a separate list that every query checks.
+	// Queries don't modify anything, so any number of threads can run them at once, as long as nothing is added, updated or removed meanwhile.
+	class LooseGrid {
+	public:
+		using Handle = uint32_t;
+		constexpr static Handle invalidHandle = std::numeric_limits<Handle>::max();
+
+		// Cells should be about as big as the largest common rect
+		explicit LooseGrid(float cellSize = 256.0f);
+
+		Handle add(Rect4f rect);
+		void update(Handle handle, Rect4f rect);
+		void remove(Handle handle);
+		void clear();
+
+		Rect4f getRect(Handle handle) const;
+		size_t size() const;
+		float getCellSize() const;
+
+		// Appends the handle of every rect overlapping area to results
+		void query(Rect4f area, Vector<Handle>& results) const;
+
+		template <typename F>
+		void forEachInArea(Rect4f area, F f) const
+		{
+			for (auto handle: oversized) {
+				if (items[handle].rect.overlaps(area)) {
+					f(handle);
+				}
+			}
+			if (gridSize.x == 0) {
+				return;
+			}
+
+			// Rects can stick out of their cell by up to half a cell
+			const auto margin = Vector2f(cellSize, cellSize) * 0.5f;
+			const auto c0 = getCellCoords(area.getTopLeft() - margin) - gridOrigin;
+			const auto c1 = getCellCoords(area.getBottomRight() + margin) - gridOrigin;
+			const int x0 = std::max(c0.x, 0);
+			const int y0 = std::max(c0.y, 0);
+			const int x1 = std::min(c1.x, gridSize.x - 1);
+			const int y1 = std::min(c1.y, gridSize.y - 1);
+			for (int y = y0; y <= y1; ++y) {
+				for (int x = x0; x <= x1; ++x) {
+					for (auto handle: cells[size_t(x + y * gridSize.x)]) {
+						if (items[handle].rect.overlaps(area)) {
+							f(handle);
+						}
+					}
+				}
+			}
+		}
+
+	private:
+		constexpr static uint32_t oversizedCell = std::numeric_limits<uint32_t>::max();
+		constexpr static uint32_t freeCell = oversizedCell - 1;
+		constexpr static int64_t maxCells = 256 * 1024;
+
+		struct Item {
+			Rect4f rect;
+			uint32_t cell;
+			uint32_t slot; // Position in the cell's (or oversized) list
+		};
+
+		float cellSize;
+		float invCellSize;
+
+		Vector<Item> items;
+		Vector<Handle> freeHandles;
+		size_t count = 0;
+
+		Vector<Vector<Handle>> cells;
+		Vector<Handle> oversized;
+		Vector2i gridOrigin;
+		Vector2i gridSize;
+
+		Vector2i getCellCoords(Vector2f point) const
+		{
+			// Clamped so that huge or infinite rects don't overflow
+			const float limit = float(1 << 30);
+			const float x = std::max(-limit, std::min(std::floor(point.x * invCellSize), limit));
+			const float y = std::max(-limit, std::min(std::floor(point.y * invCellSize), limit));
+			return Vector2i(int(x), int(y));
+		}
+
+		uint32_t getCellFor(Rect4f rect);
+		bool growToFit(Vector2i cell);
+		void insert(Handle handle, uint32_t cell);
+		void erase(Handle handle);
+		Vector<Handle>& getList(uint32_t cell);
+	};
+}
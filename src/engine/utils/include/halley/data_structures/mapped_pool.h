@@ -22,64 +22,87 @@
 \*****************************************************************/
 
 #include <cstdint>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <new>
+#include <type_traits>
+#include "halley/support/exception.h"
 
 namespace Halley {
+	// Pool of T, addressed by 64-bit ids made of an index and a revision, so ids of freed entries never match whatever reuses them.
+	// Blocks never move and the block table never grows, so get() and allocConcurrent() are safe to call while other threads reserve entries.
+	// Everything else (alloc, free) must only be called from one thread at a time, and not while get() is being called on the freed id.
 	template <typename T, size_t blockLen = 16384>
 	class MappedPool {
+		static_assert(std::is_trivially_destructible<T>::value, "Values are never destroyed");
+
 		struct Entry {
 			alignas(T) std::array<char, sizeof(T)> data;
 			uint32_t nextFreeEntryIndex;
 			uint32_t revision;
 		};
 
-		struct Block {
-			Vector<Entry> data;
-
-			Block(size_t blockIndex)
-				: data(blockLen)
-			{
-				size_t base = blockIndex * blockLen;
-				for (size_t i = 0; i < blockLen; i++) {
-					// Each entry points to the next
-					data[i].nextFreeEntryIndex = static_cast<uint32_t>(i + 1 + base);
-					data[i].revision = 0;
-				}
+		constexpr static size_t maxBlocks = 4096;
+		constexpr static uint32_t noFreeEntry = 0xFFFFFFFFu;
+
+	public:
+		MappedPool()
+			: blocks(new std::atomic<Entry*>[maxBlocks])
+		{
+			for (size_t i = 0; i < maxBlocks; ++i) {
+				blocks[i] = nullptr;
+			}
+		}
+
+		~MappedPool()
+		{
+			for (size_t i = 0; i < maxBlocks; ++i) {
+				delete[] blocks[i].load();
 			}
+		}
 
-			Block(const Block& other) = delete;
-			Block& operator=(const Block& other) = delete;
-			Block(Block&& other) = default;
-			Block& operator=(Block&& other) = default;
-		};
+		MappedPool(const MappedPool& other) = delete;
+		MappedPool& operator=(const MappedPool& other) = delete;
 
-	public:
 		std::pair<T*, int64_t> alloc() {
-			// Next entry will be at position "entryIdx", which is just what was stored on next
+			// Reuse freed entries first, otherwise take one that has never been used
 			uint32_t entryIdx = next;
-
-			// Figure which block it goes into, and make sure that exists
-			size_t blockIdx = entryIdx / blockLen;
-			if (blockIdx >= blocks.size()) {
-				blocks.push_back(Block(blocks.size()));
+			if (entryIdx != noFreeEntry) {
+				auto& data = getEntry(entryIdx);
+				next = data.nextFreeEntryIndex;
+				return use(entryIdx, data);
+			} else {
+				return allocConcurrent();
 			}
-			auto& block = blocks[blockIdx];
-
-			// Find the local entry inside that block and initialize it
-			size_t localIdx = entryIdx % blockLen;
-			auto& data = block.data[localIdx];
-			int rev = data.revision;
-			T* result = reinterpret_cast<T*>(&(data.data));
+		}
 
-			// Next block is what was stored on the nextFreeEntryIndex
-			std::swap(next, block.data[localIdx].nextFreeEntryIndex);
+		// Allocates n entries in one go, calling f(T*, int64_t) for each
+		template <typename F>
+		void alloc(size_t n, F f) {
+			size_t i = 0;
+			for (; i < n && next != noFreeEntry; ++i) {
+				auto result = alloc();
+				f(result.first, result.second);
+			}
+			if (i < n) {
+				const uint32_t first = reserveFresh(n - i);
+				for (uint32_t idx = first; i < n; ++i, ++idx) {
+					auto result = use(idx, getEntry(idx));
+					f(result.first, result.second);
+				}
+			}
+		}
 
-			// External index composes the revision with the index, so it's unique, but easily mappable
-			int64_t externalIdx = static_cast<int64_t>(entryIdx) | (static_cast<int64_t>(rev & 0x7FFFFFFF) << 32); // TODO: compute properly
-			return std::pair<T*, int64_t>(result, externalIdx);
+		// Thread-safe, but never reuses freed entries. The value is zero-initialised.
+		std::pair<T*, int64_t> allocConcurrent() {
+			const uint32_t entryIdx = reserveFresh(1);
+			return use(entryIdx, getEntry(entryIdx));
 		}
 
 		void free(T* p) {
-			// Swaps the data with the next, so this will actually be the next one to be allocated
+			// Allocated entries store their own index, so this can be pushed at the front of the free list
 			Entry* entry = reinterpret_cast<Entry*>(p);
 			std::swap(entry->nextFreeEntryIndex, next);
 
@@ -91,20 +114,20 @@ namespace Halley {
 			free(get(externalIdx));
 		}
 
-		T* get(int64_t externalIdx) {
+		T* get(int64_t externalIdx) const {
 			auto idx = static_cast<uint32_t>(externalIdx & 0xFFFFFFFFll);
 			auto rev = static_cast<uint32_t>(externalIdx >> 32);
 
-			int blockN = idx / blockLen;
-			if (blockN < 0 || blockN >= int(blocks.size())) {
+			const size_t blockN = idx / blockLen;
+			if (blockN >= maxBlocks) {
+				return nullptr;
+			}
+			Entry* block = blocks[blockN].load(std::memory_order_acquire);
+			if (!block) {
 				return nullptr;
 			}
 
-			// TODO: check if can shrink?
-
-			auto& block = blocks[blockN];
-			int localIdx = idx % blockLen;
-			auto& data = block.data[localIdx];
+			auto& data = block[idx % blockLen];
 			if (data.revision != rev) {
 				return nullptr;
 			}
@@ -112,7 +135,48 @@ namespace Halley {
 		}
 
 	private:
-		Vector<Block> blocks;
-		uint32_t next = 0;
+		std::unique_ptr<std::atomic<Entry*>[]> blocks;
+		std::atomic<uint32_t> fresh { 0 }; // Entries from here on have never been allocated
+		uint32_t next = noFreeEntry; // Head of the list of freed entries
+
+		uint32_t reserveFresh(size_t n) {
+			const uint32_t first = fresh.fetch_add(uint32_t(n));
+			const size_t lastBlock = (size_t(first) + n - 1) / blockLen;
+			if (lastBlock >= maxBlocks) {
+				throw Exception("MappedPool is full", HalleyExceptions::Utils);
+			}
+			for (size_t b = first / blockLen; b <= lastBlock; ++b) {
+				makeBlock(b);
+			}
+			return first;
+		}
+
+		void makeBlock(size_t blockN) {
+			if (blocks[blockN].load(std::memory_order_acquire)) {
+				return;
+			}
+
+			// Zeroed, so never allocated entries read as revision 0 holding a zeroed T
+			Entry* block = new Entry[blockLen]();
+			Entry* expected = nullptr;
+			if (!blocks[blockN].compare_exchange_strong(expected, block, std::memory_order_acq_rel)) {
+				// Another thread got there first
+				delete[] block;
+			}
+		}
+
+		Entry& getEntry(uint32_t idx) const {
+			return blocks[idx / blockLen].load(std::memory_order_acquire)[idx % blockLen];
+		}
+
+		std::pair<T*, int64_t> use(uint32_t entryIdx, Entry& data) {
+			data.nextFreeEntryIndex = entryIdx;
+			new (&data.data) T();
+			T* result = reinterpret_cast<T*>(&(data.data));
+
+			// External index composes the revision with the index, so it's unique, but easily mappable
+			int64_t externalIdx = static_cast<int64_t>(entryIdx) | (static_cast<int64_t>(data.revision & 0x7FFFFFFF) << 32);
+			return std::pair<T*, int64_t>(result, externalIdx);
+		}
 	};
 }
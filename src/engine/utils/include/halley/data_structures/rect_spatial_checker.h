@@ -1,11 +1,11 @@
 #pragma once
 
-#include "dynamic_grid.h"
+#include "broadphase.h"
 #include "halley/maths/rect.h"
 #include "vector.h"
-#include "hash_map.h"
 
 namespace Halley {
+	// Kept for compatibility; new code should use Broadphase directly, which can also be queried from several threads at once
 	class RectangleSpatialChecker {
 	public:
 		typedef int DataType;
@@ -24,28 +24,11 @@ namespace Halley {
 		bool remove(DataType data);
 		bool update(Rect4i rect, DataType data);
 
+		// Results are only valid until the next query
 		QueryResults query(Rect4i rect);
 
 	private:
-		struct Entry {
-			Rect4i rect;
-			DataType data;
-			int hashMask;
-		};
-
-		HashMap<DataType, Entry> entries;
+		Broadphase broadphase;
 		Vector<DataType> resultsBuffer;
-		int sweep = 0;
-
-		int resolution;
-
-		typedef Vector<Entry> GridCell;
-		DynamicGrid<GridCell> grid;
-
-		void resetSweep();
-		Vector2i pointToCell(Vector2i point) const;
-		GridCell& getGridCell(int x, int y);
-
-		bool updateData(Entry& entry, Rect4i prev, Rect4i next);
 	};
 }
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <gsl/gsl>
+#include "halley/resources/resource_data.h"
+
+namespace Halley
+{
+	class Path;
+	class MemoryMappedFilePimpl;
+
+	// Read-only view of a whole file, mapped into memory where the platform allows it.
+	// If the mapping fails (e.g. no address space for it), reads fall back to positional file reads.
+	// Reads never touch shared state, so a single instance can be used from any number of threads.
+	class MemoryMappedFile
+	{
+	public:
+		// Returns nullptr if the file can't be opened, or this platform doesn't support it
+		static std::shared_ptr<MemoryMappedFile> open(const Path& path);
+		~MemoryMappedFile();
+
+		size_t getSize() const;
+		bool isMapped() const;
+
+		// Empty if the file isn't mapped
+		gsl::span<const gsl::byte> getSpan() const;
+
+		size_t read(size_t pos, gsl::span<gsl::byte> dst) const;
+		void advise(size_t pos, size_t size, ResourceDataAccessHint hint) const;
+
+	private:
+		explicit MemoryMappedFile(std::unique_ptr<MemoryMappedFilePimpl> pimpl);
+
+		std::unique_ptr<MemoryMappedFilePimpl> pimpl;
+	};
+
+	class MemoryMappedFileReader : public ResourceDataReader
+	{
+	public:
+		explicit MemoryMappedFileReader(std::shared_ptr<MemoryMappedFile> file);
+
+		size_t size() const override;
+		int read(gsl::span<gsl::byte> dst) override;
+		void seek(int64_t pos, int whence) override;
+		size_t tell() const override;
+		void close() override;
+
+		bool supportsReadAt() const override;
+		int readAt(size_t pos, gsl::span<gsl::byte> dst) override;
+		std::shared_ptr<const char> getMappedData() override;
+		void adviseAccess(size_t pos, size_t size, ResourceDataAccessHint hint) override;
+
+	private:
+		std::shared_ptr<MemoryMappedFile> file;
+		size_t curPos = 0;
+	};
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Halley
+{
+	// Maps colours to palette indices with a perfect hash (hash and displace): each colour's bucket says how far to move it
+	// from where it hashes to, so that no two colours end up in the same slot, and a lookup is a single probe
+	class ImagePaletteTable
+	{
+	public:
+		constexpr static uint32_t notFound = 0xFFFFFFFFu;
+
+		// Colours must be unique
+		explicit ImagePaletteTable(const std::vector<std::pair<uint32_t, uint32_t>>& colourToIndex);
+
+		uint32_t getSlot(uint32_t colour) const
+		{
+			const uint32_t bucket = (colour * bucketMultiplier) >> bucketShift;
+			return (((colour * slotMultiplier) >> slotShift) + displacements[bucket]) & slotMask;
+		}
+
+		uint32_t lookup(uint32_t colour) const
+		{
+			const uint32_t slot = getSlot(colour);
+			return keys[slot] == colour ? values[slot] : notFound;
+		}
+
+		const uint32_t* getKeys() const { return keys.data(); }
+		const uint32_t* getValues() const { return values.data(); }
+		const uint32_t* getDisplacements() const { return displacements.data(); }
+		uint32_t getBucketMultiplier() const { return bucketMultiplier; }
+		uint32_t getBucketShift() const { return bucketShift; }
+		uint32_t getSlotMultiplier() const { return slotMultiplier; }
+		uint32_t getSlotShift() const { return slotShift; }
+		uint32_t getSlotMask() const { return slotMask; }
+
+	private:
+		std::vector<uint32_t> keys;
+		std::vector<uint32_t> values; // notFound in empty slots, whose key doesn't matter
+		std::vector<uint32_t> displacements;
+		uint32_t bucketMultiplier = 0;
+		uint32_t bucketShift = 0;
+		uint32_t slotMultiplier = 0;
+		uint32_t slotShift = 0;
+		uint32_t slotMask = 0;
+
+		bool tryBuild(const std::vector<std::pair<uint32_t, uint32_t>>& colourToIndex, uint32_t nSlotsLog2, uint32_t seed);
+	};
+
+	// Kernels for the per-pixel loops in Image and the image importers, on rows of RGBA pixels (one uint32_t each, with alpha
+	// on the top byte). The base class is the scalar reference; get() returns the fastest one this CPU supports.
+	class ImageOps
+	{
+	public:
+		virtual ~ImageOps() {}
+
+		static const ImageOps& get();
+		static const ImageOps& getScalar();
+		static std::vector<const ImageOps*> getAvailable(); // Scalar first
+
+		virtual const char* getName() const { return "scalar"; }
+
+		virtual void fill(uint32_t* dst, size_t n, uint32_t colour) const;
+
+		// White pixels, with the alpha from src
+		virtual void expandAlpha(uint32_t* dst, const uint8_t* src, size_t n) const;
+
+		// Writes a w x h block of dst, rotated 90 degrees clockwise from src: dst(x, y) = src(y, w - 1 - x)
+		virtual void rotate(uint32_t* dst, size_t dstPitch, const uint32_t* src, size_t srcPitch, size_t w, size_t h) const;
+
+		// Finds the first and last pixels with any alpha. Returns false if there are none.
+		virtual bool findAlphaRange(const uint32_t* src, size_t n, size_t& first, size_t& last) const;
+
+		// Draws src over dst, with its alpha scaled by opacity (0 to 255)
+		virtual void blendAlpha(uint32_t* dst, const uint32_t* src, size_t n, uint32_t opacity) const;
+
+		virtual void preMultiply(uint32_t* data, size_t n) const;
+
+		// Returns how many were mapped before one that isn't in the table, or n if they all were
+		virtual size_t mapToPalette(const ImagePaletteTable& table, const uint32_t* src, uint8_t* dst, size_t n) const;
+	};
+}
@@ -9,9 +9,12 @@ namespace Halley {} // Get GitHub to realise this is C++ :3
 #include "bytes/fuzzer.h"
 
 #include "data_structures/bin_pack.h"
+#include "data_structures/broadphase.h"
 #include "data_structures/circular_buffer.h"
 #include "data_structures/dynamic_grid.h"
+#include "data_structures/frame_arena.h"
 #include "data_structures/hash_map.h"
+#include "data_structures/loose_grid.h"
 #include "data_structures/mapped_pool.h"
 #include "data_structures/maybe.h"
 #include "data_structures/maybe_ref.h"
@@ -22,6 +25,7 @@ namespace Halley {} // Get GitHub to realise this is C++ :3
 #include "data_structures/vector.h"
 
 #include "file/directory_monitor.h"
+#include "file/memory_mapped_file.h"
 #include "file/path.h"
 
 #include "file_formats/binary_file.h"
@@ -53,6 +57,7 @@ namespace Halley {} // Get GitHub to realise this is C++ :3
 
 #include "plugin/plugin.h"
 
+#include "resources/asset_id.h"
 #include "resources/metadata.h"
 #include "resources/resource.h"
 #include "resources/resource_data.h"
@@ -62,6 +67,7 @@ namespace Halley {} // Get GitHub to realise this is C++ :3
 #include "support/debug.h"
 #include "support/exception.h"
 #include "support/logger.h"
+#include "support/profiler.h"
 #include "support/redirect_stream.h"
 
 #include "text/encode.h"
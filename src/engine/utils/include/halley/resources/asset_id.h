@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include "halley/text/halleystring.h"
+#include "halley/utils/hash.h"
+
+namespace Halley {
+	// 64-bit hash of an asset's name. The importer checks that no two assets of the same type share one, so they can be
+	// looked up without hashing or comparing names. Hold on to them (e.g. as static or member variables) rather than
+	// making them from a name on every lookup.
+	class AssetId {
+	public:
+		constexpr AssetId() = default;
+		explicit AssetId(const String& name)
+			: value(Hash::hash(gsl::as_bytes(gsl::span<const char>(name.c_str(), name.length()))))
+		{}
+
+		static constexpr AssetId fromValue(uint64_t value)
+		{
+			return AssetId(value, 0);
+		}
+
+		constexpr uint64_t getValue() const { return value; }
+
+		constexpr bool operator==(const AssetId& other) const { return value == other.value; }
+		constexpr bool operator!=(const AssetId& other) const { return value != other.value; }
+		constexpr bool operator<(const AssetId& other) const { return value < other.value; }
+
+	private:
+		uint64_t value = 0;
+
+		constexpr AssetId(uint64_t value, int)
+			: value(value)
+		{}
+	};
+}
+
+namespace std {
+	template<>
+	struct hash<Halley::AssetId>
+	{
+		size_t operator()(const Halley::AssetId& id) const
+		{
+			// Already a good hash
+			return size_t(id.getValue());
+		}
+	};
+}
@@ -29,6 +29,30 @@ namespace Halley
 		Shader
 	};
 
+	template <>
+	struct EnumNames<ImportAssetType> {
+		constexpr std::array<const char*, 16> operator()() const {
+			return{{
+				"undefined",
+				"skip",
+				"codegen",
+				"simpleCopy",
+				"font",
+				"bitmapFont",
+				"image",
+				"texture",
+				"material",
+				"animation",
+				"config",
+				"audio",
+				"audioEvent",
+				"sprite",
+				"spriteSheet",
+				"shader"
+			}};
+		}
+	};
+
 	// This order matters.
 	// Assets which depend on other types should show up on the list AFTER
 	// e.g. since materials depend on shaders, they show after shaders
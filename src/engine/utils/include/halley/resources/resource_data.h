@@ -32,6 +32,11 @@ This file is subject to the terms of halley_license.txt.
 namespace Halley {
 	enum class AssetType;
 
+	enum class ResourceDataAccessHint {
+		Sequential,
+		WillNeed
+	};
+
 	class ResourceDataReader {
 	public:
 		virtual ~ResourceDataReader() {}
@@ -41,6 +46,14 @@ namespace Halley {
 		virtual size_t tell() const = 0;
 		virtual void close() = 0;
 
+		// Positional reads don't move the cursor, and readers that support them allow them from multiple threads at once
+		virtual bool supportsReadAt() const { return false; }
+		virtual int readAt(size_t pos, gsl::span<gsl::byte> dst);
+
+		// Readers whose whole contents are mapped in memory return them here. The pointer keeps the mapping alive.
+		virtual std::shared_ptr<const char> getMappedData() { return {}; }
+		virtual void adviseAccess(size_t pos, size_t size, ResourceDataAccessHint hint) {}
+
 		Bytes readAll();
 	};
 
@@ -59,6 +72,7 @@ namespace Halley {
 	public:
 		ResourceDataStatic(String path);
 		ResourceDataStatic(const void* data, size_t size, String path, bool owning = true);
+		ResourceDataStatic(std::shared_ptr<const char> data, size_t size, String path);
 
 		void set(const void* data, size_t size, bool owning = true);
 		bool isLoaded() const;
@@ -133,6 +147,7 @@ namespace Halley {
 		const HalleyAPI* api;
 		const Metadata* metadata;
 		bool loaded = false;
+		std::unique_ptr<ResourceDataStatic> prefetched; // Already read and inflated by ResourcePreloader
 	};
 
 }
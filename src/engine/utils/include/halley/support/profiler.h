@@ -0,0 +1,92 @@
+#pragma once
+
+#include "halley/text/halleystring.h"
+#include "halley/data_structures/vector.h"
+#include <atomic>
+#include <cstdint>
+
+namespace Halley {
+	struct ProfilerEvent {
+		const char* name;
+		int64_t startNs;
+		int64_t endNs;
+		int depth;
+	};
+
+	struct ProfilerThreadEvents {
+		int threadId = 0;
+		String threadName;
+		Vector<ProfilerEvent> events; // Sorted by start time, so parents come before their children
+	};
+
+	struct ProfilerCapture {
+		int64_t startNs = 0;
+		int64_t endNs = 0;
+		size_t droppedEvents = 0;
+		Vector<ProfilerThreadEvents> threads;
+
+		// In Chrome's trace_event JSON format, which chrome://tracing and Perfetto can open
+		String toChromeTrace() const;
+	};
+
+	// Scoped zone profiler. Each thread records the zones it completes into a ring buffer of its own, without locking,
+	// and Core collects every thread's zones into a capture at the end of each frame.
+	// Zones are only compiled in on DEV_BUILD, and only recorded while the profiler is enabled. Release builds don't name threads
+	// or collect frames either, so no thread ever gets a ring buffer.
+	class Profiler {
+	public:
+		constexpr static size_t eventsPerThread = 16 * 1024;
+		constexpr static int maxDepth = 64;
+
+		static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+		static void setEnabled(bool enabled);
+
+		static void setThreadName(const String& name);
+		// Zone names must outlive any capture they end up in: use string literals, or intern them here
+		static const char* internName(const String& name);
+
+		static void beginZone(const char* name);
+		static void endZone();
+
+		// Makes everything recorded since the previous call the last frame's capture
+		static void endFrame();
+		static ProfilerCapture getLastFrame();
+
+		static int64_t getTimeNs();
+
+	private:
+		static std::atomic<bool> enabled;
+	};
+
+	class ProfilerZone {
+	public:
+		explicit ProfilerZone(const char* name)
+			: active(Profiler::isEnabled())
+		{
+			if (active) {
+				Profiler::beginZone(name);
+			}
+		}
+
+		~ProfilerZone()
+		{
+			if (active) {
+				Profiler::endZone();
+			}
+		}
+
+		ProfilerZone(const ProfilerZone& other) = delete;
+		ProfilerZone& operator=(const ProfilerZone& other) = delete;
+
+	private:
+		bool active;
+	};
+}
+
+#ifdef DEV_BUILD
+	#define HALLEY_PROFILE_ZONE_CONCAT_IMPL(a, b) a##b
+	#define HALLEY_PROFILE_ZONE_CONCAT(a, b) HALLEY_PROFILE_ZONE_CONCAT_IMPL(a, b)
+	#define HALLEY_PROFILE_ZONE(name) Halley::ProfilerZone HALLEY_PROFILE_ZONE_CONCAT(profilerZone, __LINE__)(name)
+#else
+	#define HALLEY_PROFILE_ZONE(name) ((void)0)
+#endif
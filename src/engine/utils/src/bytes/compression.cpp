@@ -1,10 +1,12 @@
 #include <cstdlib>
 #include <memory>
+#include <numeric>
 #include "halley/bytes/compression.h"
 //#include "../../contrib/lodepng/lodepng.h"
 #include "../../contrib/zlib/zlib.h"
 #include "halley/support/exception.h"
 #include "halley/text/string_converter.h"
+#include "halley/concurrency/concurrent.h"
 
 using namespace Halley;
 
@@ -65,11 +67,6 @@ Bytes Compression::compressRaw(gsl::span<const gsl::byte> bytes, bool insertLeng
 
 	const uint64_t inSize = bytes.size_bytes();
 	const size_t headerSize = insertLength ? 8 : 0;
-	Bytes result(size_t(inSize) + headerSize + 16); // Header size, plus 16 bytes for headroom, should be enough for any compression
-
-	if (insertLength) {
-		memcpy(result.data(), &inSize, 8);
-	}
 
 	z_stream stream;
 	stream.zalloc = &zlibAlloc;
@@ -80,6 +77,13 @@ Bytes Compression::compressRaw(gsl::span<const gsl::byte> bytes, bool insertLeng
 		throw Exception("Unable to initialize zlib compression", HalleyExceptions::Compression);
 	}
 
+	// Incompressible data grows slightly, so size the output for the worst case
+	Bytes result(size_t(deflateBound(&stream, uLong(inSize))) + headerSize);
+
+	if (insertLength) {
+		memcpy(result.data(), &inSize, 8);
+	}
+
 	stream.avail_in = uInt(bytes.size_bytes());
 	stream.next_in = reinterpret_cast<unsigned char*>(const_cast<gsl::byte*>(bytes.data()));
 	stream.avail_out = uInt(result.size() - headerSize);
@@ -168,3 +172,171 @@ Bytes Compression::decompressRaw(gsl::span<const gsl::byte> bytes, size_t maxSiz
 		return result;
 	}
 }
+
+void Compression::decompressRaw(gsl::span<const gsl::byte> bytes, gsl::span<gsl::byte> dst)
+{
+	z_stream stream;
+	stream.zalloc = &zlibAlloc;
+	stream.zfree = &zlibFree;
+	stream.opaque = nullptr;
+	stream.avail_in = 0;
+	stream.next_in = nullptr;
+	int ret = inflateInit(&stream);
+	if (ret != Z_OK) {
+		throw Exception("Unable to initialise zlib", HalleyExceptions::Compression);
+	}
+	stream.avail_in = uInt(bytes.size_bytes());
+	stream.next_in = reinterpret_cast<unsigned char*>(const_cast<gsl::byte*>(bytes.data()));
+	stream.avail_out = uInt(dst.size_bytes());
+	stream.next_out = reinterpret_cast<unsigned char*>(dst.data());
+
+	const int res = inflate(&stream, Z_FINISH);
+	const size_t totalOut = size_t(stream.total_out);
+	inflateEnd(&stream);
+
+	if (res != Z_STREAM_END) {
+		throw Exception("Unable to inflate stream.", HalleyExceptions::Compression);
+	}
+	if (totalOut != size_t(dst.size_bytes())) {
+		throw Exception("Unexpected outsize (" + toString(totalOut) + ") when inflating data, expected (" + toString(dst.size_bytes()) + ").", HalleyExceptions::Compression);
+	}
+}
+
+constexpr size_t ChunkedCompression::defaultChunkSize;
+
+ChunkedCompression::Table::Table(gsl::span<const gsl::byte> src)
+{
+	if (size_t(src.size_bytes()) < sizeof(Header)) {
+		throw Exception("Compressed data is truncated.", HalleyExceptions::Compression);
+	}
+	memcpy(&header, src.data(), sizeof(Header));
+
+	const size_t tableSize = getTableSize(header);
+	if (size_t(src.size_bytes()) < tableSize) {
+		throw Exception("Compressed data is truncated.", HalleyExceptions::Compression);
+	}
+	offsets.resize(size_t(header.chunkCount) + 1);
+	memcpy(offsets.data(), src.data() + sizeof(Header), offsets.size() * sizeof(uint64_t));
+
+	for (size_t i = 0; i < header.chunkCount; ++i) {
+		if (offsets[i] > offsets[i + 1]) {
+			throw Exception("Compressed data has an invalid chunk table.", HalleyExceptions::Compression);
+		}
+	}
+}
+
+size_t ChunkedCompression::Table::getTableSize(const Header& header)
+{
+	return sizeof(Header) + (size_t(header.chunkCount) + 1) * sizeof(uint64_t);
+}
+
+size_t ChunkedCompression::Table::getTableSize() const
+{
+	return getTableSize(header);
+}
+
+size_t ChunkedCompression::Table::getChunkStart(size_t chunk) const
+{
+	return getTableSize() + size_t(offsets.at(chunk));
+}
+
+size_t ChunkedCompression::Table::getChunkCompressedSize(size_t chunk) const
+{
+	return size_t(offsets.at(chunk + 1) - offsets.at(chunk));
+}
+
+size_t ChunkedCompression::Table::getChunkUncompressedSize(size_t chunk) const
+{
+	const size_t start = chunk * size_t(header.chunkSize);
+	return std::min(size_t(header.chunkSize), size_t(header.uncompressedSize) - start);
+}
+
+Bytes ChunkedCompression::compress(gsl::span<const gsl::byte> src, CompressionCodec codec, size_t chunkSize)
+{
+	Expects(chunkSize > 0 && chunkSize <= std::numeric_limits<uint32_t>::max());
+
+	Header header;
+	header.uncompressedSize = uint64_t(src.size_bytes());
+	header.chunkSize = uint32_t(chunkSize);
+	header.chunkCount = uint32_t((size_t(src.size_bytes()) + chunkSize - 1) / chunkSize);
+
+	const size_t tableSize = Table::getTableSize(header);
+	Vector<uint64_t> offsets;
+	offsets.reserve(header.chunkCount + 1);
+	Bytes result(tableSize);
+
+	for (size_t i = 0; i < header.chunkCount; ++i) {
+		offsets.push_back(uint64_t(result.size() - tableSize));
+		const auto chunk = src.subspan(i * chunkSize, std::min(chunkSize, size_t(src.size_bytes()) - i * chunkSize));
+		switch (codec) {
+		case CompressionCodec::None:
+			result.insert(result.end(), reinterpret_cast<const Byte*>(chunk.data()), reinterpret_cast<const Byte*>(chunk.data() + chunk.size()));
+			break;
+		case CompressionCodec::Deflate:
+			{
+				auto compressed = Compression::compressRaw(chunk, false);
+				result.insert(result.end(), compressed.begin(), compressed.end());
+			}
+			break;
+		}
+	}
+	offsets.push_back(uint64_t(result.size() - tableSize));
+
+	memcpy(result.data(), &header, sizeof(Header));
+	memcpy(result.data() + sizeof(Header), offsets.data(), offsets.size() * sizeof(uint64_t));
+	return result;
+}
+
+void ChunkedCompression::decompressChunk(gsl::span<const gsl::byte> chunk, CompressionCodec codec, gsl::span<gsl::byte> dst)
+{
+	switch (codec) {
+	case CompressionCodec::None:
+		if (chunk.size() != dst.size()) {
+			throw Exception("Unexpected chunk size.", HalleyExceptions::Compression);
+		}
+		memcpy(dst.data(), chunk.data(), dst.size());
+		break;
+	case CompressionCodec::Deflate:
+		Compression::decompressRaw(chunk, dst);
+		break;
+	default:
+		throw Exception("Unknown compression codec: " + toString(int(codec)), HalleyExceptions::Compression);
+	}
+}
+
+namespace {
+	void decompressChunkAt(const ChunkedCompression::Table& table, size_t i, gsl::span<const gsl::byte> src, CompressionCodec codec, gsl::span<gsl::byte> dst)
+	{
+		const size_t start = table.getChunkStart(i);
+		const size_t size = table.getChunkCompressedSize(i);
+		if (start + size > size_t(src.size_bytes())) {
+			throw Exception("Compressed data is truncated.", HalleyExceptions::Compression);
+		}
+		ChunkedCompression::decompressChunk(src.subspan(start, size), codec, dst.subspan(i * table.getChunkSize(), table.getChunkUncompressedSize(i)));
+	}
+}
+
+void ChunkedCompression::decompress(gsl::span<const gsl::byte> src, CompressionCodec codec, gsl::span<gsl::byte> dst)
+{
+	const Table table(src);
+	if (table.getUncompressedSize() != size_t(dst.size_bytes())) {
+		throw Exception("Decompression target has the wrong size.", HalleyExceptions::Compression);
+	}
+	for (size_t i = 0; i < table.getChunkCount(); ++i) {
+		decompressChunkAt(table, i, src, codec, dst);
+	}
+}
+
+void ChunkedCompression::decompress(gsl::span<const gsl::byte> src, CompressionCodec codec, gsl::span<gsl::byte> dst, ExecutionQueue& queue)
+{
+	const Table table(src);
+	if (table.getUncompressedSize() != size_t(dst.size_bytes())) {
+		throw Exception("Decompression target has the wrong size.", HalleyExceptions::Compression);
+	}
+	Vector<size_t> chunks(table.getChunkCount());
+	std::iota(chunks.begin(), chunks.end(), size_t(0));
+	Concurrent::parallelFor(queue, chunks.begin(), chunks.end(), [&] (size_t i)
+	{
+		decompressChunkAt(table, i, src, codec, dst);
+	}, 1);
+}
@@ -30,3 +30,59 @@ using namespace Halley;
 static thread_local String threadName;
 #endif
 
+
+Concurrent::ParallelForState::ParallelForState(size_t count, size_t grainSize)
+	: count(count)
+	, grainSize(grainSize)
+	, cursor(0)
+	, done(0)
+{
+}
+
+bool Concurrent::ParallelForState::claim(size_t& start, size_t& end)
+{
+	start = cursor.fetch_add(grainSize);
+	if (start >= count) {
+		return false;
+	}
+	end = std::min(start + grainSize, count);
+	return true;
+}
+
+void Concurrent::ParallelForState::onChunkDone(size_t n, std::exception_ptr e)
+{
+	if (e) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (!exception) {
+			exception = e;
+		}
+	}
+
+	if (done.fetch_add(n) + n == count) {
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.notify_all();
+	}
+}
+
+void Concurrent::ParallelForState::wait()
+{
+	// The remaining chunks are already running on other threads, so they'll usually finish very soon
+	for (int i = 0; i < 64 && done.load() < count; ++i) {
+		std::this_thread::yield();
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (done.load() < count) {
+		condition.wait(lock);
+	}
+	if (exception) {
+		std::rethrow_exception(exception);
+	}
+}
+
+size_t Concurrent::getParallelForGrainSize(size_t count, size_t nThreads)
+{
+	// Aim for several chunks per thread, so that threads finishing early can pick up the slack
+	constexpr size_t chunksPerThread = 8;
+	return std::max(size_t(1), count / ((nThreads + 1) * chunksPerThread));
+}
@@ -3,13 +3,15 @@
 #include <halley/support/exception.h>
 #include "halley/text/string_converter.h"
 #include "halley/support/logger.h"
+#include "halley/support/profiler.h"
 
 using namespace Halley;
 
 Executors* Executors::instance = nullptr;
 
 ExecutionQueue::ExecutionQueue()
-	: aborted(false)
+	: attachedCount(0)
+	, aborted(false)
 {
 	hasTasks.store(false);
 }
@@ -27,7 +29,7 @@ TaskBase ExecutionQueue::getNext()
 		}
 	}
 
-	TaskBase value = queue.front();
+	TaskBase value = std::move(queue.front());
 	queue.pop_front();
 	return value;
 }
@@ -36,7 +38,7 @@ std::vector<TaskBase> ExecutionQueue::getAll()
 {
 	std::unique_lock<std::mutex> lock(mutex);
 	hasTasks.store(false);
-	std::vector<TaskBase> tasks(queue.begin(), queue.end());
+	std::vector<TaskBase> tasks(std::make_move_iterator(queue.begin()), std::make_move_iterator(queue.end()));
 	queue.clear();
 	return tasks;
 }
@@ -45,7 +47,7 @@ void ExecutionQueue::addToQueue(TaskBase task)
 {
 #if HAS_THREADS
 	std::unique_lock<std::mutex> lock(mutex);
-	queue.emplace_back(task);
+	queue.emplace_back(std::move(task));
 	hasTasks.store(true);
 
 	condition.notify_one();
@@ -120,6 +122,7 @@ bool Executor::runPending()
 #if HAS_THREADS
 	auto tasks = queue.getAll();
 	for (auto& t : tasks) {
+		HALLEY_PROFILE_ZONE("Task");
 		t();
 	}
 #endif
@@ -129,10 +132,12 @@ bool Executor::runPending()
 void Executor::runForever()
 {
 #if HAS_THREADS
+	queue.onThreadStarted();
 	try {
 		while (running)	{
 			auto next = queue.getNext();
 			if (running) {
+				HALLEY_PROFILE_ZONE("Task");
 				next();
 			}
 		}
@@ -142,6 +147,7 @@ void Executor::runForever()
 	} catch (...) {
 		Logger::logError("Executor aborting due to unknown exception.");
 	}
+	queue.onThreadStopped();
 #endif
 }
 
@@ -163,8 +169,12 @@ ThreadPool::ThreadPool(const String& name, ExecutionQueue& queue, size_t n, Make
 	threads.resize(n);
 
 	for (size_t i = 0; i < n; i++) {
-		threads[i] = makeThread(name + " Pool " + toString(i), [this, i]()
+		const String threadName = name + " Pool " + toString(i);
+		threads[i] = makeThread(threadName, [this, i, threadName]()
 		{
+#ifdef DEV_BUILD
+			Profiler::setThreadName(threadName);
+#endif
 			try {
 				executors[i]->runForever();
 			} catch (std::exception& e) {
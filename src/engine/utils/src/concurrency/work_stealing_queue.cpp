@@ -0,0 +1,338 @@
+#include <halley/concurrency/concurrent.h>
+#include <halley/concurrency/executor.h>
+#include <halley/support/exception.h>
+#include <thread>
+#include <array>
+
+using namespace Halley;
+
+namespace {
+	// Chase-Lev deque, with a fixed capacity.
+	// Only the owning thread may push/pop at the bottom, any thread may steal from the top.
+	// Each slot carries its own flag, so the owner can't overwrite a task that a thief is still moving out of.
+	class TaskDeque
+	{
+	public:
+		explicit TaskDeque(size_t capacity)
+			: slots(nextPowerOf2(capacity))
+			, mask(int64_t(slots.size()) - 1)
+			, top(0)
+			, bottom(0)
+		{}
+
+		bool push(TaskBase& task)
+		{
+			const int64_t b = bottom.load(std::memory_order_relaxed);
+			const int64_t t = top.load(std::memory_order_acquire);
+			if (b - t > mask) {
+				return false;
+			}
+
+			auto& slot = slots[b & mask];
+			if (slot.occupied.load(std::memory_order_acquire)) {
+				return false;
+			}
+			slot.task = std::move(task);
+			slot.occupied.store(true, std::memory_order_relaxed);
+			bottom.store(b + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool pop(TaskBase& task)
+		{
+			const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+			bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t t = top.load(std::memory_order_relaxed);
+
+			if (t > b) {
+				// Empty
+				bottom.store(b + 1, std::memory_order_relaxed);
+				return false;
+			}
+
+			bool taken = true;
+			if (t == b) {
+				// Last element, race against thieves for it
+				taken = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+				bottom.store(b + 1, std::memory_order_relaxed);
+			}
+			if (taken) {
+				take(slots[b & mask], task);
+			}
+			return taken;
+		}
+
+		bool steal(TaskBase& task)
+		{
+			int64_t t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const int64_t b = bottom.load(std::memory_order_acquire);
+			if (t >= b) {
+				return false;
+			}
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				return false;
+			}
+			take(slots[t & mask], task);
+			return true;
+		}
+
+	private:
+		struct Slot
+		{
+			TaskBase task;
+			std::atomic<bool> occupied { false };
+		};
+
+		std::vector<Slot> slots;
+		const int64_t mask;
+
+		// Keep the two ends on separate cache lines (explicit padding, as C++14 doesn't guarantee over-aligned new)
+		std::array<char, 64> padding0;
+		std::atomic<int64_t> top;
+		std::array<char, 64> padding1;
+		std::atomic<int64_t> bottom;
+
+		static void take(Slot& slot, TaskBase& task)
+		{
+			task = std::move(slot.task);
+			slot.occupied.store(false, std::memory_order_release);
+		}
+
+		static size_t nextPowerOf2(size_t n)
+		{
+			size_t result = 1;
+			while (result < n) {
+				result <<= 1;
+			}
+			return result;
+		}
+	};
+
+	struct CurrentWorker
+	{
+		const WorkStealingQueue* queue = nullptr;
+		void* worker = nullptr;
+	};
+	thread_local CurrentWorker currentWorker;
+}
+
+class WorkStealingQueue::Worker
+{
+public:
+	Worker(size_t index, size_t capacity)
+		: index(index)
+		, deque(capacity)
+	{}
+
+	const size_t index;
+	TaskDeque deque;
+	std::mutex inboxMutex;
+	std::deque<TaskBase> inbox;
+	bool inUse = false;
+
+	bool popInbox(TaskBase& task)
+	{
+		std::unique_lock<std::mutex> lock(inboxMutex);
+		return popInboxLocked(task);
+	}
+
+	bool tryPopInbox(TaskBase& task)
+	{
+		std::unique_lock<std::mutex> lock(inboxMutex, std::try_to_lock);
+		return lock.owns_lock() && popInboxLocked(task);
+	}
+
+private:
+	bool popInboxLocked(TaskBase& task)
+	{
+		if (inbox.empty()) {
+			return false;
+		}
+		task = std::move(inbox.front());
+		inbox.pop_front();
+		return true;
+	}
+};
+
+WorkStealingQueue::WorkStealingQueue(size_t maxWorkers, size_t dequeCapacity)
+	: dequeCapacity(dequeCapacity)
+	, nWorkers(0)
+	, nextInbox(0)
+	, pending(0)
+	, nSleeping(0)
+	, injectionCount(0)
+{
+	// Never reallocated, so thieves can read it without locking
+	workers.reserve(maxWorkers);
+}
+
+WorkStealingQueue::~WorkStealingQueue()
+{
+}
+
+bool WorkStealingQueue::isWorkerThread() const
+{
+	return currentWorker.queue == this;
+}
+
+WorkStealingQueue::Worker* WorkStealingQueue::getCurrentWorker() const
+{
+	return currentWorker.queue == this ? static_cast<Worker*>(currentWorker.worker) : nullptr;
+}
+
+void WorkStealingQueue::onAttached()
+{
+	// A new pool is being attached after a previous one was stopped
+	if (attachedCount.load() == 0) {
+		aborted = false;
+	}
+	ExecutionQueue::onAttached();
+}
+
+void WorkStealingQueue::onThreadStarted()
+{
+	std::unique_lock<std::mutex> lock(registrationMutex);
+	Worker* worker = nullptr;
+	for (auto& w: workers) {
+		if (!w->inUse) {
+			worker = w.get();
+			break;
+		}
+	}
+	if (!worker) {
+		if (workers.size() == workers.capacity()) {
+			// Over the limit, this thread will only steal
+			return;
+		}
+		workers.push_back(std::make_unique<Worker>(workers.size(), dequeCapacity));
+		worker = workers.back().get();
+		nWorkers.store(workers.size(), std::memory_order_release);
+	}
+	worker->inUse = true;
+	currentWorker.queue = this;
+	currentWorker.worker = worker;
+}
+
+void WorkStealingQueue::onThreadStopped()
+{
+	// Anything left in this worker's deque can still be stolen, or picked up by the next thread to take over this worker
+	std::unique_lock<std::mutex> lock(registrationMutex);
+	auto worker = getCurrentWorker();
+	if (worker) {
+		worker->inUse = false;
+		currentWorker = CurrentWorker();
+	}
+}
+
+void WorkStealingQueue::abort()
+{
+	{
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		if (aborted) {
+			return;
+		}
+		aborted = true;
+	}
+	sleepCondition.notify_all();
+}
+
+void WorkStealingQueue::addToQueue(TaskBase task)
+{
+#if HAS_THREADS
+	auto self = getCurrentWorker();
+	if (!self || !self->deque.push(task)) {
+		const size_t n = nWorkers.load(std::memory_order_acquire);
+		if (n > 0) {
+			auto& worker = *workers[nextInbox++ % n];
+			std::unique_lock<std::mutex> lock(worker.inboxMutex);
+			worker.inbox.emplace_back(std::move(task));
+		} else {
+			std::unique_lock<std::mutex> lock(injectionMutex);
+			injection.emplace_back(std::move(task));
+			++injectionCount;
+		}
+	}
+	onTaskAdded();
+#else
+	task();
+#endif
+}
+
+void WorkStealingQueue::onTaskAdded()
+{
+	++pending;
+	if (nSleeping.load() > 0) {
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepCondition.notify_one();
+	}
+}
+
+bool WorkStealingQueue::tryGetTask(Worker* self, TaskBase& task)
+{
+	if (self && (self->deque.pop(task) || self->popInbox(task))) {
+		return true;
+	}
+
+	const size_t n = nWorkers.load(std::memory_order_acquire);
+	const size_t start = self ? self->index : 0;
+	for (size_t i = 0; i < n; ++i) {
+		auto& victim = *workers[(start + i + 1) % n];
+		if (&victim != self && (victim.deque.steal(task) || victim.tryPopInbox(task))) {
+			return true;
+		}
+	}
+
+	if (injectionCount.load() > 0) {
+		std::unique_lock<std::mutex> lock(injectionMutex);
+		if (!injection.empty()) {
+			task = std::move(injection.front());
+			injection.pop_front();
+			--injectionCount;
+			return true;
+		}
+	}
+	return false;
+}
+
+TaskBase WorkStealingQueue::getNext()
+{
+	auto self = getCurrentWorker();
+	TaskBase task;
+	constexpr int spinCount = 16;
+
+	while (true) {
+		for (int i = 0; i < spinCount && !aborted; ++i) {
+			if (tryGetTask(self, task)) {
+				--pending;
+				return task;
+			}
+			if (pending.load() <= 0) {
+				break;
+			}
+			std::this_thread::yield();
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		if (aborted) {
+			return TaskBase([] () {});
+		}
+		++nSleeping;
+		while (pending.load() <= 0 && !aborted) {
+			sleepCondition.wait(lock);
+		}
+		--nSleeping;
+	}
+}
+
+std::vector<TaskBase> WorkStealingQueue::getAll()
+{
+	std::vector<TaskBase> result;
+	TaskBase task;
+	while (tryGetTask(getCurrentWorker(), task)) {
+		--pending;
+		result.emplace_back(std::move(task));
+	}
+	return result;
+}
@@ -5,7 +5,11 @@
 #endif
 #include "binpack2d.hpp"
 #include <queue>
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include "halley/support/logger.h"
+#include "halley/concurrency/concurrent.h"
 
 using namespace Halley;
 
@@ -86,3 +90,220 @@ boost::optional<Vector<BinPackResult>> BinPack::fastPack(const std::vector<BinPa
 
 	return result;
 }
+
+namespace {
+	// The free space of a MaxRects bin, as the list of all maximal free rectangles (which can overlap each other)
+	class MaxRectsBin
+	{
+	public:
+		explicit MaxRectsBin(Vector2i size)
+		{
+			freeRects.push_back(Rect4i(0, 0, size.x, size.y));
+		}
+
+		bool insert(Vector2i size, bool canRotate, Rect4i& placed, bool& rotated)
+		{
+			// Best short side fit, trying the unrotated size first, so that ties always resolve the same way
+			bool found = false;
+			int bestShort = 0;
+			int bestLong = 0;
+			for (auto& f: freeRects) {
+				for (int r = 0; r < (canRotate ? 2 : 1); ++r) {
+					const int w = r == 0 ? size.x : size.y;
+					const int h = r == 0 ? size.y : size.x;
+					if (w > f.getWidth() || h > f.getHeight()) {
+						continue;
+					}
+
+					const int leftoverX = f.getWidth() - w;
+					const int leftoverY = f.getHeight() - h;
+					const int shortSide = std::min(leftoverX, leftoverY);
+					const int longSide = std::max(leftoverX, leftoverY);
+					if (!found || shortSide < bestShort || (shortSide == bestShort && longSide < bestLong)) {
+						found = true;
+						bestShort = shortSide;
+						bestLong = longSide;
+						placed = Rect4i(f.getTopLeft(), w, h);
+						rotated = r == 1;
+					}
+				}
+			}
+
+			if (found) {
+				place(placed);
+			}
+			return found;
+		}
+
+	private:
+		std::vector<Rect4i> freeRects;
+		std::vector<Rect4i> newRects;
+
+		static bool overlaps(const Rect4i& a, const Rect4i& b)
+		{
+			return a.getLeft() < b.getRight() && b.getLeft() < a.getRight() && a.getTop() < b.getBottom() && b.getTop() < a.getBottom();
+		}
+
+		static bool contains(const Rect4i& outer, const Rect4i& inner)
+		{
+			return inner.getLeft() >= outer.getLeft() && inner.getRight() <= outer.getRight() && inner.getTop() >= outer.getTop() && inner.getBottom() <= outer.getBottom();
+		}
+
+		void place(const Rect4i& used)
+		{
+			// Every free rect that overlaps the used one is replaced with what's left of it on each side
+			newRects.clear();
+			size_t kept = 0;
+			for (size_t i = 0; i < freeRects.size(); ++i) {
+				const Rect4i f = freeRects[i];
+				if (!overlaps(f, used)) {
+					freeRects[kept++] = f;
+					continue;
+				}
+
+				if (used.getLeft() > f.getLeft()) {
+					newRects.push_back(Rect4i(f.getLeft(), f.getTop(), used.getLeft() - f.getLeft(), f.getHeight()));
+				}
+				if (used.getRight() < f.getRight()) {
+					newRects.push_back(Rect4i(used.getRight(), f.getTop(), f.getRight() - used.getRight(), f.getHeight()));
+				}
+				if (used.getTop() > f.getTop()) {
+					newRects.push_back(Rect4i(f.getLeft(), f.getTop(), f.getWidth(), used.getTop() - f.getTop()));
+				}
+				if (used.getBottom() < f.getBottom()) {
+					newRects.push_back(Rect4i(f.getLeft(), used.getBottom(), f.getWidth(), f.getBottom() - used.getBottom()));
+				}
+			}
+			freeRects.resize(kept);
+
+			// None of the old ones are contained in each other, and the new ones came out of rects they weren't contained in
+			// either, so only the new ones can be redundant. Of identical ones, the first is kept.
+			const size_t nOld = freeRects.size();
+			for (size_t i = 0; i < newRects.size(); ++i) {
+				const auto& r = newRects[i];
+				bool redundant = false;
+				for (size_t j = 0; j < nOld && !redundant; ++j) {
+					redundant = contains(freeRects[j], r);
+				}
+				for (size_t j = 0; j < newRects.size() && !redundant; ++j) {
+					redundant = j != i && contains(newRects[j], r) && (j < i || !contains(r, newRects[j]));
+				}
+				if (!redundant) {
+					freeRects.push_back(r);
+				}
+			}
+		}
+	};
+
+	// Largest side first, then largest other side, then in the order they were given
+	std::vector<size_t> getMaxRectsOrder(const std::vector<BinPackEntry>& entries)
+	{
+		std::vector<size_t> order(entries.size());
+		for (size_t i = 0; i < order.size(); ++i) {
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(), [&] (size_t a, size_t b)
+		{
+			const auto& sa = entries[a].size;
+			const auto& sb = entries[b].size;
+			const int aMaj = std::max(sa.x, sa.y);
+			const int bMaj = std::max(sb.x, sb.y);
+			if (aMaj != bMaj) {
+				return aMaj > bMaj;
+			}
+			return std::min(sa.x, sa.y) > std::min(sb.x, sb.y);
+		});
+		return order;
+	}
+
+	boost::optional<Vector<BinPackResult>> maxRectsPackInOrder(const std::vector<BinPackEntry>& entries, const std::vector<size_t>& order, Vector2i binSize, const std::function<bool()>& keepGoing)
+	{
+		MaxRectsBin bin(binSize);
+		Vector<BinPackResult> results;
+		results.reserve(entries.size());
+
+		for (size_t i = 0; i < order.size(); ++i) {
+			// Checked only every so often, it's a lot cheaper than placing one
+			if ((i & 63) == 63 && keepGoing && !keepGoing()) {
+				return {};
+			}
+
+			const auto& e = entries[order[i]];
+			Rect4i rect;
+			bool rotated = false;
+			if (!bin.insert(e.size, e.canRotate, rect, rotated)) {
+				return {};
+			}
+			results.push_back(BinPackResult(rect, rotated, e.data));
+		}
+
+		return results;
+	}
+}
+
+boost::optional<Vector<BinPackResult>> BinPack::maxRectsPack(const std::vector<BinPackEntry>& entries, Vector2i binSize)
+{
+	if (!canFit(entries, binSize)) {
+		return {};
+	}
+	return maxRectsPackInOrder(entries, getMaxRectsOrder(entries), binSize, {});
+}
+
+bool BinPack::canFit(const std::vector<BinPackEntry>& entries, Vector2i binSize)
+{
+	int64_t area = 0;
+	for (auto& e: entries) {
+		const bool fits = e.size.x <= binSize.x && e.size.y <= binSize.y;
+		const bool fitsRotated = e.canRotate && e.size.y <= binSize.x && e.size.x <= binSize.y;
+		if (!fits && !fitsRotated) {
+			return false;
+		}
+		area += int64_t(e.size.x) * int64_t(e.size.y);
+	}
+	return area <= int64_t(binSize.x) * int64_t(binSize.y);
+}
+
+boost::optional<BinPackSearchResult> BinPack::packSmallest(const std::vector<BinPackEntry>& entries, const std::vector<Vector2i>& candidateSizes)
+{
+	std::vector<Vector2i> sizes;
+	for (auto& size: candidateSizes) {
+		if (canFit(entries, size)) {
+			sizes.push_back(size);
+		}
+	}
+	if (sizes.empty()) {
+		return {};
+	}
+
+	const auto order = getMaxRectsOrder(entries);
+
+	// Each batch is as many sizes as there are threads. Whichever of them fits first in the list is used, regardless of
+	// which finishes first; the larger ones give up as soon as a smaller one fits, as they can't be used anymore.
+	auto& queue = Executors::getCPUAux();
+	const size_t batchSize = std::max(size_t(1), queue.threadCount());
+	for (size_t start = 0; start < sizes.size(); start += batchSize) {
+		const size_t end = std::min(start + batchSize, sizes.size());
+		std::vector<boost::optional<Vector<BinPackResult>>> results(end - start);
+		std::vector<size_t> indices;
+		for (size_t i = start; i < end; ++i) {
+			indices.push_back(i);
+		}
+
+		std::atomic<size_t> firstFit(end);
+		Concurrent::parallelFor(queue, indices.begin(), indices.end(), [&] (size_t i)
+		{
+			auto& result = results[i - start];
+			result = maxRectsPackInOrder(entries, order, sizes[i], [&] () { return firstFit > i; });
+			if (result) {
+				size_t prev = firstFit;
+				while (i < prev && !firstFit.compare_exchange_weak(prev, i)) {}
+			}
+		}, 1);
+
+		if (firstFit < end) {
+			return BinPackSearchResult(sizes[firstFit], std::move(results[firstFit - start].get()));
+		}
+	}
+
+	return {};
+}
@@ -0,0 +1,155 @@
+#include "halley/data_structures/broadphase.h"
+
+using namespace Halley;
+
+Broadphase::Broadphase(int resolution)
+	: resolution(resolution)
+{
+}
+
+bool Broadphase::add(Rect4i rect, DataType data)
+{
+	return !update(rect, data);
+}
+
+bool Broadphase::remove(DataType data)
+{
+	const auto idx = entryIndices.find(data);
+	if (idx == FlatIndexMap<DataType>::none) {
+		return false;
+	}
+
+	setRect(entries[idx], idx, Rect4i());
+	entryIndices.erase(data);
+	freeEntries.push_back(idx);
+	return true;
+}
+
+bool Broadphase::update(Rect4i rect, DataType data)
+{
+	auto idx = entryIndices.find(data);
+	const bool existed = idx != FlatIndexMap<DataType>::none;
+	if (!existed) {
+		if (freeEntries.empty()) {
+			idx = uint32_t(entries.size());
+			entries.push_back(Entry());
+		} else {
+			idx = freeEntries.back();
+			freeEntries.pop_back();
+		}
+		auto& entry = entries[idx];
+		entry.rect = Rect4i();
+		entry.data = data;
+		entry.inGrid = false;
+		entryIndices.set(data, idx);
+	}
+
+	setRect(entries[idx], idx, rect);
+	return existed;
+}
+
+void Broadphase::update(gsl::span<const Update> updates)
+{
+	// Only the lookups have to be sized for the worst case up front; cells are created as needed
+	entryIndices.reserve(entryIndices.size() + size_t(updates.size()));
+	for (auto& u: updates) {
+		update(u.rect, u.data);
+	}
+}
+
+void Broadphase::clear()
+{
+	entries.clear();
+	freeEntries.clear();
+	entryIndices.clear();
+	for (auto& cell: cells) {
+		cell.clear();
+	}
+}
+
+bool Broadphase::contains(DataType data) const
+{
+	return entryIndices.find(data) != FlatIndexMap<DataType>::none;
+}
+
+Rect4i Broadphase::getRect(DataType data) const
+{
+	const auto idx = entryIndices.find(data);
+	return idx == FlatIndexMap<DataType>::none ? Rect4i() : entries[idx].rect;
+}
+
+size_t Broadphase::size() const
+{
+	return entryIndices.size();
+}
+
+void Broadphase::query(Rect4i rect, Vector<DataType>& results) const
+{
+	forEachInRect(rect, [&] (DataType data) { results.push_back(data); });
+}
+
+void Broadphase::getOverlappingPairs(Vector<std::pair<DataType, DataType>>& results) const
+{
+	forEachOverlappingPair([&] (DataType a, DataType b) { results.emplace_back(a, b); });
+}
+
+void Broadphase::setRect(Entry& entry, uint32_t idx, Rect4i rect)
+{
+	const bool inGrid = rect.getWidth() > 0 && rect.getHeight() > 0;
+	const auto cell0 = inGrid ? pointToCell(rect.getTopLeft()) : Vector2i();
+	const auto cell1 = inGrid ? pointToCell(rect.getBottomRight()) : Vector2i();
+	entry.rect = rect;
+
+	if (inGrid == entry.inGrid && (!inGrid || (cell0 == entry.cell0 && cell1 == entry.cell1))) {
+		// Still in the same cells, which is by far the most common case
+		return;
+	}
+
+	if (entry.inGrid) {
+		for (int y = entry.cell0.y; y <= entry.cell1.y; ++y) {
+			for (int x = entry.cell0.x; x <= entry.cell1.x; ++x) {
+				if (!inGrid || x < cell0.x || x > cell1.x || y < cell0.y || y > cell1.y) {
+					removeFromCell(x, y, idx);
+				}
+			}
+		}
+	}
+	if (inGrid) {
+		for (int y = cell0.y; y <= cell1.y; ++y) {
+			for (int x = cell0.x; x <= cell1.x; ++x) {
+				if (!entry.inGrid || x < entry.cell0.x || x > entry.cell1.x || y < entry.cell0.y || y > entry.cell1.y) {
+					getCell(x, y).push_back(idx);
+				}
+			}
+		}
+	}
+
+	entry.inGrid = inGrid;
+	entry.cell0 = cell0;
+	entry.cell1 = cell1;
+}
+
+Vector<uint32_t>& Broadphase::getCell(int x, int y)
+{
+	const auto key = getCellKey(x, y);
+	auto cellIdx = cellIndices.find(key);
+	if (cellIdx == FlatIndexMap<uint64_t>::none) {
+		cellIdx = uint32_t(cells.size());
+		cells.emplace_back();
+		cellPositions.push_back(Vector2i(x, y));
+		cellIndices.set(key, cellIdx);
+	}
+	return cells[cellIdx];
+}
+
+void Broadphase::removeFromCell(int x, int y, uint32_t idx)
+{
+	auto& cell = cells[cellIndices.find(getCellKey(x, y))];
+	for (auto& i: cell) {
+		if (i == idx) {
+			i = cell.back();
+			cell.pop_back();
+			return;
+		}
+	}
+}
@@ -0,0 +1,176 @@
+#include "halley/data_structures/frame_arena.h"
+#include "halley/data_structures/memory_pool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <gsl/gsl_assert>
+
+using namespace Halley;
+
+constexpr size_t FrameArena::blockSize;
+
+namespace {
+	std::atomic<uint64_t> currentFrame(0);
+
+	// Every live arena, so beginFrame can collect their counters
+	struct Registry {
+		std::mutex mutex;
+		Vector<FrameArena*> arenas;
+		FrameArenaStats lastFrame;
+		FrameArenaStats exited; // From threads that ended during the frame
+	};
+
+	Registry& getRegistry()
+	{
+		// Never destroyed, as threads may still be exiting during static destruction
+		static Registry* registry = new Registry();
+		return *registry;
+	}
+
+	// Blocks come from a pool of their own, as PoolPool isn't safe to use from other threads
+	struct BlockPool {
+		std::mutex mutex;
+		SizePool pool { FrameArena::blockSize };
+	};
+
+	BlockPool& getBlockPool()
+	{
+		static BlockPool* blockPool = new BlockPool();
+		return *blockPool;
+	}
+}
+
+FrameArena& FrameArena::get()
+{
+	thread_local FrameArena arena;
+	return arena;
+}
+
+void FrameArena::beginFrame()
+{
+	auto& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	FrameArenaStats stats = registry.exited;
+	for (auto arena: registry.arenas) {
+		stats.bytes += arena->bytes.exchange(0, std::memory_order_relaxed);
+		stats.allocations += arena->allocations.exchange(0, std::memory_order_relaxed);
+	}
+	registry.lastFrame = stats;
+	registry.exited = FrameArenaStats();
+
+	// Each arena notices this the next time it's allocated from
+	currentFrame.fetch_add(1, std::memory_order_release);
+}
+
+bool FrameArena::isActive()
+{
+	return currentFrame.load(std::memory_order_relaxed) != 0;
+}
+
+FrameArenaStats FrameArena::getLastFrameStats()
+{
+	auto& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	return registry.lastFrame;
+}
+
+FrameArena::FrameArena()
+	: frame(currentFrame.load(std::memory_order_acquire))
+	, bytes(0)
+	, allocations(0)
+{
+	auto& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	registry.arenas.push_back(this);
+}
+
+FrameArena::~FrameArena()
+{
+	{
+		auto& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		registry.arenas.erase(std::find(registry.arenas.begin(), registry.arenas.end(), this));
+		registry.exited.bytes += bytes.load(std::memory_order_relaxed);
+		registry.exited.allocations += allocations.load(std::memory_order_relaxed);
+	}
+
+	auto& blockPool = getBlockPool();
+	for (auto& half: halves) {
+		rewind(half);
+		std::lock_guard<std::mutex> lock(blockPool.mutex);
+		for (auto block: half.blocks) {
+			blockPool.pool.free(block);
+		}
+	}
+}
+
+void* FrameArena::alloc(size_t size, size_t alignment)
+{
+	Expects(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	const uint64_t now = currentFrame.load(std::memory_order_acquire);
+	if (now != frame) {
+		flip(now);
+	}
+
+	bytes.fetch_add(size, std::memory_order_relaxed);
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	auto& half = halves[cur];
+	if (size + alignment > blockSize) {
+		auto p = static_cast<char*>(std::malloc(size + alignment));
+		if (!p) {
+			throw std::bad_alloc();
+		}
+		half.largeBlocks.push_back(p);
+		return p + ((alignment - reinterpret_cast<uintptr_t>(p) % alignment) % alignment);
+	}
+
+	while (true) {
+		if (half.curBlock == half.blocks.size()) {
+			half.blocks.push_back(newBlock());
+		}
+		const auto base = reinterpret_cast<uintptr_t>(half.blocks[half.curBlock]);
+		const auto start = (base + half.used + alignment - 1) & ~uintptr_t(alignment - 1);
+		if (start + size <= base + blockSize) {
+			half.used = start + size - base;
+			return reinterpret_cast<void*>(start);
+		}
+		++half.curBlock;
+		half.used = 0;
+	}
+}
+
+void FrameArena::flip(uint64_t now)
+{
+	// The current half was filled during "frame", and must be kept until the frame after that ends
+	if (now - frame >= 2) {
+		rewind(halves[cur]);
+	}
+	cur = 1 - cur;
+	rewind(halves[cur]);
+	frame = now;
+}
+
+void FrameArena::rewind(Half& half)
+{
+	for (auto p: half.largeBlocks) {
+		std::free(p);
+	}
+	half.largeBlocks.clear();
+	half.curBlock = 0;
+	half.used = 0;
+}
+
+char* FrameArena::newBlock()
+{
+	// Shared between threads, but only needed when an arena grows
+	auto& blockPool = getBlockPool();
+	std::lock_guard<std::mutex> lock(blockPool.mutex);
+	auto p = static_cast<char*>(blockPool.pool.alloc());
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
@@ -0,0 +1,181 @@
+#include "halley/data_structures/loose_grid.h"
+#include <gsl/gsl_assert>
+
+using namespace Halley;
+
+constexpr LooseGrid::Handle LooseGrid::invalidHandle;
+constexpr uint32_t LooseGrid::oversizedCell;
+constexpr uint32_t LooseGrid::freeCell;
+constexpr int64_t LooseGrid::maxCells;
+
+LooseGrid::LooseGrid(float cellSize)
+	: cellSize(cellSize)
+	, invCellSize(1.0f / cellSize)
+{
+	Expects(cellSize > 0);
+}
+
+LooseGrid::Handle LooseGrid::add(Rect4f rect)
+{
+	Handle handle;
+	if (freeHandles.empty()) {
+		handle = Handle(items.size());
+		items.push_back(Item());
+	} else {
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+	}
+
+	items[handle].rect = rect;
+	insert(handle, getCellFor(rect));
+	++count;
+	return handle;
+}
+
+void LooseGrid::update(Handle handle, Rect4f rect)
+{
+	Expects(handle < items.size());
+	Expects(items[handle].cell != freeCell);
+
+	auto& item = items[handle];
+	item.rect = rect;
+	const auto cell = getCellFor(rect);
+	if (cell != item.cell) {
+		erase(handle);
+		insert(handle, cell);
+	}
+}
+
+void LooseGrid::remove(Handle handle)
+{
+	Expects(handle < items.size());
+	Expects(items[handle].cell != freeCell);
+
+	erase(handle);
+	items[handle].cell = freeCell;
+	freeHandles.push_back(handle);
+	--count;
+}
+
+void LooseGrid::clear()
+{
+	items.clear();
+	freeHandles.clear();
+	count = 0;
+	for (auto& cell: cells) {
+		cell.clear();
+	}
+	oversized.clear();
+}
+
+Rect4f LooseGrid::getRect(Handle handle) const
+{
+	Expects(handle < items.size());
+	return items[handle].rect;
+}
+
+size_t LooseGrid::size() const
+{
+	return count;
+}
+
+float LooseGrid::getCellSize() const
+{
+	return cellSize;
+}
+
+void LooseGrid::query(Rect4f area, Vector<Handle>& results) const
+{
+	forEachInArea(area, [&] (Handle handle) { results.push_back(handle); });
+}
+
+uint32_t LooseGrid::getCellFor(Rect4f rect)
+{
+	if (rect.getWidth() > cellSize || rect.getHeight() > cellSize) {
+		return oversizedCell;
+	}
+
+	auto coords = getCellCoords(rect.getCenter());
+	auto local = coords - gridOrigin;
+	if (local.x < 0 || local.y < 0 || local.x >= gridSize.x || local.y >= gridSize.y) {
+		if (!growToFit(coords)) {
+			return oversizedCell;
+		}
+		local = coords - gridOrigin;
+	}
+	return uint32_t(local.x + local.y * gridSize.x);
+}
+
+bool LooseGrid::growToFit(Vector2i cell)
+{
+	Vector2i newOrigin;
+	Vector2i newSize;
+	if (gridSize.x == 0) {
+		newOrigin = cell - Vector2i(8, 8);
+		newSize = Vector2i(16, 16);
+	} else {
+		// At least double along each axis that has to grow, so that growing is rare
+		auto p0 = gridOrigin;
+		auto p1 = gridOrigin + gridSize;
+		if (cell.x < p0.x) {
+			p0.x = std::min(cell.x, p0.x - gridSize.x);
+		} else if (cell.x >= p1.x) {
+			p1.x = std::max(cell.x + 1, p1.x + gridSize.x);
+		}
+		if (cell.y < p0.y) {
+			p0.y = std::min(cell.y, p0.y - gridSize.y);
+		} else if (cell.y >= p1.y) {
+			p1.y = std::max(cell.y + 1, p1.y + gridSize.y);
+		}
+		newOrigin = p0;
+		newSize = p1 - p0;
+	}
+
+	// Whatever is that far out is better off in the oversized list than in a huge, mostly empty grid
+	if (int64_t(newSize.x) * int64_t(newSize.y) > maxCells) {
+		return false;
+	}
+
+	Vector<Vector<Handle>> newCells(size_t(newSize.x) * size_t(newSize.y));
+	for (int y = 0; y < gridSize.y; ++y) {
+		for (int x = 0; x < gridSize.x; ++x) {
+			const auto p = Vector2i(x, y) + gridOrigin - newOrigin;
+			const auto idx = uint32_t(p.x + p.y * newSize.x);
+			auto& dst = newCells[idx];
+			dst = std::move(cells[size_t(x + y * gridSize.x)]);
+			for (auto handle: dst) {
+				items[handle].cell = idx;
+			}
+		}
+	}
+
+	cells = std::move(newCells);
+	gridOrigin = newOrigin;
+	gridSize = newSize;
+	return true;
+}
+
+void LooseGrid::insert(Handle handle, uint32_t cell)
+{
+	auto& list = getList(cell);
+	auto& item = items[handle];
+	item.cell = cell;
+	item.slot = uint32_t(list.size());
+	list.push_back(handle);
+}
+
+void LooseGrid::erase(Handle handle)
+{
+	// Swap with the last one, so removal doesn't depend on how crowded the cell is
+	auto& item = items[handle];
+	auto& list = getList(item.cell);
+	const auto last = list.back();
+	list[item.slot] = last;
+	items[last].slot = item.slot;
+	list.pop_back();
+}
+
+Vector<LooseGrid::Handle>& LooseGrid::getList(uint32_t cell)
+{
+	return cell == oversizedCell ? oversized : cells[cell];
+}
@@ -0,0 +1,307 @@
+#include "halley/file/memory_mapped_file.h"
+#include "halley/file/path.h"
+#include <cstring>
+#include <algorithm>
+
+using namespace Halley;
+
+#if defined(_WIN32) && !defined(WINDOWS_STORE)
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+namespace Halley {
+	class MemoryMappedFilePimpl
+	{
+	public:
+		static std::unique_ptr<MemoryMappedFilePimpl> open(const Path& path)
+		{
+			HANDLE file = CreateFileW(path.string().getUTF16().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) {
+				return {};
+			}
+
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize)) {
+				CloseHandle(file);
+				return {};
+			}
+
+			auto result = std::make_unique<MemoryMappedFilePimpl>();
+			result->file = file;
+			result->size = size_t(fileSize.QuadPart);
+			if (result->size > 0) {
+				result->mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (result->mapping) {
+					result->data = static_cast<const gsl::byte*>(MapViewOfFile(result->mapping, FILE_MAP_READ, 0, 0, 0));
+				}
+			}
+			return result;
+		}
+
+		~MemoryMappedFilePimpl()
+		{
+			if (data) {
+				UnmapViewOfFile(data);
+			}
+			if (mapping) {
+				CloseHandle(mapping);
+			}
+			CloseHandle(file);
+		}
+
+		size_t readUnmapped(size_t pos, gsl::span<gsl::byte> dst) const
+		{
+			// ReadFile with an explicit offset doesn't depend on the handle's file pointer, so this is safe to do concurrently
+			size_t total = 0;
+			while (total < size_t(dst.size())) {
+				OVERLAPPED overlapped = {};
+				const uint64_t offset = pos + total;
+				overlapped.Offset = DWORD(offset & 0xFFFFFFFF);
+				overlapped.OffsetHigh = DWORD(offset >> 32);
+				DWORD nRead = 0;
+				const DWORD toRead = DWORD(std::min(size_t(dst.size()) - total, size_t(1) << 30));
+				if (!ReadFile(file, dst.data() + total, toRead, &nRead, &overlapped) || nRead == 0) {
+					break;
+				}
+				total += nRead;
+			}
+			return total;
+		}
+
+		void advise(size_t, size_t, ResourceDataAccessHint) const
+		{
+			// PrefetchVirtualMemory would do, but it needs Windows 8
+		}
+
+		const gsl::byte* data = nullptr;
+		size_t size = 0;
+
+	private:
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+	};
+}
+
+#elif defined(__unix__) || defined(__APPLE__)
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+namespace Halley {
+	class MemoryMappedFilePimpl
+	{
+	public:
+		static std::unique_ptr<MemoryMappedFilePimpl> open(const Path& path)
+		{
+			const int fd = ::open(path.string().c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0) {
+				return {};
+			}
+
+			struct stat st;
+			if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+				::close(fd);
+				return {};
+			}
+
+			auto result = std::make_unique<MemoryMappedFilePimpl>();
+			result->fd = fd;
+			result->size = size_t(st.st_size);
+			if (result->size > 0) {
+				void* p = mmap(nullptr, result->size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (p != MAP_FAILED) {
+					result->data = static_cast<const gsl::byte*>(p);
+				}
+			}
+			return result;
+		}
+
+		~MemoryMappedFilePimpl()
+		{
+			if (data) {
+				munmap(const_cast<gsl::byte*>(data), size);
+			}
+			::close(fd);
+		}
+
+		size_t readUnmapped(size_t pos, gsl::span<gsl::byte> dst) const
+		{
+			size_t total = 0;
+			while (total < size_t(dst.size())) {
+				const ssize_t n = pread(fd, dst.data() + total, size_t(dst.size()) - total, off_t(pos + total));
+				if (n < 0 && errno == EINTR) {
+					continue;
+				}
+				if (n <= 0) {
+					break;
+				}
+				total += size_t(n);
+			}
+			return total;
+		}
+
+		void advise(size_t pos, size_t len, ResourceDataAccessHint hint) const
+		{
+			if (data) {
+				// Ranges given to madvise must start on a page boundary
+				const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+				const size_t start = pos - pos % pageSize;
+				const int advice = hint == ResourceDataAccessHint::Sequential ? POSIX_MADV_SEQUENTIAL : POSIX_MADV_WILLNEED;
+				posix_madvise(const_cast<gsl::byte*>(data) + start, len + (pos - start), advice);
+			} else {
+#ifdef POSIX_FADV_SEQUENTIAL
+				const int advice = hint == ResourceDataAccessHint::Sequential ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_WILLNEED;
+				posix_fadvise(fd, off_t(pos), off_t(len), advice);
+#endif
+			}
+		}
+
+		const gsl::byte* data = nullptr;
+		size_t size = 0;
+
+	private:
+		int fd = -1;
+	};
+}
+
+#else
+
+namespace Halley {
+	// Not implemented
+	class MemoryMappedFilePimpl
+	{
+	public:
+		static std::unique_ptr<MemoryMappedFilePimpl> open(const Path&) { return {}; }
+		size_t readUnmapped(size_t, gsl::span<gsl::byte>) const { return 0; }
+		void advise(size_t, size_t, ResourceDataAccessHint) const {}
+
+		const gsl::byte* data = nullptr;
+		size_t size = 0;
+	};
+}
+
+#endif
+
+std::shared_ptr<MemoryMappedFile> MemoryMappedFile::open(const Path& path)
+{
+	auto pimpl = MemoryMappedFilePimpl::open(path);
+	if (!pimpl) {
+		return {};
+	}
+	return std::shared_ptr<MemoryMappedFile>(new MemoryMappedFile(std::move(pimpl)));
+}
+
+MemoryMappedFile::MemoryMappedFile(std::unique_ptr<MemoryMappedFilePimpl> pimpl)
+	: pimpl(std::move(pimpl))
+{}
+
+MemoryMappedFile::~MemoryMappedFile() = default;
+
+size_t MemoryMappedFile::getSize() const
+{
+	return pimpl->size;
+}
+
+bool MemoryMappedFile::isMapped() const
+{
+	return pimpl->data != nullptr;
+}
+
+gsl::span<const gsl::byte> MemoryMappedFile::getSpan() const
+{
+	if (!pimpl->data) {
+		return {};
+	}
+	return gsl::span<const gsl::byte>(pimpl->data, pimpl->size);
+}
+
+size_t MemoryMappedFile::read(size_t pos, gsl::span<gsl::byte> dst) const
+{
+	if (pos >= pimpl->size) {
+		return 0;
+	}
+	const size_t toRead = std::min(size_t(dst.size()), pimpl->size - pos);
+	if (pimpl->data) {
+		memcpy(dst.data(), pimpl->data + pos, toRead);
+		return toRead;
+	} else {
+		return pimpl->readUnmapped(pos, dst.subspan(0, toRead));
+	}
+}
+
+void MemoryMappedFile::advise(size_t pos, size_t size, ResourceDataAccessHint hint) const
+{
+	if (pos < pimpl->size && size > 0) {
+		pimpl->advise(pos, std::min(size, pimpl->size - pos), hint);
+	}
+}
+
+MemoryMappedFileReader::MemoryMappedFileReader(std::shared_ptr<MemoryMappedFile> file)
+	: file(std::move(file))
+{
+	Expects(this->file);
+}
+
+size_t MemoryMappedFileReader::size() const
+{
+	return file->getSize();
+}
+
+int MemoryMappedFileReader::read(gsl::span<gsl::byte> dst)
+{
+	const size_t n = file->read(curPos, dst);
+	curPos += n;
+	return int(n);
+}
+
+void MemoryMappedFileReader::seek(int64_t pos, int whence)
+{
+	switch (whence) {
+	case SEEK_SET:
+		curPos = size_t(pos);
+		break;
+	case SEEK_CUR:
+		curPos = size_t(curPos + pos);
+		break;
+	case SEEK_END:
+		curPos = size_t(file->getSize() + pos);
+		break;
+	}
+}
+
+size_t MemoryMappedFileReader::tell() const
+{
+	return curPos;
+}
+
+void MemoryMappedFileReader::close()
+{
+}
+
+bool MemoryMappedFileReader::supportsReadAt() const
+{
+	return true;
+}
+
+int MemoryMappedFileReader::readAt(size_t pos, gsl::span<gsl::byte> dst)
+{
+	return int(file->read(pos, dst));
+}
+
+std::shared_ptr<const char> MemoryMappedFileReader::getMappedData()
+{
+	if (!file->isMapped()) {
+		return {};
+	}
+	// Shares ownership of the file, so the mapping outlives anything still pointing into it
+	return std::shared_ptr<const char>(file, reinterpret_cast<const char*>(file->getSpan().data()));
+}
+
+void MemoryMappedFileReader::adviseAccess(size_t pos, size_t size, ResourceDataAccessHint hint)
+{
+	file->advise(pos, size, hint);
+}
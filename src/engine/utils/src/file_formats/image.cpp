@@ -20,7 +20,9 @@
 \*****************************************************************/
 
 #include <cassert>
+#include <cstring>
 #include "halley/file_formats/image.h"
+#include "halley/file_formats/image_ops.h"
 #include "../../contrib/stb_image/stb_image.h"
 #include "../../contrib/lodepng/lodepng.h"
 #include "halley/support/exception.h"
@@ -136,18 +138,16 @@ Rect4i Image::getTrimRect() const
 	int y0 = h;
 	int y1 = 0;
 
-	const unsigned int* src = reinterpret_cast<const unsigned int*>(px.get());
+	auto& ops = ImageOps::get();
+	const uint32_t* src = reinterpret_cast<const uint32_t*>(px.get());
 	for (int y = 0; y < int(h); y++) {
-		for (int x = 0; x < int(w); x++) {
-			unsigned int px = src[x + y * w];
-			int alpha = int(px >> 24);
-
-			if (alpha > 0) {
-				x0 = std::min(x0, x);
-				y0 = std::min(y0, y);
-				x1 = std::max(x1, x);
-				y1 = std::max(y1, y);
-			}
+		size_t first;
+		size_t last;
+		if (ops.findAlphaRange(src + size_t(y) * w, w, first, last)) {
+			x0 = std::min(x0, int(first));
+			y0 = std::min(y0, y);
+			x1 = std::max(x1, int(last));
+			y1 = std::max(y1, y);
 		}
 	}
 
@@ -165,12 +165,7 @@ Rect4i Image::getRect() const
 
 void Image::clear(int colour)
 {
-	int* dst = reinterpret_cast<int*>(px.get());
-	for (unsigned int y = 0; y < h; y++) {
-		for (unsigned int x = 0; x < w; x++) {
-			*dst++ = colour;
-		}
-	}
+	ImageOps::get().fill(reinterpret_cast<uint32_t*>(px.get()), size_t(w) * h, uint32_t(colour));
 }
 
 void Image::blitFrom(Vector2i pos, const char* buffer, size_t width, size_t height, size_t pitch, size_t bpp)
@@ -192,18 +187,15 @@ void Image::blitFrom(Vector2i pos, const char* buffer, size_t width, size_t heig
 			}
 		}
 	} else if (bpp == 8) {
-		const char* src = reinterpret_cast<const char*>(buffer);
-		for (size_t y = yMin; y < yMax; y++) {
-			for (size_t x = xMin; x < xMax; x++) {
-				dst[x + y * w] = convertRGBAToInt(255, 255, 255, src[x + y * pitch]);
-			}
+		const uint8_t* src = reinterpret_cast<const uint8_t*>(buffer);
+		auto& ops = ImageOps::get();
+		for (size_t y = yMin; y < yMax && xMin < xMax; y++) {
+			ops.expandAlpha(reinterpret_cast<uint32_t*>(dst + xMin + y * w), src + xMin + y * pitch, xMax - xMin);
 		}
 	} else if (bpp == 32) {
 		const int* src = reinterpret_cast<const int*>(buffer);
-		for (size_t y = yMin; y < yMax; y++) {
-			for (size_t x = xMin; x < xMax; x++) {
-				dst[x + y * w] = src[x + y * pitch];
-			}
+		for (size_t y = yMin; y < yMax && xMin < xMax; y++) {
+			memcpy(dst + xMin + y * w, src + xMin + y * pitch, (xMax - xMin) * sizeof(int));
 		}
 	} else {
 		throw Exception("Unknown amount of bits per pixel: " + toString(bpp), HalleyExceptions::Utils);
@@ -222,16 +214,14 @@ void Image::blitFromRotated(Vector2i pos, const char* buffer, size_t width, size
 	auto yMin = intersection.getTop();
 	auto xMax = intersection.getRight();
 	auto yMax = intersection.getBottom();
-	int* dst = reinterpret_cast<int*>(px.get());
+	uint32_t* dst = reinterpret_cast<uint32_t*>(px.get());
 
 	if (bpp == 32) {
-		const int* src = reinterpret_cast<const int*>(buffer);
-		for (auto y = yMin; y < yMax; y++) {
-			for (auto x = xMin; x < xMax; x++) {
-				auto srcX = y - yMin;
-				auto srcY = height - (x - xMin) - 1;
-				dst[x + y * w] = src[srcX + srcY * pitch];
-			}
+		if (xMax > xMin && yMax > yMin) {
+			// Destination column x comes from source row (height - 1 - (x - xMin))
+			const size_t dstW = size_t(xMax - xMin);
+			const uint32_t* src = reinterpret_cast<const uint32_t*>(buffer) + (height - dstW) * pitch;
+			ImageOps::get().rotate(dst + xMin + size_t(yMin) * w, w, src, pitch, dstW, size_t(yMax - yMin));
 		}
 	} else {
 		throw Exception("Unknown amount of bits per pixel: " + toString(bpp), HalleyExceptions::Utils);
@@ -259,35 +249,6 @@ void Image::blitFrom(Vector2i pos, Image& srcImg, Rect4i srcArea, bool rotated)
 	}
 }
 
-inline constexpr static uint32_t alphaBlend(uint32_t src, uint32_t dst, uint32_t opacity)
-{
-	const uint32_t sr = src & 0xFF;
-	const uint32_t sg = (src >> 8) & 0xFF;
-	const uint32_t sb = (src >> 16) & 0xFF;
-	const uint32_t sa = (src >> 24) & 0xFF;
-	const uint32_t srcAlpha = (sa * opacity) / 255;
-
-	if (srcAlpha == 0) {
-		return dst;
-	} else {
-		const uint32_t dr = dst & 0xFF;
-		const uint32_t dg = (dst >> 8) & 0xFF;
-		const uint32_t db = (dst >> 16) & 0xFF;
-		const uint32_t da = (dst >> 24) & 0xFF;
-
-		const uint32_t oneMinusSrcAlpha = 255 - srcAlpha;
-		const uint32_t dstAlpha = (oneMinusSrcAlpha * da) / 255;
-		const uint32_t totalAlpha = srcAlpha + dstAlpha;
-
-		const uint32_t r = (sr * srcAlpha + dr * dstAlpha) / totalAlpha;
-		const uint32_t g = (sg * srcAlpha + dg * dstAlpha) / totalAlpha;
-		const uint32_t b = (sb * srcAlpha + db * dstAlpha) / totalAlpha;
-		const uint32_t a = srcAlpha + dstAlpha * oneMinusSrcAlpha / 255;
-
-		return r | (g << 8) | (b << 16) | (a << 24);
-	}
-}
-
 inline constexpr static uint32_t lightenBlend(uint32_t src, uint32_t dst, uint32_t opacity)
 {
 	const uint32_t sr = src & 0xFF;
@@ -340,7 +301,18 @@ void blendImages(F f, const Image& src, Image& dst, Vector2i pos, uint8_t opacit
 
 void Image::drawImageAlpha(const Image& src, Vector2i pos, uint8_t opacity)
 {
-	blendImages(alphaBlend, src, *this, pos, opacity);
+	if (format != Format::RGBA || src.getFormat() != Format::RGBA) {
+		throw Exception("Both images must be RGBA for drawing with alpha", HalleyExceptions::Utils);
+	}
+
+	const Rect4i srcRect = src.getRect().intersection(getRect() - pos);
+	const Rect4i dstRect = getRect().intersection(src.getRect() + pos);
+	auto& ops = ImageOps::get();
+	for (int i = 0; i < srcRect.getHeight(); ++i) {
+		const uint32_t* srcData = reinterpret_cast<const uint32_t*>(src.getPixels()) + ((i + srcRect.getTop()) * src.getWidth() + srcRect.getLeft());
+		uint32_t* dstData = reinterpret_cast<uint32_t*>(getPixels()) + ((i + dstRect.getTop()) * w + dstRect.getLeft());
+		ops.blendAlpha(dstData, srcData, size_t(srcRect.getWidth()), opacity);
+	}
 }
 
 void Image::drawImageLighten(const Image& src, Vector2i pos, uint8_t opacity)
@@ -427,18 +399,7 @@ void Image::preMultiply()
 {
 	Expects(format == Format::RGBA);
 
-	size_t n = w * h;
-	unsigned int* data = reinterpret_cast<unsigned int*>(px.get());
-	for (size_t i = 0; i < n; i++) {
-		unsigned int cur = data[i];
-		unsigned int r, g, b, a;
-		convertIntToRGBA(cur, r, g, b, a);
-		++a;
-		data[i] = ((r * a >> 8) & 0xFF)
-			    | ((g * a) & 0xFF00)
-				| ((b * a << 8) & 0xFF0000)
-				| ((a-1) << 24);
-	}
+	ImageOps::get().preMultiply(reinterpret_cast<uint32_t*>(px.get()), size_t(w) * h);
 
 	format = Format::RGBAPremultiplied;
 }
@@ -0,0 +1,269 @@
+#include "halley/file_formats/image_ops.h"
+#include "halley/support/exception.h"
+#include "image_ops_simd.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(HAS_IMAGE_OPS_AVX2) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace Halley;
+
+constexpr uint32_t ImagePaletteTable::notFound;
+
+namespace {
+	uint32_t makeMultiplier(uint64_t& state)
+	{
+		// splitmix64, so that the same colours always get the same table
+		state += 0x9E3779B97F4A7C15ull;
+		uint64_t z = state;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return uint32_t(z ^ (z >> 31)) | 1u;
+	}
+}
+
+ImagePaletteTable::ImagePaletteTable(const std::vector<std::pair<uint32_t, uint32_t>>& colourToIndex)
+{
+	// Starts at twice as many slots as colours, and only grows if it keeps failing to find a table, which is rare
+	uint32_t nSlotsLog2 = 4;
+	while ((size_t(1) << nSlotsLog2) < colourToIndex.size() * 2) {
+		++nSlotsLog2;
+	}
+
+	for (; nSlotsLog2 <= 24; ++nSlotsLog2) {
+		for (uint32_t seed = 0; seed < 16; ++seed) {
+			if (tryBuild(colourToIndex, nSlotsLog2, seed)) {
+				return;
+			}
+		}
+	}
+	throw Exception("Unable to build palette table, are there duplicated colours?", HalleyExceptions::Utils);
+}
+
+bool ImagePaletteTable::tryBuild(const std::vector<std::pair<uint32_t, uint32_t>>& colourToIndex, uint32_t nSlotsLog2, uint32_t seed)
+{
+	const uint32_t nBucketsLog2 = nSlotsLog2 - 1;
+	const size_t nSlots = size_t(1) << nSlotsLog2;
+	const size_t nBuckets = size_t(1) << nBucketsLog2;
+
+	uint64_t state = uint64_t(seed) * 0x632BE59BD9B4E019ull + nSlotsLog2;
+	bucketMultiplier = makeMultiplier(state);
+	slotMultiplier = makeMultiplier(state);
+	bucketShift = 32 - nBucketsLog2;
+	slotShift = 32 - nSlotsLog2;
+	slotMask = uint32_t(nSlots - 1);
+
+	keys.assign(nSlots, 0);
+	values.assign(nSlots, notFound);
+	displacements.assign(nBuckets, 0);
+
+	std::vector<std::vector<size_t>> buckets(nBuckets);
+	for (size_t i = 0; i < colourToIndex.size(); ++i) {
+		buckets[(colourToIndex[i].first * bucketMultiplier) >> bucketShift].push_back(i);
+	}
+
+	// Fullest buckets first, while there's still plenty of room
+	std::vector<uint32_t> order(nBuckets);
+	for (size_t i = 0; i < nBuckets; ++i) {
+		order[i] = uint32_t(i);
+	}
+	std::stable_sort(order.begin(), order.end(), [&] (uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+	std::vector<uint8_t> used(nSlots, 0);
+	std::vector<uint32_t> slots;
+	for (auto b: order) {
+		const auto& bucket = buckets[b];
+		if (bucket.empty()) {
+			break;
+		}
+
+		bool placed = false;
+		for (uint32_t d = 0; d < nSlots && !placed; ++d) {
+			slots.clear();
+			placed = true;
+			for (auto i: bucket) {
+				const uint32_t slot = (((colourToIndex[i].first * slotMultiplier) >> slotShift) + d) & slotMask;
+				if (used[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+					placed = false;
+					break;
+				}
+				slots.push_back(slot);
+			}
+
+			if (placed) {
+				displacements[b] = d;
+				for (size_t j = 0; j < bucket.size(); ++j) {
+					used[slots[j]] = 1;
+					keys[slots[j]] = colourToIndex[bucket[j]].first;
+					values[slots[j]] = colourToIndex[bucket[j]].second;
+				}
+			}
+		}
+
+		if (!placed) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+const ImageOps& ImageOps::getScalar()
+{
+	static ImageOps scalar;
+	return scalar;
+}
+
+#ifdef HAS_IMAGE_OPS_AVX2
+static bool hasAVX2()
+{
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, 1);
+	const bool osUsesXSAVE = (regs[2] & (1 << 27)) != 0;
+	const bool cpuAVX = (regs[2] & (1 << 28)) != 0;
+	if (!osUsesXSAVE || !cpuAVX || (_xgetbv(0) & 0x6) != 0x6) {
+		return false;
+	}
+	__cpuidex(regs, 7, 0);
+	return (regs[1] & (1 << 5)) != 0;
+#else
+	// Also checks that the OS saves the AVX registers
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+std::vector<const ImageOps*> ImageOps::getAvailable()
+{
+	std::vector<const ImageOps*> result;
+	result.push_back(&getScalar());
+
+#ifdef HAS_IMAGE_OPS_SSE2
+	static ImageOpsSSE2 sse2;
+	result.push_back(&sse2);
+#endif
+
+#ifdef HAS_IMAGE_OPS_AVX2
+	static ImageOpsAVX2 avx2;
+	if (hasAVX2()) {
+		result.push_back(&avx2);
+	}
+#endif
+
+#ifdef HAS_IMAGE_OPS_NEON
+	static ImageOpsNEON neon;
+	result.push_back(&neon);
+#endif
+
+	return result;
+}
+
+const ImageOps& ImageOps::get()
+{
+	static const ImageOps& best = *getAvailable().back();
+	return best;
+}
+
+void ImageOps::fill(uint32_t* dst, size_t n, uint32_t colour) const
+{
+	for (size_t i = 0; i < n; ++i) {
+		dst[i] = colour;
+	}
+}
+
+void ImageOps::expandAlpha(uint32_t* dst, const uint8_t* src, size_t n) const
+{
+	for (size_t i = 0; i < n; ++i) {
+		dst[i] = (uint32_t(src[i]) << 24) | 0xFFFFFF;
+	}
+}
+
+void ImageOps::rotate(uint32_t* dst, size_t dstPitch, const uint32_t* src, size_t srcPitch, size_t w, size_t h) const
+{
+	for (size_t y = 0; y < h; ++y) {
+		for (size_t x = 0; x < w; ++x) {
+			dst[x + y * dstPitch] = src[y + (w - 1 - x) * srcPitch];
+		}
+	}
+}
+
+bool ImageOps::findAlphaRange(const uint32_t* src, size_t n, size_t& first, size_t& last) const
+{
+	size_t i = 0;
+	while (i < n && (src[i] >> 24) == 0) {
+		++i;
+	}
+	if (i == n) {
+		return false;
+	}
+	first = i;
+
+	size_t j = n - 1;
+	while ((src[j] >> 24) == 0) {
+		--j;
+	}
+	last = j;
+	return true;
+}
+
+void ImageOps::blendAlpha(uint32_t* dst, const uint32_t* src, size_t n, uint32_t opacity) const
+{
+	for (size_t i = 0; i < n; ++i) {
+		const uint32_t s = src[i];
+		const uint32_t sr = s & 0xFF;
+		const uint32_t sg = (s >> 8) & 0xFF;
+		const uint32_t sb = (s >> 16) & 0xFF;
+		const uint32_t sa = (s >> 24) & 0xFF;
+		const uint32_t srcAlpha = (sa * opacity) / 255;
+
+		if (srcAlpha != 0) {
+			const uint32_t d = dst[i];
+			const uint32_t dr = d & 0xFF;
+			const uint32_t dg = (d >> 8) & 0xFF;
+			const uint32_t db = (d >> 16) & 0xFF;
+			const uint32_t da = (d >> 24) & 0xFF;
+
+			const uint32_t oneMinusSrcAlpha = 255 - srcAlpha;
+			const uint32_t dstAlpha = (oneMinusSrcAlpha * da) / 255;
+			const uint32_t totalAlpha = srcAlpha + dstAlpha;
+
+			const uint32_t r = (sr * srcAlpha + dr * dstAlpha) / totalAlpha;
+			const uint32_t g = (sg * srcAlpha + dg * dstAlpha) / totalAlpha;
+			const uint32_t b = (sb * srcAlpha + db * dstAlpha) / totalAlpha;
+			const uint32_t a = srcAlpha + dstAlpha * oneMinusSrcAlpha / 255;
+
+			dst[i] = r | (g << 8) | (b << 16) | (a << 24);
+		}
+	}
+}
+
+void ImageOps::preMultiply(uint32_t* data, size_t n) const
+{
+	for (size_t i = 0; i < n; i++) {
+		const uint32_t cur = data[i];
+		const uint32_t r = cur & 0xFF;
+		const uint32_t g = (cur >> 8) & 0xFF;
+		const uint32_t b = (cur >> 16) & 0xFF;
+		const uint32_t a = ((cur >> 24) & 0xFF) + 1;
+		data[i] = ((r * a >> 8) & 0xFF)
+			| ((g * a) & 0xFF00)
+			| ((b * a << 8) & 0xFF0000)
+			| ((a - 1) << 24);
+	}
+}
+
+size_t ImageOps::mapToPalette(const ImagePaletteTable& table, const uint32_t* src, uint8_t* dst, size_t n) const
+{
+	for (size_t i = 0; i < n; ++i) {
+		const uint32_t index = table.lookup(src[i]);
+		if (index == ImagePaletteTable::notFound) {
+			return i;
+		}
+		dst[i] = uint8_t(index);
+	}
+	return n;
+}
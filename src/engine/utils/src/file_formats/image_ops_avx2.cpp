@@ -0,0 +1,194 @@
+#include "image_ops_simd.h"
+
+#ifdef HAS_IMAGE_OPS_AVX2
+#include <immintrin.h>
+
+using namespace Halley;
+
+namespace {
+	// One bit per pixel, set for those with any alpha
+	int getAlphaMask(__m256i px)
+	{
+		const __m256i transparent = _mm256_cmpeq_epi32(_mm256_and_si256(px, _mm256_set1_epi32(int(0xFF000000))), _mm256_setzero_si256());
+		return ~_mm256_movemask_ps(_mm256_castsi256_ps(transparent)) & 0xFF;
+	}
+
+	// floor(a / b), exact as long as a < 2^24 and the quotient is small, which it always is here
+	__m256i divideFloor(__m256i a, __m256 b)
+	{
+		return _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(a), b));
+	}
+
+	int firstBit(int mask)
+	{
+		int i = 0;
+		while ((mask & (1 << i)) == 0) {
+			++i;
+		}
+		return i;
+	}
+
+	int lastBit(int mask)
+	{
+		int i = 7;
+		while ((mask & (1 << i)) == 0) {
+			--i;
+		}
+		return i;
+	}
+}
+
+void ImageOpsAVX2::fill(uint32_t* dst, size_t n, uint32_t colour) const
+{
+	const __m256i value = _mm256_set1_epi32(int(colour));
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), value);
+	}
+	ImageOps::fill(dst + i, n - i, colour);
+}
+
+void ImageOpsAVX2::expandAlpha(uint32_t* dst, const uint8_t* src, size_t n) const
+{
+	const __m256i white = _mm256_set1_epi32(0xFFFFFF);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m256i alpha = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_or_si256(_mm256_slli_epi32(alpha, 24), white));
+	}
+	ImageOps::expandAlpha(dst + i, src + i, n - i);
+}
+
+bool ImageOpsAVX2::findAlphaRange(const uint32_t* src, size_t n, size_t& first, size_t& last) const
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const int mask = getAlphaMask(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)));
+		if (mask != 0) {
+			i += firstBit(mask);
+			break;
+		}
+	}
+	while (i < n && (src[i] >> 24) == 0) {
+		++i;
+	}
+	if (i == n) {
+		return false;
+	}
+	first = i;
+
+	// There's at least one at i, so this stops there at the latest
+	size_t j = n;
+	for (; j >= i + 8; j -= 8) {
+		const int mask = getAlphaMask(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + j - 8)));
+		if (mask != 0) {
+			last = j - 8 + lastBit(mask);
+			return true;
+		}
+	}
+	do {
+		--j;
+	} while ((src[j] >> 24) == 0);
+	last = j;
+	return true;
+}
+
+void ImageOpsAVX2::blendAlpha(uint32_t* dst, const uint32_t* src, size_t n, uint32_t opacity) const
+{
+	const __m256i byteMask = _mm256_set1_epi32(0xFF);
+	const __m256i v255 = _mm256_set1_epi32(255);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256 f255 = _mm256_set1_ps(255.0f);
+	const __m256i op = _mm256_set1_epi32(int(opacity));
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+		const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+
+		const __m256i srcAlpha = divideFloor(_mm256_mullo_epi32(_mm256_srli_epi32(s, 24), op), f255);
+		const __m256i untouched = _mm256_cmpeq_epi32(srcAlpha, _mm256_setzero_si256());
+		if (_mm256_movemask_epi8(untouched) == -1) {
+			continue;
+		}
+
+		const __m256i oneMinusSrcAlpha = _mm256_sub_epi32(v255, srcAlpha);
+		const __m256i dstAlpha = divideFloor(_mm256_mullo_epi32(oneMinusSrcAlpha, _mm256_srli_epi32(d, 24)), f255);
+		const __m256 totalAlpha = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_add_epi32(srcAlpha, dstAlpha), _mm256_and_si256(untouched, one))); // Never 0, even where untouched
+
+		__m256i result = _mm256_slli_epi32(_mm256_add_epi32(srcAlpha, divideFloor(_mm256_mullo_epi32(dstAlpha, oneMinusSrcAlpha), f255)), 24);
+		for (int shift = 0; shift < 24; shift += 8) {
+			const __m128i count = _mm_cvtsi32_si128(shift);
+			const __m256i sc = _mm256_and_si256(_mm256_srl_epi32(s, count), byteMask);
+			const __m256i dc = _mm256_and_si256(_mm256_srl_epi32(d, count), byteMask);
+			const __m256i c = divideFloor(_mm256_add_epi32(_mm256_mullo_epi32(sc, srcAlpha), _mm256_mullo_epi32(dc, dstAlpha)), totalAlpha);
+			result = _mm256_or_si256(result, _mm256_sll_epi32(c, count));
+		}
+
+		result = _mm256_blendv_epi8(result, d, untouched);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), result);
+	}
+	ImageOps::blendAlpha(dst + i, src + i, n - i, opacity);
+}
+
+void ImageOpsAVX2::preMultiply(uint32_t* data, size_t n) const
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi16(1);
+	const __m256i alphaMask = _mm256_set1_epi32(int(0xFF000000));
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+
+		// Unpacking and packing both work within each 128-bit half, so the pixels end up back where they were
+		__m256i lo = _mm256_unpacklo_epi8(px, zero);
+		__m256i hi = _mm256_unpackhi_epi8(px, zero);
+		const __m256i loAlpha = _mm256_add_epi16(_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)), one);
+		const __m256i hiAlpha = _mm256_add_epi16(_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)), one);
+		lo = _mm256_srli_epi16(_mm256_mullo_epi16(lo, loAlpha), 8);
+		hi = _mm256_srli_epi16(_mm256_mullo_epi16(hi, hiAlpha), 8);
+
+		const __m256i result = _mm256_packus_epi16(lo, hi);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_blendv_epi8(result, px, alphaMask));
+	}
+	ImageOps::preMultiply(data + i, n - i);
+}
+
+size_t ImageOpsAVX2::mapToPalette(const ImagePaletteTable& table, const uint32_t* src, uint8_t* dst, size_t n) const
+{
+	const __m256i bucketMultiplier = _mm256_set1_epi32(int(table.getBucketMultiplier()));
+	const __m128i bucketShift = _mm_cvtsi32_si128(int(table.getBucketShift()));
+	const __m256i slotMultiplier = _mm256_set1_epi32(int(table.getSlotMultiplier()));
+	const __m128i slotShift = _mm_cvtsi32_si128(int(table.getSlotShift()));
+	const __m256i slotMask = _mm256_set1_epi32(int(table.getSlotMask()));
+	const __m256i notFound = _mm256_set1_epi32(int(ImagePaletteTable::notFound));
+	const int* displacements = reinterpret_cast<const int*>(table.getDisplacements());
+	const int* keys = reinterpret_cast<const int*>(table.getKeys());
+	const int* values = reinterpret_cast<const int*>(table.getValues());
+
+	// The low byte of each index, from both halves, into the low 8 bytes
+	const __m256i lowBytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m256i joinHalves = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m256i colour = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+		const __m256i bucket = _mm256_srl_epi32(_mm256_mullo_epi32(colour, bucketMultiplier), bucketShift);
+		const __m256i displacement = _mm256_i32gather_epi32(displacements, bucket, 4);
+		const __m256i slot = _mm256_and_si256(_mm256_add_epi32(_mm256_srl_epi32(_mm256_mullo_epi32(colour, slotMultiplier), slotShift), displacement), slotMask);
+
+		const __m256i key = _mm256_i32gather_epi32(keys, slot, 4);
+		const __m256i value = _mm256_i32gather_epi32(values, slot, 4);
+		const __m256i missing = _mm256_or_si256(_mm256_xor_si256(_mm256_cmpeq_epi32(key, colour), _mm256_set1_epi32(-1)), _mm256_cmpeq_epi32(value, notFound));
+		if (!_mm256_testz_si256(missing, missing)) {
+			return i + ImageOps::mapToPalette(table, src + i, dst + i, 8);
+		}
+
+		const __m256i indices = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(value, lowBytes), joinHalves);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm256_castsi256_si128(indices));
+	}
+	return i + ImageOps::mapToPalette(table, src + i, dst + i, n - i);
+}
+
+#endif
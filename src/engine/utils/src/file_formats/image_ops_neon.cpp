@@ -0,0 +1,190 @@
+#include "image_ops_simd.h"
+
+#ifdef HAS_IMAGE_OPS_NEON
+#include <arm_neon.h>
+
+using namespace Halley;
+
+namespace {
+	// One bit per pixel, set for those with any alpha
+	int getAlphaMask(uint32x4_t px)
+	{
+		// Loaded rather than brace-initialised, as MSVC's NEON vector types are not aggregates of lanes
+		static const uint32_t bitValues[4] = { 1, 2, 4, 8 };
+		const uint32x4_t opaque = vtstq_u32(px, vdupq_n_u32(0xFF000000u));
+		const uint32x4_t bits = vandq_u32(opaque, vld1q_u32(bitValues));
+		return int(vaddvq_u32(bits));
+	}
+
+	// floor(a / b), exact as long as a < 2^24 and the quotient is small, which it always is here
+	uint32x4_t divideFloor(uint32x4_t a, float32x4_t b)
+	{
+		return vcvtq_u32_f32(vdivq_f32(vcvtq_f32_u32(a), b));
+	}
+
+	int firstBit(int mask)
+	{
+		int i = 0;
+		while ((mask & (1 << i)) == 0) {
+			++i;
+		}
+		return i;
+	}
+
+	int lastBit(int mask)
+	{
+		int i = 3;
+		while ((mask & (1 << i)) == 0) {
+			--i;
+		}
+		return i;
+	}
+}
+
+void ImageOpsNEON::fill(uint32_t* dst, size_t n, uint32_t colour) const
+{
+	const uint32x4_t value = vdupq_n_u32(colour);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		vst1q_u32(dst + i, value);
+	}
+	ImageOps::fill(dst + i, n - i, colour);
+}
+
+void ImageOpsNEON::expandAlpha(uint32_t* dst, const uint8_t* src, size_t n) const
+{
+	const uint32x4_t white = vdupq_n_u32(0xFFFFFF);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const uint16x8_t alpha = vmovl_u8(vld1_u8(src + i));
+		vst1q_u32(dst + i, vorrq_u32(vshlq_n_u32(vmovl_u16(vget_low_u16(alpha)), 24), white));
+		vst1q_u32(dst + i + 4, vorrq_u32(vshlq_n_u32(vmovl_u16(vget_high_u16(alpha)), 24), white));
+	}
+	ImageOps::expandAlpha(dst + i, src + i, n - i);
+}
+
+void ImageOpsNEON::rotate(uint32_t* dst, size_t dstPitch, const uint32_t* src, size_t srcPitch, size_t w, size_t h) const
+{
+	// 4x4 blocks: four source rows make four destination columns, so transposing the block rotates it
+	const size_t w4 = w & ~size_t(3);
+	const size_t h4 = h & ~size_t(3);
+	for (size_t y = 0; y < h4; y += 4) {
+		for (size_t x = 0; x < w4; x += 4) {
+			const uint32_t* s = src + y + (w - 1 - x) * srcPitch;
+			const uint32x4_t r0 = vld1q_u32(s);
+			const uint32x4_t r1 = vld1q_u32(s - srcPitch);
+			const uint32x4_t r2 = vld1q_u32(s - 2 * srcPitch);
+			const uint32x4_t r3 = vld1q_u32(s - 3 * srcPitch);
+
+			const uint32x4_t t0 = vzip1q_u32(r0, r1);
+			const uint32x4_t t1 = vzip1q_u32(r2, r3);
+			const uint32x4_t t2 = vzip2q_u32(r0, r1);
+			const uint32x4_t t3 = vzip2q_u32(r2, r3);
+
+			uint32_t* d = dst + x + y * dstPitch;
+			vst1q_u32(d, vreinterpretq_u32_u64(vzip1q_u64(vreinterpretq_u64_u32(t0), vreinterpretq_u64_u32(t1))));
+			vst1q_u32(d + dstPitch, vreinterpretq_u32_u64(vzip2q_u64(vreinterpretq_u64_u32(t0), vreinterpretq_u64_u32(t1))));
+			vst1q_u32(d + 2 * dstPitch, vreinterpretq_u32_u64(vzip1q_u64(vreinterpretq_u64_u32(t2), vreinterpretq_u64_u32(t3))));
+			vst1q_u32(d + 3 * dstPitch, vreinterpretq_u32_u64(vzip2q_u64(vreinterpretq_u64_u32(t2), vreinterpretq_u64_u32(t3))));
+		}
+
+		// Right edge
+		for (size_t j = y; j < y + 4; ++j) {
+			for (size_t x = w4; x < w; ++x) {
+				dst[x + j * dstPitch] = src[j + (w - 1 - x) * srcPitch];
+			}
+		}
+	}
+
+	// Bottom edge
+	for (size_t y = h4; y < h; ++y) {
+		for (size_t x = 0; x < w; ++x) {
+			dst[x + y * dstPitch] = src[y + (w - 1 - x) * srcPitch];
+		}
+	}
+}
+
+bool ImageOpsNEON::findAlphaRange(const uint32_t* src, size_t n, size_t& first, size_t& last) const
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		const int mask = getAlphaMask(vld1q_u32(src + i));
+		if (mask != 0) {
+			i += firstBit(mask);
+			break;
+		}
+	}
+	while (i < n && (src[i] >> 24) == 0) {
+		++i;
+	}
+	if (i == n) {
+		return false;
+	}
+	first = i;
+
+	// There's at least one at i, so this stops there at the latest
+	size_t j = n;
+	for (; j >= i + 4; j -= 4) {
+		const int mask = getAlphaMask(vld1q_u32(src + j - 4));
+		if (mask != 0) {
+			last = j - 4 + lastBit(mask);
+			return true;
+		}
+	}
+	do {
+		--j;
+	} while ((src[j] >> 24) == 0);
+	last = j;
+	return true;
+}
+
+void ImageOpsNEON::blendAlpha(uint32_t* dst, const uint32_t* src, size_t n, uint32_t opacity) const
+{
+	const uint32x4_t byteMask = vdupq_n_u32(0xFF);
+	const uint32x4_t v255 = vdupq_n_u32(255);
+	const uint32x4_t one = vdupq_n_u32(1);
+	const float32x4_t f255 = vdupq_n_f32(255.0f);
+	const uint32x4_t op = vdupq_n_u32(opacity);
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		const uint32x4_t s = vld1q_u32(src + i);
+		const uint32x4_t d = vld1q_u32(dst + i);
+
+		const uint32x4_t srcAlpha = divideFloor(vmulq_u32(vshrq_n_u32(s, 24), op), f255);
+		const uint32x4_t untouched = vceqq_u32(srcAlpha, vdupq_n_u32(0));
+		if (vminvq_u32(untouched) != 0) {
+			continue;
+		}
+
+		const uint32x4_t oneMinusSrcAlpha = vsubq_u32(v255, srcAlpha);
+		const uint32x4_t dstAlpha = divideFloor(vmulq_u32(oneMinusSrcAlpha, vshrq_n_u32(d, 24)), f255);
+		const float32x4_t totalAlpha = vcvtq_f32_u32(vaddq_u32(vaddq_u32(srcAlpha, dstAlpha), vandq_u32(untouched, one))); // Never 0, even where untouched
+
+		const uint32x4_t a = vaddq_u32(srcAlpha, divideFloor(vmulq_u32(dstAlpha, oneMinusSrcAlpha), f255));
+		const uint32x4_t r = divideFloor(vmlaq_u32(vmulq_u32(vandq_u32(s, byteMask), srcAlpha), vandq_u32(d, byteMask), dstAlpha), totalAlpha);
+		const uint32x4_t g = divideFloor(vmlaq_u32(vmulq_u32(vandq_u32(vshrq_n_u32(s, 8), byteMask), srcAlpha), vandq_u32(vshrq_n_u32(d, 8), byteMask), dstAlpha), totalAlpha);
+		const uint32x4_t b = divideFloor(vmlaq_u32(vmulq_u32(vandq_u32(vshrq_n_u32(s, 16), byteMask), srcAlpha), vandq_u32(vshrq_n_u32(d, 16), byteMask), dstAlpha), totalAlpha);
+
+		const uint32x4_t result = vorrq_u32(vorrq_u32(r, vshlq_n_u32(g, 8)), vorrq_u32(vshlq_n_u32(b, 16), vshlq_n_u32(a, 24)));
+		vst1q_u32(dst + i, vbslq_u32(untouched, d, result));
+	}
+	ImageOps::blendAlpha(dst + i, src + i, n - i, opacity);
+}
+
+void ImageOpsNEON::preMultiply(uint32_t* data, size_t n) const
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		// De-interleaved into one register per channel
+		uint8x8x4_t px = vld4_u8(reinterpret_cast<const uint8_t*>(data + i));
+		const uint16x8_t alpha = vaddw_u8(vdupq_n_u16(1), px.val[3]);
+		for (int c = 0; c < 3; ++c) {
+			px.val[c] = vshrn_n_u16(vmulq_u16(vmovl_u8(px.val[c]), alpha), 8);
+		}
+		vst4_u8(reinterpret_cast<uint8_t*>(data + i), px);
+	}
+	ImageOps::preMultiply(data + i, n - i);
+}
+
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+#include "halley/file_formats/image_ops.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAS_IMAGE_OPS_SSE2
+#if defined(WITH_IMAGE_OPS_AVX2) && (defined(__x86_64__) || defined(_M_X64))
+// Only image_ops_avx2.cpp is compiled with AVX2 enabled, which CMakeLists.txt does wherever it defines WITH_IMAGE_OPS_AVX2.
+// It's only used if the CPU has it.
+#define HAS_IMAGE_OPS_AVX2
+#endif
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define HAS_IMAGE_OPS_NEON
+#endif
+
+namespace Halley
+{
+#ifdef HAS_IMAGE_OPS_SSE2
+	class ImageOpsSSE2 : public ImageOps
+	{
+	public:
+		const char* getName() const override { return "SSE2"; }
+
+		void fill(uint32_t* dst, size_t n, uint32_t colour) const override;
+		void expandAlpha(uint32_t* dst, const uint8_t* src, size_t n) const override;
+		void rotate(uint32_t* dst, size_t dstPitch, const uint32_t* src, size_t srcPitch, size_t w, size_t h) const override;
+		bool findAlphaRange(const uint32_t* src, size_t n, size_t& first, size_t& last) const override;
+		void blendAlpha(uint32_t* dst, const uint32_t* src, size_t n, uint32_t opacity) const override;
+		void preMultiply(uint32_t* data, size_t n) const override;
+	};
+#endif
+
+#ifdef HAS_IMAGE_OPS_AVX2
+	// Rotation stays in 4x4 blocks, as in SSE2
+	class ImageOpsAVX2 : public ImageOpsSSE2
+	{
+	public:
+		const char* getName() const override { return "AVX2"; }
+
+		void fill(uint32_t* dst, size_t n, uint32_t colour) const override;
+		void expandAlpha(uint32_t* dst, const uint8_t* src, size_t n) const override;
+		bool findAlphaRange(const uint32_t* src, size_t n, size_t& first, size_t& last) const override;
+		void blendAlpha(uint32_t* dst, const uint32_t* src, size_t n, uint32_t opacity) const override;
+		void preMultiply(uint32_t* data, size_t n) const override;
+		size_t mapToPalette(const ImagePaletteTable& table, const uint32_t* src, uint8_t* dst, size_t n) const override;
+	};
+#endif
+
+#ifdef HAS_IMAGE_OPS_NEON
+	class ImageOpsNEON : public ImageOps
+	{
+	public:
+		const char* getName() const override { return "NEON"; }
+
+		void fill(uint32_t* dst, size_t n, uint32_t colour) const override;
+		void expandAlpha(uint32_t* dst, const uint8_t* src, size_t n) const override;
+		void rotate(uint32_t* dst, size_t dstPitch, const uint32_t* src, size_t srcPitch, size_t w, size_t h) const override;
+		bool findAlphaRange(const uint32_t* src, size_t n, size_t& first, size_t& last) const override;
+		void blendAlpha(uint32_t* dst, const uint32_t* src, size_t n, uint32_t opacity) const override;
+		void preMultiply(uint32_t* data, size_t n) const override;
+	};
+#endif
+}
@@ -0,0 +1,212 @@
+#include "image_ops_simd.h"
+
+#ifdef HAS_IMAGE_OPS_SSE2
+#include <emmintrin.h>
+
+using namespace Halley;
+
+namespace {
+	int firstBit(int mask)
+	{
+		int i = 0;
+		while ((mask & (1 << i)) == 0) {
+			++i;
+		}
+		return i;
+	}
+
+	int lastBit(int mask)
+	{
+		int i = 3;
+		while ((mask & (1 << i)) == 0) {
+			--i;
+		}
+		return i;
+	}
+
+	// One bit per pixel, set for those with any alpha
+	int getAlphaMask(__m128i px)
+	{
+		const __m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(px, _mm_set1_epi32(int(0xFF000000))), _mm_setzero_si128());
+		return ~_mm_movemask_ps(_mm_castsi128_ps(transparent)) & 0xF;
+	}
+
+	// floor(a / b), exact as long as a < 2^24 and the quotient is small, which it always is here
+	__m128i divideFloor(__m128i a, __m128 b)
+	{
+		return _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(a), b));
+	}
+
+	__m128i mul(__m128i a, __m128i b)
+	{
+		// Both under 2^16, so the low 32 bits of the 16x16 products are all that's needed
+		const __m128i lo = _mm_mullo_epi16(a, b);
+		const __m128i hi = _mm_mulhi_epu16(a, b);
+		return _mm_or_si128(_mm_and_si128(lo, _mm_set1_epi32(0xFFFF)), _mm_slli_epi32(hi, 16));
+	}
+}
+
+void ImageOpsSSE2::fill(uint32_t* dst, size_t n, uint32_t colour) const
+{
+	const __m128i value = _mm_set1_epi32(int(colour));
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), value);
+	}
+	ImageOps::fill(dst + i, n - i, colour);
+}
+
+void ImageOpsSSE2::expandAlpha(uint32_t* dst, const uint8_t* src, size_t n) const
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i white = _mm_set1_epi32(0xFFFFFF);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const __m128i alpha = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		const __m128i lo = _mm_unpacklo_epi8(zero, alpha);
+		const __m128i hi = _mm_unpackhi_epi8(zero, alpha);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_or_si128(_mm_unpacklo_epi16(zero, lo), white));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), _mm_or_si128(_mm_unpackhi_epi16(zero, lo), white));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), _mm_or_si128(_mm_unpacklo_epi16(zero, hi), white));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 12), _mm_or_si128(_mm_unpackhi_epi16(zero, hi), white));
+	}
+	ImageOps::expandAlpha(dst + i, src + i, n - i);
+}
+
+void ImageOpsSSE2::rotate(uint32_t* dst, size_t dstPitch, const uint32_t* src, size_t srcPitch, size_t w, size_t h) const
+{
+	// 4x4 blocks: four source rows make four destination columns, so transposing the block rotates it
+	const size_t w4 = w & ~size_t(3);
+	const size_t h4 = h & ~size_t(3);
+	for (size_t y = 0; y < h4; y += 4) {
+		for (size_t x = 0; x < w4; x += 4) {
+			const uint32_t* s = src + y + (w - 1 - x) * srcPitch;
+			const __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+			const __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s - srcPitch));
+			const __m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s - 2 * srcPitch));
+			const __m128i r3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s - 3 * srcPitch));
+
+			const __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+			const __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+			const __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+			const __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+			uint32_t* d = dst + x + y * dstPitch;
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(d), _mm_unpacklo_epi64(t0, t1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(d + dstPitch), _mm_unpackhi_epi64(t0, t1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(d + 2 * dstPitch), _mm_unpacklo_epi64(t2, t3));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(d + 3 * dstPitch), _mm_unpackhi_epi64(t2, t3));
+		}
+
+		// Right edge
+		for (size_t j = y; j < y + 4; ++j) {
+			for (size_t x = w4; x < w; ++x) {
+				dst[x + j * dstPitch] = src[j + (w - 1 - x) * srcPitch];
+			}
+		}
+	}
+
+	// Bottom edge
+	for (size_t y = h4; y < h; ++y) {
+		for (size_t x = 0; x < w; ++x) {
+			dst[x + y * dstPitch] = src[y + (w - 1 - x) * srcPitch];
+		}
+	}
+}
+
+bool ImageOpsSSE2::findAlphaRange(const uint32_t* src, size_t n, size_t& first, size_t& last) const
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		const int mask = getAlphaMask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+		if (mask != 0) {
+			i += firstBit(mask);
+			break;
+		}
+	}
+	while (i < n && (src[i] >> 24) == 0) {
+		++i;
+	}
+	if (i == n) {
+		return false;
+	}
+	first = i;
+
+	// There's at least one at i, so this stops there at the latest
+	size_t j = n;
+	for (; j >= i + 4; j -= 4) {
+		const int mask = getAlphaMask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j - 4)));
+		if (mask != 0) {
+			last = j - 4 + lastBit(mask);
+			return true;
+		}
+	}
+	do {
+		--j;
+	} while ((src[j] >> 24) == 0);
+	last = j;
+	return true;
+}
+
+void ImageOpsSSE2::blendAlpha(uint32_t* dst, const uint32_t* src, size_t n, uint32_t opacity) const
+{
+	const __m128i byteMask = _mm_set1_epi32(0xFF);
+	const __m128i v255 = _mm_set1_epi32(255);
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128 f255 = _mm_set1_ps(255.0f);
+	const __m128i op = _mm_set1_epi32(int(opacity));
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+
+		const __m128i srcAlpha = divideFloor(mul(_mm_srli_epi32(s, 24), op), f255);
+		const __m128i untouched = _mm_cmpeq_epi32(srcAlpha, _mm_setzero_si128());
+		if (_mm_movemask_epi8(untouched) == 0xFFFF) {
+			continue;
+		}
+
+		const __m128i oneMinusSrcAlpha = _mm_sub_epi32(v255, srcAlpha);
+		const __m128i dstAlpha = divideFloor(mul(oneMinusSrcAlpha, _mm_srli_epi32(d, 24)), f255);
+		const __m128 totalAlpha = _mm_cvtepi32_ps(_mm_add_epi32(_mm_add_epi32(srcAlpha, dstAlpha), _mm_and_si128(untouched, one))); // Never 0, even where untouched
+
+		__m128i result = _mm_slli_epi32(_mm_add_epi32(srcAlpha, divideFloor(mul(dstAlpha, oneMinusSrcAlpha), f255)), 24);
+		for (int shift = 0; shift < 24; shift += 8) {
+			const __m128i sc = _mm_and_si128(_mm_srli_epi32(s, shift), byteMask);
+			const __m128i dc = _mm_and_si128(_mm_srli_epi32(d, shift), byteMask);
+			const __m128i c = divideFloor(_mm_add_epi32(mul(sc, srcAlpha), mul(dc, dstAlpha)), totalAlpha);
+			result = _mm_or_si128(result, _mm_slli_epi32(c, shift));
+		}
+
+		result = _mm_or_si128(_mm_and_si128(untouched, d), _mm_andnot_si128(untouched, result));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), result);
+	}
+	ImageOps::blendAlpha(dst + i, src + i, n - i, opacity);
+}
+
+void ImageOpsSSE2::preMultiply(uint32_t* data, size_t n) const
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i alphaMask = _mm_set1_epi32(int(0xFF000000));
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+
+		// Two pixels in each, one channel per 16-bit lane, times their alpha + 1
+		__m128i lo = _mm_unpacklo_epi8(px, zero);
+		__m128i hi = _mm_unpackhi_epi8(px, zero);
+		const __m128i loAlpha = _mm_add_epi16(_mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)), one);
+		const __m128i hiAlpha = _mm_add_epi16(_mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)), one);
+		lo = _mm_srli_epi16(_mm_mullo_epi16(lo, loAlpha), 8);
+		hi = _mm_srli_epi16(_mm_mullo_epi16(hi, hiAlpha), 8);
+
+		const __m128i result = _mm_packus_epi16(lo, hi);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_or_si128(_mm_andnot_si128(alphaMask, result), _mm_and_si128(alphaMask, px)));
+	}
+	ImageOps::preMultiply(data + i, n - i);
+}
+
+#endif
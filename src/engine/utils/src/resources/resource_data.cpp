@@ -7,6 +7,11 @@
 
 using namespace Halley;
 
+int ResourceDataReader::readAt(size_t, gsl::span<gsl::byte>)
+{
+	throw Exception("This reader doesn't support positional reads.", HalleyExceptions::Resources);
+}
+
 Bytes ResourceDataReader::readAll()
 {
 	Bytes result(size() - tell());
@@ -32,6 +37,14 @@ ResourceDataStatic::ResourceDataStatic(const void* _data, size_t _size, String p
 	set(_data, _size, owning);
 }
 
+ResourceDataStatic::ResourceDataStatic(std::shared_ptr<const char> _data, size_t _size, String path)
+	: ResourceData(path)
+	, data(std::move(_data))
+	, size(_size)
+	, loaded(true)
+{
+}
+
 static void deleter(const char* data)
 {
 	delete[] data;
@@ -117,8 +130,12 @@ ResourceDataStream::ResourceDataStream(String path, ResourceDataMakeReader makeR
 ResourceLoader::ResourceLoader(ResourceLoader&& loader) noexcept
 	: locator(loader.locator)
 	, name(std::move(loader.name))
+	, type(loader.type)
 	, priority(loader.priority)
 	, api(loader.api)
+	, metadata(loader.metadata)
+	, loaded(loader.loaded)
+	, prefetched(std::move(loader.prefetched))
 {
 }
 
@@ -138,6 +155,11 @@ ResourceLoader::ResourceLoader(IResourceLocator& locator, const String& name, As
 
 std::unique_ptr<ResourceDataStatic> ResourceLoader::getStatic()
 {
+	if (prefetched) {
+		loaded = true;
+		return std::move(prefetched);
+	}
+
 	auto result = locator.getStatic(name, type);
 	if (result) {
 		if (metadata->getString("asset_compression", "") == "deflate") {
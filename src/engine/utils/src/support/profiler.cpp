@@ -0,0 +1,281 @@
+#include "halley/support/profiler.h"
+#include "halley/text/string_converter.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <gsl/gsl_assert>
+
+using namespace Halley;
+
+std::atomic<bool> Profiler::enabled(false);
+constexpr size_t Profiler::eventsPerThread;
+constexpr int Profiler::maxDepth;
+
+namespace {
+	class ThreadRecorder;
+
+	struct Registry {
+		std::mutex mutex;
+		Vector<ThreadRecorder*> threads;
+		std::set<std::string> names;
+		int nextThreadId = 0;
+		int64_t frameStart = 0;
+		ProfilerCapture lastFrame;
+		Vector<ProfilerThreadEvents> exited; // From threads that ended since the last frame
+	};
+
+	Registry& getRegistry()
+	{
+		// Never destroyed, as threads may still be exiting during static destruction
+		static Registry* registry = new Registry();
+		return *registry;
+	}
+
+	class ThreadRecorder {
+	public:
+		explicit ThreadRecorder(const String& name)
+			: events(new ProfilerEvent[Profiler::eventsPerThread])
+			, written(0)
+		{
+			auto& registry = getRegistry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			threadId = registry.nextThreadId++;
+			threadName = name.isEmpty() ? "Thread " + toString(threadId) : name;
+			registry.threads.push_back(this);
+		}
+
+		~ThreadRecorder()
+		{
+			auto& registry = getRegistry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			size_t dropped = 0;
+			auto remaining = collect(dropped);
+			if (!remaining.events.empty()) {
+				registry.exited.push_back(std::move(remaining));
+			}
+			registry.threads.erase(std::find(registry.threads.begin(), registry.threads.end(), this));
+		}
+
+		void begin(const char* name)
+		{
+			if (depth < Profiler::maxDepth) {
+				openNames[depth] = name;
+				openStarts[depth] = Profiler::getTimeNs();
+			}
+			++depth;
+		}
+
+		void end()
+		{
+			Expects(depth > 0);
+			--depth;
+			if (depth < Profiler::maxDepth) {
+				const uint64_t idx = written.load(std::memory_order_relaxed);
+				// Keeps the previous store to written ahead of this write to the ring, which collect() relies on to detect overwrites
+				std::atomic_thread_fence(std::memory_order_release);
+				events[idx % Profiler::eventsPerThread] = ProfilerEvent{ openNames[depth], openStarts[depth], Profiler::getTimeNs(), depth };
+				written.store(idx + 1, std::memory_order_release);
+			}
+		}
+
+		// Must be called with the registry locked
+		ProfilerThreadEvents collect(size_t& dropped)
+		{
+			ProfilerThreadEvents result;
+			result.threadId = threadId;
+			result.threadName = threadName;
+
+			// Leave the owning thread a quarter of the ring to keep writing into while this copies
+			constexpr uint64_t maxBacklog = Profiler::eventsPerThread - Profiler::eventsPerThread / 4;
+			const uint64_t end = written.load(std::memory_order_acquire);
+			uint64_t start = collected;
+			if (end - start > maxBacklog) {
+				dropped += size_t(end - maxBacklog - start);
+				start = end - maxBacklog;
+			}
+
+			result.events.reserve(size_t(end - start));
+			for (uint64_t i = start; i < end; ++i) {
+				result.events.push_back(events[i % Profiler::eventsPerThread]);
+			}
+
+			// The owning thread may have lapped the copy anyway, so check how far it got, as a seqlock would.
+			// Anything it wrote over can be torn, including the slot it might be writing right now, so drop those.
+			std::atomic_thread_fence(std::memory_order_acquire);
+			const uint64_t after = written.load(std::memory_order_relaxed) + 1;
+			if (after > start + Profiler::eventsPerThread) {
+				const size_t torn = size_t(std::min(after - Profiler::eventsPerThread, end) - start);
+				result.events.erase(result.events.begin(), result.events.begin() + torn);
+				dropped += torn;
+			}
+
+			collected = end;
+			return result;
+		}
+
+		void setName(const String& name)
+		{
+			auto& registry = getRegistry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			threadName = name;
+		}
+
+	private:
+		std::unique_ptr<ProfilerEvent[]> events;
+		std::atomic<uint64_t> written;
+		uint64_t collected = 0;
+
+		int depth = 0;
+		std::array<const char*, Profiler::maxDepth> openNames;
+		std::array<int64_t, Profiler::maxDepth> openStarts;
+
+		int threadId;
+		String threadName;
+	};
+
+	struct ThreadState {
+		std::unique_ptr<ThreadRecorder> recorder;
+		String name;
+	};
+
+	ThreadState& getThreadState()
+	{
+		thread_local ThreadState state;
+		return state;
+	}
+
+	// Only created once the thread records a zone, so threads that never do cost nothing
+	ThreadRecorder& getRecorder()
+	{
+		auto& state = getThreadState();
+		if (!state.recorder) {
+			state.recorder = std::make_unique<ThreadRecorder>(state.name);
+		}
+		return *state.recorder;
+	}
+
+	String escapeJson(const char* str)
+	{
+		std::stringstream ss;
+		for (const char* c = str; *c; ++c) {
+			if (*c == '"' || *c == '\\') {
+				ss << '\\' << *c;
+			} else if (static_cast<unsigned char>(*c) < 0x20) {
+				ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(*c) << std::dec;
+			} else {
+				ss << *c;
+			}
+		}
+		return ss.str();
+	}
+}
+
+void Profiler::setEnabled(bool e)
+{
+	enabled.store(e, std::memory_order_relaxed);
+}
+
+void Profiler::setThreadName(const String& name)
+{
+	auto& state = getThreadState();
+	state.name = name;
+	if (state.recorder) {
+		state.recorder->setName(name);
+	}
+}
+
+const char* Profiler::internName(const String& name)
+{
+	auto& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	return registry.names.insert(name.cppStr()).first->c_str();
+}
+
+void Profiler::beginZone(const char* name)
+{
+	getRecorder().begin(name);
+}
+
+void Profiler::endZone()
+{
+	getRecorder().end();
+}
+
+void Profiler::endFrame()
+{
+	const int64_t now = getTimeNs();
+	auto& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	ProfilerCapture capture;
+	capture.startNs = registry.frameStart;
+	capture.endNs = now;
+	capture.threads = std::move(registry.exited);
+	registry.exited.clear();
+	for (auto thread: registry.threads) {
+		auto events = thread->collect(capture.droppedEvents);
+		if (!events.events.empty()) {
+			capture.threads.push_back(std::move(events));
+		}
+	}
+
+	// Zones are recorded as they end, so children come out before their parents
+	for (auto& thread: capture.threads) {
+		std::sort(thread.events.begin(), thread.events.end(), [] (const ProfilerEvent& a, const ProfilerEvent& b)
+		{
+			return a.startNs != b.startNs ? a.startNs < b.startNs : a.depth < b.depth;
+		});
+	}
+	std::sort(capture.threads.begin(), capture.threads.end(), [] (const ProfilerThreadEvents& a, const ProfilerThreadEvents& b)
+	{
+		return a.threadId < b.threadId;
+	});
+
+	registry.lastFrame = std::move(capture);
+	registry.frameStart = now;
+}
+
+ProfilerCapture Profiler::getLastFrame()
+{
+	auto& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	return registry.lastFrame;
+}
+
+int64_t Profiler::getTimeNs()
+{
+	static const auto epoch = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+String ProfilerCapture::toChromeTrace() const
+{
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(3);
+	ss << "{\"traceEvents\":[";
+
+	bool first = true;
+	auto separator = [&] () -> const char*
+	{
+		const bool wasFirst = first;
+		first = false;
+		return wasFirst ? "\n" : ",\n";
+	};
+
+	for (auto& thread: threads) {
+		ss << separator() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.threadId
+			<< ",\"args\":{\"name\":\"" << escapeJson(thread.threadName.c_str()) << "\"}}";
+		for (auto& e: thread.events) {
+			ss << separator() << "{\"name\":\"" << escapeJson(e.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread.threadId
+				<< ",\"ts\":" << (double(e.startNs) / 1000.0) << ",\"dur\":" << (double(e.endNs - e.startNs) / 1000.0) << "}";
+		}
+	}
+
+	ss << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	return ss.str();
+}
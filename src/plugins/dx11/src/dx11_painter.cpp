@@ -16,6 +16,8 @@ using namespace Halley;
 DX11Painter::DX11Painter(DX11Video& video, Resources& resources)
 	: Painter(resources)
 	, video(video)
+	, quadVertexBuffer(video, DX11Buffer::Type::Vertex, 256)
+	, quadIndexBuffer(video, DX11Buffer::Type::Index, 256)
 {
 #ifdef WINDOWS_STORE
 	// Due to the architecture of "some" platforms available here, updating a dynamic buffer is extremely slow if it's still in use
@@ -42,7 +44,7 @@ void DX11Painter::doEndRender()
 {
 }
 
-void DX11Painter::clear(Colour colour)
+void DX11Painter::doClear(Colour colour)
 {
 	const float col[] = { colour.r, colour.g, colour.b, colour.a };
 	auto view = dynamic_cast<IDX11RenderTarget&>(getActiveRenderTarget()).getRenderTargetView();
@@ -55,8 +57,8 @@ void DX11Painter::setMaterialPass(const Material& material, int passN)
 
 	// Shader
 	auto& shader = static_cast<DX11Shader&>(pass.getShader());
-	shader.setMaterialLayout(video, material.getDefinition().getAttributes());
-	shader.bind(video);
+	shader.setMaterialLayout(video, material.getDefinition());
+	shader.bind(video, instancing);
 
 	// Blend
 	getBlendMode(pass.getBlend()).bind(video);
@@ -117,6 +119,50 @@ void DX11Painter::setVertices(const MaterialDefinition& material, size_t numVert
 		ib.setData(gsl::as_bytes(gsl::span<unsigned short>(indices, numIndices)));
 		video.getDeviceContext().IASetIndexBuffer(ib.getBuffer(), DXGI_FORMAT_R16_UINT, ib.getOffset());
 	}
+
+	instancing = false;
+}
+
+bool DX11Painter::supportsInstancedSprites() const
+{
+	return true;
+}
+
+void DX11Painter::setInstances(const MaterialDefinition& material, size_t numInstances, void* instanceData)
+{
+	const size_t stride = material.getVertexStride();
+	const size_t instanceDataSize = stride * numInstances;
+
+	if (!quadLoaded) {
+		const std::array<Vector4f, 4> corners = {{ Vector4f(0, 0, 0, 0), Vector4f(1, 0, 1, 0), Vector4f(1, 1, 1, 1), Vector4f(0, 1, 0, 1) }};
+		std::array<unsigned short, 6> indices;
+		generateQuadIndices(0, 1, indices.data());
+		quadVertexBuffer.setData(gsl::as_bytes(gsl::span<const Vector4f>(corners)));
+		quadIndexBuffer.setData(gsl::as_bytes(gsl::span<const unsigned short>(indices)));
+		quadLoaded = true;
+	}
+
+	if (!vertexBuffers[curBuffer].canFit(instanceDataSize)) {
+		rotateBuffers();
+	}
+
+	auto& vb = vertexBuffers[curBuffer];
+	vb.setData(gsl::span<const gsl::byte>(reinterpret_cast<const gsl::byte*>(instanceData), instanceDataSize));
+	ID3D11Buffer* buffers[] = { quadVertexBuffer.getBuffer(), vb.getBuffer() };
+	UINT strides[] = { UINT(sizeof(Vector4f)), UINT(stride) };
+	UINT offsets[] = { quadVertexBuffer.getOffset(), vb.getOffset() };
+	auto& devCon = video.getDeviceContext();
+	devCon.IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	devCon.IASetIndexBuffer(quadIndexBuffer.getBuffer(), DXGI_FORMAT_R16_UINT, quadIndexBuffer.getOffset());
+
+	instancing = true;
+}
+
+void DX11Painter::drawInstancedQuads(size_t numInstances)
+{
+	auto& devCon = video.getDeviceContext();
+	devCon.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	devCon.DrawIndexedInstanced(6, UINT(numInstances), 0, 0, 0);
 }
 
 void DX11Painter::drawTriangles(size_t numIndices)
@@ -14,7 +14,7 @@ namespace Halley
 	public:
 		explicit DX11Painter(DX11Video& video, Resources& resources);
 		
-		void clear(Colour colour) override;
+		void doClear(Colour colour) override;
 		void setMaterialPass(const Material& material, int pass) override;
 		void setMaterialData(const Material& material) override;
 
@@ -28,6 +28,10 @@ namespace Halley
 
 		void onUpdateProjection(Material& material) override;
 
+		bool supportsInstancedSprites() const override;
+		void setInstances(const MaterialDefinition& material, size_t numInstances, void* instanceData) override;
+		void drawInstancedQuads(size_t numInstances) override;
+
 	private:
 		DX11Video& video;
 
@@ -38,6 +42,12 @@ namespace Halley
 		std::unique_ptr<DX11Rasterizer> normalRaster;
 		std::unique_ptr<DX11Rasterizer> scissorRaster;
 
+		// Unit quad shared by all instanced sprites
+		DX11Buffer quadVertexBuffer;
+		DX11Buffer quadIndexBuffer;
+		bool quadLoaded = false;
+		bool instancing = false;
+
 		size_t curBuffer = 0;
 
 		DX11Blend& getBlendMode(BlendType type);
@@ -30,6 +30,10 @@ DX11Shader::~DX11Shader()
 		layout->Release();
 		layout = nullptr;
 	}
+	if (instancedLayout) {
+		instancedLayout->Release();
+		instancedLayout = nullptr;
+	}
 }
 
 void DX11Shader::loadShader(DX11Video& video, ShaderType type, const Bytes& bytes)
@@ -69,17 +73,18 @@ int DX11Shader::getBlockLocation(const String& name, ShaderType stage)
 	return -1;
 }
 
-void DX11Shader::bind(DX11Video& video)
+void DX11Shader::bind(DX11Video& video, bool instanced)
 {
 	Expects(vertexShader);
 	Expects(layout);
+	Expects(!instanced || instancedLayout);
 
 	auto& devCon = video.getDeviceContext();
 	devCon.VSSetShader(vertexShader, nullptr, 0);
 	devCon.GSSetShader(geometryShader, nullptr, 0);
 	devCon.PSSetShader(pixelShader, nullptr, 0);
 
-	devCon.IASetInputLayout(layout);
+	devCon.IASetInputLayout(instanced ? instancedLayout : layout);
 }
 
 static DXGI_FORMAT getDX11Format(ShaderParameterType type)
@@ -106,7 +111,7 @@ static DXGI_FORMAT getDX11Format(ShaderParameterType type)
 	}
 }
 
-void DX11Shader::setMaterialLayout(DX11Video& video, const std::vector<MaterialAttribute>& attributes)
+void DX11Shader::setMaterialLayout(DX11Video& video, const MaterialDefinition& material)
 {
 	if (layout) {
 		return;
@@ -114,8 +119,10 @@ void DX11Shader::setMaterialLayout(DX11Video& video, const std::vector<MaterialA
 
 	Expects(!vertexBlob.empty());
 
+	auto& attributes = material.getAttributes();
 	std::vector<std::array<char, 64>> names(attributes.size());
 	std::vector<D3D11_INPUT_ELEMENT_DESC> desc(attributes.size());
+	std::vector<D3D11_INPUT_ELEMENT_DESC> instancedDesc(attributes.size());
 
 	for (size_t i = 0; i < desc.size(); ++i) {
 		auto& a = attributes[i];
@@ -136,11 +143,20 @@ void DX11Shader::setMaterialLayout(DX11Video& video, const std::vector<MaterialA
 		strcpy_s(names[i].data(), 64, name.c_str());
 
 		desc[i] = { names[i].data(), semanticIndex, format, inputSlot, byteOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 };
+		if (a.offset == int(material.getVertexPosOffset())) {
+			instancedDesc[i] = { names[i].data(), semanticIndex, format, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 };
+		} else {
+			instancedDesc[i] = { names[i].data(), semanticIndex, format, 1, byteOffset, D3D11_INPUT_PER_INSTANCE_DATA, 1 };
+		}
 	}
 
 	HRESULT result = video.getDevice().CreateInputLayout(desc.data(), UINT(desc.size()), vertexBlob.data(), vertexBlob.size(), &layout);
 	if (result != S_OK) {
 		throw Exception("Unable to create input layout for shader " + name, HalleyExceptions::VideoPlugin);
 	}
+	result = video.getDevice().CreateInputLayout(instancedDesc.data(), UINT(instancedDesc.size()), vertexBlob.data(), vertexBlob.size(), &instancedLayout);
+	if (result != S_OK) {
+		throw Exception("Unable to create instanced input layout for shader " + name, HalleyExceptions::VideoPlugin);
+	}
 	vertexBlob.clear();
 }
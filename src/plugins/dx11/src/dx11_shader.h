@@ -8,6 +8,7 @@
 namespace Halley
 {
 	class DX11Video;
+	class MaterialDefinition;
 
 	class DX11Shader : public Shader
 	{
@@ -18,8 +19,8 @@ namespace Halley
 		int getUniformLocation(const String& name, ShaderType stage) override;
 		int getBlockLocation(const String& name, ShaderType stage) override;
 
-		void bind(DX11Video& video);
-		void setMaterialLayout(DX11Video& video, const std::vector<MaterialAttribute>& attributes);
+		void bind(DX11Video& video, bool instanced = false);
+		void setMaterialLayout(DX11Video& video, const MaterialDefinition& material);
 
 	private:
 		String name;
@@ -27,6 +28,7 @@ namespace Halley
 		ID3D11PixelShader* pixelShader = nullptr;
 		ID3D11GeometryShader* geometryShader = nullptr;
 		ID3D11InputLayout* layout = nullptr;
+		ID3D11InputLayout* instancedLayout = nullptr; // vertPos from the unit quad in slot 0, everything else per instance from slot 1
 		Bytes vertexBlob;
 
 		void loadShader(DX11Video& video, ShaderType type, const Bytes& bytes);
@@ -259,6 +259,12 @@ String DX11Video::getShaderLanguage()
 	return "hlsl";
 }
 
+bool DX11Video::supportsRenderThread() const
+{
+	// Resources are created through the device, which is free-threaded, and the immediate context is only used by the painter, render targets and Present
+	return true;
+}
+
 ID3D11Device& DX11Video::getDevice()
 {
 	return *device;
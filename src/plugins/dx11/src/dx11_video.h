@@ -37,6 +37,7 @@ namespace Halley {
 		std::unique_ptr<Painter> makePainter(Resources& resources) override;
 
 		String getShaderLanguage() override;
+		bool supportsRenderThread() const override;
 
 		ID3D11Device& getDevice();
 		ID3D11DeviceContext1& getDeviceContext();
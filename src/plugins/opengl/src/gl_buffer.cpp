@@ -34,11 +34,26 @@ void GLBuffer::setData(gsl::span<const gsl::byte> data)
 	glCheckError();
 }
 
+void GLBuffer::setCapacity(size_t c)
+{
+	bind();
+	capacity = c;
+	size = 0;
+	glBufferData(target, capacity, nullptr, usage);
+
+	glCheckError();
+}
+
 size_t GLBuffer::getSize() const
 {
 	return size;
 }
 
+size_t GLBuffer::getCapacity() const
+{
+	return capacity;
+}
+
 void GLBuffer::bind()
 {
 	glBindBuffer(target, name);
@@ -15,7 +15,9 @@ namespace Halley
 		void bindToTarget(GLuint index);
 		void init(GLenum target, GLenum usage = GL_STREAM_DRAW);
 		void setData(gsl::span<const gsl::byte> data);
+		void setCapacity(size_t capacity);
 		size_t getSize() const;
+		size_t getCapacity() const;
 
 	private:
 		GLenum target = 0;
@@ -8,6 +8,12 @@
 
 using namespace Halley;
 
+#ifdef WITH_OPENGL
+namespace {
+	constexpr size_t streamBufferSize = 4 * 1024 * 1024;
+}
+#endif
+
 PainterOpenGL::PainterOpenGL(Resources& resources)
 	: Painter(resources)
 {}
@@ -15,6 +21,13 @@ PainterOpenGL::PainterOpenGL(Resources& resources)
 PainterOpenGL::~PainterOpenGL()
 {
 #ifdef WITH_OPENGL
+	for (auto& stream: streamBuffers) {
+		if (stream.fence) {
+			glDeleteSync(stream.fence);
+			stream.fence = nullptr;
+		}
+	}
+
 	if (vao != 0) {
 		glBindVertexArray(0);
 		glDeleteVertexArrays(1, &vao);
@@ -40,6 +53,16 @@ void PainterOpenGL::doStartRender()
 	stdQuadElementBuffer.init(GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
 
 #ifdef WITH_OPENGL
+	for (auto& stream: streamBuffers) {
+		stream.buffer.init(GL_ARRAY_BUFFER);
+	}
+
+	quadVertexBuffer.init(GL_ARRAY_BUFFER, GL_STATIC_DRAW);
+	if (quadVertexBuffer.getSize() == 0) {
+		const std::array<Vector4f, 4> corners = {{ Vector4f(0, 0, 0, 0), Vector4f(1, 0, 1, 0), Vector4f(1, 1, 1, 1), Vector4f(0, 1, 0, 1) }};
+		quadVertexBuffer.setData(gsl::as_bytes(gsl::span<const Vector4f>(corners)));
+	}
+
 	if (vao == 0) {
 		glGenVertexArrays(1, &vao);
 		glCheckError();
@@ -52,7 +75,7 @@ void PainterOpenGL::doStartRender()
 	glBindVertexArray(vao);
 #endif
 
-	clear(Colour(0, 0, 0, 1.0f));
+	doClear(Colour(0, 0, 0, 1.0f));
 }
 
 void PainterOpenGL::doEndRender()
@@ -63,7 +86,7 @@ void PainterOpenGL::doEndRender()
 	glCheckError();
 }
 
-void PainterOpenGL::clear(Colour colour)
+void PainterOpenGL::doClear(Colour colour)
 {
 	glCheckError();
 	glClearColor(colour.r, colour.g, colour.b, colour.a);
@@ -141,31 +164,137 @@ void PainterOpenGL::setVertices(const MaterialDefinition& material, size_t numVe
 
 	// Load indices into VBO
 	if (standardQuadsOnly) {
-		if (stdQuadElementBuffer.getSize() < numIndices * sizeof(unsigned short)) {
-			size_t indicesToAllocate = nextPowerOf2(numIndices);
-			std::vector<unsigned short> tmp(indicesToAllocate);
-			generateQuadIndices(0, indicesToAllocate / 6, tmp.data());
-			stdQuadElementBuffer.setData(gsl::as_bytes(gsl::span<unsigned short>(tmp)));
-		} else {
-			stdQuadElementBuffer.bind();
-		}
+		bindStandardQuadIndices(numIndices);
 	} else {
 		elementBuffer.setData(gsl::as_bytes(gsl::span<unsigned short>(indices, numIndices)));
 	}
 
-	// Load vertices into VBO
-	size_t bytesSize = numVertices * material.getVertexStride();
-	vertexBuffer.setData(gsl::as_bytes(gsl::span<char>(static_cast<char*>(vertexData), bytesSize)));
+	// Load vertices into VBO and set attributes
+	const size_t baseOffset = uploadVertices(numVertices * material.getVertexStride(), vertexData);
+	setupVertexAttributes(material, baseOffset, false);
+}
+
+bool PainterOpenGL::supportsInstancedSprites() const
+{
+#ifdef WITH_OPENGL
+	return true;
+#else
+	return false;
+#endif
+}
+
+void PainterOpenGL::setInstances(const MaterialDefinition& material, size_t numInstances, void* instanceData)
+{
+	Expects(numInstances > 0);
+	Expects(instanceData);
+
+	// Every instance is drawn from the same six indices into the unit quad
+	bindStandardQuadIndices(6);
+
+	const size_t baseOffset = uploadVertices(numInstances * material.getVertexStride(), instanceData);
+	setupVertexAttributes(material, baseOffset, true);
+}
+
+void PainterOpenGL::drawInstancedQuads(size_t numInstances)
+{
+	Expects(numInstances > 0);
+
+#ifdef WITH_OPENGL
+	glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, nullptr, GLsizei(numInstances));
+	glCheckError();
+#endif
+}
+
+void PainterOpenGL::bindStandardQuadIndices(size_t numIndices)
+{
+	if (stdQuadElementBuffer.getSize() < numIndices * sizeof(unsigned short)) {
+		size_t indicesToAllocate = nextPowerOf2(numIndices);
+		std::vector<unsigned short> tmp(indicesToAllocate);
+		generateQuadIndices(0, indicesToAllocate / 6, tmp.data());
+		stdQuadElementBuffer.setData(gsl::as_bytes(gsl::span<unsigned short>(tmp)));
+	} else {
+		stdQuadElementBuffer.bind();
+	}
+}
+
+size_t PainterOpenGL::uploadVertices(size_t numBytes, void* vertexData)
+{
+	// Vertices that have already been written into a stream buffer don't need to be uploaded
+#ifdef WITH_OPENGL
+	if (verticesStreamed) {
+		verticesStreamed = false;
+		streamBuffers[curStream].buffer.bind();
+		return streamOffset;
+	}
+#endif
+
+	vertexBuffer.setData(gsl::as_bytes(gsl::span<char>(static_cast<char*>(vertexData), numBytes)));
+	return 0;
+}
+
+char* PainterOpenGL::mapVertices(size_t minBytes, size_t& capacity)
+{
+#ifdef WITH_OPENGL
+	if (streamBuffers[curStream].used + minBytes > streamBuffers[curStream].buffer.getCapacity()) {
+		auto& prev = streamBuffers[curStream];
+		if (prev.used > 0) {
+			prev.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			curStream = (curStream + 1) % streamBuffers.size();
+		}
+
+		// Wait until the GPU is done reading whatever was last drawn from this buffer
+		auto& stream = streamBuffers[curStream];
+		if (stream.fence) {
+			while (glClientWaitSync(stream.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+			glDeleteSync(stream.fence);
+			stream.fence = nullptr;
+		}
+		stream.used = 0;
+		if (stream.buffer.getCapacity() < minBytes) {
+			stream.buffer.setCapacity(std::max(streamBufferSize, nextPowerOf2(minBytes)));
+		}
+	}
+
+	auto& stream = streamBuffers[curStream];
+	stream.buffer.bind();
+	capacity = stream.buffer.getCapacity() - stream.used;
+	auto result = glMapBufferRange(GL_ARRAY_BUFFER, stream.used, capacity, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+	glCheckError();
+	return static_cast<char*>(result);
+#else
+	return nullptr;
+#endif
+}
+
+void PainterOpenGL::unmapVertices(size_t bytesUsed)
+{
+#ifdef WITH_OPENGL
+	auto& stream = streamBuffers[curStream];
+	stream.buffer.bind();
+	if (bytesUsed > 0) {
+		glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, bytesUsed);
+	}
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+	glCheckError();
 
-	// Set attributes
-	setupVertexAttributes(material);
+	streamOffset = stream.used;
+	stream.used = alignUp(stream.used + bytesUsed, size_t(16));
+	verticesStreamed = bytesUsed > 0;
+#endif
 }
 
-void PainterOpenGL::setupVertexAttributes(const MaterialDefinition& material)
+void PainterOpenGL::setupVertexAttributes(const MaterialDefinition& material, size_t baseOffset, bool instanced)
 {
 	// Set vertex attribute pointers in VBO
+	// When instanced, every attribute advances once per instance, except for vertPos, which is read from the unit quad after the loop
 	size_t vertexStride = material.getVertexStride();
+	const MaterialAttribute* vertPosAttribute = nullptr;
 	for (auto& attribute : material.getAttributes()) {
+		if (instanced && attribute.offset == int(material.getVertexPosOffset())) {
+			vertPosAttribute = &attribute;
+			continue;
+		}
+
 		int count = 0;
 		int type = 0;
 		switch (attribute.type) {
@@ -205,10 +334,34 @@ void PainterOpenGL::setupVertexAttributes(const MaterialDefinition& material)
 			break;
 		}
 		glEnableVertexAttribArray(attribute.location);
-		size_t offset = attribute.offset;
+		size_t offset = baseOffset + attribute.offset;
 		glVertexAttribPointer(attribute.location, count, type, GL_FALSE, GLsizei(vertexStride), reinterpret_cast<GLvoid*>(offset));
 		glCheckError();
+
+#ifdef WITH_OPENGL
+		const uint32_t locationBit = 1u << attribute.location;
+		if (instanced != ((instancedAttributes & locationBit) != 0)) {
+			glVertexAttribDivisor(attribute.location, instanced ? 1 : 0);
+			instancedAttributes ^= locationBit;
+		}
+#endif
+	}
+
+#ifdef WITH_OPENGL
+	if (instanced) {
+		Expects(vertPosAttribute);
+		Expects(vertPosAttribute->type == ShaderParameterType::Float4);
+		quadVertexBuffer.bind();
+		glEnableVertexAttribArray(vertPosAttribute->location);
+		glVertexAttribPointer(vertPosAttribute->location, 4, GL_FLOAT, GL_FALSE, GLsizei(sizeof(Vector4f)), nullptr);
+		const uint32_t locationBit = 1u << vertPosAttribute->location;
+		if (instancedAttributes & locationBit) {
+			glVertexAttribDivisor(vertPosAttribute->location, 0);
+			instancedAttributes &= ~locationBit;
+		}
+		glCheckError();
 	}
+#endif
 
 	// TODO: disable positions not used by this program
 }
@@ -18,27 +18,50 @@ namespace Halley
 		void doStartRender() override;
 		void doEndRender() override;
 
-		void clear(Colour colour) override;
+		void doClear(Colour colour) override;
 		void setMaterialPass(const Material& material, int pass) override;
 		void setMaterialData(const Material& material) override;
 
 		void setClip(Rect4i clip, bool enable) override;
+		bool supportsInstancedSprites() const override;
 
 	protected:
 		void setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices, bool standardQuadsOnly) override;
 		void drawTriangles(size_t numIndices) override;
+		void setInstances(const MaterialDefinition& material, size_t numInstances, void* instanceData) override;
+		void drawInstancedQuads(size_t numInstances) override;
+		char* mapVertices(size_t minBytes, size_t& capacity) override;
+		void unmapVertices(size_t bytesUsed) override;
 		void setViewPort(Rect4i rect) override;
 		void onUpdateProjection(Material& material) override;
 
 	private:
 #ifdef WITH_OPENGL
 		GLuint vao = 0;
+
+		// Ring of vertex buffers that batches are written into directly while mapped.
+		// Mapping is unsynchronized, so each buffer is fenced when the ring moves past it, and only waited on when it comes back around.
+		struct StreamBuffer
+		{
+			GLBuffer buffer;
+			size_t used = 0;
+			GLsync fence = nullptr;
+		};
+		std::array<StreamBuffer, 3> streamBuffers;
+		size_t curStream = 0;
+		size_t streamOffset = 0;
+		bool verticesStreamed = false;
+
+		GLBuffer quadVertexBuffer;
+		uint32_t instancedAttributes = 0; // Bit mask of attribute locations with their divisor set to 1
 #endif
 		GLBuffer vertexBuffer;
 		GLBuffer elementBuffer;
 		GLBuffer stdQuadElementBuffer;
 		std::unique_ptr<GLUtils> glUtils;
 
-		void setupVertexAttributes(const MaterialDefinition& material);
+		size_t uploadVertices(size_t numBytes, void* vertexData);
+		void bindStandardQuadIndices(size_t numIndices);
+		void setupVertexAttributes(const MaterialDefinition& material, size_t baseOffset, bool instanced);
 	};
 }
@@ -0,0 +1,203 @@
+// Packs a spritesheet's worth of sprites with each of the packers, reporting how long it took to find the smallest atlas
+// they fit in (trying sizes the way SpriteImporter does), and how much of that atlas they cover.
+// Pass image files to pack their trimmed sizes, as the sprite importer would; otherwise, sprite-like sizes are made up.
+
+#include <halley/data_structures/bin_pack.h>
+#include <halley/file_formats/image.h>
+#include <halley/concurrency/executor.h>
+#include <halley/maths/random.h>
+#include <halley/utils/utils.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+using namespace Halley;
+
+namespace {
+	std::vector<Vector2i> loadSizes(int argc, char** argv)
+	{
+		std::vector<Vector2i> sizes;
+		for (int i = 1; i < argc; ++i) {
+			std::ifstream file(argv[i], std::ios::binary);
+			const std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+			if (data.empty()) {
+				printf("Unable to read %s\n", argv[i]);
+				continue;
+			}
+			Image img(gsl::as_bytes(gsl::span<const char>(data)));
+			const auto size = img.getTrimRect().getSize();
+			if (size.x > 0 && size.y > 0) {
+				sizes.push_back(size);
+			}
+		}
+		return sizes;
+	}
+
+	std::vector<Vector2i> makeSizes(int n)
+	{
+		// Mostly small characters and props, a few large backgrounds, and some long thin ones
+		Random rng(1234);
+		std::vector<Vector2i> sizes;
+		for (int i = 0; i < n; ++i) {
+			const int kind = rng.getInt(0, 39);
+			if (kind == 0) {
+				sizes.push_back(Vector2i(rng.getInt(128, 320), rng.getInt(128, 240)));
+			} else if (kind < 3) {
+				sizes.push_back(rng.getInt(0, 1) ? Vector2i(rng.getInt(100, 300), rng.getInt(4, 24)) : Vector2i(rng.getInt(4, 24), rng.getInt(100, 300)));
+			} else {
+				sizes.push_back(Vector2i(rng.getInt(8, 64), rng.getInt(8, 64)));
+			}
+		}
+		return sizes;
+	}
+
+	// Same sequence as SpriteImporter: 64x64, then 128x64, 128x128, 256x128, etc
+	std::vector<Vector2i> getCandidateSizes(int64_t totalArea)
+	{
+		const int minSize = nextPowerOf2(int(sqrt(double(totalArea)))) / 2;
+		const int64_t guessArea = int64_t(minSize) * int64_t(minSize);
+		const int maxSize = 4096;
+		int curSize = std::min(maxSize, std::max(32, int(minSize)));
+		bool wide = guessArea > 2 * totalArea;
+
+		std::vector<Vector2i> sizes;
+		while (true) {
+			Vector2i size(curSize * (wide ? 2 : 1), curSize);
+			if (size.x > maxSize || size.y > maxSize) {
+				break;
+			}
+			sizes.push_back(size);
+			if (wide) {
+				wide = false;
+				curSize *= 2;
+			} else {
+				wide = true;
+			}
+		}
+		return sizes;
+	}
+
+	bool isValid(const std::vector<BinPackEntry>& entries, const BinPackSearchResult& result)
+	{
+		if (result.results.size() != entries.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < result.results.size(); ++i) {
+			const auto& a = result.results[i];
+			const auto* entry = reinterpret_cast<const BinPackEntry*>(a.data);
+			const auto expected = a.rotated ? Vector2i(entry->size.y, entry->size.x) : entry->size;
+			if (a.rect.getSize() != expected || (a.rotated && !entry->canRotate)) {
+				return false;
+			}
+			if (a.rect.getLeft() < 0 || a.rect.getTop() < 0 || a.rect.getRight() > result.binSize.x || a.rect.getBottom() > result.binSize.y) {
+				return false;
+			}
+			for (size_t j = 0; j < i; ++j) {
+				const auto& b = result.results[j].rect;
+				if (a.rect.getLeft() < b.getRight() && b.getLeft() < a.rect.getRight() && a.rect.getTop() < b.getBottom() && b.getTop() < a.rect.getBottom()) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	template <typename F>
+	bool run(const char* name, const std::vector<BinPackEntry>& entries, int64_t totalArea, F pack)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		auto result = pack();
+		const double ms = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000.0;
+
+		if (!result) {
+			printf("%-24s %9.2f ms  doesn't fit\n", name, ms);
+			return true;
+		}
+
+		// The atlas is shrunk to what's used before being written
+		Vector2i used;
+		for (auto& r: result->results) {
+			used = Vector2i(std::max(used.x, r.rect.getRight()), std::max(used.y, r.rect.getBottom()));
+		}
+		const auto shrunk = Vector2i(nextPowerOf2(used.x), nextPowerOf2(used.y));
+		const double occupancy = 100.0 * double(totalArea) / (double(shrunk.x) * double(shrunk.y));
+		const double usedOccupancy = 100.0 * double(totalArea) / (double(used.x) * double(used.y));
+		printf("%-24s %9.2f ms  %4dx%-4d  %5.1f%% occupancy (%5.1f%% of the %dx%d used)\n", name, ms, shrunk.x, shrunk.y, occupancy, usedOccupancy, used.x, used.y);
+
+		if (!isValid(entries, *result)) {
+			printf("FAILED: %s produced an invalid pack\n", name);
+			return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Executors executors;
+	Executors::set(executors);
+	auto makeThread = [] (String, std::function<void()> runnable) { return std::thread(runnable); };
+	auto pool = std::make_unique<ThreadPool>("Default", ExecutionQueue::getDefault(), std::max(2u, std::thread::hardware_concurrency()), makeThread);
+	auto auxPool = std::make_unique<ThreadPool>("CPUAux", Executors::getCPUAux(), std::max(2u, std::thread::hardware_concurrency()), makeThread);
+
+	auto sizes = argc > 1 ? loadSizes(argc, argv) : makeSizes(2000);
+	if (sizes.empty()) {
+		printf("Nothing to pack\n");
+		return 1;
+	}
+
+	// Entries point at themselves, so that the results can be checked against them
+	std::vector<BinPackEntry> entries;
+	std::vector<BinPackEntry> rotatableEntries;
+	int64_t totalArea = 0;
+	for (auto& s: sizes) {
+		entries.emplace_back(s);
+		rotatableEntries.emplace_back(s, nullptr, true);
+		totalArea += int64_t(s.x) * int64_t(s.y);
+	}
+	for (size_t i = 0; i < entries.size(); ++i) {
+		entries[i].data = &entries[i];
+		rotatableEntries[i].data = &rotatableEntries[i];
+	}
+
+	const auto candidates = getCandidateSizes(totalArea);
+	printf("%zu sprites, %lld px^2, %zu candidate sizes\n", sizes.size(), static_cast<long long>(totalArea), candidates.size());
+
+	auto tryInOrder = [&] (const std::vector<BinPackEntry>& es, std::function<boost::optional<Vector<BinPackResult>>(const std::vector<BinPackEntry>&, Vector2i)> f) -> boost::optional<BinPackSearchResult>
+	{
+		for (auto& size: candidates) {
+			auto result = f(es, size);
+			if (result) {
+				return BinPackSearchResult(size, std::move(result.get()));
+			}
+		}
+		return {};
+	};
+
+	bool ok = true;
+	ok &= run("BinPack2D", entries, totalArea, [&] () { return tryInOrder(entries, &BinPack::pack); });
+	ok &= run("shelf", entries, totalArea, [&] () { return tryInOrder(entries, &BinPack::fastPack); });
+	ok &= run("MaxRects", entries, totalArea, [&] () { return tryInOrder(entries, &BinPack::maxRectsPack); });
+	ok &= run("MaxRects, search", entries, totalArea, [&] () { return BinPack::packSmallest(entries, candidates); });
+	ok &= run("MaxRects, search, rotate", rotatableEntries, totalArea, [&] () { return BinPack::packSmallest(rotatableEntries, candidates); });
+
+	// Has to come out the same every time, regardless of which thread finishes first
+	auto first = BinPack::packSmallest(rotatableEntries, candidates);
+	for (int i = 0; i < 5 && first; ++i) {
+		auto again = BinPack::packSmallest(rotatableEntries, candidates);
+		bool same = again && again->binSize == first->binSize && again->results.size() == first->results.size();
+		for (size_t j = 0; same && j < first->results.size(); ++j) {
+			same = again->results[j].rect == first->results[j].rect && again->results[j].rotated == first->results[j].rotated && again->results[j].data == first->results[j].data;
+		}
+		if (!same) {
+			printf("FAILED: packing the same sprites gave different results\n");
+			ok = false;
+			break;
+		}
+	}
+
+	return ok ? 0 : 1;
+}
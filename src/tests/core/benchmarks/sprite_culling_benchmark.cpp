@@ -0,0 +1,174 @@
+// Headless comparison of SpritePainter culling: adding every sprite each frame, so that all of them get sorted and then tested
+// against the view, or registering them once in the spatial index, so that only the visible ones are sorted and drawn.
+// Sprites are scattered over a world about 20 times the size of the view, and the view pans every frame.
+
+#include <halley/text/halleystring.h>
+#include <halley/core/graphics/painter.h>
+#include <halley/core/graphics/sprite/sprite.h>
+#include <halley/core/graphics/sprite/sprite_painter.h>
+#include <halley/core/graphics/material/material.h>
+#include <halley/core/graphics/material/material_definition.h>
+#include <halley/core/graphics/material/material_parameter.h>
+#include <halley/core/resources/resources.h>
+#include <halley/core/resources/resource_locator.h>
+#include <halley/file_formats/config_file.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace Halley;
+
+// Stands in for a GPU backend that does nothing with what it's given
+class BenchmarkPainter final : public Painter {
+public:
+	explicit BenchmarkPainter(Resources& resources)
+		: Painter(resources)
+	{}
+
+	void doClear(Colour) override {}
+	void setMaterialPass(const Material&, int) override {}
+	void setMaterialData(const Material&) override {}
+
+protected:
+	void doStartRender() override {}
+	void doEndRender() override {}
+	void setViewPort(Rect4i) override {}
+	void setClip(Rect4i, bool) override {}
+	void onUpdateProjection(Material&) override {}
+	void drawTriangles(size_t) override {}
+	void setVertices(const MaterialDefinition&, size_t, void*, size_t, unsigned short*, bool) override {}
+};
+
+static std::shared_ptr<MaterialDefinition> makeSpriteMaterial()
+{
+	// Same layout as shared_assets/material/sprite_base.yaml
+	const char* attributes[][2] = {
+		{ "a_vertPos", "vec4" }, { "a_position", "vec2" }, { "a_pivot", "vec2" }, { "a_size", "vec2" }, { "a_scale", "vec2" },
+		{ "a_colour", "vec4" }, { "a_texCoord0", "vec4" }, { "a_rotation", "float" }, { "a_textureRotation", "float" }
+	};
+
+	ConfigNode::SequenceType attributeList;
+	for (auto& a: attributes) {
+		ConfigNode::MapType entry;
+		entry[a[0]] = ConfigNode(String(a[1]));
+		attributeList.emplace_back(std::move(entry));
+	}
+	ConfigNode::MapType root;
+	root["name"] = ConfigNode(String("Benchmark/Sprite"));
+	root["attributes"] = ConfigNode(std::move(attributeList));
+
+	auto definition = std::make_shared<MaterialDefinition>();
+	definition->load(ConfigNode(std::move(root)));
+	definition->addPass(MaterialPass());
+	return definition;
+}
+
+struct Result {
+	double msPerFrame;
+	size_t verticesPerFrame;
+};
+
+static Rect4f getView(int frame)
+{
+	// 800x600 out of 4000x2500, a little under 5% of the world
+	const auto pos = Vector2f(float((frame * 7) % 3200), float((frame * 3) % 1900));
+	return Rect4f(pos, pos + Vector2f(800, 600));
+}
+
+template <typename F>
+static Result run(Resources& resources, int nFrames, F frame)
+{
+	BenchmarkPainter painter(resources);
+	frame(painter, 0);
+	painter.flush();
+
+	const size_t verticesBefore = painter.getNumVertices();
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 1; i <= nFrames; ++i) {
+		frame(painter, i);
+	}
+	const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	return Result{ elapsed * 1000.0 / nFrames, (painter.getNumVertices() - verticesBefore) / size_t(nFrames) };
+}
+
+int main(int argc, char** argv)
+{
+	const int nSprites = argc > 1 ? atoi(argv[1]) : 100000;
+	const int nFrames = argc > 2 ? atoi(argv[2]) : 100;
+
+	Resources resources(nullptr, nullptr);
+	resources.init<MaterialDefinition>();
+	auto baseMaterial = std::make_shared<MaterialDefinition>();
+	baseMaterial->addPass(MaterialPass());
+	resources.of<MaterialDefinition>().setResource(0, "Halley/MaterialBase", baseMaterial);
+
+	Vector<std::shared_ptr<Material>> materials;
+	auto definition = makeSpriteMaterial();
+	for (int i = 0; i < 4; ++i) {
+		materials.push_back(std::make_shared<Material>(definition));
+	}
+
+	uint32_t seed = 12345;
+	auto random = [&] (float range) {
+		seed = seed * 1664525u + 1013904223u;
+		return float(seed >> 8) / float(1 << 24) * range;
+	};
+	Vector<Vector2f> startPositions;
+	for (int i = 0; i < nSprites; ++i) {
+		startPositions.push_back(Vector2f(random(4000), random(2500)));
+	}
+	Vector<Sprite> sprites(nSprites);
+	auto reset = [&] () {
+		for (int i = 0; i < nSprites; ++i) {
+			sprites[i].setMaterial(materials[i % materials.size()]).setPos(startPositions[i]).setSize(Vector2f(16, 16));
+		}
+	};
+
+	// A few sprites move every frame
+	const int nMoving = nSprites / 100;
+	auto move = [&] (int frame) {
+		for (int i = 0; i < nMoving; ++i) {
+			auto& sprite = sprites[(i * 97 + frame) % nSprites];
+			sprite.setPos(sprite.getPosition() + Vector2f(1, 1));
+		}
+	};
+
+	reset();
+	SpritePainter unindexed;
+	const auto all = run(resources, nFrames, [&] (Painter& painter, int frame) {
+		move(frame);
+		unindexed.start(sprites.size());
+		for (auto& sprite: sprites) {
+			unindexed.add(sprite, 1, 0, sprite.getPosition().y);
+		}
+		unindexed.draw(1, painter, getView(frame));
+	});
+
+	reset();
+	SpritePainter indexed;
+	Vector<SpritePainter::IndexedSpriteId> ids;
+	for (auto& sprite: sprites) {
+		ids.push_back(indexed.addIndexed(sprite, 1, 0, sprite.getPosition().y));
+	}
+	const auto culled = run(resources, nFrames, [&] (Painter& painter, int frame) {
+		move(frame);
+		indexed.start(0);
+		for (int i = 0; i < nMoving; ++i) {
+			const int idx = (i * 97 + frame) % nSprites;
+			indexed.updateIndexed(ids[idx], sprites[idx], 1, 0, sprites[idx].getPosition().y);
+		}
+		indexed.draw(1, painter, getView(frame));
+	});
+
+	printf("%d sprites, %d moving, %d frames\n", nSprites, nMoving, nFrames);
+	printf("add all: %.3f ms per frame, %zu vertices per frame\n", all.msPerFrame, all.verticesPerFrame);
+	printf("indexed: %.3f ms per frame, %zu vertices per frame\n", culled.msPerFrame, culled.verticesPerFrame);
+	printf("%.2fx faster\n", all.msPerFrame / culled.msPerFrame);
+
+	if (all.verticesPerFrame != culled.verticesPerFrame) {
+		printf("FAILED: indexed culling drew a different number of sprites\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,149 @@
+// Headless comparison of the two sprite submission paths in Painter: four expanded vertices plus six indices per sprite,
+// or one instance record per sprite. Reports CPU time and the bytes written for the backend to upload each frame.
+
+#include <halley/text/halleystring.h>
+#include <halley/core/graphics/painter.h>
+#include <halley/core/graphics/sprite/sprite.h>
+#include <halley/core/graphics/material/material.h>
+#include <halley/core/graphics/material/material_definition.h>
+#include <halley/core/graphics/material/material_parameter.h>
+#include <halley/core/resources/resources.h>
+#include <halley/core/resources/resource_locator.h>
+#include <halley/file_formats/config_file.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace Halley;
+
+// Stands in for a GPU backend, copying everything submitted to it like a buffer upload would
+class BenchmarkPainter final : public Painter {
+public:
+	BenchmarkPainter(Resources& resources, bool instancing)
+		: Painter(resources)
+		, instancing(instancing)
+	{}
+
+	void doClear(Colour) override {}
+	void setMaterialPass(const Material&, int) override {}
+	void setMaterialData(const Material&) override {}
+	bool supportsInstancedSprites() const override { return instancing; }
+
+	size_t getBytesUploaded() const { return bytesUploaded; }
+
+protected:
+	void doStartRender() override {}
+	void doEndRender() override {}
+	void setViewPort(Rect4i) override {}
+	void setClip(Rect4i, bool) override {}
+	void onUpdateProjection(Material&) override {}
+	void drawTriangles(size_t) override {}
+	void drawInstancedQuads(size_t) override {}
+
+	void setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices, bool) override
+	{
+		upload(vertexData, numVertices * material.getVertexStride());
+		upload(indices, numIndices * sizeof(unsigned short));
+	}
+
+	void setInstances(const MaterialDefinition& material, size_t numInstances, void* instanceData) override
+	{
+		upload(instanceData, numInstances * material.getVertexStride());
+	}
+
+private:
+	bool instancing;
+	Vector<char> gpuBuffer;
+	size_t bytesUploaded = 0;
+
+	void upload(const void* data, size_t size)
+	{
+		if (gpuBuffer.size() < size) {
+			gpuBuffer.resize(size);
+		}
+		memcpy(gpuBuffer.data(), data, size);
+		bytesUploaded += size;
+	}
+};
+
+static std::shared_ptr<MaterialDefinition> makeSpriteMaterial()
+{
+	// Same layout as shared_assets/material/sprite_base.yaml
+	const char* attributes[][2] = {
+		{ "a_vertPos", "vec4" }, { "a_position", "vec2" }, { "a_pivot", "vec2" }, { "a_size", "vec2" }, { "a_scale", "vec2" },
+		{ "a_colour", "vec4" }, { "a_texCoord0", "vec4" }, { "a_rotation", "float" }, { "a_textureRotation", "float" }
+	};
+
+	ConfigNode::SequenceType attributeList;
+	for (auto& a: attributes) {
+		ConfigNode::MapType entry;
+		entry[a[0]] = ConfigNode(String(a[1]));
+		attributeList.emplace_back(std::move(entry));
+	}
+	ConfigNode::MapType root;
+	root["name"] = ConfigNode(String("Benchmark/Sprite"));
+	root["attributes"] = ConfigNode(std::move(attributeList));
+
+	auto definition = std::make_shared<MaterialDefinition>();
+	definition->load(ConfigNode(std::move(root)));
+	definition->addPass(MaterialPass());
+	return definition;
+}
+
+struct Result {
+	double msPerFrame;
+	double bytesPerFrame;
+};
+
+static Result run(Resources& resources, const std::shared_ptr<Material>& material, const Vector<Sprite>& sprites, bool instancing, int nFrames)
+{
+	BenchmarkPainter painter(resources, instancing);
+
+	// Particle systems draw in runs of a few hundred sprites
+	const size_t runLength = 256;
+	auto frame = [&] () {
+		for (size_t i = 0; i < sprites.size(); i += runLength) {
+			Sprite::draw(sprites.data() + i, std::min(runLength, sprites.size() - i), painter);
+		}
+		painter.flush();
+	};
+
+	frame();
+	const size_t bytesBefore = painter.getNumBytesSubmitted();
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < nFrames; ++i) {
+		frame();
+	}
+	const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	return Result{ elapsed * 1000.0 / nFrames, double(painter.getNumBytesSubmitted() - bytesBefore) / nFrames };
+}
+
+int main(int argc, char** argv)
+{
+	const int nSprites = argc > 1 ? atoi(argv[1]) : 100000;
+	const int nFrames = argc > 2 ? atoi(argv[2]) : 100;
+
+	Resources resources(nullptr, nullptr);
+	resources.init<MaterialDefinition>();
+	auto baseMaterial = std::make_shared<MaterialDefinition>();
+	baseMaterial->addPass(MaterialPass());
+	resources.of<MaterialDefinition>().setResource(0, "Halley/MaterialBase", baseMaterial);
+
+	auto material = std::make_shared<Material>(makeSpriteMaterial());
+	Vector<Sprite> sprites(nSprites);
+	for (int i = 0; i < nSprites; ++i) {
+		sprites[i].setMaterial(material).setPos(Vector2f(float(i % 1000), float(i / 1000))).setSize(Vector2f(8, 8));
+	}
+
+	const auto expanded = run(resources, material, sprites, false, nFrames);
+	const auto instanced = run(resources, material, sprites, true, nFrames);
+
+	printf("%d sprites, %d frames\n", nSprites, nFrames);
+	printf("expanded:  %.3f ms per frame, %.2f MB submitted per frame\n", expanded.msPerFrame, expanded.bytesPerFrame / (1024 * 1024));
+	printf("instanced: %.3f ms per frame, %.2f MB submitted per frame\n", instanced.msPerFrame, instanced.bytesPerFrame / (1024 * 1024));
+	printf("%.2fx fewer bytes, %.2fx faster\n", expanded.bytesPerFrame / instanced.bytesPerFrame, expanded.msPerFrame / instanced.msPerFrame);
+
+	return 0;
+}
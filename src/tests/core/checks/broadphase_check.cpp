@@ -0,0 +1,287 @@
+// Checks Broadphase against brute force over random adds, removes, single and batch updates and clears, comparing every query and,
+// regularly, every overlapping pair, which must each come out exactly once. FlatIndexMap is checked against std::unordered_map over
+// keys crowded into few slots, so erasing constantly shifts long probe runs back. Finally, queries run from several threads at once.
+
+#include <halley/data_structures/broadphase.h>
+#include <halley/data_structures/rect_spatial_checker.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace Halley;
+
+namespace {
+	uint32_t seed = 12345;
+
+	uint32_t random()
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return seed;
+	}
+
+	int randomInt(int min, int max)
+	{
+		return min + int(random() % uint32_t(max - min + 1));
+	}
+
+	// Mostly small, some spanning many cells, some empty, around the origin so that negative cells are covered too
+	Rect4i randomRect()
+	{
+		const Vector2i p(randomInt(-2000, 2000), randomInt(-2000, 2000));
+		switch (random() % 8) {
+		case 0:
+			return Rect4i(p, p + Vector2i(randomInt(0, 1200), randomInt(0, 1200)));
+		case 1:
+			return Rect4i(p, p + (random() % 2 == 0 ? Vector2i(0, randomInt(0, 100)) : Vector2i(randomInt(0, 100), 0)));
+		default:
+			return Rect4i(p, p + Vector2i(randomInt(1, 200), randomInt(1, 200)));
+		}
+	}
+
+	bool isInGrid(Rect4i rect)
+	{
+		return rect.getWidth() > 0 && rect.getHeight() > 0;
+	}
+
+	using Model = std::map<int, Rect4i>;
+
+	std::vector<int> bruteForceQuery(const Model& model, Rect4i rect)
+	{
+		// Empty rects are never found, but an empty query still finds what Rect4i::overlaps says it does, as it always has
+		std::vector<int> result;
+		for (auto& e: model) {
+			if (isInGrid(e.second) && e.second.overlaps(rect)) {
+				result.push_back(e.first);
+			}
+		}
+		return result;
+	}
+
+	bool checkQuery(const Broadphase& broadphase, const Model& model, Rect4i rect)
+	{
+		Vector<int> results;
+		broadphase.query(rect, results);
+		std::sort(results.begin(), results.end());
+		const auto expected = bruteForceQuery(model, rect);
+		return results.size() == expected.size() && std::equal(results.begin(), results.end(), expected.begin());
+	}
+
+	bool checkPairs(const Broadphase& broadphase, const Model& model)
+	{
+		Vector<std::pair<int, int>> results;
+		broadphase.getOverlappingPairs(results);
+		for (auto& p: results) {
+			if (p.first > p.second) {
+				std::swap(p.first, p.second);
+			}
+		}
+		std::sort(results.begin(), results.end());
+
+		std::vector<std::pair<int, int>> expected;
+		for (auto a = model.begin(); a != model.end(); ++a) {
+			for (auto b = std::next(a); b != model.end(); ++b) {
+				if (isInGrid(a->second) && isInGrid(b->second) && a->second.overlaps(b->second)) {
+					expected.emplace_back(a->first, b->first);
+				}
+			}
+		}
+		return results.size() == expected.size() && std::equal(results.begin(), results.end(), expected.begin());
+	}
+
+	bool checkAgainstBruteForce(int resolution)
+	{
+		Broadphase broadphase(resolution);
+		Model model;
+
+		for (int op = 0; op < 20000; ++op) {
+			const int id = randomInt(0, 400);
+			const auto rect = randomRect();
+			const uint32_t what = random() % 100;
+			const char* opName;
+
+			if (what < 30) {
+				opName = "add";
+				const bool added = broadphase.add(rect, id);
+				if (added != (model.find(id) == model.end())) {
+					printf("FAILED: add returned %d for %d\n", int(added), id);
+					return false;
+				}
+				model[id] = rect;
+			} else if (what < 55) {
+				opName = "update";
+				const bool existed = broadphase.update(rect, id);
+				if (existed != (model.find(id) != model.end())) {
+					printf("FAILED: update returned %d for %d\n", int(existed), id);
+					return false;
+				}
+				model[id] = rect;
+			} else if (what < 85) {
+				opName = "remove";
+				const bool removed = broadphase.remove(id);
+				if (removed != (model.erase(id) > 0)) {
+					printf("FAILED: remove returned %d for %d\n", int(removed), id);
+					return false;
+				}
+			} else if (what < 99) {
+				// Moves most rects a little, staying in the same cells, and some of them across the map; ids may repeat
+				opName = "batch update";
+				Vector<Broadphase::Update> updates;
+				const int n = randomInt(0, 200);
+				for (int i = 0; i < n; ++i) {
+					const int uid = randomInt(0, 400);
+					auto it = model.find(uid);
+					Rect4i r = it != model.end() && random() % 4 != 0 ? it->second + Vector2i(randomInt(-2, 2), randomInt(-2, 2)) : randomRect();
+					updates.push_back(Broadphase::Update{ uid, r });
+					model[uid] = r;
+				}
+				broadphase.update(gsl::span<const Broadphase::Update>(updates.data(), updates.size()));
+			} else {
+				opName = "clear";
+				broadphase.clear();
+				model.clear();
+			}
+
+			if (broadphase.size() != model.size()) {
+				printf("FAILED: resolution %d, size is %zu after %s, expected %zu\n", resolution, broadphase.size(), opName, model.size());
+				return false;
+			}
+			const int probe = randomInt(0, 400);
+			const auto found = model.find(probe);
+			if (broadphase.contains(probe) != (found != model.end()) || broadphase.getRect(probe) != (found != model.end() ? found->second : Rect4i())) {
+				printf("FAILED: resolution %d, wrong entry for %d after %s\n", resolution, probe, opName);
+				return false;
+			}
+
+			for (int i = 0; i < 4; ++i) {
+				if (!checkQuery(broadphase, model, randomRect())) {
+					printf("FAILED: resolution %d, query differs from brute force after %s\n", resolution, opName);
+					return false;
+				}
+			}
+			if (op % 100 == 0 && !checkPairs(broadphase, model)) {
+				printf("FAILED: resolution %d, overlapping pairs differ from brute force after %s\n", resolution, opName);
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	template <typename K>
+	bool checkFlatIndexMap(K keyRange, K keyScale)
+	{
+		FlatIndexMap<K> map;
+		std::unordered_map<K, uint32_t> expected;
+
+		for (int op = 0; op < 200000; ++op) {
+			const K key = K(random() % uint32_t(keyRange)) * keyScale;
+			if (random() % 2 == 0) {
+				const uint32_t value = random() % 1000;
+				map.set(key, value);
+				expected[key] = value;
+			} else if (map.erase(key) != (expected.erase(key) > 0)) {
+				printf("FAILED: FlatIndexMap erase of %lld disagrees\n", (long long)key);
+				return false;
+			}
+
+			const K probe = K(random() % uint32_t(keyRange)) * keyScale;
+			const auto iter = expected.find(probe);
+			if (map.size() != expected.size() || map.find(probe) != (iter == expected.end() ? FlatIndexMap<K>::none : iter->second)) {
+				printf("FAILED: FlatIndexMap lookup of %lld disagrees after %d operations\n", (long long)probe, op);
+				return false;
+			}
+
+			// Occasionally check everything, as a bad backward shift can strand an entry anywhere along its run
+			if (op % 5000 == 0) {
+				for (auto& e: expected) {
+					if (map.find(e.first) != e.second) {
+						printf("FAILED: FlatIndexMap lost %lld\n", (long long)e.first);
+						return false;
+					}
+				}
+			}
+		}
+
+		return true;
+	}
+
+	bool checkConcurrentQueries()
+	{
+		Broadphase broadphase;
+		Model model;
+		for (int i = 0; i < 2000; ++i) {
+			const auto rect = randomRect();
+			broadphase.add(rect, i);
+			model[i] = rect;
+		}
+
+		std::vector<Rect4i> queries;
+		for (int i = 0; i < 8 * 200; ++i) {
+			queries.push_back(randomRect());
+		}
+
+		std::vector<int> failed(8, 0);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 8; ++t) {
+			threads.emplace_back([&, t] () {
+				for (int i = 0; i < 200; ++i) {
+					if (!checkQuery(broadphase, model, queries[t * 200 + i])) {
+						failed[t] = 1;
+					}
+				}
+				size_t n = 0;
+				broadphase.forEachOverlappingPair([&] (int, int) { ++n; });
+				Vector<std::pair<int, int>> pairs;
+				broadphase.getOverlappingPairs(pairs);
+				if (n != pairs.size()) {
+					failed[t] = 1;
+				}
+			});
+		}
+		for (auto& thread: threads) {
+			thread.join();
+		}
+
+		if (std::count(failed.begin(), failed.end(), 1) > 0) {
+			printf("FAILED: concurrent queries differ from brute force\n");
+			return false;
+		}
+		return true;
+	}
+
+	bool checkSpatialChecker()
+	{
+		// Reports whether the rect was placed in the grid, as it did before it wrapped Broadphase
+		RectangleSpatialChecker checker(7);
+		const bool ok = checker.add(Rect4i(10, 10, 20, 20), 1) && checker.add(Rect4i(10, 10, 0, 20), 2) && !checker.add(Rect4i(), 3)
+			&& checker.update(Rect4i(0, 0, 5, 5), 1) && !checker.update(Rect4i(0, 0, 5, 5), 4)
+			&& checker.query(Rect4i(0, 0, 8, 8)).n == 2 && checker.remove(4) && !checker.remove(4);
+		if (!ok) {
+			printf("FAILED: RectangleSpatialChecker results changed\n");
+		}
+		return ok;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool ok = true;
+	ok &= checkFlatIndexMap<int>(64, 1);
+	ok &= checkFlatIndexMap<uint64_t>(4096, uint64_t(1) << 32);
+	for (int resolution: { 4, 7 }) {
+		ok &= checkAgainstBruteForce(resolution);
+	}
+	ok &= checkConcurrentQueries();
+	ok &= checkSpatialChecker();
+
+	if (ok) {
+		printf("OK\n");
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+// Compresses buffers that end on, just past and well past chunk boundaries, and checks that they come back identical both
+// when decompressed whole and when read through ChunkedDecompressionReader, including reads that start after seeking
+// anywhere in the data and cross into the next chunks.
+
+#include <halley/bytes/compression.h>
+#include <halley/core/resources/asset_pack.h>
+#include <halley/support/exception.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace Halley;
+
+namespace {
+	uint32_t seed = 12345;
+
+	uint32_t random()
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return seed;
+	}
+
+	// Runs of repeated bytes between random ones, so that deflate has something to do but doesn't make chunks trivially small
+	Bytes makeData(size_t size)
+	{
+		Bytes result(size);
+		for (size_t i = 0; i < size; ) {
+			const Byte value = Byte(random());
+			const size_t run = random() % 2 == 0 ? 1 : random() % 64;
+			for (size_t j = 0; j < run && i < size; ++j) {
+				result[i++] = value;
+			}
+		}
+		return result;
+	}
+
+	// Stands in for PackDataReader, which is how packs feed ChunkedDecompressionReader
+	class MemoryReader : public ResourceDataReader {
+	public:
+		explicit MemoryReader(const Bytes& data)
+			: data(data)
+		{}
+
+		size_t size() const override { return data.size(); }
+
+		int read(gsl::span<gsl::byte> dst) override
+		{
+			const size_t n = std::min(size_t(dst.size()), data.size() - std::min(pos, data.size()));
+			memcpy(dst.data(), data.data() + pos, n);
+			pos += n;
+			return int(n);
+		}
+
+		void seek(int64_t offset, int whence) override
+		{
+			switch (whence) {
+			case SEEK_SET:
+				pos = size_t(offset);
+				break;
+			case SEEK_CUR:
+				pos = size_t(pos + offset);
+				break;
+			case SEEK_END:
+				pos = size_t(data.size() + offset);
+				break;
+			}
+		}
+
+		size_t tell() const override { return pos; }
+		void close() override {}
+
+	private:
+		const Bytes& data;
+		size_t pos = 0;
+	};
+
+	bool check(bool condition, const char* what, CompressionCodec codec, size_t size, size_t chunkSize)
+	{
+		if (!condition) {
+			printf("FAILED: %s, %s with %zu bytes in chunks of %zu\n", what, toString(codec).c_str(), size, chunkSize);
+		}
+		return condition;
+	}
+
+	bool checkRoundTrip(CompressionCodec codec, size_t size, size_t chunkSize)
+	{
+		bool ok = true;
+		const Bytes original = makeData(size);
+		const Bytes compressed = ChunkedCompression::compress(gsl::as_bytes(gsl::span<const Byte>(original)), codec, chunkSize);
+
+		const ChunkedCompression::Table table(gsl::as_bytes(gsl::span<const Byte>(compressed)));
+		const size_t expectedChunks = (size + chunkSize - 1) / chunkSize;
+		ok &= check(table.getUncompressedSize() == size && table.getChunkCount() == expectedChunks, "wrong table", codec, size, chunkSize);
+
+		// Whole buffer
+		Bytes whole(size);
+		ChunkedCompression::decompress(gsl::as_bytes(gsl::span<const Byte>(compressed)), codec, gsl::as_writeable_bytes(gsl::span<Byte>(whole)));
+		ok &= check(whole == original, "whole-buffer decompression differs", codec, size, chunkSize);
+
+		// Streamed from start to end in odd-sized reads
+		ChunkedDecompressionReader reader(std::make_unique<MemoryReader>(compressed), codec);
+		ok &= check(reader.size() == size, "reader has the wrong size", codec, size, chunkSize);
+		Bytes streamed;
+		Bytes buffer(chunkSize / 3 + 7);
+		while (true) {
+			const int n = reader.read(gsl::as_writeable_bytes(gsl::span<Byte>(buffer)));
+			if (n <= 0) {
+				break;
+			}
+			streamed.insert(streamed.end(), buffer.begin(), buffer.begin() + n);
+		}
+		ok &= check(streamed == original && reader.tell() == size, "streamed read differs", codec, size, chunkSize);
+
+		// Random seeks, with reads up to a few chunks long, including ones that run past the end
+		for (int i = 0; i < 200 && ok; ++i) {
+			const size_t target = size == 0 ? 0 : random() % (size + 1);
+			switch (i % 3) {
+			case 0:
+				reader.seek(int64_t(target), SEEK_SET);
+				break;
+			case 1:
+				reader.seek(int64_t(target) - int64_t(reader.tell()), SEEK_CUR);
+				break;
+			case 2:
+				reader.seek(int64_t(target) - int64_t(size), SEEK_END);
+				break;
+			}
+			ok &= check(reader.tell() == target, "seek went to the wrong place", codec, size, chunkSize);
+
+			Bytes part(random() % (3 * chunkSize));
+			const size_t expected = std::min(part.size(), size - target);
+			const int n = reader.read(gsl::as_writeable_bytes(gsl::span<Byte>(part)));
+			ok &= check(n == int(expected), "read after seek returned the wrong length", codec, size, chunkSize);
+			ok &= check(std::equal(part.begin(), part.begin() + expected, original.begin() + target), "read after seek differs", codec, size, chunkSize);
+			ok &= check(reader.tell() == target + expected, "read after seek left the cursor in the wrong place", codec, size, chunkSize);
+		}
+
+		return ok;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool ok = true;
+	for (auto codec: { CompressionCodec::None, CompressionCodec::Deflate }) {
+		for (size_t chunkSize: { size_t(1000), ChunkedCompression::defaultChunkSize }) {
+			for (size_t size: { size_t(0), size_t(1), chunkSize - 1, chunkSize, chunkSize + 1, 7 * chunkSize, 7 * chunkSize + chunkSize / 2 }) {
+				ok &= checkRoundTrip(codec, size, chunkSize);
+			}
+		}
+	}
+
+	if (ok) {
+		printf("OK\n");
+	}
+	return ok ? 0 : 1;
+}
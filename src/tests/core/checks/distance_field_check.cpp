@@ -0,0 +1,98 @@
+// Generates distance fields for a few glyph-like shapes with both the exact transform and the brute force reference, and
+// checks that they match. The brute force search gives up on texels further than the radius from any edge, so the shapes
+// are made so that there are none.
+
+#include <halley/tools/distance_field/distance_field_generator.h>
+#include <halley/file_formats/image.h>
+#include <halley/concurrency/executor.h>
+#include <halley/maths/random.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace Halley;
+
+namespace {
+	// Overlapping sets of concentric rings, narrower than the radius, with every crossing of a ring flipping inside and outside
+	std::unique_ptr<Image> makeShape(Vector2i size, float bandWidth, int seed)
+	{
+		auto img = std::make_unique<Image>(Image::Format::RGBA, size);
+		Random rng(seed);
+		Vector2f centres[3];
+		for (auto& c: centres) {
+			c = Vector2f(rng.getFloat(0.0f, float(size.x)), rng.getFloat(0.0f, float(size.y)));
+		}
+
+		int* px = reinterpret_cast<int*>(img->getPixels());
+		for (int y = 0; y < size.y; ++y) {
+			for (int x = 0; x < size.x; ++x) {
+				int crossings = 0;
+				for (auto& c: centres) {
+					crossings += int((Vector2f(float(x), float(y)) - c).length() / bandWidth);
+				}
+				px[x + y * size.x] = Image::convertRGBAToInt(255, 255, 255, crossings % 2 == 0 ? 255 : 0);
+			}
+		}
+		return img;
+	}
+
+	double secondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool ok = true;
+
+	Executors executors;
+	Executors::set(executors);
+	auto makeThread = [] (String, std::function<void()> runnable) { return std::thread(runnable); };
+	auto pool = std::make_unique<ThreadPool>("Default", ExecutionQueue::getDefault(), std::max(2u, std::thread::hardware_concurrency()), makeThread);
+
+	// Including one that isn't a multiple of the destination size
+	const Vector2i dstSizes[] = { Vector2i(32, 32), Vector2i(48, 40), Vector2i(16, 24), Vector2i(30, 20) };
+	const Vector2i srcSizes[] = { Vector2i(128, 128), Vector2i(384, 320), Vector2i(96, 144), Vector2i(100, 70) };
+	const float radii[] = { 4.0f, 2.0f, 0.0f, 3.0f };
+	const int nTests = 4;
+
+	double bruteTime = 0;
+	double exactTime = 0;
+	for (int test = 0; test < nTests; ++test) {
+		const Vector2i dstSize = dstSizes[test];
+		const float srcRadius = radii[test] * srcSizes[test].x / dstSize.x;
+		auto src = makeShape(srcSizes[test], std::max(srcRadius * 0.7f, 3.0f), test + 1);
+
+		auto start = std::chrono::steady_clock::now();
+		auto reference = DistanceFieldGenerator::generate(*src, dstSize, radii[test], DistanceFieldGenerator::Method::BruteForce);
+		bruteTime += secondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		auto result = DistanceFieldGenerator::generate(*src, dstSize, radii[test], DistanceFieldGenerator::Method::Exact);
+		exactTime += secondsSince(start);
+
+		const int* a = reinterpret_cast<const int*>(reference->getPixels());
+		const int* b = reinterpret_cast<const int*>(result->getPixels());
+		int maxDiff = 0;
+		int mismatches = 0;
+		for (int i = 0; i < dstSize.x * dstSize.y; ++i) {
+			const int diff = std::abs(((a[i] >> 24) & 0xFF) - ((b[i] >> 24) & 0xFF));
+			// Summing in a different order can round the other way
+			if (diff > 1) {
+				++mismatches;
+			}
+			maxDiff = std::max(maxDiff, diff);
+		}
+		if (mismatches > 0) {
+			printf("FAILED: %d of %d pixels don't match the reference in test %d (max difference %d)\n", mismatches, dstSize.x * dstSize.y, test, maxDiff);
+			ok = false;
+		}
+	}
+
+	if (ok) {
+		printf("Distance fields match OK (brute force %.3fs, exact %.3fs)\n", bruteTime, exactTime);
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+// Runs frames the way Core does, with worker threads allocating from their own FrameArenas alongside the main thread.
+// Everything allocated in a frame is filled with a pattern and checked again at the end of the next frame, which must
+// still see it intact. Also checks alignment, the per-frame counters, and the heap fallback before the first frame.
+
+#include <halley/data_structures/frame_arena.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace Halley;
+
+struct Allocation {
+	unsigned char* data;
+	size_t size;
+	unsigned char pattern;
+};
+
+struct FrameAllocations {
+	std::vector<Allocation> allocations;
+	size_t bytes = 0;
+};
+
+static void allocate(FrameAllocations& result, int frame, int thread, uint32_t& seed, bool& ok)
+{
+	for (int i = 0; i < 200; ++i) {
+		seed = seed * 1664525u + 1013904223u;
+		// Mostly small, now and then bigger than a block
+		const size_t size = (seed >> 28) == 0 ? 100000 + (seed >> 8) % 50000 : 1 + (seed >> 8) % 700;
+		const size_t alignment = size_t(1) << ((seed >> 4) % 7);
+		auto data = static_cast<unsigned char*>(FrameArena::get().alloc(size, alignment));
+		if (reinterpret_cast<uintptr_t>(data) % alignment != 0) {
+			printf("FAILED: allocation not aligned to %zu\n", alignment);
+			ok = false;
+		}
+		const auto pattern = static_cast<unsigned char>(frame * 31 + thread * 7 + i);
+		memset(data, pattern, size);
+		result.allocations.push_back(Allocation{ data, size, pattern });
+		result.bytes += size;
+	}
+}
+
+static bool verify(const FrameAllocations& allocations)
+{
+	for (auto& a: allocations.allocations) {
+		for (size_t i = 0; i < a.size; ++i) {
+			if (a.data[i] != a.pattern) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	const int nFrames = argc > 1 ? atoi(argv[1]) : 100;
+	const int nThreads = argc > 2 ? atoi(argv[2]) : 4;
+	bool ok = true;
+
+	{
+		FrameVector<int> beforeFrames(1000, 1);
+		if (FrameArena::isActive() || FrameArena::get().alloc(1) == nullptr) {
+			printf("FAILED: arena active before the first frame\n");
+			ok = false;
+		}
+	}
+	FrameArena::beginFrame();
+
+	std::vector<std::vector<FrameAllocations>> previous(nThreads + 1);
+	for (int frame = 0; frame < nFrames; ++frame) {
+		std::vector<FrameAllocations> current(nThreads + 1);
+		std::vector<char> threadOk(nThreads + 1, 1);
+		std::vector<std::thread> threads;
+
+		// Threads come and go, so some arenas skip frames entirely
+		for (int t = 1; t <= nThreads; ++t) {
+			if ((frame + t) % 3 != 0) {
+				threads.emplace_back([&, t] () {
+					uint32_t seed = uint32_t(frame * 1000 + t);
+					bool threadResult = true;
+					allocate(current[t], frame, t, seed, threadResult);
+					threadOk[t] = threadResult;
+				});
+			}
+		}
+		uint32_t seed = uint32_t(frame);
+		allocate(current[0], frame, 0, seed, ok);
+		FrameVector<int> scratch;
+		scratch.reserve(256);
+		for (int i = 0; i < 256; ++i) {
+			scratch.push_back(i);
+		}
+		for (auto& thread: threads) {
+			thread.join();
+		}
+
+		// Last frame's allocations on the main thread must have survived this one
+		for (auto& p: previous[0]) {
+			if (!verify(p)) {
+				printf("FAILED: frame %d overwrote memory from the previous frame\n", frame);
+				ok = false;
+			}
+		}
+		for (int t = 0; t <= nThreads; ++t) {
+			ok = ok && threadOk[t];
+		}
+
+		size_t expectedBytes = scratch.capacity() * sizeof(int);
+		size_t expectedAllocations = 1;
+		for (auto& c: current) {
+			expectedBytes += c.bytes;
+			expectedAllocations += c.allocations.size();
+		}
+
+		FrameArena::beginFrame();
+		const auto stats = FrameArena::getLastFrameStats();
+		if (stats.bytes != expectedBytes || stats.allocations != expectedAllocations) {
+			printf("FAILED: frame %d counted %zu bytes in %zu allocations, expected %zu in %zu\n", frame, stats.bytes, stats.allocations, expectedBytes, expectedAllocations);
+			ok = false;
+		}
+		previous[0] = { std::move(current[0]) };
+	}
+
+	if (ok) {
+		printf("%d frames on %d threads OK\n", nFrames, nThreads + 1);
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+// Runs every ImageOps kernel this CPU supports on the same input as the scalar reference, and checks that the output is
+// identical. Lengths go up to a few times the widest vector so that the leftover pixels after the vector loops are covered
+// too. Alpha blending is checked for every combination of source alpha, destination alpha and opacity.
+
+#include <halley/file_formats/image_ops.h>
+#include <halley/file_formats/image.h>
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+
+using namespace Halley;
+
+namespace {
+	uint32_t seed = 12345;
+
+	uint32_t random()
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return seed;
+	}
+
+	// Mostly fully transparent or opaque, as sprites are
+	uint32_t randomPixel()
+	{
+		const uint32_t colour = random() & 0xFFFFFF;
+		switch (random() % 4) {
+		case 0:
+			return colour;
+		case 1:
+			return colour | 0xFF000000u;
+		default:
+			return colour | (random() << 24);
+		}
+	}
+
+	std::vector<uint32_t> randomPixels(size_t n)
+	{
+		std::vector<uint32_t> result(n);
+		for (auto& p: result) {
+			p = randomPixel();
+		}
+		return result;
+	}
+
+	bool check(bool condition, const ImageOps& ops, const char* kernel, size_t n)
+	{
+		if (!condition) {
+			printf("FAILED: %s %s differs from scalar with %zu pixels\n", ops.getName(), kernel, n);
+		}
+		return condition;
+	}
+
+	bool checkKernels(const ImageOps& ops, const ImageOps& ref)
+	{
+		bool ok = true;
+
+		for (size_t n = 0; n < 70; ++n) {
+			// Offset by one so that it's not aligned
+			std::vector<uint32_t> a(n + 1, 0);
+			std::vector<uint32_t> b(n + 1, 0);
+			const uint32_t colour = randomPixel();
+			ops.fill(a.data() + 1, n, colour);
+			ref.fill(b.data() + 1, n, colour);
+			ok &= check(a == b, ops, "fill", n);
+
+			std::vector<uint8_t> alpha(n + 1);
+			for (auto& v: alpha) {
+				v = uint8_t(random());
+			}
+			ops.expandAlpha(a.data() + 1, alpha.data() + 1, n);
+			ref.expandAlpha(b.data() + 1, alpha.data() + 1, n);
+			ok &= check(a == b, ops, "expandAlpha", n);
+
+			// Rows that are all transparent, or have just a few pixels with any alpha
+			for (int pattern = 0; pattern < 8; ++pattern) {
+				std::vector<uint32_t> row(n);
+				for (auto& p: row) {
+					p = random() & 0xFFFFFF;
+				}
+				for (int i = 0; i < pattern && n > 0; ++i) {
+					row[random() % n] |= (random() % 255 + 1) << 24;
+				}
+				size_t first0 = 0;
+				size_t last0 = 0;
+				size_t first1 = 0;
+				size_t last1 = 0;
+				const bool found0 = ops.findAlphaRange(row.data(), n, first0, last0);
+				const bool found1 = ref.findAlphaRange(row.data(), n, first1, last1);
+				ok &= check(found0 == found1 && (!found0 || (first0 == first1 && last0 == last1)), ops, "findAlphaRange", n);
+			}
+
+			const auto src = randomPixels(n);
+			a = randomPixels(n);
+			b = a;
+			const uint32_t opacity = random() % 256;
+			ops.blendAlpha(a.data(), src.data(), n, opacity);
+			ref.blendAlpha(b.data(), src.data(), n, opacity);
+			ok &= check(a == b, ops, "blendAlpha", n);
+
+			a = randomPixels(n);
+			b = a;
+			ops.preMultiply(a.data(), n);
+			ref.preMultiply(b.data(), n);
+			ok &= check(a == b, ops, "preMultiply", n);
+		}
+
+		// Every combination of alphas, with random colours
+		for (uint32_t opacity = 0; opacity < 256; ++opacity) {
+			std::vector<uint32_t> src(65536);
+			std::vector<uint32_t> a(65536);
+			for (uint32_t i = 0; i < 65536; ++i) {
+				src[i] = (random() & 0xFFFFFF) | ((i & 0xFF) << 24);
+				a[i] = (random() & 0xFFFFFF) | ((i >> 8) << 24);
+			}
+			auto b = a;
+			ops.blendAlpha(a.data(), src.data(), a.size(), opacity);
+			ref.blendAlpha(b.data(), src.data(), b.size(), opacity);
+			if (!check(a == b, ops, "blendAlpha (all alphas)", a.size())) {
+				ok = false;
+				break;
+			}
+		}
+
+		// Every channel value with every alpha
+		{
+			std::vector<uint32_t> a(65536);
+			for (uint32_t i = 0; i < 65536; ++i) {
+				const uint32_t v = i & 0xFF;
+				a[i] = v | ((255 - v) << 8) | ((v ^ 0x5A) << 16) | ((i >> 8) << 24);
+			}
+			auto b = a;
+			ops.preMultiply(a.data(), a.size());
+			ref.preMultiply(b.data(), b.size());
+			ok &= check(a == b, ops, "preMultiply (all values)", a.size());
+		}
+
+		for (size_t w = 0; w < 19; ++w) {
+			for (size_t h = 0; h < 19; ++h) {
+				const size_t srcPitch = h + 3;
+				const size_t dstPitch = w + 5;
+				const auto src = randomPixels(srcPitch * std::max(w, size_t(1)));
+				std::vector<uint32_t> a(dstPitch * std::max(h, size_t(1)), 0);
+				auto b = a;
+				ops.rotate(a.data(), dstPitch, src.data(), srcPitch, w, h);
+				ref.rotate(b.data(), dstPitch, src.data(), srcPitch, w, h);
+				ok &= check(a == b, ops, "rotate", w * h);
+			}
+		}
+
+		{
+			// Palettes are 256 unique colours at most, including transparent
+			std::vector<std::pair<uint32_t, uint32_t>> palette;
+			std::unordered_map<uint32_t, uint32_t> paletteMap;
+			paletteMap[0] = 0;
+			while (paletteMap.size() < 256) {
+				paletteMap.emplace(random(), uint32_t(paletteMap.size()));
+			}
+			for (auto& c: paletteMap) {
+				palette.push_back(c);
+			}
+			const ImagePaletteTable table(palette);
+			for (auto& c: palette) {
+				ok &= check(table.lookup(c.first) == c.second, ops, "palette table", palette.size());
+			}
+
+			for (size_t n = 0; n < 70; ++n) {
+				std::vector<uint32_t> src(n);
+				for (auto& p: src) {
+					p = random() % 32 == 0 ? random() : palette[random() % palette.size()].first;
+				}
+				std::vector<uint8_t> a(n, 0);
+				std::vector<uint8_t> b(n, 0);
+				const size_t mapped0 = ops.mapToPalette(table, src.data(), a.data(), n);
+				const size_t mapped1 = ref.mapToPalette(table, src.data(), b.data(), n);
+				ok &= check(mapped0 == mapped1 && std::equal(a.begin(), a.begin() + mapped0, b.begin()), ops, "mapToPalette", n);
+				if (mapped1 < n) {
+					ok &= check(paletteMap.find(src[mapped1]) == paletteMap.end(), ops, "mapToPalette (stopped at a colour in the palette)", n);
+				}
+			}
+		}
+
+		return ok;
+	}
+
+	// Image itself, with whatever ImageOps::get() picked, against the loops it used to have
+	bool checkImage()
+	{
+		bool ok = true;
+
+		Image img(Image::Format::RGBA, Vector2i(37, 23));
+		img.clear(0);
+		uint32_t* px = reinterpret_cast<uint32_t*>(img.getPixels());
+		px[5 + 3 * 37] = 0x01000000;
+		px[30 + 17 * 37] = 0xFF123456;
+		px[12 + 20 * 37] = 0x80000000;
+		if (img.getTrimRect() != Rect4i(Vector2i(5, 3), Vector2i(31, 21))) {
+			printf("FAILED: wrong trim rect\n");
+			ok = false;
+		}
+
+		Image src(Image::Format::RGBA, Vector2i(13, 9));
+		const auto srcPixels = randomPixels(13 * 9);
+		std::copy(srcPixels.begin(), srcPixels.end(), reinterpret_cast<uint32_t*>(src.getPixels()));
+		for (int dx = -3; dx <= 30; dx += 11) {
+			for (int dy = -3; dy <= 16; dy += 6) {
+				img.clear(0);
+				img.blitFrom(Vector2i(dx, dy), src, true);
+				for (int y = 0; y < 23; ++y) {
+					for (int x = 0; x < 37; ++x) {
+						const int sy = 8 - (x - dx);
+						const int sx = y - dy;
+						const bool inside = x >= dx && y >= dy && sx < 13 && sy >= 0 && x >= 0 && y >= 0;
+						// Clipping at the top left shifts the source the way it always did, so only check unclipped blits there
+						if (dx >= 0 && dy >= 0 && px[x + y * 37] != (inside ? srcPixels[sx + sy * 13] : 0u)) {
+							printf("FAILED: wrong rotated blit at %d, %d\n", dx, dy);
+							return false;
+						}
+					}
+				}
+			}
+		}
+
+		return ok;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool ok = true;
+	const auto& ref = ImageOps::getScalar();
+	for (auto* ops: ImageOps::getAvailable()) {
+		if (ops != &ref) {
+			const bool opsOk = checkKernels(*ops, ref);
+			printf("%s: %s\n", ops->getName(), opsOk ? "OK" : "FAILED");
+			ok &= opsOk;
+		}
+	}
+	printf("Using %s\n", ImageOps::get().getName());
+	ok &= checkImage();
+
+	return ok ? 0 : 1;
+}
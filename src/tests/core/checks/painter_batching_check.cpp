@@ -0,0 +1,194 @@
+// Paints through the dummy video plugin and checks how the painter batches: distinct material instances with equal parameters
+// share a batch, every batch break is counted under the right reason, and vertices streamed through the dummy's mapped ring
+// account for everything submitted. Fails if any batch count differs from the expected one.
+
+#include <halley/text/halleystring.h>
+#include <halley/core/graphics/painter.h>
+#include <halley/core/graphics/camera.h>
+#include <halley/core/graphics/render_context.h>
+#include <halley/core/graphics/render_target/render_target_screen.h>
+#include <halley/core/graphics/material/material.h>
+#include <halley/core/graphics/material/material_definition.h>
+#include <halley/core/graphics/material/material_parameter.h>
+#include <halley/core/resources/resources.h>
+#include <halley/core/resources/resource_locator.h>
+#include <halley/file_formats/config_file.h>
+#include "dummy/dummy_video.h"
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+
+using namespace Halley;
+
+static std::shared_ptr<MaterialDefinition> makeMaterialDefinition(const String& name, bool textured)
+{
+	ConfigNode::SequenceType attributeList;
+	attributeList.emplace_back(ConfigNode::MapType{ { "a_vertPos", ConfigNode(String("vec4")) } });
+	attributeList.emplace_back(ConfigNode::MapType{ { "a_colour", ConfigNode(String("vec4")) } });
+
+	ConfigNode::MapType root;
+	root["name"] = ConfigNode(String(name));
+	root["attributes"] = ConfigNode(std::move(attributeList));
+	if (textured) {
+		ConfigNode::SequenceType textureList;
+		textureList.emplace_back(ConfigNode::MapType{ { "tex0", ConfigNode(String("sampler2D")) } });
+		root["textures"] = ConfigNode(std::move(textureList));
+	}
+
+	// No passes: those need shaders, which can't be built headless. Batches still reach the backend without them.
+	auto definition = std::make_shared<MaterialDefinition>();
+	definition->load(ConfigNode(std::move(root)));
+	return definition;
+}
+
+static std::shared_ptr<MaterialDefinition> makeBaseMaterialDefinition()
+{
+	// Same as shared_assets/material/material_base.yaml, which the painter sets the projection on
+	ConfigNode::SequenceType blockUniforms;
+	blockUniforms.emplace_back(ConfigNode::MapType{ { "u_mvp", ConfigNode(String("mat4")) } });
+	ConfigNode::SequenceType uniformList;
+	uniformList.emplace_back(ConfigNode::MapType{ { "HalleyBlock", ConfigNode(std::move(blockUniforms)) } });
+
+	ConfigNode::MapType root;
+	root["name"] = ConfigNode(String("Halley/MaterialBase"));
+	root["uniforms"] = ConfigNode(std::move(uniformList));
+
+	auto definition = std::make_shared<MaterialDefinition>();
+	definition->load(ConfigNode(std::move(root)));
+	return definition;
+}
+
+class BatchingCheck
+{
+public:
+	BatchingCheck()
+		: resources(nullptr, nullptr)
+		, camera(Vector2f(320, 240))
+		, screen(Rect4i(0, 0, 640, 480))
+		, definition(makeMaterialDefinition("Check/Textured", true))
+		, texture0(std::make_shared<DummyTexture>(Vector2i(16, 16)))
+		, texture1(std::make_shared<DummyTexture>(Vector2i(16, 16)))
+	{
+		resources.init<MaterialDefinition>();
+		resources.of<MaterialDefinition>().setResource(0, "Halley/MaterialBase", makeBaseMaterialDefinition());
+	}
+
+	std::shared_ptr<Material> makeMaterial(const std::shared_ptr<Texture>& texture) const
+	{
+		auto material = std::make_shared<Material>(definition);
+		material->set("tex0", texture);
+		return material;
+	}
+
+	void drawQuads(Painter& painter, const std::shared_ptr<Material>& material, size_t numVertices)
+	{
+		vertices.resize(numVertices * definition->getVertexStride());
+		painter.drawQuads(material, numVertices, vertices.data());
+	}
+
+	bool run(const char* name, bool streaming, std::function<void(Painter&)> paint, std::map<PainterBatchBreak, size_t> expectedBreaks)
+	{
+		DummyPainter painter(resources);
+		painter.setStreamingEnabled(streaming);
+		RenderContext context(painter, camera, screen);
+		context.bind(paint);
+
+		bool ok = true;
+		for (int i = 0; i < int(PainterBatchBreak::NumOfBatchBreaks); ++i) {
+			const auto reason = PainterBatchBreak(i);
+			const size_t expected = expectedBreaks[reason];
+			const size_t actual = painter.getNumBatchBreaks(reason);
+			if (actual != expected) {
+				printf("FAILED: %s: %zu batch breaks of type %d, expected %zu\n", name, actual, i, expected);
+				ok = false;
+			}
+		}
+
+		if (streaming && painter.getVerticesStreamed() != painter.getVerticesSubmitted()) {
+			printf("FAILED: %s: only %zu of %zu vertices were streamed\n", name, painter.getVerticesStreamed(), painter.getVerticesSubmitted());
+			ok = false;
+		}
+		if (!streaming && painter.getVerticesStreamed() != 0) {
+			printf("FAILED: %s: %zu vertices streamed with streaming disabled\n", name, painter.getVerticesStreamed());
+			ok = false;
+		}
+
+		printf("%s: %zu vertices, %zu streamed\n", name, painter.getVerticesSubmitted(), painter.getVerticesStreamed());
+		return ok;
+	}
+
+	std::shared_ptr<Texture> getTexture0() const { return texture0; }
+	std::shared_ptr<Texture> getTexture1() const { return texture1; }
+
+private:
+	Resources resources;
+	Camera camera;
+	ScreenRenderTarget screen;
+	std::shared_ptr<MaterialDefinition> definition;
+	std::shared_ptr<Texture> texture0;
+	std::shared_ptr<Texture> texture1;
+	Vector<char> vertices;
+};
+
+int main(int argc, char** argv)
+{
+	BatchingCheck check;
+	bool ok = true;
+
+	// Distinct instances, equal parameters: one batch, submitted when the context is unbound
+	ok &= check.run("Equal materials", true, [&] (Painter& painter)
+	{
+		auto a = check.makeMaterial(check.getTexture0());
+		auto b = check.makeMaterial(check.getTexture0());
+		for (int i = 0; i < 8; ++i) {
+			check.drawQuads(painter, i % 2 == 0 ? a : b, 4);
+		}
+	}, { { PainterBatchBreak::Flush, 1 } });
+
+	// A different texture breaks the batch every time it changes
+	ok &= check.run("Different materials", true, [&] (Painter& painter)
+	{
+		auto a = check.makeMaterial(check.getTexture0());
+		auto b = check.makeMaterial(check.getTexture0());
+		auto c = check.makeMaterial(check.getTexture1());
+		check.drawQuads(painter, a, 4);
+		check.drawQuads(painter, c, 4);
+		check.drawQuads(painter, b, 4);
+		check.drawQuads(painter, c, 8);
+	}, { { PainterBatchBreak::Material, 3 }, { PainterBatchBreak::Flush, 1 } });
+
+	ok &= check.run("Clip", true, [&] (Painter& painter)
+	{
+		auto a = check.makeMaterial(check.getTexture0());
+		check.drawQuads(painter, a, 4);
+		painter.setClip(Rect4i(10, 10, 100, 100));
+		check.drawQuads(painter, a, 4);
+		painter.setClip();
+		check.drawQuads(painter, a, 4);
+		painter.flush();
+	}, { { PainterBatchBreak::Clip, 2 }, { PainterBatchBreak::Flush, 1 } });
+
+	// Staged rather than streamed, so the index range runs out before the mapped buffer does
+	ok &= check.run("Index range", false, [&] (Painter& painter)
+	{
+		auto a = check.makeMaterial(check.getTexture0());
+		for (int i = 0; i < 40; ++i) {
+			check.drawQuads(painter, a, 4096);
+		}
+	}, { { PainterBatchBreak::IndexRange, 2 }, { PainterBatchBreak::Flush, 1 } });
+
+	// 32 bytes per vertex, so each 256 KiB buffer in the dummy's ring takes 8192 of them
+	ok &= check.run("Streaming", true, [&] (Painter& painter)
+	{
+		auto a = check.makeMaterial(check.getTexture0());
+		for (int i = 0; i < 40; ++i) {
+			check.drawQuads(painter, a, 1024);
+		}
+	}, { { PainterBatchBreak::BufferFull, 4 }, { PainterBatchBreak::Flush, 1 } });
+
+	if (ok) {
+		printf("OK\n");
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+// Paints the same frames twice through the dummy video plugin: straight to the backend, and recorded into PainterCommandLists
+// that are replayed on another thread, one frame behind, while the next frame is recorded. Materials are changed between frames,
+// so anything recorded by reference rather than by value shows up. Fails unless the backend sees identical calls, byte-for-byte.
+
+#include <halley/text/halleystring.h>
+#include <halley/core/graphics/painter.h>
+#include <halley/core/graphics/painter_command_list.h>
+#include <halley/core/graphics/sprite/sprite.h>
+#include <halley/core/graphics/material/material.h>
+#include <halley/core/graphics/material/material_definition.h>
+#include <halley/core/graphics/material/material_parameter.h>
+#include <halley/core/resources/resources.h>
+#include <halley/core/resources/resource_locator.h>
+#include <halley/file_formats/config_file.h>
+#include "dummy/dummy_video.h"
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace Halley;
+
+static std::shared_ptr<MaterialDefinition> makeSpriteMaterial(const String& name, int nPasses)
+{
+	// Same layout as shared_assets/material/sprite_base.yaml
+	const char* attributes[][2] = {
+		{ "a_vertPos", "vec4" }, { "a_position", "vec2" }, { "a_pivot", "vec2" }, { "a_size", "vec2" }, { "a_scale", "vec2" },
+		{ "a_colour", "vec4" }, { "a_texCoord0", "vec4" }, { "a_rotation", "float" }, { "a_textureRotation", "float" }
+	};
+
+	ConfigNode::SequenceType attributeList;
+	for (auto& a: attributes) {
+		ConfigNode::MapType entry;
+		entry[a[0]] = ConfigNode(String(a[1]));
+		attributeList.emplace_back(std::move(entry));
+	}
+	ConfigNode::MapType root;
+	root["name"] = ConfigNode(String(name));
+	root["attributes"] = ConfigNode(std::move(attributeList));
+
+	auto definition = std::make_shared<MaterialDefinition>();
+	definition->load(ConfigNode(std::move(root)));
+	for (int i = 0; i < nPasses; ++i) {
+		definition->addPass(MaterialPass());
+	}
+	return definition;
+}
+
+class Scene
+{
+public:
+	Scene()
+		: spriteMaterial(std::make_shared<Material>(makeSpriteMaterial("Check/Sprite", 2)))
+		, quadMaterial(std::make_shared<Material>(makeSpriteMaterial("Check/Quad", 1)))
+		, sprites(1000)
+	{
+		for (size_t i = 0; i < sprites.size(); ++i) {
+			sprites[i].setMaterial(spriteMaterial).setPos(Vector2f(float(i % 40), float(i / 40))).setSize(Vector2f(8, 8));
+		}
+	}
+
+	void paint(Painter& painter, int frame)
+	{
+		const size_t vertexStride = quadMaterial->getDefinition().getVertexStride();
+		Vector<char> quad(4 * vertexStride, char(frame));
+
+		painter.clear(Colour4f(0.1f * frame, 0, 0, 1));
+		painter.setSpriteInstancingEnabled(frame % 3 != 0);
+
+		spriteMaterial->setPassEnabled(1, frame % 2 == 0);
+		for (auto& s: sprites) {
+			s.setColour(Colour4f(1, 1, 1, 0.01f * frame));
+		}
+		Sprite::draw(sprites.data(), sprites.size() / 2, painter);
+		painter.drawQuads(quadMaterial, 4, quad.data());
+
+		// The same material instance, changed before the first batch using it has been executed
+		spriteMaterial->setPassEnabled(1, frame % 2 != 0);
+		Sprite::draw(sprites.data() + sprites.size() / 2, sprites.size() / 2, painter);
+		painter.drawSlicedSprite(spriteMaterial, Vector2f(10, 10), Vector4f(0.25f, 0.25f, 0.25f, 0.25f), quad.data());
+		painter.flush();
+	}
+
+private:
+	std::shared_ptr<Material> spriteMaterial;
+	std::shared_ptr<Material> quadMaterial;
+	Vector<Sprite> sprites;
+};
+
+int main(int argc, char** argv)
+{
+	const int nFrames = argc > 1 ? atoi(argv[1]) : 20;
+
+	Resources resources(nullptr, nullptr);
+	resources.init<MaterialDefinition>();
+	auto baseMaterial = std::make_shared<MaterialDefinition>();
+	baseMaterial->addPass(MaterialPass());
+	resources.of<MaterialDefinition>().setResource(0, "Halley/MaterialBase", baseMaterial);
+
+	// Recorded batches are never streamed, so streaming has to be off for the batches to match
+	DummyPainter immediate(resources);
+	immediate.setStreamingEnabled(false);
+	immediate.setCallLogEnabled(true);
+	{
+		Scene scene;
+		for (int i = 0; i < nFrames; ++i) {
+			scene.paint(immediate, i);
+		}
+	}
+
+	DummyPainter replayed(resources);
+	replayed.setStreamingEnabled(false);
+	replayed.setCallLogEnabled(true);
+	size_t commandBytes = 0;
+	size_t dataBytes = 0;
+	{
+		Scene scene;
+		std::array<PainterCommandList, 2> lists;
+		std::thread renderThread;
+		for (int i = 0; i < nFrames; ++i) {
+			auto& list = lists[i % 2];
+			replayed.startRecording(list);
+			scene.paint(replayed, i);
+			replayed.stopRecording();
+			commandBytes += list.getCommandBytes();
+			dataBytes += list.getDataBytes();
+
+			if (renderThread.joinable()) {
+				renderThread.join();
+			}
+			renderThread = std::thread([&replayed, &list] () { replayed.replay(list); });
+		}
+		if (renderThread.joinable()) {
+			renderThread.join();
+		}
+	}
+
+	auto& expected = immediate.getCallLog();
+	auto& actual = replayed.getCallLog();
+	printf("%d frames, %zu bytes of backend calls, %zu command bytes and %zu data bytes recorded\n", nFrames, expected.size(), commandBytes, dataBytes);
+
+	if (expected != actual) {
+		size_t i = 0;
+		while (i < expected.size() && i < actual.size() && expected[i] == actual[i]) {
+			++i;
+		}
+		printf("FAILED: replayed backend calls differ from immediate mode at byte %zu (%zu vs %zu bytes)\n", i, actual.size(), expected.size());
+		return 1;
+	}
+	if (immediate.getNumDrawCalls() != replayed.getNumDrawCalls() || immediate.getNumVertices() != replayed.getNumVertices() || immediate.getNumBytesSubmitted() != replayed.getNumBytesSubmitted()) {
+		printf("FAILED: painter stats differ between immediate and recorded modes\n");
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
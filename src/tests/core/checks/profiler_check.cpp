@@ -0,0 +1,167 @@
+// Records nested zones on the main thread and on workers, the way Core and the executors do, and checks that each frame's
+// capture has every zone exactly once, properly nested, and that the Chrome trace export has an event for each of them.
+// Pass a file name to also write the last frame's trace, to open in chrome://tracing.
+
+#include <halley/support/profiler.h>
+#include <halley/text/string_converter.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+using namespace Halley;
+
+static void work(int depth, int breadth)
+{
+	HALLEY_PROFILE_ZONE(depth % 2 == 0 ? "Even \"zone\"" : "Odd zone");
+	volatile int sink = 0;
+	for (int i = 0; i < 2000; ++i) {
+		sink = sink + i;
+	}
+	if (depth > 0) {
+		for (int i = 0; i < breadth; ++i) {
+			work(depth - 1, breadth);
+		}
+	}
+}
+
+static size_t countZones(int depth, int breadth)
+{
+	return depth == 0 ? 1 : 1 + size_t(breadth) * countZones(depth - 1, breadth);
+}
+
+static size_t countOccurrences(const String& haystack, const char* needle)
+{
+	size_t n = 0;
+	for (size_t pos = haystack.find(needle); pos != String::npos; pos = haystack.find(needle, pos + 1)) {
+		++n;
+	}
+	return n;
+}
+
+int main(int argc, char** argv)
+{
+	const int nFrames = 20;
+	const int nThreads = 4;
+	bool ok = true;
+
+	Profiler::setThreadName("Main");
+	Profiler::setEnabled(true);
+	Profiler::endFrame();
+
+	String trace;
+	for (int frame = 0; frame < nFrames; ++frame) {
+		{
+			HALLEY_PROFILE_ZONE("Frame");
+			std::vector<std::thread> threads;
+			for (int t = 0; t < nThreads; ++t) {
+				threads.emplace_back([t] () {
+					Profiler::setThreadName("Worker " + toString(t));
+					HALLEY_PROFILE_ZONE("Task");
+					work(3, 3);
+				});
+			}
+			work(2, 4);
+			for (auto& thread: threads) {
+				thread.join();
+			}
+		}
+		Profiler::endFrame();
+
+		const auto capture = Profiler::getLastFrame();
+		size_t total = 0;
+		for (auto& thread: capture.threads) {
+			total += thread.events.size();
+
+			// Every zone must sit inside the closest earlier zone one level up
+			std::vector<const ProfilerEvent*> stack;
+			for (auto& e: thread.events) {
+				while (!stack.empty() && stack.back()->depth >= e.depth) {
+					stack.pop_back();
+				}
+				const bool nested = int(stack.size()) == e.depth && (stack.empty() || (stack.back()->startNs <= e.startNs && e.endNs <= stack.back()->endNs));
+				if (!nested || e.startNs < capture.startNs || e.endNs > capture.endNs) {
+					printf("FAILED: zone \"%s\" on %s is out of place\n", e.name, thread.threadName.c_str());
+					ok = false;
+					break;
+				}
+				stack.push_back(&e);
+			}
+		}
+
+		const size_t expected = 1 + countZones(2, 4) + nThreads * (1 + countZones(3, 3));
+		if (total != expected || capture.droppedEvents != 0) {
+			printf("FAILED: frame %d captured %zu zones (%zu dropped), expected %zu\n", frame, total, capture.droppedEvents, expected);
+			ok = false;
+		}
+
+		trace = capture.toChromeTrace();
+		if (countOccurrences(trace, "\"ph\":\"X\"") != expected || countOccurrences(trace, "Even \\\"zone\\\"") == 0) {
+			printf("FAILED: Chrome trace doesn't match the capture\n");
+			ok = false;
+		}
+	}
+
+	// A thread that keeps recording while its ring is being collected, and often laps it: what comes out must never be torn
+	{
+		std::atomic<bool> running(true);
+		size_t recorded = 0;
+		std::thread flood([&] () {
+			while (running) {
+				HALLEY_PROFILE_ZONE("Flood");
+				++recorded;
+			}
+		});
+
+		size_t collected = 0;
+		size_t dropped = 0;
+		for (int i = 0; i < 200 || collected == 0; ++i) {
+			std::this_thread::yield();
+			Profiler::endFrame();
+			const auto capture = Profiler::getLastFrame();
+			dropped += capture.droppedEvents;
+			for (auto& thread: capture.threads) {
+				for (auto& e: thread.events) {
+					if (strcmp(e.name, "Flood") != 0 || e.depth != 0 || e.endNs < e.startNs) {
+						printf("FAILED: torn zone collected while its thread was recording\n");
+						ok = false;
+						break;
+					}
+				}
+				collected += thread.events.size();
+			}
+		}
+		running = false;
+		flood.join();
+		Profiler::endFrame();
+		for (auto& thread: Profiler::getLastFrame().threads) {
+			collected += thread.events.size();
+		}
+
+		if (collected + dropped > recorded) {
+			printf("FAILED: %zu zones collected and %zu dropped, but only %zu recorded\n", collected, dropped, recorded);
+			ok = false;
+		}
+	}
+
+	// Nothing is recorded while disabled
+	Profiler::setEnabled(false);
+	work(2, 2);
+	Profiler::endFrame();
+	if (!Profiler::getLastFrame().threads.empty()) {
+		printf("FAILED: zones recorded while the profiler was disabled\n");
+		ok = false;
+	}
+
+	if (argc > 1) {
+		std::ofstream(argv[1]) << trace.cppStr();
+	}
+
+	if (ok) {
+		printf("%d frames on %d threads OK\n", nFrames, nThreads + 1);
+	}
+	return ok ? 0 : 1;
+}
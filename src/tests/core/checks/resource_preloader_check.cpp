@@ -0,0 +1,218 @@
+// Preloads a few hundred text assets, each depending on some binary assets, from a locator that's slow to read, while
+// getting some of them straight away the way a stage would. Checks that every asset is read exactly once and ends up
+// loaded with the right contents, that the disk thread reads them in priority order, and that a missing asset only
+// makes getting that one fail.
+
+#include <halley/core/resources/resources.h>
+#include <halley/core/resources/resource_locator.h>
+#include <halley/core/resources/asset_database.h>
+#include <halley/file_formats/binary_file.h>
+#include <halley/file_formats/text_file.h>
+#include <halley/concurrency/executor.h>
+#include <halley/support/logger.h>
+#include <halley/text/string_converter.h>
+#include "dummy/dummy_system.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace Halley;
+
+namespace {
+	class SlowMemoryLocator : public IResourceLocatorProvider {
+	public:
+		std::map<String, String> contents;
+		std::map<String, std::atomic<int>> reads;
+		std::mutex orderMutex;
+		Vector<String> readOrder;
+
+		void add(const String& name, AssetType type, const String& data)
+		{
+			contents[name] = data;
+			reads[name] = 0;
+			db.addAsset(name, type, AssetDatabase::Entry(name, Metadata()));
+		}
+
+		std::unique_ptr<ResourceData> getData(const String& path, AssetType, bool) override
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+			++reads.at(path);
+			{
+				std::lock_guard<std::mutex> lock(orderMutex);
+				readOrder.push_back(path);
+			}
+			auto& data = contents.at(path);
+			char* buffer = new char[data.size()];
+			memcpy(buffer, data.c_str(), data.size());
+			return std::make_unique<ResourceDataStatic>(buffer, data.size(), path);
+		}
+
+		const AssetDatabase& getAssetDatabase() override { return db; }
+		void purge(SystemAPI&) override {}
+
+	private:
+		AssetDatabase db;
+	};
+
+	String textName(int i) { return "text/" + toString(i); }
+	String binName(int i) { return "bin/" + toString(i); }
+	String binContents(int i) { return "binary " + toString(i); }
+}
+
+int main(int argc, char** argv)
+{
+	const int nTexts = 300;
+	const int nBins = 40;
+	bool ok = true;
+
+	StdOutSink sink(false);
+	Logger logger;
+	Logger::setInstance(logger);
+	Logger::addSink(sink);
+
+	Executors executors;
+	Executors::set(executors);
+	auto makeThread = [] (String, std::function<void()> runnable) { return std::thread(runnable); };
+	auto cpuAux = std::make_unique<ThreadPool>("CPUAux", executors.getCPUAux(), 4, makeThread);
+	auto diskIO = std::make_unique<ThreadPool>("IO", executors.getDiskIO(), 1, makeThread);
+
+	DummySystemAPI system;
+	auto provider = std::make_unique<SlowMemoryLocator>();
+	auto& files = *provider;
+	for (int i = 0; i < nBins; ++i) {
+		files.add(binName(i), AssetType::BinaryFile, binContents(i));
+	}
+	for (int i = 0; i < nTexts; ++i) {
+		files.add(textName(i), AssetType::TextFile, binName(i % nBins) + " " + binName((i * 7) % nBins));
+	}
+	auto locator = std::make_unique<ResourceLocator>(system);
+	locator->add(std::move(provider));
+
+	{
+		Resources resources(std::move(locator), nullptr);
+		resources.init<TextFile>();
+		resources.init<BinaryFile>();
+		resources.setPreloadPolicy<BinaryFile>(ResourcePreloadPolicy::ReadAhead);
+		resources.setPreloadPolicy<TextFile>(ResourcePreloadPolicy::Decode, [] (const String&, const ResourceDataStatic* data)
+		{
+			Vector<ResourceRef> result;
+			for (auto& name: data->getString().split(' ')) {
+				result.emplace_back(AssetType::BinaryFile, name);
+			}
+			return result;
+		});
+
+		// Every third one is wanted sooner, and every third later
+		const ResourceLoadPriority priorities[] = { ResourceLoadPriority::Low, ResourceLoadPriority::Normal, ResourceLoadPriority::High };
+		Vector<ResourceRef> assets[3];
+		for (int i = 0; i < nTexts; ++i) {
+			assets[i % 3].emplace_back(AssetType::TextFile, textName(i));
+		}
+		// Highest first, so that reads that start while the rest are being queued are already in order
+		for (int p = 2; p >= 0; --p) {
+			resources.preload(assets[p], priorities[p]);
+		}
+		resources.preload<TextFile>("text/missing");
+
+		// Some are needed before they're done
+		for (int i = nTexts - 1; i >= 0; i -= 37) {
+			auto text = resources.get<TextFile>(textName(i));
+			if (text->getData() != files.contents.at(textName(i))) {
+				printf("FAILED: got wrong contents for %s\n", textName(i).c_str());
+				ok = false;
+			}
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+		while (resources.getPreloadsPending() > 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(30)) {
+			resources.update(0.002);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		if (resources.getPreloadsPending() > 0) {
+			printf("FAILED: %zu assets still pending\n", resources.getPreloadsPending());
+			ok = false;
+		}
+
+		for (int i = 0; i < nTexts; ++i) {
+			ok = ok && resources.of<TextFile>().isLoaded(textName(i));
+		}
+		for (int i = 0; i < nBins; ++i) {
+			if (!resources.of<BinaryFile>().isLoaded(binName(i))) {
+				printf("FAILED: dependency %s wasn't preloaded\n", binName(i).c_str());
+				ok = false;
+			} else {
+				auto bytes = resources.get<BinaryFile>(binName(i))->getBytes();
+				if (String(reinterpret_cast<const char*>(bytes.data()), bytes.size()) != binContents(i)) {
+					printf("FAILED: got wrong contents for %s\n", binName(i).c_str());
+					ok = false;
+				}
+			}
+		}
+
+		bool threw = false;
+		try {
+			resources.get<TextFile>("text/missing");
+		} catch (Exception&) {
+			threw = true;
+		}
+		if (!threw) {
+			printf("FAILED: getting a missing asset didn't throw\n");
+			ok = false;
+		}
+
+		// The locator, and files with it, go away along with resources
+		for (auto& r: files.reads) {
+			if (r.second != 1) {
+				printf("FAILED: %s was read %d times\n", r.first.c_str(), int(r.second));
+				ok = false;
+			}
+		}
+
+		// Getting by id finds the same ones, whether they're loaded or not
+		if (resources.get<BinaryFile>(AssetId(binName(0))) != resources.get<BinaryFile>(binName(0))) {
+			printf("FAILED: getting %s by id returned a different resource\n", binName(0).c_str());
+			ok = false;
+		}
+		resources.unload<TextFile>(textName(0));
+		if (resources.get<TextFile>(AssetId(textName(0)))->getData() != files.contents.at(textName(0))) {
+			printf("FAILED: got wrong contents for %s by id\n", textName(0).c_str());
+			ok = false;
+		}
+
+		// The batches queued up front must come in priority order, apart from the ones that were gotten straight away
+		int lastPriority = 2;
+		int preloadedReads = 0;
+		for (auto& name: files.readOrder) {
+			if (!name.startsWith("text/") || name == "text/missing") {
+				continue;
+			}
+			const int n = name.mid(5).toInteger();
+			if ((nTexts - 1 - n) % 37 == 0) {
+				continue;
+			}
+			if (++preloadedReads > 100) {
+				break;
+			}
+			const int priority = n % 3;
+			if (priority > lastPriority) {
+				printf("FAILED: %s was read after lower priority assets\n", name.c_str());
+				ok = false;
+				break;
+			}
+			lastPriority = priority;
+		}
+	}
+
+	cpuAux.reset();
+	diskIO.reset();
+
+	if (ok) {
+		printf("%d assets preloaded OK\n", nTexts + nBins);
+	}
+	return ok ? 0 : 1;
+}
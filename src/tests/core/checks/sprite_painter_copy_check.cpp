@@ -0,0 +1,253 @@
+// Paints the same sprites through SpritePainter by reference, as compact copies, and as copies added from several threads at once
+// through per-thread buffers. Sprites are clipped (relative and absolute), sliced, hidden, masked out and outside the view, so the
+// compact records have to resolve everything Sprite::draw does. Fails unless the backend sees identical calls, byte-for-byte.
+
+#include <halley/text/halleystring.h>
+#include <halley/core/graphics/painter.h>
+#include <halley/core/graphics/camera.h>
+#include <halley/core/graphics/render_context.h>
+#include <halley/core/graphics/render_target/render_target_screen.h>
+#include <halley/core/graphics/sprite/sprite.h>
+#include <halley/core/graphics/sprite/sprite_painter.h>
+#include <halley/core/graphics/material/material.h>
+#include <halley/core/graphics/material/material_definition.h>
+#include <halley/core/graphics/material/material_parameter.h>
+#include <halley/core/resources/resources.h>
+#include <halley/core/resources/resource_locator.h>
+#include <halley/file_formats/config_file.h>
+#include "dummy/dummy_video.h"
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace Halley;
+
+namespace {
+	uint32_t seed = 12345;
+
+	uint32_t nextRandom()
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return seed;
+	}
+
+	float randomFloat(float min, float max)
+	{
+		return min + (max - min) * float(nextRandom() % 10000) / 10000.0f;
+	}
+
+	std::shared_ptr<MaterialDefinition> makeSpriteMaterial(const String& name)
+	{
+		// Same layout as shared_assets/material/sprite_base.yaml
+		const char* attributes[][2] = {
+			{ "a_vertPos", "vec4" }, { "a_position", "vec2" }, { "a_pivot", "vec2" }, { "a_size", "vec2" }, { "a_scale", "vec2" },
+			{ "a_colour", "vec4" }, { "a_texCoord0", "vec4" }, { "a_rotation", "float" }, { "a_textureRotation", "float" }
+		};
+
+		ConfigNode::SequenceType attributeList;
+		for (auto& a: attributes) {
+			ConfigNode::MapType entry;
+			entry[a[0]] = ConfigNode(String(a[1]));
+			attributeList.emplace_back(std::move(entry));
+		}
+		ConfigNode::MapType root;
+		root["name"] = ConfigNode(String(name));
+		root["attributes"] = ConfigNode(std::move(attributeList));
+
+		auto definition = std::make_shared<MaterialDefinition>();
+		definition->load(ConfigNode(std::move(root)));
+		definition->addPass(MaterialPass());
+		return definition;
+	}
+
+	std::shared_ptr<MaterialDefinition> makeBaseMaterialDefinition()
+	{
+		// Same as shared_assets/material/material_base.yaml, which the painter sets the projection on
+		ConfigNode::SequenceType blockUniforms;
+		blockUniforms.emplace_back(ConfigNode::MapType{ { "u_mvp", ConfigNode(String("mat4")) } });
+		ConfigNode::SequenceType uniformList;
+		uniformList.emplace_back(ConfigNode::MapType{ { "HalleyBlock", ConfigNode(std::move(blockUniforms)) } });
+
+		ConfigNode::MapType root;
+		root["name"] = ConfigNode(String("Halley/MaterialBase"));
+		root["uniforms"] = ConfigNode(std::move(uniformList));
+
+		auto definition = std::make_shared<MaterialDefinition>();
+		definition->load(ConfigNode(std::move(root)));
+		return definition;
+	}
+
+	enum class Mode
+	{
+		Reference,
+		Copy,
+		ThreadedCopy
+	};
+
+	const char* getName(Mode mode)
+	{
+		switch (mode) {
+		case Mode::Reference:
+			return "add";
+		case Mode::Copy:
+			return "addCopy";
+		default:
+			return "threaded addCopy";
+		}
+	}
+}
+
+class Scene
+{
+public:
+	// Sprites sharing a tie breaker come in runs of this length, and threads are handed whole runs, so that the order
+	// between buffers never depends on which thread claimed which
+	constexpr static size_t runLength = 4;
+
+	Scene()
+		: camera(Vector2f(320, 240))
+		, screen(Rect4i(0, 0, 640, 480))
+		, sprites(4000)
+		, masks(sprites.size())
+		, layers(sprites.size())
+	{
+		for (int i = 0; i < 3; ++i) {
+			materials.push_back(std::make_shared<Material>(makeSpriteMaterial("Check/Sprite" + toString(i))));
+		}
+	}
+
+	// Moves everything around, so that each frame has different sprites clipped, sliced, hidden and out of view
+	void update()
+	{
+		for (size_t i = 0; i < sprites.size(); ++i) {
+			auto& s = sprites[i];
+			s.setMaterial(materials[nextRandom() % materials.size()]);
+			s.setPos(Vector2f(randomFloat(-100, 740), randomFloat(-100, 580)));
+			s.setSize(Vector2f(randomFloat(4, 64), randomFloat(4, 64)));
+			s.setScale(Vector2f(randomFloat(0.5f, 2), randomFloat(0.5f, 2)));
+			s.setPivot(Vector2f(randomFloat(0, 1), randomFloat(0, 1)));
+			s.setRotation(Angle1f::fromRadians(nextRandom() % 4 == 0 ? randomFloat(0, 6) : 0.0f));
+			s.setColour(Colour4f(randomFloat(0, 1), randomFloat(0, 1), randomFloat(0, 1), randomFloat(0, 1)));
+			s.setVisible(nextRandom() % 16 != 0);
+
+			switch (nextRandom() % 8) {
+			case 0:
+				s.setClip(Rect4f(randomFloat(-8, 0), randomFloat(-8, 0), randomFloat(4, 32), randomFloat(4, 32)));
+				break;
+			case 1:
+				s.setAbsoluteClip(Rect4f(randomFloat(0, 320), randomFloat(0, 240), randomFloat(32, 320), randomFloat(32, 240)));
+				break;
+			default:
+				s.setClip();
+			}
+			if (nextRandom() % 6 == 0) {
+				s.setSliced(Vector4s(short(nextRandom() % 4), short(nextRandom() % 4), short(nextRandom() % 4), short(nextRandom() % 4)));
+			} else {
+				s.setNotSliced();
+			}
+
+			masks[i] = nextRandom() % 8 == 0 ? 2 : 1;
+			layers[i] = int(nextRandom() % 4);
+		}
+	}
+
+	float getTieBreaker(size_t i) const
+	{
+		return float(i / runLength) * 0.5f;
+	}
+
+	void paint(SpritePainter& spritePainter, Painter& painter, Mode mode)
+	{
+		spritePainter.start(sprites.size());
+
+		if (mode == Mode::ThreadedCopy) {
+			const size_t nThreads = 8;
+			const size_t nRuns = (sprites.size() + runLength - 1) / runLength;
+			std::vector<std::thread> threads;
+			for (size_t t = 0; t < nThreads; ++t) {
+				threads.emplace_back([&, t] () {
+					auto& buffer = spritePainter.getThreadBuffer();
+					const size_t start = std::min(nRuns * t / nThreads * runLength, sprites.size());
+					const size_t end = std::min(nRuns * (t + 1) / nThreads * runLength, sprites.size());
+					for (size_t i = start; i < end; ++i) {
+						buffer.addCopy(sprites[i], masks[i], layers[i], getTieBreaker(i));
+					}
+				});
+			}
+			for (auto& thread: threads) {
+				thread.join();
+			}
+		} else {
+			for (size_t i = 0; i < sprites.size(); ++i) {
+				if (mode == Mode::Reference) {
+					spritePainter.add(sprites[i], masks[i], layers[i], getTieBreaker(i));
+				} else {
+					spritePainter.addCopy(sprites[i], masks[i], layers[i], getTieBreaker(i));
+				}
+			}
+		}
+
+		RenderContext context(painter, camera, screen);
+		context.bind([&] (Painter& painter)
+		{
+			spritePainter.draw(1, painter, Rect4f(0, 0, 640, 480));
+		});
+	}
+
+private:
+	Camera camera;
+	ScreenRenderTarget screen;
+	Vector<std::shared_ptr<Material>> materials;
+	Vector<Sprite> sprites;
+	Vector<int> masks;
+	Vector<int> layers;
+};
+
+int main(int argc, char** argv)
+{
+	const int nFrames = argc > 1 ? atoi(argv[1]) : 10;
+
+	Resources resources(nullptr, nullptr);
+	resources.init<MaterialDefinition>();
+	resources.of<MaterialDefinition>().setResource(0, "Halley/MaterialBase", makeBaseMaterialDefinition());
+
+	// Each mode gets its own painters, which are kept across frames so that buffers are reused as they would be in a game
+	const Mode modes[] = { Mode::Reference, Mode::Copy, Mode::ThreadedCopy };
+	std::vector<std::unique_ptr<DummyPainter>> painters;
+	std::vector<std::unique_ptr<SpritePainter>> spritePainters;
+	for (size_t i = 0; i < 3; ++i) {
+		painters.push_back(std::make_unique<DummyPainter>(resources));
+		painters.back()->setCallLogEnabled(true);
+		spritePainters.push_back(std::make_unique<SpritePainter>());
+	}
+
+	bool ok = true;
+	Scene scene;
+	for (int frame = 0; frame < nFrames && ok; ++frame) {
+		scene.update();
+		for (size_t i = 0; i < 3; ++i) {
+			painters[i]->clearCallLog();
+			scene.paint(*spritePainters[i], *painters[i], modes[i]);
+		}
+
+		auto& expected = painters[0]->getCallLog();
+		for (size_t i = 1; i < 3; ++i) {
+			auto& actual = painters[i]->getCallLog();
+			if (expected != actual) {
+				size_t pos = 0;
+				while (pos < expected.size() && pos < actual.size() && expected[pos] == actual[pos]) {
+					++pos;
+				}
+				printf("FAILED: frame %d: backend calls from %s differ from %s at byte %zu (%zu vs %zu bytes)\n", frame, getName(modes[i]), getName(modes[0]), pos, actual.size(), expected.size());
+				ok = false;
+			}
+		}
+	}
+
+	if (ok) {
+		printf("%d frames, %zu bytes of backend calls in the last one OK\n", nFrames, painters[0]->getCallLog().size());
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+// Compares spawning a level's worth of entities one by one against World::createEntities, and reserving them from
+// worker threads with World::reserveEntity. Each approach ends with every entity in a family, and the same total.
+
+#include <halley/text/halleystring.h>
+#include <halley/entity/world.h>
+#include <halley/entity/family_binding.h>
+#include <halley/data_structures/memory_pool.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace Halley;
+
+class PositionComponent final : public Component {
+public:
+	static constexpr int componentIndex = 0;
+	int x = 0;
+	int y = 0;
+
+	PositionComponent() {}
+	PositionComponent(int x, int y) : x(x), y(y) {}
+};
+
+class MainFamily : public FamilyBaseOf<MainFamily> {
+public:
+	PositionComponent& position;
+	using Type = FamilyType<PositionComponent>;
+};
+
+struct Result {
+	double ms;
+	size_t familySize;
+	bool valid;
+};
+
+template <typename F>
+static Result run(F spawn)
+{
+	World world(nullptr, false);
+	auto& family = world.getFamily<MainFamily>();
+
+	const auto start = std::chrono::steady_clock::now();
+	Vector<EntityId> ids = spawn(world);
+	world.spawnPending();
+	const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	bool valid = true;
+	for (size_t i = 0; i < ids.size(); ++i) {
+		auto entity = world.tryGetEntity(ids[i]);
+		valid = valid && entity && world.getEntity(ids[i]).getComponent<PositionComponent>().x == int(i);
+	}
+
+	// Stale ids must not find whatever reuses their slot
+	world.destroyEntities(ids);
+	world.spawnPending();
+	auto again = world.createEntities(ids.size(), [] (EntityRef& e, size_t i) { e.addComponent(PositionComponent(-1, 0)); });
+	world.spawnPending();
+	for (auto& id: ids) {
+		valid = valid && world.tryGetEntity(id) == nullptr;
+	}
+	valid = valid && family.count() == again.size();
+
+	return Result{ elapsed * 1000.0, ids.size(), valid };
+}
+
+int main(int argc, char** argv)
+{
+	const int nEntities = argc > 1 ? atoi(argv[1]) : 200000;
+	const int nThreads = argc > 2 ? atoi(argv[2]) : 4;
+
+	// Normally done by HalleyStatics
+	Vector<TypeDeleterBase*> deleters;
+	ComponentDeleterTable::getDeleters() = &deleters;
+	MaskStorageInterface::createMaskStorage();
+
+	const auto single = run([&] (World& world) {
+		Vector<EntityId> ids;
+		for (int i = 0; i < nEntities; ++i) {
+			ids.push_back(world.createEntity().addComponent(PositionComponent(i, 0)).getEntityId());
+		}
+		return ids;
+	});
+
+	const auto bulk = run([&] (World& world) {
+		return world.createEntities(size_t(nEntities), [] (EntityRef& e, size_t i) {
+			e.addComponent(PositionComponent(int(i), 0));
+		});
+	});
+
+	const auto reserved = run([&] (World& world) {
+		Vector<EntityId> ids(nEntities);
+		Vector<std::thread> threads;
+		for (int t = 0; t < nThreads; ++t) {
+			threads.emplace_back([&, t] () {
+				for (int i = t; i < nEntities; i += nThreads) {
+					ids[i] = world.reserveEntity([i] (EntityRef& e) { e.addComponent(PositionComponent(i, 0)); });
+				}
+			});
+		}
+		for (auto& thread: threads) {
+			thread.join();
+		}
+		return ids;
+	});
+
+	printf("%d entities\n", nEntities);
+	printf("one by one: %.3f ms\n", single.ms);
+	printf("bulk:       %.3f ms (%.2fx faster)\n", bulk.ms, single.ms / bulk.ms);
+	printf("reserved:   %.3f ms from %d threads\n", reserved.ms, nThreads);
+
+	if (!single.valid || !bulk.valid || !reserved.valid) {
+		printf("FAILED: entities were not all created, or stale ids still resolved\n");
+		return 1;
+	}
+	return 0;
+}
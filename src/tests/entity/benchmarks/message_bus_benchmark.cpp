@@ -0,0 +1,137 @@
+// Stress test for System messaging: a sender system sends messages to every entity each step,
+// and two receiver systems process them. Reports throughput and heap allocations per message.
+
+#include <halley/text/halleystring.h>
+#include <halley/entity/world.h>
+#include <halley/entity/system.h>
+#include <halley/entity/family_binding.h>
+#include <halley/concurrency/executor.h>
+#include <halley/data_structures/memory_pool.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+using namespace Halley;
+
+namespace {
+	std::atomic<size_t> heapAllocations(0);
+}
+
+void* operator new(size_t size)
+{
+	++heapAllocations;
+	void* p = std::malloc(size);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+class CounterComponent final : public Component {
+public:
+	static constexpr int componentIndex = 0;
+	int hits = 0;
+};
+
+class DamageMessage final : public Message {
+public:
+	static constexpr int messageIndex = 0;
+	int amount = 0;
+
+	DamageMessage() {}
+	DamageMessage(int amount) : amount(amount) {}
+	size_t getSize() const override final { return sizeof(DamageMessage); }
+};
+
+class MainFamily : public FamilyBaseOf<MainFamily> {
+public:
+	CounterComponent& counter;
+	using Type = FamilyType<CounterComponent>;
+};
+
+class SenderSystem final : public System {
+public:
+	SenderSystem(int messagesPerEntity) : System({&mainFamily}, {}), messagesPerEntity(messagesPerEntity) {}
+
+	void updateBase(Time) override
+	{
+		for (auto& e: mainFamily) {
+			for (int i = 0; i < messagesPerEntity; ++i) {
+				sendMessageGeneric(e.entityId, DamageMessage(i + 1));
+			}
+		}
+	}
+
+	FamilyBinding<MainFamily> mainFamily;
+	int messagesPerEntity;
+};
+
+class ReceiverSystem final : public System {
+public:
+	ReceiverSystem() : System({&mainFamily}, {DamageMessage::messageIndex}) {}
+
+	void onMessagesReceived(int msgIndex, Message** msgs, size_t* idx, size_t n) override
+	{
+		if (msgIndex == DamageMessage::messageIndex) {
+			for (size_t i = 0; i < n; ++i) {
+				mainFamily[idx[i]].counter.hits += static_cast<DamageMessage*>(msgs[i])->amount;
+				++received;
+			}
+		}
+	}
+
+	FamilyBinding<MainFamily> mainFamily;
+	size_t received = 0;
+};
+
+int main(int argc, char** argv)
+{
+	const int nEntities = argc > 1 ? atoi(argv[1]) : 10000;
+	const int messagesPerEntity = argc > 2 ? atoi(argv[2]) : 4;
+	const int nSteps = argc > 3 ? atoi(argv[3]) : 200;
+
+	// Normally done by HalleyStatics
+	Vector<TypeDeleterBase*> deleters;
+	ComponentDeleterTable::getDeleters() = &deleters;
+	MaskStorageInterface::createMaskStorage();
+	Executors executors;
+	Executors::set(executors);
+
+	World world(nullptr, false);
+	world.addSystem(std::make_unique<SenderSystem>(messagesPerEntity), TimeLine::FixedUpdate);
+	auto& receiverA = static_cast<ReceiverSystem&>(world.addSystem(std::make_unique<ReceiverSystem>(), TimeLine::FixedUpdate));
+	auto& receiverB = static_cast<ReceiverSystem&>(world.addSystem(std::make_unique<ReceiverSystem>(), TimeLine::FixedUpdate));
+
+	for (int i = 0; i < nEntities; ++i) {
+		world.createEntity().addComponent(CounterComponent());
+	}
+
+	// Warm up, so the message block pool is populated
+	for (int i = 0; i < 5; ++i) {
+		world.step(TimeLine::FixedUpdate, 0.016);
+	}
+
+	const size_t receivedBefore = receiverA.received + receiverB.received;
+	const size_t allocationsBefore = heapAllocations.load();
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < nSteps; ++i) {
+		world.step(TimeLine::FixedUpdate, 0.016);
+	}
+	const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const size_t allocations = heapAllocations.load() - allocationsBefore;
+
+	const double sent = double(nEntities) * messagesPerEntity * nSteps;
+	const size_t delivered = receiverA.received + receiverB.received - receivedBefore;
+	printf("%d entities, %d messages per entity, %d steps\n", nEntities, messagesPerEntity, nSteps);
+	printf("%.3f ms per step, %.1f M messages sent/s, %zu deliveries\n", elapsed * 1000.0 / nSteps, sent / elapsed / 1000000.0, delivered);
+	printf("%zu heap allocations (%.4f per message)\n", allocations, double(allocations) / sent);
+
+	return delivered == size_t(2 * sent) ? 0 : 1;
+}
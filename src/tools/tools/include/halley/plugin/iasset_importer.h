@@ -81,7 +81,7 @@ namespace Halley
 		virtual void output(const String& name, AssetType type, const Bytes& data, Maybe<Metadata> metadata = {}, const String& platform = "pc") = 0;
 		virtual void addAdditionalAsset(ImportingAsset&& asset) = 0;
 		virtual bool reportProgress(float progress, const String& label = "") = 0;
-		virtual Bytes readAdditionalFile(const Path& filePath) = 0;
+		virtual Bytes readAdditionalFile(const Path& filePath) = 0; // Must be used for any other files the import depends on
 		virtual const Path& getDestinationDirectory() = 0;
 	};
 
@@ -94,6 +94,13 @@ namespace Halley
 		virtual void import(const ImportingAsset&, IAssetCollector&) {}
 		virtual int dropFrontCount() const { return 1; }
 
+		// Bump this whenever the output changes for the same input, so that cached imports are discarded
+		virtual int getVersion() const { return 0; }
+
+		// If the output also depends on the machine importing (e.g. on which compilers it has), describe that here.
+		// Cached imports are only reused by machines with the same tag.
+		virtual String getHostTag() const { return ""; }
+
 		virtual String getAssetId(const Path& file, const Maybe<Metadata>& metadata) const
 		{
 			return file.dropFront(dropFrontCount()).string();
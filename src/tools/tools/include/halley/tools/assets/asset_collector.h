@@ -20,6 +20,7 @@ namespace Halley {
 		std::vector<std::pair<Path, Bytes>> collectOutFiles();
 		const std::vector<AssetResource>& getAssets() const;
 		const std::vector<TimestampedPath>& getAdditionalInputs() const;
+		const std::vector<std::pair<Path, uint64_t>>& getAdditionalInputHashes() const;
 		
 	private:
 		const ImportingAsset& asset;
@@ -30,6 +31,7 @@ namespace Halley {
 		std::vector<AssetResource> assets;
 		std::vector<ImportingAsset> additionalAssets;
 		std::vector<TimestampedPath> additionalInputs;
+		std::vector<std::pair<Path, uint64_t>> additionalInputHashes; // As requested, for the import cache
 		std::vector<std::pair<Path, Bytes>> outFiles;
 	};
 }
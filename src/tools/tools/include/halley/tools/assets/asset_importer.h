@@ -15,6 +15,8 @@ namespace Halley
 		IAssetImporter& getRootImporter(Path path) const;
 		std::vector<std::reference_wrapper<IAssetImporter>> getImporters(ImportAssetType type) const;
 		const std::vector<Path>& getAssetsSrc() const;
+		// Of the importers for this type only, including their host tags
+		uint64_t getVersionHash(ImportAssetType type) const;
 
 	private:
 		std::map<ImportAssetType, std::vector<std::unique_ptr<IAssetImporter>>> importers;
@@ -68,6 +68,8 @@ namespace Halley
 		};
 
 	public:
+		constexpr static int currentAssetVersion = 54;
+
 		ImportAssetsDatabase(Path directory, Path dbFile, Path assetsDbFile, std::vector<String> platforms);
 
 		void load();
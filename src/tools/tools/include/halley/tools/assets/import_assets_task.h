@@ -2,13 +2,22 @@
 #include "halley/tools/tasks/editor_task.h"
 #include "halley/file/path.h"
 #include "import_assets_database.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
 #include <vector>
 #include <set>
 
 namespace Halley
 {
 	class Project;
-	
+	class ExecutionQueue;
+
+	// Imports each asset as a graph of jobs: its input files are read on the disk IO queue, then each importer runs on
+	// the CPU aux queue, with any additional assets it produces becoming jobs of their own. Once they're all done, the
+	// output is written on the disk IO queue, and handed back to the task's own thread, which is the only one that
+	// updates and saves the database.
 	class ImportAssetsTask : public EditorTask
 	{
 	public:
@@ -18,6 +27,45 @@ namespace Halley
 		void run() override;
 
 	private:
+		// Everything produced for one of the assets being imported, by it and by any additional assets it produced
+		struct AssetImport
+		{
+			ImportAssetsDatabaseEntry& asset;
+			std::vector<AssetResource> out;
+			std::vector<std::pair<Path, Bytes>> outFiles;
+			std::vector<TimestampedPath> additionalInputs;
+			std::vector<std::pair<Path, uint64_t>> additionalInputHashes;
+			std::set<ImportAssetType> importerTypes; // Of this asset and every additional asset it produced
+			uint64_t cacheKey = 0;
+			bool fromCache = false;
+			Maybe<String> error;
+
+			std::mutex mutex;
+			std::atomic<int> pendingJobs{ 0 };
+
+			explicit AssetImport(ImportAssetsDatabaseEntry& asset) : asset(asset) {}
+		};
+
+		struct ImportJob
+		{
+			std::shared_ptr<AssetImport> root;
+			ImportingAsset asset;
+		};
+
+		struct ImporterStats
+		{
+			size_t jobs = 0;
+			size_t maxConcurrent = 0;
+			int64_t workTime = 0;
+			int64_t activeTime = 0; // While at least one was running
+			int64_t bytesIn = 0;
+			int64_t bytesOut = 0;
+
+			size_t running = 0;
+			std::chrono::steady_clock::time_point activeSince;
+			std::deque<ImportJob> waiting; // Over the limit of how many can run at once
+		};
+
 		ImportAssetsDatabase& db;
 		const AssetImporter& importer;
 		Path assetsPath;
@@ -27,16 +75,34 @@ namespace Halley
 		Vector<ImportAssetsDatabaseEntry> files;
 		std::vector<String> deletedAssets;
 		std::set<String> outputAssets;
-		
+
 		std::atomic<int64_t> totalImportTime;
 		std::atomic<size_t> assetsImported{};
+		std::atomic<size_t> assetsFromCache{};
 		size_t assetsToImport{};
 
 		std::mutex mutex;
-		
+		std::condition_variable jobsChanged;
+		std::vector<std::shared_ptr<AssetImport>> finished; // Waiting for the database to be updated
+		std::map<ImportAssetType, ImporterStats> stats;
+		std::deque<std::function<void()>> serialJobs; // Only used when not importing in parallel
+		size_t jobsInFlight = 0;
+		bool parallelImport = true;
+
 		std::string curFileLabel;
 
-		bool importAsset(ImportAssetsDatabaseEntry& asset);
+		void dispatch(ExecutionQueue& queue, std::function<void()> job);
+		void onJobDone();
+
+		void readInputs(std::shared_ptr<AssetImport> root);
+		void startImport(std::shared_ptr<AssetImport> root, ImportingAsset asset);
+		void addJob(ImportJob job);
+		void runJob(ImportJob& job);
+		void writeOutputs(std::shared_ptr<AssetImport> root);
+		void finishImport(AssetImport& import);
+
+		static size_t getMaxConcurrentJobs(ImportAssetType type);
+		void logStats() const;
 
 		std::vector<Path> loadFont(const ImportAssetsDatabaseEntry& asset, Path dstDir);
 		std::vector<Path> genericImporter(const ImportAssetsDatabaseEntry& asset, Path dstDir);
@@ -0,0 +1,71 @@
+#pragma once
+#include "halley/file/path.h"
+#include "halley/text/halleystring.h"
+#include "halley/data_structures/maybe.h"
+#include "halley/plugin/iasset_importer.h"
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace Halley
+{
+	class AssetImporter;
+	class ImportAssetsDatabaseEntry;
+
+	// What an import produced, as stored in the cache
+	class ImportCacheResult
+	{
+	public:
+		std::vector<std::pair<Path, uint64_t>> additionalInputs; // As requested through the collector, and the hash of their contents
+		std::vector<std::pair<int, uint64_t>> importerVersions; // For each type of asset imported along the way, AssetImporter::getVersionHash of its importers
+		std::vector<AssetResource> outputAssets;
+		std::vector<std::pair<Path, uint64_t>> outputFiles; // Relative to the output directory, and the hash of their contents
+
+		void serialize(Serializer& s) const;
+		void deserialize(Deserializer& s);
+	};
+
+	// Remembers the outputs of imports by the contents of their inputs, rather than by their timestamps, so that assets that
+	// were imported before (by any checkout, or any machine sharing the directory) don't need to be imported again.
+	//
+	// Entries are keyed by a hash of the asset's input files, their metadata and the version of its importers. As the additional
+	// files an importer reads, and the additional assets it produces, are only known after importing, each entry can hold a few
+	// results, each of which is only used if the additional files it read still have the same contents, and the importers of
+	// every additional asset are still at the same version (and host tag). Output files are stored by their hash.
+	class ImportCache
+	{
+	public:
+		// An empty directory disables the cache
+		explicit ImportCache(Path directory);
+
+		// Either $HALLEY_IMPORT_CACHE, or a directory in the user's data directory
+		static Path getDefaultDirectory();
+
+		bool isEnabled() const;
+		const Path& getDirectory() const;
+
+		uint64_t getKey(const ImportingAsset& asset, const AssetImporter& importer) const;
+
+		struct Hit
+		{
+			std::vector<AssetResource> outputAssets;
+			std::vector<std::pair<Path, Bytes>> outputFiles;
+			std::vector<TimestampedPath> additionalInputs; // Resolved against assetsSrc, with their current timestamps
+		};
+
+		// Looks for a previous import with the same inputs, whose additional inputs (searched for in the importer's assetsSrc) and importers are also the same
+		Maybe<Hit> retrieve(uint64_t key, const AssetImporter& importer) const;
+		void store(uint64_t key, const AssetImporter& importer, const std::set<ImportAssetType>& importerTypes, const std::vector<std::pair<Path, uint64_t>>& additionalInputs, const std::vector<AssetResource>& outputAssets, const std::vector<std::pair<Path, Bytes>>& outputFiles);
+
+	private:
+		constexpr static size_t maxResultsPerKey = 4;
+
+		Path directory;
+		mutable std::mutex mutex;
+
+		Path getEntryPath(uint64_t key) const;
+		Path getObjectPath(uint64_t hash) const;
+		void writeAtomically(const Path& path, const Bytes& data) const;
+	};
+}
@@ -79,6 +79,7 @@ namespace Halley
 		SystemMethod method = SystemMethod::Update;
 		CodegenLanguage language = CodegenLanguage::CPlusPlus;
 		int smearing = 0;
+		bool threadSafe = false;
 
 		std::unordered_set<String> includeFiles;
 
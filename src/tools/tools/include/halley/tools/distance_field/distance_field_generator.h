@@ -10,6 +10,16 @@ namespace Halley
 	class DistanceFieldGenerator
 	{
 	public:
-		static std::unique_ptr<Image> generate(Image& src, Vector2i size, float radius);
+		enum class Method
+		{
+			Exact, // Euclidean distance transform of the whole source image, in time linear to its size
+			BruteForce // Searches a window around each source texel. Much slower, kept as a reference.
+		};
+
+		static std::unique_ptr<Image> generate(Image& src, Vector2i size, float radius, Method method = Method::Exact);
+
+	private:
+		static std::unique_ptr<Image> generateBruteForce(Image& src, Vector2i size, float radius);
+		static std::unique_ptr<Image> generateExact(Image& src, Vector2i size, float radius);
 	};
 }
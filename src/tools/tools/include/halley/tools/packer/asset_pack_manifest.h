@@ -2,6 +2,7 @@
 #include "halley/text/halleystring.h"
 #include "halley/data_structures/maybe.h"
 #include "halley/utils/utils.h"
+#include "halley/bytes/compression.h"
 
 namespace Halley {
 	class ConfigNode;
@@ -16,10 +17,12 @@ namespace Halley {
 		bool checkMatch(const String& asset) const;
 		bool isEncrypted() const;
 		const String& getEncryptionKey() const;
+		CompressionCodec getCompression() const;
 
 	private:
 		String name;
 		String encryptionKey;
+		CompressionCodec compression = CompressionCodec::Deflate;
 		std::vector<String> matches;
 	};
 
@@ -23,11 +23,12 @@ namespace Halley {
 		};
 		
 		AssetPackListing();
-		AssetPackListing(String name, String encryptionKey);
+		AssetPackListing(String name, String encryptionKey, CompressionCodec compression);
 		
 		void addFile(AssetType type, const String& name, const AssetDatabase::Entry& entry);
 		const std::vector<Entry>& getEntries() const;
 		const String& getEncryptionKey() const;
+		CompressionCodec getCompression() const;
 		
 		void setActive(bool active);
 		bool isActive() const;
@@ -36,6 +37,7 @@ namespace Halley {
 	private:
 		String name;
 		String encryptionKey;
+		CompressionCodec compression = CompressionCodec::None;
 
 		bool active = false;
 
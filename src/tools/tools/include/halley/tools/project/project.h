@@ -8,6 +8,7 @@
 namespace Halley
 {
 	class ImportAssetsDatabase;
+	class ImportCache;
 
 	class HalleyStatics;
 	class IHalleyPlugin;
@@ -37,6 +38,9 @@ namespace Halley
 		ImportAssetsDatabase& getImportAssetsDatabase() const;
 		ImportAssetsDatabase& getCodegenDatabase() const;
 
+		ImportCache& getImportCache() const;
+		void setImportCachePath(const Path& path); // Empty to disable it
+
 		const AssetImporter& getAssetImporter() const;
 		std::vector<std::unique_ptr<IAssetImporter>> getAssetImportersFromPlugins(ImportAssetType type) const;
 
@@ -52,6 +56,7 @@ namespace Halley
 
 		std::unique_ptr<ImportAssetsDatabase> importAssetsDatabase;
 		std::unique_ptr<ImportAssetsDatabase> codegenDatabase;
+		std::unique_ptr<ImportCache> importCache;
 		std::unique_ptr<AssetImporter> assetImporter;
 
 		std::vector<HalleyPluginPtr> plugins;
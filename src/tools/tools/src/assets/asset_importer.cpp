@@ -14,6 +14,7 @@
 #include "importers/bitmap_font_importer.h"
 #include "importers/shader_importer.h"
 #include "halley/text/string_converter.h"
+#include "halley/utils/hash.h"
 #include "halley/tools/project/project.h"
 #include <boost/variant/detail/substitute.hpp>
 #include "importers/texture_importer.h"
@@ -102,3 +103,16 @@ const std::vector<Path>& AssetImporter::getAssetsSrc() const
 {
 	return assetsSrc;
 }
+
+uint64_t AssetImporter::getVersionHash(ImportAssetType type) const
+{
+	Hash::Hasher hasher;
+	hasher.feed(int(type));
+	for (auto& importer: getImporters(type)) {
+		hasher.feed(importer.get().getVersion());
+		const auto tag = importer.get().getHostTag();
+		hasher.feed(uint64_t(tag.length()));
+		hasher.feedBytes(gsl::as_bytes(gsl::span<const char>(tag.c_str(), tag.length())));
+	}
+	return hasher.digest();
+}
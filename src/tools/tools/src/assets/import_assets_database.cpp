@@ -3,10 +3,10 @@
 #include "halley/resources/resource_data.h"
 #include "halley/tools/file/filesystem.h"
 
-constexpr static int currentAssetVersion = 53;
-
 using namespace Halley;
 
+constexpr int ImportAssetsDatabase::currentAssetVersion;
+
 void ImportAssetsDatabaseEntry::serialize(Serializer& s) const
 {
 	s << assetId;
@@ -259,6 +259,7 @@ std::vector<ImportAssetsDatabaseEntry> ImportAssetsDatabase::getAllMissing() con
 
 std::vector<AssetResource> ImportAssetsDatabase::getOutFiles(String assetId) const
 {
+	std::lock_guard<std::mutex> lock(mutex);
 	auto iter = assetsImported.find(assetId);
 	if (iter != assetsImported.end()) {
 		return iter->second.asset.outputFiles;
@@ -308,9 +309,10 @@ std::unique_ptr<AssetDatabase> ImportAssetsDatabase::makeAssetDatabase(const Str
 			}
 
 			if (version) {
-				result->addAsset(o.name, o.type, AssetDatabase::Entry(version->filepath, version->metadata));
+				result->appendAsset(o.name, o.type, AssetDatabase::Entry(version->filepath, version->metadata));
 			}
 		}
 	}
+	result->sortAssets();
 	return result;
 }
@@ -1,4 +1,5 @@
 #include <thread>
+#include <cmath>
 #include "halley/tools/assets/import_assets_task.h"
 #include "halley/tools/assets/check_assets_task.h"
 #include "halley/tools/project/project.h"
@@ -6,6 +7,7 @@
 #include "halley/resources/resource_data.h"
 #include "halley/tools/file/filesystem.h"
 #include "halley/tools/assets/asset_collector.h"
+#include "halley/tools/assets/import_cache.h"
 #include "halley/concurrency/concurrent.h"
 #include "halley/tools/packer/asset_packer_task.h"
 #include "halley/support/logger.h"
@@ -31,39 +33,53 @@ void ImportAssetsTask::run()
 	Stopwatch timer;
 	using namespace std::chrono_literals;
 	auto lastSave = std::chrono::steady_clock::now();
+	bool needsSave = false;
 
 	assetsImported = 0;
 	assetsToImport = files.size();
-	std::vector<Future<void>> tasks;
+	parallelImport = !Debug::isDebug();
 
-	constexpr bool parallelImport = !Debug::isDebug();
+	for (auto& file: files) {
+		auto root = std::make_shared<AssetImport>(file);
+		dispatch(Executors::getDiskIO(), [this, root] () { readInputs(root); });
+	}
 
-	for (size_t i = 0; i < files.size(); ++i) {
-		auto importFunc = [&, i] () {
-			if (isCancelled()) {
-				return;
+	// Update the database with whatever finished, until everything has
+	while (true) {
+		std::vector<std::shared_ptr<AssetImport>> done;
+		std::function<void()> serialJob;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (!serialJobs.empty()) {
+				serialJob = std::move(serialJobs.front());
+				serialJobs.pop_front();
+			} else if (finished.empty() && jobsInFlight > 0) {
+				jobsChanged.wait_for(lock, 100ms);
 			}
-
-			if (importAsset(files[i])) {
-				++assetsImported;
-				setProgress(float(assetsImported) * 0.98f / float(assetsToImport), files[i].assetId);
+			done = std::move(finished);
+			finished.clear();
+			if (!serialJob && done.empty() && jobsInFlight == 0) {
+				break;
 			}
+		}
 
-			auto now = std::chrono::steady_clock::now();
-			if (now - lastSave > 1s) {
-				db.save();
-				lastSave = now;
-			}
-		};
+		if (serialJob) {
+			serialJob();
+		}
 
-		if (parallelImport) {
-			tasks.push_back(Concurrent::execute(Executors::getCPUAux(), importFunc));
-		} else {
-			importFunc();
+		for (auto& import: done) {
+			finishImport(*import);
+			needsSave = true;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		if (needsSave && now - lastSave > 1s) {
+			db.save();
+			lastSave = now;
+			needsSave = false;
 		}
 	}
 
-	Concurrent::whenAll(tasks.begin(), tasks.end()).get();
 	db.save();
 
 	if (!isCancelled()) {
@@ -78,105 +94,327 @@ void ImportAssetsTask::run()
 	Time realTime = timer.elapsedNanoSeconds() / 1000000000.0;
 	Time importTime = totalImportTime / 1000000000.0;
 	Logger::logInfo("Import took " + toString(realTime) + " seconds, on which " + toString(importTime) + " seconds of work were performed (" + toString(importTime / realTime) + "x realtime)");
+	if (assetsFromCache > 0) {
+		Logger::logInfo(toString(size_t(assetsFromCache)) + " of " + toString(assetsToImport) + " assets were taken from the import cache at " + project.getImportCache().getDirectory());
+	}
+	logStats();
 }
 
-bool ImportAssetsTask::importAsset(ImportAssetsDatabaseEntry& asset)
+void ImportAssetsTask::dispatch(ExecutionQueue& queue, std::function<void()> job)
 {
-	Logger::logInfo("Importing " + asset.assetId);
-	Stopwatch timer;
+	std::unique_lock<std::mutex> lock(mutex);
+	++jobsInFlight;
 
-	std::vector<AssetResource> out;
-	std::vector<std::pair<Path, Bytes>> outFiles;
-	std::vector<TimestampedPath> additionalInputs;
-	try {
-		// Create queue
-		std::list<ImportingAsset> toLoad;
+	if (parallelImport) {
+		lock.unlock();
+		Concurrent::execute(queue, [this, job] ()
+		{
+			job();
+			onJobDone();
+		});
+	} else {
+		serialJobs.push_back([this, job] ()
+		{
+			job();
+			onJobDone();
+		});
+	}
+}
 
-		// Load files from disk
-		ImportingAsset importingAsset;
-		importingAsset.assetId = asset.assetId;
-		importingAsset.assetType = asset.assetType;
+void ImportAssetsTask::onJobDone()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	--jobsInFlight;
+	jobsChanged.notify_all();
+}
+
+void ImportAssetsTask::readInputs(std::shared_ptr<AssetImport> root)
+{
+	auto& asset = root->asset;
+	if (isCancelled()) {
+		return;
+	}
+
+	Stopwatch timer;
+	auto importingAsset = std::make_shared<ImportingAsset>();
+	try {
+		importingAsset->assetId = asset.assetId;
+		importingAsset->assetType = asset.assetType;
 		for (auto& f: asset.inputFiles) {
 			auto meta = db.getMetadata(f.first);
-			importingAsset.inputFiles.emplace_back(ImportingAssetFile(f.first, FileSystem::readFile(asset.srcDir / f.first), meta ? meta.get() : Metadata()));
+			importingAsset->inputFiles.emplace_back(ImportingAssetFile(f.first, FileSystem::readFile(asset.srcDir / f.first), meta ? meta.get() : Metadata()));
+		}
+	} catch (std::exception& e) {
+		root->error = String(e.what());
+	}
+	totalImportTime += timer.elapsedNanoSeconds();
+
+	if (root->error) {
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.push_back(root);
+		jobsChanged.notify_all();
+	} else {
+		dispatch(Executors::getCPUAux(), [this, root, importingAsset] () { startImport(root, std::move(*importingAsset)); });
+	}
+}
+
+void ImportAssetsTask::startImport(std::shared_ptr<AssetImport> root, ImportingAsset asset)
+{
+	if (isCancelled()) {
+		return;
+	}
+
+	// If these exact inputs were imported before, just reuse that
+	auto& cache = project.getImportCache();
+	if (cache.isEnabled()) {
+		Stopwatch timer;
+		root->cacheKey = cache.getKey(asset, importer);
+		auto hit = cache.retrieve(root->cacheKey, importer);
+		totalImportTime += timer.elapsedNanoSeconds();
+
+		if (hit) {
+			Logger::logInfo("Importing " + asset.assetId + " from cache");
+			root->fromCache = true;
+			root->out = std::move(hit->outputAssets);
+			root->outFiles = std::move(hit->outputFiles);
+			root->additionalInputs = std::move(hit->additionalInputs);
+			dispatch(Executors::getDiskIO(), [this, root] () { writeOutputs(root); });
+			return;
 		}
-		toLoad.emplace_back(std::move(importingAsset));
-
-		// Import
-		while (!toLoad.empty()) {
-			auto cur = std::move(toLoad.front());
-			toLoad.pop_front();
-			
-			AssetCollector collector(cur, assetsPath, importer.getAssetsSrc(), [=] (float assetProgress, const String& label) -> bool
+	}
+
+	Logger::logInfo("Importing " + asset.assetId);
+	addJob(ImportJob{ root, std::move(asset) });
+}
+
+void ImportAssetsTask::addJob(ImportJob job)
+{
+	++job.root->pendingJobs;
+	const auto type = job.asset.assetType;
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		auto& importerStats = stats[type];
+		if (importerStats.running >= getMaxConcurrentJobs(type)) {
+			importerStats.waiting.push_back(std::move(job));
+			return;
+		}
+		if (importerStats.running++ == 0) {
+			importerStats.activeSince = std::chrono::steady_clock::now();
+		}
+		importerStats.maxConcurrent = std::max(importerStats.maxConcurrent, importerStats.running);
+	}
+
+	auto sharedJob = std::make_shared<ImportJob>(std::move(job));
+	dispatch(Executors::getCPUAux(), [this, sharedJob] () { runJob(*sharedJob); });
+}
+
+void ImportAssetsTask::runJob(ImportJob& job)
+{
+	auto& root = *job.root;
+	const auto type = job.asset.assetType;
+	Stopwatch timer;
+	int64_t bytesIn = 0;
+	int64_t bytesOut = 0;
+
+	bool failed;
+	{
+		std::unique_lock<std::mutex> lock(root.mutex);
+		failed = bool(root.error);
+	}
+
+	if (!isCancelled() && !failed) {
+		for (auto& f: job.asset.inputFiles) {
+			bytesIn += int64_t(f.data.size());
+		}
+
+		try {
+			AssetCollector collector(job.asset, assetsPath, importer.getAssetsSrc(), [=] (float assetProgress, const String& label) -> bool
 			{
-				//setProgress(lerp(curFileProgressStart, curFileProgressEnd, assetProgress), curFileLabel + " " + label);
 				return !isCancelled();
 			});
 
-			for (auto& importer: importer.getImporters(cur.assetType)) {
-				importer.get().import(cur, collector);
-			}
-			
-			for (auto& additional: collector.collectAdditionalAssets()) {
-				toLoad.emplace_front(std::move(additional));
+			for (auto& importer: importer.getImporters(type)) {
+				importer.get().import(job.asset, collector);
 			}
 
-			for (auto& outFile: collector.collectOutFiles()) {
-				outFiles.push_back(std::move(outFile));
+			auto outFiles = collector.collectOutFiles();
+			for (auto& f: outFiles) {
+				bytesOut += int64_t(f.second.size());
 			}
 
-			for (auto& o: collector.getAssets()) {
-				out.push_back(o);
+			{
+				std::unique_lock<std::mutex> lock(root.mutex);
+				root.importerTypes.insert(type);
+				for (auto& f: outFiles) {
+					root.outFiles.push_back(std::move(f));
+				}
+				for (auto& o: collector.getAssets()) {
+					root.out.push_back(o);
+				}
+				for (auto& i: collector.getAdditionalInputs()) {
+					root.additionalInputs.push_back(i);
+				}
+				for (auto& i: collector.getAdditionalInputHashes()) {
+					root.additionalInputHashes.push_back(i);
+				}
 			}
 
-			for (auto& i: collector.getAdditionalInputs()) {
-				additionalInputs.push_back(i);
+			// Added before this one is done, so the asset can't be considered finished in the meantime
+			for (auto& additional: collector.collectAdditionalAssets()) {
+				addJob(ImportJob{ job.root, std::move(additional) });
+			}
+		} catch (std::exception& e) {
+			std::unique_lock<std::mutex> lock(root.mutex);
+			if (!root.error) {
+				root.error = String(e.what());
 			}
 		}
-	} catch (std::exception& e) {
-		addError("\"" + asset.assetId + "\" - " + e.what());
-		asset.additionalInputFiles = std::move(additionalInputs);
-		db.markFailed(asset);
+	}
+
+	timer.pause();
+	const int64_t time = timer.elapsedNanoSeconds();
+	totalImportTime += time;
 
-		return false;
+	// Let the next one of this type start
+	std::shared_ptr<ImportJob> next;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		auto& importerStats = stats[type];
+		++importerStats.jobs;
+		importerStats.workTime += time;
+		importerStats.bytesIn += bytesIn;
+		importerStats.bytesOut += bytesOut;
+
+		if (!importerStats.waiting.empty()) {
+			next = std::make_shared<ImportJob>(std::move(importerStats.waiting.front()));
+			importerStats.waiting.pop_front();
+		} else {
+			--importerStats.running;
+			if (importerStats.running == 0) {
+				importerStats.activeTime += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - importerStats.activeSince).count();
+			}
+		}
+	}
+	if (next) {
+		dispatch(Executors::getCPUAux(), [this, next] () { runJob(*next); });
 	}
 
-	// Check if it didn't get cancelled
-	if (isCancelled()) {
-		return false;
+	if (--root.pendingJobs == 0) {
+		auto rootPtr = job.root;
+		dispatch(Executors::getDiskIO(), [this, rootPtr] () { writeOutputs(rootPtr); });
 	}
+}
+
+void ImportAssetsTask::writeOutputs(std::shared_ptr<AssetImport> root)
+{
+	auto& asset = root->asset;
+
+	if (!root->error && !isCancelled()) {
+		Stopwatch timer;
+		try {
+			// Retrieve previous output from this asset, and remove any files which went missing
+			auto previous = db.getOutFiles(asset.assetId);
+			for (auto& f: previous) {
+				for (auto& v: f.platformVersions) {
+					if (std::find_if(root->outFiles.begin(), root->outFiles.end(), [&] (const std::pair<Path, Bytes>& r) { return r.first == v.second.filepath; }) == root->outFiles.end()) {
+						// File no longer exists as part of this asset, remove it
+						FileSystem::remove(assetsPath / v.second.filepath);
+					}
+				}
+			}
 
-	// Retrieve previous output from this asset, and remove any files which went missing
-	auto previous = db.getOutFiles(asset.assetId);
-	for (auto& f: previous) {
-		for (auto& v: f.platformVersions) {
-			if (std::find_if(outFiles.begin(), outFiles.end(), [&] (const std::pair<Path, Bytes>& r) { return r.first == v.second.filepath; }) == outFiles.end()) {
-				// File no longer exists as part of this asset, remove it
-				FileSystem::remove(assetsPath / v.second.filepath);
+			// Write files
+			for (auto& outFile: root->outFiles) {
+				auto path = assetsPath / outFile.first;
+				Logger::logInfo("- " + asset.assetId + " -> " + path + " (" + String::prettySize(outFile.second.size()) + ")");
+				FileSystem::writeFile(path, outFile.second);
 			}
+
+			auto& cache = project.getImportCache();
+			if (!root->fromCache && cache.isEnabled()) {
+				cache.store(root->cacheKey, importer, root->importerTypes, root->additionalInputHashes, root->out, root->outFiles);
+			}
+		} catch (std::exception& e) {
+			root->error = String(e.what());
 		}
+		totalImportTime += timer.elapsedNanoSeconds();
 	}
 
-	// Write files
-	for (auto& outFile: outFiles) {
-		auto path = assetsPath / outFile.first;
-		Logger::logInfo("- " + asset.assetId + " -> " + path + " (" + String::prettySize(outFile.second.size()) + ")");
-		FileSystem::writeFile(path, outFile.second);
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.push_back(root);
+	jobsChanged.notify_all();
+}
+
+void ImportAssetsTask::finishImport(AssetImport& import)
+{
+	auto& asset = import.asset;
+
+	// Check if it didn't get cancelled
+	if (isCancelled()) {
+		return;
+	}
+
+	if (import.error) {
+		addError("\"" + asset.assetId + "\" - " + import.error.get());
+		asset.additionalInputFiles = std::move(import.additionalInputs);
+		db.markFailed(asset);
+		return;
 	}
 
 	// Add to list of output assets
-	for (auto& o: out) {
-		std::unique_lock<std::mutex> lock(mutex);
+	for (auto& o: import.out) {
 		outputAssets.insert(toString(o.type) + ":" + o.name);
 	}
 
 	// Store output in db
-	asset.additionalInputFiles = std::move(additionalInputs);
-	asset.outputFiles = std::move(out);
+	asset.additionalInputFiles = std::move(import.additionalInputs);
+	asset.outputFiles = std::move(import.out);
 	db.markAsImported(asset);
 
-	timer.pause();
-	totalImportTime += timer.elapsedNanoSeconds();
+	if (import.fromCache) {
+		++assetsFromCache;
+	}
+	++assetsImported;
+	setProgress(float(assetsImported) * 0.98f / float(assetsToImport), asset.assetId);
+}
+
+size_t ImportAssetsTask::getMaxConcurrentJobs(ImportAssetType type)
+{
+	switch (type) {
+	case ImportAssetType::Font:
+		// Already renders its glyphs in parallel, and holds all of them in memory while doing it
+		return 2;
+	case ImportAssetType::SpriteSheet:
+		// Holds every frame of the sheet in memory while packing
+		return 2;
+	case ImportAssetType::Shader:
+		// Shader compilers don't scale well with concurrent compilations
+		return 2;
+	default:
+		return std::numeric_limits<size_t>::max();
+	}
+}
 
-	return true;
+void ImportAssetsTask::logStats() const
+{
+	const size_t nThreads = parallelImport ? std::max(size_t(1), Executors::getCPUAux().threadCount()) : 1;
+
+	for (auto& s: stats) {
+		auto& importerStats = s.second;
+		if (importerStats.jobs == 0) {
+			continue;
+		}
+
+		// How many of them ran at once on average, compared to how many could have
+		const Time workTime = importerStats.workTime / 1000000000.0;
+		const Time activeTime = std::max(importerStats.activeTime, int64_t(1)) / 1000000000.0;
+		const Time parallelism = workTime / activeTime;
+		const size_t maxParallel = std::min(getMaxConcurrentJobs(s.first), nThreads);
+		const int efficiency = int(lround(100 * parallelism / maxParallel));
+
+		Logger::logInfo("- " + toString(s.first) + ": " + toString(importerStats.jobs) + " imports, " + toString(workTime, 2) + " seconds of work in "
+			+ toString(activeTime, 2) + " seconds (" + toString(parallelism, 2) + "x, " + toString(efficiency) + "% of " + toString(maxParallel) + " threads), "
+			+ String::prettySize(importerStats.bytesIn) + " in, " + String::prettySize(importerStats.bytesOut) + " out");
+	}
 }
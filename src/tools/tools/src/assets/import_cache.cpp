@@ -0,0 +1,222 @@
+#include "halley/tools/assets/import_cache.h"
+#include "halley/tools/assets/asset_importer.h"
+#include "halley/tools/assets/import_assets_database.h"
+#include "halley/tools/file/filesystem.h"
+#include "halley/bytes/byte_serializer.h"
+#include "halley/os/os.h"
+#include "halley/support/logger.h"
+#include "halley/text/string_converter.h"
+#include "halley/utils/hash.h"
+#include <algorithm>
+#include <cstdlib>
+
+using namespace Halley;
+
+constexpr size_t ImportCache::maxResultsPerKey;
+
+// Changes whenever the format of the entries does
+constexpr static int importCacheVersion = 1;
+
+void ImportCacheResult::serialize(Serializer& s) const
+{
+	s << additionalInputs;
+	s << importerVersions;
+	s << outputAssets;
+	s << outputFiles;
+}
+
+void ImportCacheResult::deserialize(Deserializer& s)
+{
+	s >> additionalInputs;
+	s >> importerVersions;
+	s >> outputAssets;
+	s >> outputFiles;
+}
+
+ImportCache::ImportCache(Path directory)
+	: directory(std::move(directory))
+{
+}
+
+Path ImportCache::getDefaultDirectory()
+{
+	const char* env = getenv("HALLEY_IMPORT_CACHE");
+	if (env) {
+		return Path(env);
+	}
+	return Path(OS::get().getUserDataDir()) / "halley" / "import_cache";
+}
+
+bool ImportCache::isEnabled() const
+{
+	return !directory.getString().isEmpty();
+}
+
+const Path& ImportCache::getDirectory() const
+{
+	return directory;
+}
+
+uint64_t ImportCache::getKey(const ImportingAsset& asset, const AssetImporter& importer) const
+{
+	Hash::Hasher hasher;
+	hasher.feed(importCacheVersion);
+	hasher.feed(ImportAssetsDatabase::currentAssetVersion);
+	hasher.feed(importer.getVersionHash(asset.assetType));
+	hasher.feed(int(asset.assetType));
+
+	auto feedString = [&] (const String& str)
+	{
+		hasher.feed(uint64_t(str.length()));
+		hasher.feedBytes(gsl::as_bytes(gsl::span<const char>(str.c_str(), str.length())));
+	};
+
+	feedString(asset.assetId);
+	for (auto& file: asset.inputFiles) {
+		feedString(file.name.string());
+		hasher.feed(Hash::hash(file.data));
+		const auto meta = Serializer::toBytes(file.metadata);
+		hasher.feed(Hash::hash(meta));
+	}
+	return hasher.digest();
+}
+
+Maybe<ImportCache::Hit> ImportCache::retrieve(uint64_t key, const AssetImporter& importer) const
+{
+	if (!isEnabled()) {
+		return {};
+	}
+
+	std::vector<ImportCacheResult> results;
+	try {
+		const auto data = FileSystem::readFile(getEntryPath(key));
+		if (data.empty()) {
+			return {};
+		}
+		Deserializer::fromBytes(results, data);
+	} catch (std::exception& e) {
+		Logger::logWarning("Ignoring corrupted import cache entry " + getEntryPath(key) + ": " + e.what());
+		return {};
+	}
+
+	// Most recent first
+	for (auto iter = results.rbegin(); iter != results.rend(); ++iter) {
+		auto& result = *iter;
+		Hit hit;
+
+		// Any of the importers that ran could have changed since, or be running on a machine that would import differently
+		const bool importersMatch = std::all_of(result.importerVersions.begin(), result.importerVersions.end(), [&] (const std::pair<int, uint64_t>& version)
+		{
+			return importer.getVersionHash(ImportAssetType(version.first)) == version.second;
+		});
+		if (!importersMatch) {
+			continue;
+		}
+
+		// The additional inputs have to be the same as when it was imported
+		bool inputsMatch = true;
+		auto& assetsSrc = importer.getAssetsSrc();
+		for (auto& input: result.additionalInputs) {
+			auto src = std::find_if(assetsSrc.begin(), assetsSrc.end(), [&] (const Path& src) { return FileSystem::exists(src / input.first); });
+			if (src == assetsSrc.end() || Hash::hash(FileSystem::readFile(*src / input.first)) != input.second) {
+				inputsMatch = false;
+				break;
+			}
+			hit.additionalInputs.emplace_back(*src / input.first, FileSystem::getLastWriteTime(*src / input.first));
+		}
+		if (!inputsMatch) {
+			continue;
+		}
+
+		for (auto& file: result.outputFiles) {
+			const auto objectPath = getObjectPath(file.second);
+			auto bytes = FileSystem::readFile(objectPath);
+			if (Hash::hash(bytes) != file.second) {
+				Logger::logWarning("Import cache object " + objectPath + " is missing or corrupted");
+				return {};
+			}
+			hit.outputFiles.emplace_back(file.first, std::move(bytes));
+		}
+		hit.outputAssets = std::move(result.outputAssets);
+
+		return std::move(hit);
+	}
+
+	return {};
+}
+
+void ImportCache::store(uint64_t key, const AssetImporter& importer, const std::set<ImportAssetType>& importerTypes, const std::vector<std::pair<Path, uint64_t>>& additionalInputs, const std::vector<AssetResource>& outputAssets, const std::vector<std::pair<Path, Bytes>>& outputFiles)
+{
+	if (!isEnabled()) {
+		return;
+	}
+
+	ImportCacheResult result;
+	result.additionalInputs = additionalInputs;
+	result.outputAssets = outputAssets;
+	for (auto type: importerTypes) {
+		result.importerVersions.emplace_back(int(type), importer.getVersionHash(type));
+	}
+
+	try {
+		// Objects first, so that the entry never refers to anything that isn't there
+		for (auto& file: outputFiles) {
+			const uint64_t hash = Hash::hash(file.second);
+			const auto objectPath = getObjectPath(hash);
+			if (!FileSystem::exists(objectPath)) {
+				writeAtomically(objectPath, file.second);
+			}
+			result.outputFiles.emplace_back(file.first, hash);
+		}
+
+		// Several imports of the same asset could be finishing at once, on this machine or elsewhere
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto entryPath = getEntryPath(key);
+		std::vector<ImportCacheResult> results;
+		const auto data = FileSystem::readFile(entryPath);
+		if (!data.empty()) {
+			try {
+				Deserializer::fromBytes(results, data);
+			} catch (...) {
+				results.clear();
+			}
+		}
+
+		// Replaces any result with the same additional inputs and importers, and drops the oldest once there's too many
+		results.erase(std::remove_if(results.begin(), results.end(), [&] (const ImportCacheResult& r)
+		{
+			return r.additionalInputs == result.additionalInputs && r.importerVersions == result.importerVersions;
+		}), results.end());
+		results.push_back(std::move(result));
+		if (results.size() > maxResultsPerKey) {
+			results.erase(results.begin(), results.begin() + (results.size() - maxResultsPerKey));
+		}
+		writeAtomically(entryPath, Serializer::toBytes(results));
+	} catch (std::exception& e) {
+		// Not being able to cache it doesn't make the import fail
+		Logger::logWarning("Unable to store import in cache at " + directory + ": " + e.what());
+	}
+}
+
+Path ImportCache::getEntryPath(uint64_t key) const
+{
+	const auto name = toString(key, 16).asciiLower();
+	return directory / "entries" / name.left(2) / name;
+}
+
+Path ImportCache::getObjectPath(uint64_t hash) const
+{
+	const auto name = toString(hash, 16).asciiLower();
+	return directory / "objects" / name.left(2) / name;
+}
+
+void ImportCache::writeAtomically(const Path& path, const Bytes& data) const
+{
+	// Written next to it and then moved into place, so that nobody ever reads half a file
+	const auto tmpPath = Path(path.getString() + "." + FileSystem::getTemporaryPath().getFilename().getString());
+	FileSystem::writeFile(tmpPath, data);
+	if (!FileSystem::rename(tmpPath, path)) {
+		FileSystem::remove(tmpPath);
+		throw Exception("Unable to write " + path, HalleyExceptions::Tools);
+	}
+}
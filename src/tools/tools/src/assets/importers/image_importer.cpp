@@ -3,8 +3,11 @@
 #include "halley/bytes/byte_serializer.h"
 #include "halley/resources/metadata.h"
 #include "halley/file_formats/image.h"
+#include "halley/file_formats/image_ops.h"
 #include "halley/tools/file/filesystem.h"
 #include "halley/maths/colour.h"
+#include <algorithm>
+#include <unordered_set>
 
 using namespace Halley;
 
@@ -51,24 +54,29 @@ void ImageImporter::import(const ImportingAsset& asset, IAssetCollector& collect
 
 std::unique_ptr<Image> ImageImporter::convertToIndexed(const Image& image, const Image& palette)
 {
-	auto lookup = makePaletteConversion(palette);
+	// Sorted, so that the table always comes out the same
+	auto conversion = makePaletteConversion(palette);
+	std::vector<std::pair<uint32_t, uint32_t>> colours(conversion.begin(), conversion.end());
+	std::sort(colours.begin(), colours.end());
+	const ImagePaletteTable lookup(colours);
 
 	auto result = std::make_unique<Image>(Image::Format::Indexed, image.getSize());
 	auto dst = reinterpret_cast<uint8_t*>(result->getPixels());
 	auto src = reinterpret_cast<const uint32_t*>(image.getPixels());
 	size_t n = image.getWidth() * image.getHeight();
 
-	std::vector<int> coloursMissing;
+	std::vector<uint32_t> coloursMissing;
+	std::unordered_set<uint32_t> coloursMissingSet;
 
-	for (size_t i = 0; i < n; ++i) {
-		auto res = lookup.find(src[i]);
-		if (res == lookup.end()) {
-			if (std::find(coloursMissing.begin(), coloursMissing.end(), src[i]) == coloursMissing.end()) {
-				coloursMissing.push_back(src[i]);
-			}
-		} else {
-			dst[i] = uint8_t(res->second);
+	auto& ops = ImageOps::get();
+	size_t i = ops.mapToPalette(lookup, src, dst, n);
+	while (i < n) {
+		// Stopped at one that isn't in the palette
+		if (coloursMissingSet.insert(src[i]).second) {
+			coloursMissing.push_back(src[i]);
 		}
+		++i;
+		i += ops.mapToPalette(lookup, src + i, dst + i, n - i);
 	}
 
 	if (!coloursMissing.empty()) {
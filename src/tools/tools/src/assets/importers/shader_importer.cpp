@@ -34,6 +34,16 @@ void ShaderImporter::import(const ImportingAsset& asset, IAssetCollector& collec
 	collector.output(asset.assetId, AssetType::Shader, Serializer::toBytes(shader), asset.inputFiles.at(0).metadata);
 }
 
+String ShaderImporter::getHostTag() const
+{
+	// HLSL can only be compiled with the D3D compiler, and comes out empty elsewhere
+#ifdef _MSC_VER
+	return "d3dcompiler";
+#else
+	return "no-hlsl";
+#endif
+}
+
 Bytes ShaderImporter::compileHLSL(const String& name, ShaderType type, const Bytes& bytes) const
 {
 #ifdef _MSC_VER
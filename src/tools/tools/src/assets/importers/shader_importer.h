@@ -11,6 +11,7 @@ namespace Halley
 		ImportAssetType getType() const override { return ImportAssetType::Shader; }
 
 		void import(const ImportingAsset& asset, IAssetCollector& collector) override;
+		String getHostTag() const override;
 
 	private:
 		Bytes compileHLSL(const String& name, ShaderType type, const Bytes& data) const;
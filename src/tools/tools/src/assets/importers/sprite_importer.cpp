@@ -110,7 +110,7 @@ void SpriteImporter::import(const ImportingAsset& asset, IAssetCollector& collec
 
 	// Generate atlas + spritesheet
 	SpriteSheet spriteSheet;
-	auto atlasImage = generateAtlas(atlasName, totalFrames, spriteSheet);
+	auto atlasImage = generateAtlas(atlasName, totalFrames, spriteSheet, startMeta ? startMeta->getBool("allowRotation", false) : false);
 	spriteSheet.setTextureName(atlasName);
 
 	// Image metafile
@@ -178,7 +178,7 @@ Animation SpriteImporter::generateAnimation(const String& spriteName, const Stri
 	return animation;
 }
 
-std::unique_ptr<Image> SpriteImporter::generateAtlas(const String& atlasName, std::vector<ImageData>& images, SpriteSheet& spriteSheet)
+std::unique_ptr<Image> SpriteImporter::generateAtlas(const String& atlasName, std::vector<ImageData>& images, SpriteSheet& spriteSheet, bool allowRotation)
 {
 	if (images.size() > 1) {
 		Logger::logInfo("Generating atlas \"" + atlasName + "\" with " + toString(images.size()) + " sprites...");
@@ -191,7 +191,7 @@ std::unique_ptr<Image> SpriteImporter::generateAtlas(const String& atlasName, st
 	for (auto& img: images) {
 		auto size = img.clip.getSize();
 		totalImageArea += size.x * size.y;
-		entries.emplace_back(size, &img);
+		entries.emplace_back(size, &img, allowRotation);
 	}
 
 	// Figure out a reasonable pack size to start with
@@ -200,35 +200,36 @@ std::unique_ptr<Image> SpriteImporter::generateAtlas(const String& atlasName, st
 	const int maxSize = 4096;
 	int curSize = std::min(maxSize, std::max(32, int(minSize)));
 
-	// Try packing
+	// Try 64x64, then 128x64, 128x128, 256x128, etc
+	std::vector<Vector2i> sizes;
 	bool wide = guessArea > 2 * totalImageArea;
 	while (true) {
 		Vector2i size(curSize * (wide ? 2 : 1), curSize);
 		if (size.x > maxSize || size.y > maxSize) {
-			// Give up!
-			throw Exception("Unable to pack " + toString(images.size()) + " sprites in a reasonably sized atlas! curSize at " + toString(curSize) + ", maxSize is " + toString(maxSize) + ". Total image area is " + toString(totalImageArea) + " px^2, sqrt = " + toString(lround(sqrt(totalImageArea))) + " px.", HalleyExceptions::Tools);
+			break;
 		}
-
-		Logger::logInfo("Trying " + toString(size.x) + "x" + toString(size.y) + " px...");
-		auto res = BinPack::pack(entries, size);
-		if (res.is_initialized()) {
-			// Found a pack
-			if (images.size() > 1) {
-				Logger::logInfo("Atlas \"" + atlasName + "\" generated at " + toString(size.x) + "x" + toString(size.y) + " px with " + toString(images.size()) + " sprites. Total image area is " + toString(totalImageArea) + " px^2, sqrt = " + toString(lround(sqrt(totalImageArea))) + " px.");
-			}
-
-			
-			return makeAtlas(res.get(), size, spriteSheet);
+		sizes.push_back(size);
+		if (wide) {
+			wide = false;
+			curSize *= 2;
 		} else {
-			// Try 64x64, then 128x64, 128x128, 256x128, etc
-			if (wide) {
-				wide = false;
-				curSize *= 2;
-			} else {
-				wide = true;
-			}
+			wide = true;
 		}
 	}
+
+	auto res = BinPack::packSmallest(entries, sizes);
+	if (!res) {
+		// Give up!
+		throw Exception("Unable to pack " + toString(images.size()) + " sprites in a reasonably sized atlas! curSize at " + toString(curSize) + ", maxSize is " + toString(maxSize) + ". Total image area is " + toString(totalImageArea) + " px^2, sqrt = " + toString(lround(sqrt(totalImageArea))) + " px.", HalleyExceptions::Tools);
+	}
+
+	// Found a pack
+	const auto size = res->binSize;
+	if (images.size() > 1) {
+		Logger::logInfo("Atlas \"" + atlasName + "\" generated at " + toString(size.x) + "x" + toString(size.y) + " px with " + toString(images.size()) + " sprites. Total image area is " + toString(totalImageArea) + " px^2, sqrt = " + toString(lround(sqrt(totalImageArea))) + " px.");
+	}
+
+	return makeAtlas(res->results, size, spriteSheet);
 }
 
 std::unique_ptr<Image> SpriteImporter::makeAtlas(const std::vector<BinPackResult>& result, Vector2i origSize, SpriteSheet& spriteSheet)
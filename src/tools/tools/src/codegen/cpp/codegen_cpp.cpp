@@ -291,7 +291,8 @@ Vector<String> CodegenCPP::generateSystemHeader(SystemSchema& system) const
 				.addBlankLine()
 				.addTypeDefinition("Type", "Halley::FamilyType<" + String::concatList(convert<ComponentReferenceSchema, String>(fam.components, [](auto& comp)
 				{
-					return comp.optional ? "Halley::MaybeRef<" + comp.name + "Component>" : comp.name + "Component";
+					const String type = (comp.write ? "" : "const ") + comp.name + "Component";
+					return comp.optional ? "Halley::MaybeRef<" + type + ">" : type;
 				}), ", ") + ">")
 				.addBlankLine()
 				.addAccessLevelSection(CPPAccess::Protected)
@@ -302,6 +303,9 @@ Vector<String> CodegenCPP::generateSystemHeader(SystemSchema& system) const
 
 	sysClassGen.addAccessLevelSection(CPPAccess::Protected);
 
+	if (system.threadSafe) {
+		sysClassGen.addMethodDefinition(MethodSchema(TypeSchema("bool"), {}, "isThreadSafe", true, false, true, true), "return true;");
+	}
 	if ((int(system.access) & int(SystemAccess::API)) != 0) {
 		sysClassGen.addMethodDefinition(MethodSchema(TypeSchema("const Halley::HalleyAPI&"), {}, "getAPI", true), "return doGetAPI();");
 	}
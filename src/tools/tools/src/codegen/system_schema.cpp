@@ -129,4 +129,8 @@ SystemSchema::SystemSchema(YAML::Node node)
 			services.push_back(service);
 		}
 	}
+
+	// Systems that only touch their own families can be scheduled concurrently with non-conflicting systems
+	const bool pure = access == SystemAccess::Pure && messages.empty() && services.empty();
+	threadSafe = node["threadSafe"].as<bool>(pure && method == SystemMethod::Update);
 }
@@ -1,8 +1,16 @@
 #include "halley/tools/distance_field/distance_field_generator.h"
 #include <cassert>
+#include <climits>
 #include <halley/file_formats/image.h>
+#include <halley/concurrency/concurrent.h>
+#include <halley/data_structures/vector.h>
 #include <gsl/gsl_assert>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DISTANCE_FIELD_SSE2
+#include <emmintrin.h>
+#endif
+
 using namespace Halley;
 
 static float getDistanceAt(const int* src, int srcW, int srcH, int xCentre, int yCentre, float radius)
@@ -38,9 +46,19 @@ static float getDistanceAt(const int* src, int srcW, int srcH, int xCentre, int
 	return finalValue;
 }
 
-std::unique_ptr<Image> DistanceFieldGenerator::generate(Image& srcImg, Vector2i size, float radius)
+std::unique_ptr<Image> DistanceFieldGenerator::generate(Image& srcImg, Vector2i size, float radius, Method method)
 {
 	Expects(srcImg.getPixels() != nullptr);
+	switch (method) {
+	case Method::BruteForce:
+		return generateBruteForce(srcImg, size, radius);
+	default:
+		return generateExact(srcImg, size, radius);
+	}
+}
+
+std::unique_ptr<Image> DistanceFieldGenerator::generateBruteForce(Image& srcImg, Vector2i size, float radius)
+{
 	const int srcW = srcImg.getWidth();
 	const int srcH = srcImg.getHeight();
 	const int* src = reinterpret_cast<int*>(srcImg.getPixels());
@@ -72,3 +90,187 @@ std::unique_ptr<Image> DistanceFieldGenerator::generate(Image& srcImg, Vector2i
 
 	return dstImg;
 }
+
+namespace {
+	// Columns are processed in strips this wide, so that each row of a strip is read in one go
+	constexpr int columnStripWidth = 16;
+
+	int64_t floorDiv(int64_t a, int64_t b)
+	{
+		const int64_t q = a / b;
+		return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+	}
+
+	// Meijster et al.'s second phase, for one row: given the vertical distance g to the nearest feature pixel in each
+	// column, computes the squared distance to the nearest feature pixel overall, as the lower envelope of the parabolas
+	// (x - i)^2 + g(i)^2.
+	void transformRow(const int* g, int* dst, int w, Vector<int>& s, Vector<int>& t)
+	{
+		auto f = [&] (int x, int i) -> int64_t { return int64_t(x - i) * (x - i) + int64_t(g[i]) * g[i]; };
+		auto sep = [&] (int i, int u) -> int64_t { return floorDiv(int64_t(u) * u - int64_t(i) * i + int64_t(g[u]) * g[u] - int64_t(g[i]) * g[i], 2 * int64_t(u - i)); };
+
+		int q = 0;
+		s[0] = 0;
+		t[0] = 0;
+		for (int u = 1; u < w; ++u) {
+			while (q >= 0 && f(t[q], s[q]) > f(t[q], u)) {
+				--q;
+			}
+			if (q < 0) {
+				q = 0;
+				s[0] = u;
+			} else {
+				const int64_t next = 1 + sep(s[q], u);
+				if (next < w) {
+					++q;
+					s[q] = u;
+					t[q] = int(next);
+				}
+			}
+		}
+		for (int u = w - 1; u >= 0; --u) {
+			dst[u] = int(std::min(f(u, s[q]), int64_t(INT_MAX)));
+			if (u == t[q]) {
+				--q;
+			}
+		}
+	}
+
+	// Adds the coverage value of each texel in a row of signed squared distances to acc
+	void accumulateRow(const int* signedDistSqr, float* acc, int n, float invRadius)
+	{
+		int i = 0;
+#ifdef DISTANCE_FIELD_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i signMask = _mm_set1_epi32(INT_MIN);
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 scale = _mm_set1_ps(0.5f * invRadius);
+		for (; i + 4 <= n; i += 4) {
+			const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(signedDistSqr + i));
+			const __m128i outside = _mm_cmplt_epi32(value, zero);
+			const __m128i distSqr = _mm_sub_epi32(_mm_xor_si128(value, outside), outside); // abs
+			const __m128 dist = _mm_sqrt_ps(_mm_cvtepi32_ps(distSqr));
+
+			// Flip the sign of the offset from the edge for texels outside
+			const __m128 offset = _mm_mul_ps(_mm_sub_ps(dist, half), scale);
+			const __m128 signedOffset = _mm_xor_ps(offset, _mm_castsi128_ps(_mm_and_si128(outside, signMask)));
+			_mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_add_ps(half, signedOffset)));
+		}
+#endif
+		for (; i < n; ++i) {
+			const int value = signedDistSqr[i];
+			const float offset = (std::sqrt(float(std::abs(value))) - 0.5f) * 0.5f * invRadius;
+			acc[i] += 0.5f + (value < 0 ? -offset : offset);
+		}
+	}
+}
+
+std::unique_ptr<Image> DistanceFieldGenerator::generateExact(Image& srcImg, Vector2i size, float radius)
+{
+	const int srcW = srcImg.getWidth();
+	const int srcH = srcImg.getHeight();
+	const int* src = reinterpret_cast<int*>(srcImg.getPixels());
+
+	auto dstImg = std::make_unique<Image>(Image::Format::RGBA, size);
+	const int w = size.x;
+	const int h = size.y;
+	int* dstStart = reinterpret_cast<int*>(dstImg->getPixels());
+
+	const int texelW = srcW / w;
+	const int texelH = srcH / h;
+	const float srcRadius = radius * srcW / w;
+	const bool hasRadius = srcRadius >= 0.001f;
+
+	auto isInside = [&] (int x, int y) { return ((src[x + y * srcW] & 0xFF000000) >> 24) > 127; };
+
+	// Distances are computed to the nearest outside texel for texels inside, and vice versa. Infinity has to be small
+	// enough that its square fits; anything at least that far means there's no texel of the other kind at all.
+	const int infinity = srcW + srcH;
+	const int64_t infinitySqr = int64_t(infinity) * infinity;
+	Vector<int> toOutside(size_t(srcW) * srcH);
+	Vector<int> toInside(size_t(srcW) * srcH);
+
+	// First pass: distance to the nearest feature in the same column
+	Vector<int> strips((srcW + columnStripWidth - 1) / columnStripWidth);
+	for (size_t i = 0; i < strips.size(); ++i) {
+		strips[i] = int(i) * columnStripWidth;
+	}
+	Concurrent::foreach(strips.begin(), strips.end(), [&] (int x0)
+	{
+		const int x1 = std::min(x0 + columnStripWidth, srcW);
+		for (int y = 0; y < srcH; ++y) {
+			for (int x = x0; x < x1; ++x) {
+				const size_t idx = size_t(x) + size_t(y) * srcW;
+				const bool inside = isInside(x, y);
+				toOutside[idx] = inside ? (y > 0 ? std::min(toOutside[idx - srcW] + 1, infinity) : infinity) : 0;
+				toInside[idx] = inside ? 0 : (y > 0 ? std::min(toInside[idx - srcW] + 1, infinity) : infinity);
+			}
+		}
+		for (int y = srcH - 2; y >= 0; --y) {
+			for (int x = x0; x < x1; ++x) {
+				const size_t idx = size_t(x) + size_t(y) * srcW;
+				toOutside[idx] = std::min(toOutside[idx], toOutside[idx + srcW] + 1);
+				toInside[idx] = std::min(toInside[idx], toInside[idx + srcW] + 1);
+			}
+		}
+	});
+
+	// Second pass: squared distance to the nearest feature anywhere. Each texel ends up with the distance to the other
+	// kind, negated for texels outside, stored back into toOutside.
+	Vector<int> rows(srcH);
+	for (int y = 0; y < srcH; ++y) {
+		rows[y] = y;
+	}
+	Concurrent::foreach(rows.begin(), rows.end(), [&] (int y)
+	{
+		Vector<int> s(srcW);
+		Vector<int> t(srcW);
+		Vector<int> outsideRow(srcW);
+		Vector<int> insideRow(srcW);
+		const size_t rowStart = size_t(y) * srcW;
+		transformRow(toOutside.data() + rowStart, outsideRow.data(), srcW, s, t);
+		transformRow(toInside.data() + rowStart, insideRow.data(), srcW, s, t);
+
+		int* dst = toOutside.data() + rowStart;
+		for (int x = 0; x < srcW; ++x) {
+			const bool inside = isInside(x, y);
+			const int distSqr = inside ? outsideRow[x] : insideRow[x];
+			const int result = distSqr >= infinitySqr ? INT_MAX : distSqr;
+			dst[x] = inside ? result : -result;
+		}
+	});
+	const int* signedDistSqr = toOutside.data();
+
+	// Downsample, averaging the coverage of all source texels in each destination pixel
+	Vector<int> dstRows(h);
+	for (int y = 0; y < h; ++y) {
+		dstRows[y] = y;
+	}
+	Concurrent::foreach(dstRows.begin(), dstRows.end(), [&] (int y)
+	{
+		Vector<float> acc(srcW, 0.0f);
+		const int y0 = y * srcH / h;
+		for (int j = 0; j < texelH; ++j) {
+			const int* row = signedDistSqr + size_t(y0 + j) * srcW;
+			if (hasRadius) {
+				accumulateRow(row, acc.data(), srcW, 1.0f / srcRadius);
+			} else {
+				for (int x = 0; x < srcW; ++x) {
+					acc[x] += row[x] > 0 ? 1.0f : 0.0f;
+				}
+			}
+		}
+
+		for (int x = 0; x < w; ++x) {
+			const int x0 = x * srcW / w;
+			float distAcc = 0;
+			for (int i = 0; i < texelW; ++i) {
+				distAcc += acc[x0 + i];
+			}
+			const int distance = clamp(int(distAcc * 255 / (texelW * texelH)), 0, 255);
+			dstStart[x + y * w] = Image::convertRGBAToInt(255, 255, 255, distance);
+		}
+	});
+
+	return dstImg;
+}
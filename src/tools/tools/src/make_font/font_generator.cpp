@@ -15,11 +15,11 @@
 
 using namespace Halley;
 
-static boost::optional<Vector<BinPackResult>> tryPacking(FontFace& font, float fontSize, Vector2i packSize, float scale, float borderSuperSampled, const std::vector<int>& characters)
+static std::vector<BinPackEntry> getGlyphEntries(FontFace& font, float fontSize, float scale, float borderSuperSampled, const std::vector<int>& characters)
 {
 	font.setSize(fontSize);
 
-	Vector<BinPackEntry> entries;
+	std::vector<BinPackEntry> entries;
 	for (int code : font.getCharCodes()) {
 		if (std::binary_search(characters.begin(), characters.end(), code)) {
 			Vector2i glyphSize = font.getGlyphSize(code);
@@ -31,13 +31,12 @@ static boost::optional<Vector<BinPackResult>> tryPacking(FontFace& font, float f
 			entries.push_back(BinPackEntry(finalSize, reinterpret_cast<void*>(payload)));
 		}
 	}
+	return entries;
+}
 
-	constexpr bool fastPack = true;
-	if (fastPack) {
-		return BinPack::fastPack(entries, packSize);
-	} else {
-		return BinPack::pack(entries, packSize);
-	}
+static boost::optional<Vector<BinPackResult>> tryPacking(FontFace& font, float fontSize, Vector2i packSize, float scale, float borderSuperSampled, const std::vector<int>& characters)
+{
+	return BinPack::maxRectsPack(getGlyphEntries(font, fontSize, scale, borderSuperSampled, characters), packSize);
 }
 
 static boost::optional<Vector<BinPackResult>> binarySearch(std::function<boost::optional<Vector<BinPackResult>>(int)> f, int minBound, int maxBound, int &best)
@@ -95,13 +94,16 @@ FontGeneratorResult FontGenerator::generateFont(const Metadata& meta, gsl::span<
 
 		constexpr int minSize = 16;
 		constexpr int maxSize = 4096;
+		std::vector<Vector2i> sizes;
 		for (int i = 0; i < (2 * fastLog2Floor(uint32_t(maxSize / minSize))); ++i) {
-			auto curSize = Vector2i(minSize << ((i + 1) / 2), minSize << (i / 2));
-			result = tryPacking(font, float(fontSize), curSize, scale, borderSuperSample, characters);
-			if (result) {
-				imageSize = curSize;
-				break;
-			}
+			sizes.push_back(Vector2i(minSize << ((i + 1) / 2), minSize << (i / 2)));
+		}
+
+		// The glyphs are the same size for all of them, so they're only measured once
+		auto packed = BinPack::packSmallest(getGlyphEntries(font, float(fontSize), scale, borderSuperSample, characters), sizes);
+		if (packed) {
+			imageSize = packed->binSize;
+			result = std::move(packed->results);
 		}
 	} else if (sizeInfo.imageSize) {
 		imageSize = sizeInfo.imageSize.get();
@@ -48,6 +48,13 @@ void AssetPackInspector::parse(const Bytes& bytes)
 
 void AssetPackInspector::parseTable(Deserializer s, const Bytes& packBytes)
 {
+	int version;
+	s >> version;
+	if (version != AssetDatabase::currentVersion) {
+		throw Exception("Unsupported asset database version: " + toString(version), HalleyExceptions::Tools);
+	}
+	s.setVersion(version);
+
 	unsigned int numTypedDbs;
 	s >> numTypedDbs;
 
@@ -67,9 +74,10 @@ void AssetPackInspector::parseTypedDB(Deserializer& s, const Bytes& packBytes)
 	entries.reserve(entries.size() + numEntries);
 
 	for (unsigned int i = 0; i < numEntries; ++i) {
+		uint64_t id;
 		String key;
 		AssetDatabase::Entry entry;
-		s >> key >> entry;
+		s >> id >> key >> entry;
 
 		auto splitPath = entry.path.split(':');
 		size_t pos = splitPath.at(0).toInteger64();
@@ -111,7 +119,7 @@ void AssetPackInspector::printData() const
 		}
 
 		auto splitPath = entry.entry.path.split(':');
-		std::cout << "    [" << i << "] " << strCol << entry.key << stdCol << " [" << infoCol << toString(entry.hash, 16) << stdCol << "]: at " << infoCol << splitPath.at(0) << stdCol << ", " << infoCol << splitPath.at(1) << stdCol << " bytes, " << strCol << toString(entry.entry.meta) <<  stdCol << "\n";
+		std::cout << "    [" << i << "] " << strCol << entry.key << stdCol << " [" << infoCol << toString(entry.hash, 16) << stdCol << "]: at " << infoCol << splitPath.at(0) << stdCol << ", " << infoCol << splitPath.at(1) << stdCol << " bytes (" << infoCol << toString(entry.entry.compression) << stdCol << "), " << strCol << toString(entry.entry.meta) <<  stdCol << "\n";
 
 		++i;
 	}
@@ -8,6 +8,10 @@
 #include "halley/core/resources/asset_pack.h"
 #include "halley/tools/project/project.h"
 #include "halley/tools/assets/import_assets_database.h"
+#include "halley/concurrency/concurrent.h"
+#include "halley/concurrency/executor.h"
+#include "halley/bytes/compression.h"
+#include <numeric>
 using namespace Halley;
 
 
@@ -20,9 +24,10 @@ AssetPackListing::AssetPackListing()
 {
 }
 
-AssetPackListing::AssetPackListing(String name, String encryptionKey)
+AssetPackListing::AssetPackListing(String name, String encryptionKey, CompressionCodec compression)
 	: name(name)
 	, encryptionKey(encryptionKey)
+	, compression(compression)
 {
 }
 
@@ -41,6 +46,11 @@ const String& AssetPackListing::getEncryptionKey() const
 	return encryptionKey;
 }
 
+CompressionCodec AssetPackListing::getCompression() const
+{
+	return compression;
+}
+
 void AssetPackListing::setActive(bool a)
 {
 	active = a;
@@ -86,22 +96,24 @@ std::map<String, AssetPackListing> AssetPacker::sortIntoPacks(const AssetPackMan
 		const auto type = fromString<AssetType>(typeName);
 		auto& db = srcAssetDb.getDatabase(type);
 		for (auto& assetEntry: db.getAssets()) {
-			const String assetName = String(typeName) + ":" + assetEntry.first;
+			const String assetName = String(typeName) + ":" + assetEntry.name;
 
 			// Find which pack this asset goes into
 			auto packEntry = manifest.getPack("~:" + assetName);
 			String packName;
 			String encryptionKey;
+			CompressionCodec compression = CompressionCodec::None;
 			if (packEntry) {
 				packName = packEntry.get().get().getName();
 				encryptionKey = packEntry.get().get().getEncryptionKey();
+				compression = packEntry.get().get().getCompression();
 			}
 
 			// Retrieve pack
 			auto iter = packs.find(packName);
 			if (iter == packs.end()) {
 				// Pack doesn't exist yet, create it first
-				packs[packName] = AssetPackListing(packName, encryptionKey);
+				packs[packName] = AssetPackListing(packName, encryptionKey, compression);
 				iter = packs.find(packName);
 
 				// Initialise it to active if there's no asset list to pack
@@ -118,7 +130,7 @@ std::map<String, AssetPackListing> AssetPacker::sortIntoPacks(const AssetPackMan
 			}
 
 			// Add file to pack
-			iter->second.addFile(type, assetEntry.first, assetEntry.second);
+			iter->second.addFile(type, assetEntry.name, assetEntry.entry);
 		}
 	}
 
@@ -170,24 +182,55 @@ void AssetPacker::generatePack(const String& packId, const AssetPackListing& pac
 	AssetDatabase& db = pack.getAssetDatabase();
 	Bytes& data = pack.getData();
 
-	for (auto& entry: packListing.getEntries()) {
-		//Logger::logDev("  [" + toString(entry.type) + "] " + entry.name);
-
-		// Read original file
-		auto fileData = FileSystem::readFile(src / entry.path);
-		const size_t pos = data.size();
-		const size_t size = fileData.size();
-		if (size == 0) {
+	// Read and compress all files in parallel
+	struct PackedFile {
+		Bytes data;
+		CompressionCodec compression = CompressionCodec::None;
+	};
+	const auto& entries = packListing.getEntries();
+	std::vector<PackedFile> files(entries.size());
+	std::vector<size_t> indices(entries.size());
+	std::iota(indices.begin(), indices.end(), size_t(0));
+	Concurrent::foreach(Executors::getCPUAux(), indices.begin(), indices.end(), [&] (size_t i)
+	{
+		auto& entry = entries[i];
+		auto& file = files[i];
+		file.data = FileSystem::readFile(src / entry.path);
+		if (file.data.empty()) {
 			throw Exception("Unable to pack: \"" + (src / entry.path) + "\". File not found or empty.", HalleyExceptions::Tools);
 		}
-		
+
+		// Only keep the compressed version if it's worth the cost of decompressing it
+		if (packListing.getCompression() != CompressionCodec::None) {
+			auto compressed = ChunkedCompression::compress(gsl::as_bytes(gsl::span<const Byte>(file.data)), packListing.getCompression());
+			if (compressed.size() < file.data.size() * 9 / 10) {
+				file.data = std::move(compressed);
+				file.compression = packListing.getCompression();
+			}
+		}
+	});
+
+	size_t totalSize = 0;
+	size_t uncompressedSize = 0;
+	for (auto& file: files) {
+		totalSize += file.data.size();
+	}
+	data.reserve(totalSize);
+
+	for (size_t i = 0; i < entries.size(); ++i) {
+		auto& entry = entries[i];
+		auto& file = files[i];
+		//Logger::logDev("  [" + toString(entry.type) + "] " + entry.name);
+
 		// Read data into pack data
-		data.reserve(nextPowerOf2(pos + size));
-		data.resize(pos + size);
-		memcpy(data.data() + pos, fileData.data(), size);
+		const size_t pos = data.size();
+		const size_t size = file.data.size();
+		data.insert(data.end(), file.data.begin(), file.data.end());
+		uncompressedSize += file.compression == CompressionCodec::None ? size : size_t(ChunkedCompression::Table(gsl::as_bytes(gsl::span<const Byte>(file.data))).getUncompressedSize());
 
-		db.addAsset(entry.name, entry.type, AssetDatabase::Entry(toString(pos) + ":" + toString(size), entry.metadata));
+		db.appendAsset(entry.name, entry.type, AssetDatabase::Entry(toString(pos) + ":" + toString(size), entry.metadata, file.compression));
 	}
+	db.sortAssets();
 
 	if (!packListing.getEncryptionKey().isEmpty()) {
 		Logger::logInfo("- Encrypting \"" + packId + "\"...");
@@ -196,5 +239,5 @@ void AssetPacker::generatePack(const String& packId, const AssetPackListing& pac
 
 	// Write pack
 	FileSystem::writeFile(dst, pack.writeOut());
-	Logger::logInfo("- Packed " + toString(packListing.getEntries().size()) + " entries on \"" + packId + "\" (" + String::prettySize(data.size()) + ").");
+	Logger::logInfo("- Packed " + toString(entries.size()) + " entries on \"" + packId + "\" (" + String::prettySize(data.size()) + ", " + String::prettySize(uncompressedSize) + " uncompressed).");
 }